@@ -24,9 +24,11 @@
 
 /*
  * Copyright (c) 2017, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <err.h>
 #include <string.h>
@@ -59,6 +61,22 @@ custr_reset(custr_t *cus)
 	cus->cus_data[0] = '\0';
 }
 
+int
+custr_trunc(custr_t *cus, size_t idx)
+{
+	if (idx > cus->cus_strlen) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (cus->cus_data != NULL) {
+		cus->cus_strlen = idx;
+		cus->cus_data[idx] = '\0';
+	}
+
+	return (0);
+}
+
 size_t
 custr_len(custr_t *cus)
 {
@@ -81,59 +99,117 @@ custr_cstr(custr_t *cus)
 	return (cus->cus_data);
 }
 
+/*
+ * Make sure there is room for "len" more characters (and the terminating
+ * NUL) in the buffer.  The buffer at least doubles in size each time it has to
+ * grow, so a string built up one character at a time is copied O(log n) times
+ * rather than every STRING_CHUNK_SIZE characters.
+ */
 static int
-custr_append_vprintf(custr_t *cus, const char *fmt, va_list ap)
+custr_grow(custr_t *cus, size_t len)
 {
-	int len = vsnprintf(NULL, 0, fmt, ap);
-	size_t chunksz = STRING_CHUNK_SIZE;
+	size_t need;
+	size_t new_datalen;
+	char *new_data;
 
-	if (len < 0) {
+	if (len >= SIZE_MAX - cus->cus_strlen) {
+		errno = EOVERFLOW;
 		return (-1);
 	}
+	need = cus->cus_strlen + len + 1;
 
-	while (chunksz < (size_t)len) {
-		chunksz *= 2;
-	}
+	if (need <= cus->cus_datalen)
+		return (0);
 
-	if (len + cus->cus_strlen + 1 >= cus->cus_datalen) {
-		char *new_data;
-		size_t new_datalen = cus->cus_datalen + chunksz;
+	if (cus->cus_flags & CUSTR_FIXEDBUF) {
+		errno = EOVERFLOW;
+		return (-1);
+	}
 
-		if (cus->cus_flags & CUSTR_FIXEDBUF) {
-			errno = EOVERFLOW;
-			return (-1);
+	new_datalen = cus->cus_datalen > STRING_CHUNK_SIZE ?
+	    cus->cus_datalen : STRING_CHUNK_SIZE;
+	while (new_datalen < need) {
+		if (new_datalen > SIZE_MAX / 2) {
+			new_datalen = need;
+			break;
 		}
+		new_datalen *= 2;
+	}
 
+	/*
+	 * Allocate replacement memory:
+	 */
+	if ((new_data = malloc(new_datalen)) == NULL) {
+		return (-1);
+	}
+
+	/*
+	 * Copy existing data into replacement memory and free
+	 * the old memory.
+	 */
+	if (cus->cus_data != NULL) {
+		(void) memcpy(new_data, cus->cus_data, cus->cus_strlen + 1);
+		free(cus->cus_data);
+	} else {
+		new_data[0] = '\0';
+	}
+
+	/*
+	 * Swap in the replacement buffer:
+	 */
+	cus->cus_data = new_data;
+	cus->cus_datalen = new_datalen;
+
+	return (0);
+}
+
+int
+custr_reserve(custr_t *cus, size_t len)
+{
+	return (custr_grow(cus, len));
+}
+
+static int
+custr_append_vprintf(custr_t *cus, const char *fmt, va_list ap)
+{
+	size_t avail = cus->cus_datalen - cus->cus_strlen;
+	va_list ap2;
+	int len;
+
+	/*
+	 * Format directly into whatever space is left in the buffer, and only
+	 * if that turns out to be too small, grow the buffer and format again.
+	 */
+	va_copy(ap2, ap);
+	len = vsnprintf(cus->cus_data == NULL ? NULL :
+	    cus->cus_data + cus->cus_strlen, avail, fmt, ap2);
+	va_end(ap2);
+
+	if (len < 0) {
+		if (cus->cus_data != NULL)
+			cus->cus_data[cus->cus_strlen] = '\0';
+		return (-1);
+	}
+
+	if ((size_t)len >= avail) {
 		/*
-		 * Allocate replacement memory:
+		 * The output was truncated, so put back the terminator for
+		 * the unmodified string before trying to make more room.
 		 */
-		if ((new_data = malloc(new_datalen)) == NULL) {
+		if (cus->cus_data != NULL)
+			cus->cus_data[cus->cus_strlen] = '\0';
+
+		if (custr_grow(cus, len) != 0)
 			return (-1);
-		}
 
-		/*
-		 * Copy existing data into replacement memory and free
-		 * the old memory.
-		 */
-		if (cus->cus_data != NULL) {
-			(void) memcpy(new_data, cus->cus_data,
-			    cus->cus_strlen + 1);
-			free(cus->cus_data);
+		len = vsnprintf(cus->cus_data + cus->cus_strlen,
+		    cus->cus_datalen - cus->cus_strlen, fmt, ap);
+		if (len < 0) {
+			cus->cus_data[cus->cus_strlen] = '\0';
+			return (-1);
 		}
-
-		/*
-		 * Swap in the replacement buffer:
-		 */
-		cus->cus_data = new_data;
-		cus->cus_datalen = new_datalen;
 	}
-	/*
-	 * Append new string to existing string:
-	 */
-	len = vsnprintf(cus->cus_data + cus->cus_strlen,
-	    (uintptr_t)cus->cus_data - (uintptr_t)cus->cus_strlen, fmt, ap);
-	if (len == -1)
-		return (len);
+
 	cus->cus_strlen += len;
 
 	return (0);
@@ -142,7 +218,15 @@ custr_append_vprintf(custr_t *cus, const char *fmt, va_list ap)
 int
 custr_appendc(custr_t *cus, char newc)
 {
-	return (custr_append_printf(cus, "%c", newc));
+	if (cus->cus_strlen + 1 >= cus->cus_datalen &&
+	    custr_grow(cus, 1) != 0) {
+		return (-1);
+	}
+
+	cus->cus_data[cus->cus_strlen++] = newc;
+	cus->cus_data[cus->cus_strlen] = '\0';
+
+	return (0);
 }
 
 int
@@ -158,10 +242,31 @@ custr_append_printf(custr_t *cus, const char *fmt, ...)
 	return (ret);
 }
 
+static int
+custr_append_len(custr_t *cus, const char *str, size_t len)
+{
+	if (cus->cus_strlen + len >= cus->cus_datalen &&
+	    custr_grow(cus, len) != 0) {
+		return (-1);
+	}
+
+	(void) memcpy(cus->cus_data + cus->cus_strlen, str, len);
+	cus->cus_strlen += len;
+	cus->cus_data[cus->cus_strlen] = '\0';
+
+	return (0);
+}
+
 int
 custr_append(custr_t *cus, const char *name)
 {
-	return (custr_append_printf(cus, "%s", name));
+	return (custr_append_len(cus, name, strlen(name)));
+}
+
+int
+custr_append_n(custr_t *cus, const char *str, size_t n)
+{
+	return (custr_append_len(cus, str, strnlen(str, n)));
 }
 
 int
@@ -11,6 +11,7 @@
 
 /*
  * Copyright (c) 2017, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 #ifndef _CUSTR_H
@@ -49,6 +50,13 @@ extern int custr_alloc_buf(custr_t **, void *, size_t);
 extern int custr_appendc(custr_t *, char);
 extern int custr_append(custr_t *, const char *);
 
+/*
+ * Append at most "n" characters of a string to a dynamic string, stopping
+ * early at a NUL.  Returns 0 on success and -1 otherwise.  The dynamic string
+ * will be unmodified if the function returns -1.
+ */
+extern int custr_append_n(custr_t *, const char *, size_t);
+
 /*
  * Append a format string and arguments as though the contents were being parsed
  * through snprintf. Returns 0 on success and -1 otherwise.  The dynamic string
@@ -56,6 +64,14 @@ extern int custr_append(custr_t *, const char *);
  */
 extern int custr_append_printf(custr_t *, const char *, ...);
 
+/*
+ * Make sure the dynamic string has room for at least "len" more characters,
+ * so that appending that many will not need to allocate memory.  Returns 0 on
+ * success and -1 otherwise.  The contents of the dynamic string are never
+ * modified.
+ */
+extern int custr_reserve(custr_t *, size_t);
+
 /*
  * Determine the length in bytes, not including the NUL terminator, of the
  * dynamic string.
@@ -68,6 +84,12 @@ extern size_t custr_len(custr_t *);
  */
 extern void custr_reset(custr_t *);
 
+/*
+ * Truncate a dynamic string to its first "idx" bytes.  Returns 0 on success,
+ * or -1 (with errno set to EINVAL) if the string is shorter than that.
+ */
+extern int custr_trunc(custr_t *, size_t);
+
 /*
  * Retrieve a const pointer to a NUL-terminated string version of the contents
  * of the dynamic string.  Storage for this string should not be freed, and
@@ -11,10 +11,21 @@
 
 /*
  * Copyright 2015 Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 /*
  * smartos-live: String List with variable element count.
+ *
+ * A list allocated with strlist_alloc_arena() keeps its strings in a few large
+ * chunks of memory, rather than in a separate allocation for each one.  The
+ * chunks never move, so the pointers in the array stay valid, and strings
+ * that are replaced are not freed until the list is reset.  This is for lists
+ * that are built up once and then used, like an environment for execve(2).
+ *
+ * Either kind of list can also be treated as a set of "NAME=value" entries,
+ * with strlist_set_entry() and strlist_lookup().  These use a hash table of
+ * the names, which is built the first time it is needed.
  */
 
 #include <stdio.h>
@@ -24,6 +35,7 @@
 #include <strings.h>
 #include <err.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/debug.h>
 
 #include "strlist.h"
@@ -43,12 +55,58 @@
  */
 #define	MAX_CAPACITY	(SIZE_MAX / sizeof (char *) - 1)
 
+/*
+ * The size of each chunk of an arena-backed list.  Strings longer than a
+ * quarter of this get a chunk of their own.
+ */
+#define	ARENA_CHUNK	16384
+
+/*
+ * The smallest size of the name index.  The index is rebuilt at twice the
+ * size when it becomes three quarters full.
+ */
+#define	INDEX_MIN	64
+
+/*
+ * Flags for sl_flags:
+ */
+#define	SLF_ARENA	0x1
+
+typedef struct strlist_chunk {
+	struct strlist_chunk *slc_next;
+	size_t slc_size;
+	size_t slc_used;
+	char slc_data[];
+} strlist_chunk_t;
 
 struct strlist {
 	char **sl_strings;
 	unsigned int sl_capacity;
+	/*
+	 * Every element before this one is in use.
+	 */
+	unsigned int sl_first_empty;
+	unsigned int sl_flags;
+	/*
+	 * For a list from strlist_alloc_arena(), the chunks holding the
+	 * strings, with the one being filled at the head.
+	 */
+	strlist_chunk_t *sl_arena;
+	/*
+	 * The name index, if it has been built: an open-addressed hash table
+	 * of the elements with a "NAME=" prefix, each stored as its index plus
+	 * one (so that 0 is an empty slot).  When there are several elements
+	 * with the same name, the index has the first.
+	 */
+	unsigned int *sl_index;
+	unsigned int sl_index_size;
+	unsigned int sl_index_used;
 };
 
+static void strlist_index_drop(strlist_t *);
+static void strlist_index_add(strlist_t *, unsigned int);
+static size_t strlist_name_len(const char *);
+
 /*
  * Allocate a strlist_t.
  */
@@ -73,6 +131,60 @@ strlist_alloc(strlist_t **slp, unsigned int capacity)
 	return (0);
 }
 
+/*
+ * Allocate a strlist_t that keeps its strings in an arena; see above.
+ */
+int
+strlist_alloc_arena(strlist_t **slp, unsigned int capacity)
+{
+	if (strlist_alloc(slp, capacity) != 0) {
+		return (-1);
+	}
+	(*slp)->sl_flags |= SLF_ARENA;
+
+	return (0);
+}
+
+/*
+ * Copy "str" into the arena, returning the copy.
+ */
+static char *
+strlist_arena_copy(strlist_t *sl, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	strlist_chunk_t *c = sl->sl_arena;
+	char *t;
+
+	if (c == NULL || c->slc_size - c->slc_used < len) {
+		size_t size = len > ARENA_CHUNK / 4 ? len : ARENA_CHUNK;
+		strlist_chunk_t *nc;
+
+		if ((nc = malloc(sizeof (strlist_chunk_t) + size)) == NULL) {
+			return (NULL);
+		}
+		nc->slc_size = size;
+		nc->slc_used = 0;
+
+		if (c != NULL && size != ARENA_CHUNK) {
+			/*
+			 * Keep filling the current chunk with small strings.
+			 */
+			nc->slc_next = c->slc_next;
+			c->slc_next = nc;
+		} else {
+			nc->slc_next = c;
+			sl->sl_arena = nc;
+		}
+		c = nc;
+	}
+
+	t = c->slc_data + c->slc_used;
+	(void) memcpy(t, str, len);
+	c->slc_used += len;
+
+	return (t);
+}
+
 /*
  * Increase the capacity of a strlist_t.
  */
@@ -129,9 +241,21 @@ strlist_reset(strlist_t *sl)
 	 * Free every string buffer in the list.
 	 */
 	for (unsigned int i = 0; i < sl->sl_capacity; i++) {
-		free(sl->sl_strings[i]);
+		if (!(sl->sl_flags & SLF_ARENA)) {
+			free(sl->sl_strings[i]);
+		}
 		sl->sl_strings[i] = NULL;
 	}
+	sl->sl_first_empty = 0;
+
+	while (sl->sl_arena != NULL) {
+		strlist_chunk_t *c = sl->sl_arena;
+
+		sl->sl_arena = c->slc_next;
+		free(c);
+	}
+
+	strlist_index_drop(sl);
 }
 
 /*
@@ -155,6 +279,7 @@ strlist_free(strlist_t *sl)
 int
 strlist_set(strlist_t *sl, unsigned int idx, const char *str)
 {
+	char *old;
 	char *t;
 
 	VERIFY(str != NULL);
@@ -165,16 +290,42 @@ strlist_set(strlist_t *sl, unsigned int idx, const char *str)
 	}
 	VERIFY(idx < sl->sl_capacity);
 
-	if ((t = strdup(str)) == NULL) {
+	if ((t = (sl->sl_flags & SLF_ARENA) ? strlist_arena_copy(sl, str) :
+	    strdup(str)) == NULL) {
 		return (-1);
 	}
 
+	/*
+	 * If the name index has the old string, it needs to be rebuilt unless
+	 * the new one has the same name.
+	 */
+	old = sl->sl_strings[idx];
+	if (sl->sl_index != NULL && old != NULL) {
+		size_t len = strlist_name_len(old);
+
+		if (len != 0 && (strlist_name_len(t) != len ||
+		    strncmp(old, t, len) != 0)) {
+			strlist_index_drop(sl);
+		}
+	}
+
 	/*
 	 * Free the old string.
 	 */
-	free(sl->sl_strings[idx]);
+	if (!(sl->sl_flags & SLF_ARENA)) {
+		free(old);
+	}
 	sl->sl_strings[idx] = t;
 
+	while (sl->sl_first_empty < sl->sl_capacity &&
+	    sl->sl_strings[sl->sl_first_empty] != NULL) {
+		sl->sl_first_empty++;
+	}
+
+	if (sl->sl_index != NULL) {
+		strlist_index_add(sl, idx);
+	}
+
 	return (0);
 }
 
@@ -205,8 +356,9 @@ strlist_first_empty(strlist_t *sl, unsigned int *idx)
 
 again:
 	VERIFY(try++ < 2);
-	for (unsigned int i = 0; i < sl->sl_capacity; i++) {
+	for (unsigned int i = sl->sl_first_empty; i < sl->sl_capacity; i++) {
 		if (sl->sl_strings[i] == NULL) {
+			sl->sl_first_empty = i;
 			*idx = i;
 			return (0);
 		}
@@ -261,18 +413,30 @@ strlist_get(strlist_t *sl, unsigned int idx)
 /*
  * Return the string from this offset, clearing the pointer.  The storage now
  * belongs to the caller, who must call free(3C) when finished with the string.
+ * For an arena-backed list, the caller gets a copy, and NULL if the copy
+ * could not be allocated (in which case the element is left alone).
  */
 char *
 strlist_adopt(strlist_t *sl, unsigned int idx)
 {
 	char *t;
 
-	if (idx >= sl->sl_capacity) {
+	if (idx >= sl->sl_capacity || sl->sl_strings[idx] == NULL) {
 		return (NULL);
 	}
 
 	t = sl->sl_strings[idx];
+	if ((sl->sl_flags & SLF_ARENA) && (t = strdup(t)) == NULL) {
+		return (NULL);
+	}
+
+	if (sl->sl_index != NULL && strlist_name_len(t) != 0) {
+		strlist_index_drop(sl);
+	}
 	sl->sl_strings[idx] = NULL;
+	if (idx < sl->sl_first_empty) {
+		sl->sl_first_empty = idx;
+	}
 
 	return (t);
 }
@@ -287,3 +451,211 @@ strlist_array(strlist_t *sl)
 {
 	return (sl->sl_strings);
 }
+
+/*
+ * Return the length of the name in a "NAME=value" string, or 0 if it has no
+ * name.
+ */
+static size_t
+strlist_name_len(const char *str)
+{
+	const char *eq = strchr(str, '=');
+
+	return (eq == NULL ? 0 : (size_t)(eq - str));
+}
+
+static uint32_t
+strlist_hash(const char *name, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ (uint8_t)name[i]) * 16777619U;
+	}
+
+	return (h);
+}
+
+static void
+strlist_index_drop(strlist_t *sl)
+{
+	free(sl->sl_index);
+	sl->sl_index = NULL;
+	sl->sl_index_size = 0;
+	sl->sl_index_used = 0;
+}
+
+/*
+ * Find the slot in the index for the name "name" (of length "len"): either the
+ * slot that has it, or the empty slot where it would go.
+ */
+static unsigned int *
+strlist_index_slot(strlist_t *sl, const char *name, size_t len)
+{
+	unsigned int mask = sl->sl_index_size - 1;
+	unsigned int i = strlist_hash(name, len) & mask;
+
+	for (;;) {
+		unsigned int *slot = &sl->sl_index[i];
+		const char *str;
+
+		if (*slot == 0) {
+			return (slot);
+		}
+
+		str = sl->sl_strings[*slot - 1];
+		if (strlist_name_len(str) == len &&
+		    strncmp(str, name, len) == 0) {
+			return (slot);
+		}
+
+		i = (i + 1) & mask;
+	}
+}
+
+/*
+ * (Re)build the index with "size" slots, which must be a power of two.  On
+ * failure, there is no index.
+ */
+static int
+strlist_index_build(strlist_t *sl, unsigned int size)
+{
+	strlist_index_drop(sl);
+
+	if ((sl->sl_index = calloc(size, sizeof (unsigned int))) == NULL) {
+		return (-1);
+	}
+	sl->sl_index_size = size;
+
+	for (unsigned int i = 0; i < sl->sl_capacity; i++) {
+		if (sl->sl_strings[i] != NULL) {
+			strlist_index_add(sl, i);
+			if (sl->sl_index == NULL) {
+				return (-1);
+			}
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Add element "idx" to the index, if it has a name.  If the index can't be
+ * grown, it is dropped, to be rebuilt when it's next needed.
+ */
+static void
+strlist_index_add(strlist_t *sl, unsigned int idx)
+{
+	const char *str = sl->sl_strings[idx];
+	size_t len = strlist_name_len(str);
+	unsigned int *slot;
+
+	if (len == 0) {
+		return;
+	}
+
+	slot = strlist_index_slot(sl, str, len);
+	if (*slot != 0) {
+		if (idx + 1 < *slot) {
+			*slot = idx + 1;
+		}
+		return;
+	}
+
+	if ((sl->sl_index_used + 1) * 4 > sl->sl_index_size * 3) {
+		/*
+		 * Rebuilding the index adds this element too.
+		 */
+		if (sl->sl_index_size > UINT_MAX / 2 ||
+		    strlist_index_build(sl, sl->sl_index_size * 2) != 0) {
+			strlist_index_drop(sl);
+		}
+		return;
+	}
+
+	*slot = idx + 1;
+	sl->sl_index_used++;
+}
+
+/*
+ * Find the first element named "name" (of length "len"), building the index
+ * if need be.  Returns -1 if there isn't one.
+ */
+static int
+strlist_find(strlist_t *sl, const char *name, size_t len, unsigned int *idx)
+{
+	unsigned int *slot;
+
+	if (sl->sl_index == NULL) {
+		unsigned int size = INDEX_MIN;
+
+		while (size < UINT_MAX / 2 && size / 2 < sl->sl_capacity) {
+			size *= 2;
+		}
+
+		if (strlist_index_build(sl, size) != 0) {
+			/*
+			 * Search the slow way.
+			 */
+			for (unsigned int i = 0; i < sl->sl_capacity; i++) {
+				const char *str = sl->sl_strings[i];
+
+				if (str != NULL && strlist_name_len(str) ==
+				    len && strncmp(str, name, len) == 0) {
+					*idx = i;
+					return (0);
+				}
+			}
+			return (-1);
+		}
+	}
+
+	slot = strlist_index_slot(sl, name, len);
+	if (*slot == 0) {
+		return (-1);
+	}
+
+	*idx = *slot - 1;
+	return (0);
+}
+
+/*
+ * Store "entry", of the form "NAME=value", in place of the first element with
+ * the same name, or at the tail of the list if there isn't one.  Fails with
+ * EINVAL if "entry" has no name.
+ */
+int
+strlist_set_entry(strlist_t *sl, const char *entry)
+{
+	size_t len = strlist_name_len(entry);
+	unsigned int idx;
+
+	if (len == 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if (strlist_find(sl, entry, len, &idx) == 0) {
+		return (strlist_set(sl, idx, entry));
+	}
+
+	return (strlist_set_tail(sl, entry));
+}
+
+/*
+ * Return the value of the first "NAME=value" element named "name", or NULL if
+ * there isn't one.
+ */
+const char *
+strlist_lookup(strlist_t *sl, const char *name)
+{
+	size_t len = strlen(name);
+	unsigned int idx;
+
+	if (len == 0 || strchr(name, '=') != NULL ||
+	    strlist_find(sl, name, len, &idx) != 0) {
+		return (NULL);
+	}
+
+	return (sl->sl_strings[idx] + len + 1);
+}
@@ -11,6 +11,7 @@
 
 /*
  * Copyright 2015 Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 #ifndef _STRLIST_H
@@ -28,13 +29,16 @@ typedef struct strlist strlist_t;
 
 
 extern int strlist_alloc(strlist_t **, unsigned int);
+extern int strlist_alloc_arena(strlist_t **, unsigned int);
 extern void strlist_reset(strlist_t *);
 extern void strlist_free(strlist_t *);
 
 extern int strlist_set(strlist_t *, unsigned int, const char *);
 extern int strlist_set_tail(strlist_t *, const char *);
+extern int strlist_set_entry(strlist_t *, const char *);
 
 extern const char *strlist_get(strlist_t *, unsigned int);
+extern const char *strlist_lookup(strlist_t *, const char *);
 extern char *strlist_adopt(strlist_t *, unsigned int);
 
 extern int strlist_first_empty(strlist_t *, unsigned int *);
@@ -0,0 +1,196 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * custr_bench: micro-benchmark for building strings with custr.
+ *
+ * Usage: custr_bench [-r rounds] [size ...]
+ *
+ * For each size in bytes (default 1 KiB, 64 KiB, 1 MiB and 16 MiB) this
+ * builds a string of that length from scratch in several ways:
+ *
+ *   appendc          one character at a time, as the parsers do
+ *   appendc_reserve  the same, after custr_reserve() of the full size
+ *   append           16 characters at a time with custr_append()
+ *   append_n         16 characters at a time with custr_append_n()
+ *   printf           16 characters at a time with custr_append_printf()
+ *
+ * Each result is the best of <rounds> runs, printed as "name size value unit".
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "custr.h"
+
+#define	DEFAULT_ROUNDS	5
+#define	PIECE		"0123456789abcdef"
+#define	PIECE_LEN	16
+
+typedef enum {
+	B_APPENDC,
+	B_APPENDC_RESERVE,
+	B_APPEND,
+	B_APPEND_N,
+	B_PRINTF,
+	B_MAX
+} bench_type_t;
+
+static const char *bench_names[B_MAX] = {
+	"appendc",
+	"appendc_reserve",
+	"append",
+	"append_n",
+	"printf"
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: custr_bench [-r rounds] [size ...]\n");
+	exit(2);
+}
+
+/*
+ * Build a string of "size" bytes, returning the number of append calls made.
+ */
+static size_t
+build(bench_type_t type, size_t size)
+{
+	custr_t *cu;
+	size_t n = 0;
+	size_t i;
+	int ret = 0;
+
+	if (custr_alloc(&cu) != 0)
+		err(1, "custr_alloc");
+
+	if (type == B_APPENDC_RESERVE && custr_reserve(cu, size) != 0)
+		err(1, "custr_reserve");
+
+	switch (type) {
+	case B_APPENDC:
+	case B_APPENDC_RESERVE:
+		for (i = 0; i < size && ret == 0; i++, n++)
+			ret = custr_appendc(cu, PIECE[i % PIECE_LEN]);
+		break;
+	case B_APPEND:
+		for (i = 0; i < size && ret == 0; i += PIECE_LEN, n++)
+			ret = custr_append(cu, PIECE);
+		break;
+	case B_APPEND_N:
+		for (i = 0; i < size && ret == 0; i += PIECE_LEN, n++)
+			ret = custr_append_n(cu, PIECE, PIECE_LEN);
+		break;
+	case B_PRINTF:
+		for (i = 0; i < size && ret == 0; i += PIECE_LEN, n++)
+			ret = custr_append_printf(cu, "%s", PIECE);
+		break;
+	default:
+		errx(1, "unknown benchmark %d", type);
+	}
+
+	if (ret != 0)
+		err(1, "%s", bench_names[type]);
+	if (custr_len(cu) < size)
+		errx(1, "%s: string is too short", bench_names[type]);
+
+	custr_free(cu);
+
+	return (n);
+}
+
+static void
+bench(size_t size, int rounds)
+{
+	bench_type_t type;
+	uint64_t best;
+	uint64_t start;
+	uint64_t t;
+	size_t n = 0;
+	int r;
+
+	for (type = 0; type < B_MAX; type++) {
+		best = UINT64_MAX;
+		for (r = 0; r < rounds; r++) {
+			start = now_ns();
+			n = build(type, size);
+			if ((t = now_ns() - start) < best)
+				best = t;
+		}
+		if (best == 0)
+			best = 1;
+
+		printf("%s %zu %.0f appends/s\n", bench_names[type], size,
+		    n / (best / 1e9));
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static size_t default_sizes[] = {
+		1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024
+	};
+	int rounds = DEFAULT_ROUNDS;
+	long size;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (rounds <= 0)
+		usage();
+
+	if (argc == 0) {
+		for (i = 0; i < 4; i++)
+			bench(default_sizes[i], rounds);
+		return (0);
+	}
+
+	for (i = 0; i < argc; i++) {
+		if ((size = strtol(argv[i], NULL, 10)) <= 0)
+			usage();
+		bench((size_t)size, rounds);
+	}
+
+	return (0);
+}
@@ -0,0 +1,193 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * strlist_bench: micro-benchmark for building an environment with strlist.
+ *
+ * Usage: strlist_bench [-r rounds] [count ...]
+ *
+ * For each count (default 100, 1000, 10000 and 100000) this builds an
+ * environment of that many "NAME=value" entries, setting every name twice so
+ * that half of the sets replace an existing entry, in several ways:
+ *
+ *   scan         find the name by walking the list, as dockerinit used to
+ *   set_entry    strlist_set_entry() on a list from strlist_alloc()
+ *   arena        strlist_set_entry() on a list from strlist_alloc_arena()
+ *
+ * Each result is the best of <rounds> runs, printed as "name count value unit".
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "strlist.h"
+
+#define	DEFAULT_ROUNDS	3
+
+typedef enum {
+	B_SCAN,
+	B_SET_ENTRY,
+	B_ARENA,
+	B_MAX
+} bench_type_t;
+
+static const char *bench_names[B_MAX] = {
+	"scan",
+	"set_entry",
+	"arena"
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: strlist_bench [-r rounds] [count ...]\n");
+	exit(2);
+}
+
+/*
+ * Insert or replace "entry" by walking the list, the way dockerinit's
+ * insertOrReplaceEnv() did, including copying out each name to compare it.
+ */
+static int
+scan_set(strlist_t *sl, const char *entry)
+{
+	size_t len = strchr(entry, '=') - entry;
+	const char *str;
+	unsigned int i;
+
+	for (i = 0; (str = strlist_get(sl, i)) != NULL; i++) {
+		const char *eq = strchr(str, '=');
+		char *name;
+		int match;
+
+		if ((name = strndup(str, eq - str)) == NULL)
+			return (-1);
+		match = strlen(name) == len && strncmp(name, entry, len) == 0;
+		free(name);
+		if (match)
+			return (strlist_set(sl, i, entry));
+	}
+
+	return (strlist_set_tail(sl, entry));
+}
+
+static void
+build(bench_type_t type, unsigned int count)
+{
+	strlist_t *sl;
+	char buf[64];
+	unsigned int i;
+	int ret = 0;
+
+	if ((type == B_ARENA ? strlist_alloc_arena(&sl, 0) :
+	    strlist_alloc(&sl, 0)) != 0)
+		err(1, "strlist_alloc");
+
+	for (i = 0; i < count * 2 && ret == 0; i++) {
+		(void) snprintf(buf, sizeof (buf), "VARIABLE_%u=value %u",
+		    i % count, i);
+		if (type == B_SCAN)
+			ret = scan_set(sl, buf);
+		else
+			ret = strlist_set_entry(sl, buf);
+	}
+
+	if (ret != 0)
+		err(1, "%s", bench_names[type]);
+	if (strlist_contig_count(sl) != count)
+		errx(1, "%s: wrong number of entries", bench_names[type]);
+
+	strlist_free(sl);
+}
+
+static void
+bench(unsigned int count, int rounds)
+{
+	bench_type_t type;
+	uint64_t best;
+	uint64_t start;
+	uint64_t t;
+	int r;
+
+	for (type = 0; type < B_MAX; type++) {
+		best = UINT64_MAX;
+		for (r = 0; r < rounds; r++) {
+			start = now_ns();
+			build(type, count);
+			if ((t = now_ns() - start) < best)
+				best = t;
+		}
+		if (best == 0)
+			best = 1;
+
+		printf("%s %u %.0f sets/s\n", bench_names[type], count,
+		    count * 2 / (best / 1e9));
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static unsigned int default_counts[] = { 100, 1000, 10000, 100000 };
+	int rounds = DEFAULT_ROUNDS;
+	long count;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (rounds <= 0)
+		usage();
+
+	if (argc == 0) {
+		for (i = 0; i < 4; i++)
+			bench(default_counts[i], rounds);
+		return (0);
+	}
+
+	for (i = 0; i < argc; i++) {
+		if ((count = strtol(argv[i], NULL, 10)) <= 0)
+			usage();
+		bench((unsigned int)count, rounds);
+	}
+
+	return (0);
+}
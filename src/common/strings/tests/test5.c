@@ -0,0 +1,132 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <err.h>
+#include <errno.h>
+#include <sys/debug.h>
+
+#include "custr.h"
+
+#define	NUM_CHARS	100000
+
+static void
+check_str(custr_t *cu, const char *expect)
+{
+	if (custr_len(cu) != strlen(expect) ||
+	    strcmp(custr_cstr(cu), expect) != 0) {
+		errx(1, "expected \"%s\" (%zu), got \"%s\" (%zu)", expect,
+		    strlen(expect), custr_cstr(cu), custr_len(cu));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	custr_t *cu;
+	char buf[8];
+	const char *s;
+
+	/*
+	 * Dynamic strings:
+	 */
+	if (custr_alloc(&cu) != 0) {
+		err(1, "custr_alloc failure");
+	}
+	check_str(cu, "");
+
+	for (unsigned int i = 0; i < NUM_CHARS; i++) {
+		if (custr_appendc(cu, 'a' + i % 26) != 0) {
+			err(1, "custr_appendc failure");
+		}
+	}
+	VERIFY3U(custr_len(cu), ==, NUM_CHARS);
+	s = custr_cstr(cu);
+	for (unsigned int i = 0; i < NUM_CHARS; i++) {
+		if (s[i] != (char)('a' + i % 26)) {
+			errx(1, "wrong character at %u", i);
+		}
+	}
+	VERIFY3U(s[NUM_CHARS], ==, '\0');
+
+	custr_reset(cu);
+	check_str(cu, "");
+
+	VERIFY0(custr_append(cu, "abc"));
+	VERIFY0(custr_append(cu, ""));
+	VERIFY0(custr_append_n(cu, "defghi", 3));
+	VERIFY0(custr_append_n(cu, "gh\0ij", 5));
+	VERIFY0(custr_append_n(cu, "xyz", 0));
+	VERIFY0(custr_appendc(cu, '.'));
+	check_str(cu, "abcdefgh.");
+
+	VERIFY0(custr_append_printf(cu, "%d-%s", 42, "x"));
+	check_str(cu, "abcdefgh.42-x");
+
+	VERIFY0(custr_trunc(cu, 9));
+	check_str(cu, "abcdefgh.");
+	VERIFY3S(custr_trunc(cu, 10), ==, -1);
+	VERIFY3S(errno, ==, EINVAL);
+	VERIFY0(custr_append(cu, "42-x"));
+	check_str(cu, "abcdefgh.42-x");
+
+	/*
+	 * Reserving space doesn't change the contents, and a printf larger
+	 * than the remaining space still works.
+	 */
+	VERIFY0(custr_reserve(cu, 4096));
+	check_str(cu, "abcdefgh.42-x");
+	VERIFY0(custr_append_printf(cu, "%0*d", 10000, 7));
+	VERIFY3U(custr_len(cu), ==, 13 + 10000);
+	VERIFY3U(custr_cstr(cu)[custr_len(cu) - 1], ==, '7');
+
+	custr_free(cu);
+
+	/*
+	 * Fixed buffers: appends that don't fit must fail with EOVERFLOW and
+	 * leave the string alone.
+	 */
+	if (custr_alloc_buf(&cu, buf, sizeof (buf)) != 0) {
+		err(1, "custr_alloc_buf failure");
+	}
+
+	VERIFY0(custr_append(cu, "abc"));
+	VERIFY0(custr_reserve(cu, 4));
+	VERIFY3S(custr_reserve(cu, 5), ==, -1);
+	VERIFY3S(errno, ==, EOVERFLOW);
+
+	VERIFY3S(custr_append(cu, "defgh"), ==, -1);
+	VERIFY3S(errno, ==, EOVERFLOW);
+	check_str(cu, "abc");
+
+	VERIFY3S(custr_append_printf(cu, "%s", "defgh"), ==, -1);
+	VERIFY3S(errno, ==, EOVERFLOW);
+	check_str(cu, "abc");
+
+	VERIFY0(custr_append_printf(cu, "%s", "de"));
+	VERIFY0(custr_append_n(cu, "fgh", 2));
+	check_str(cu, "abcdefg");
+
+	VERIFY3S(custr_appendc(cu, 'h'), ==, -1);
+	VERIFY3S(errno, ==, EOVERFLOW);
+	check_str(cu, "abcdefg");
+
+	custr_free(cu);
+
+	return (0);
+}
@@ -0,0 +1,186 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <err.h>
+#include <errno.h>
+#include <sys/debug.h>
+
+#include "strlist.h"
+
+#define	NUM_ENTRIES	20000
+
+static void
+check_lookup(strlist_t *sl, const char *name, const char *expect)
+{
+	const char *val = strlist_lookup(sl, name);
+
+	if (expect == NULL && val != NULL) {
+		errx(1, "lookup \"%s\": expected nothing, got \"%s\"", name,
+		    val);
+	}
+	if (expect != NULL && (val == NULL || strcmp(val, expect) != 0)) {
+		errx(1, "lookup \"%s\": expected \"%s\", got \"%s\"", name,
+		    expect, val == NULL ? "<NULL>" : val);
+	}
+}
+
+static void
+set_entry(strlist_t *sl, const char *entry)
+{
+	if (strlist_set_entry(sl, entry) != 0) {
+		err(1, "strlist_set_entry(%s) failure", entry);
+	}
+}
+
+static void
+test_entries(strlist_t *sl)
+{
+	char buf[64];
+	char *big;
+	const char *first;
+	char *t;
+
+	/*
+	 * Insert and replace:
+	 */
+	set_entry(sl, "HOME=/");
+	set_entry(sl, "PATH=/bin");
+	set_entry(sl, "TERM=xterm");
+	set_entry(sl, "PATH=/usr/bin:/bin");
+	VERIFY3U(strlist_contig_count(sl), ==, 3);
+	VERIFY0(strcmp(strlist_get(sl, 1), "PATH=/usr/bin:/bin"));
+	check_lookup(sl, "PATH", "/usr/bin:/bin");
+	check_lookup(sl, "PAT", NULL);
+	check_lookup(sl, "PATHS", NULL);
+	check_lookup(sl, "", NULL);
+	check_lookup(sl, "PATH=/bin", NULL);
+
+	/*
+	 * Values may be empty or contain "=", and names without "=" are
+	 * refused:
+	 */
+	set_entry(sl, "EMPTY=");
+	set_entry(sl, "EQ=a=b");
+	check_lookup(sl, "EMPTY", "");
+	check_lookup(sl, "EQ", "a=b");
+	VERIFY3S(strlist_set_entry(sl, "NOEQUALS"), ==, -1);
+	VERIFY3S(errno, ==, EINVAL);
+	VERIFY3S(strlist_set_entry(sl, "=value"), ==, -1);
+
+	/*
+	 * Elements set by index are seen by the index, and the first of
+	 * several with the same name wins:
+	 */
+	if (strlist_set_tail(sl, "DUP=second") != 0 ||
+	    strlist_set_tail(sl, "DUP=third") != 0) {
+		err(1, "strlist_set_tail failure");
+	}
+	check_lookup(sl, "DUP", "second");
+	if (strlist_set(sl, 0, "DUP=first") != 0) {
+		err(1, "strlist_set failure");
+	}
+	check_lookup(sl, "DUP", "first");
+	check_lookup(sl, "HOME", NULL);
+	if (strlist_set(sl, 0, "HOME=/root") != 0) {
+		err(1, "strlist_set failure");
+	}
+	check_lookup(sl, "DUP", "second");
+	check_lookup(sl, "HOME", "/root");
+
+	/*
+	 * Taking an element out leaves a hole for the next tail:
+	 */
+	t = strlist_adopt(sl, 1);
+	VERIFY0(strcmp(t, "PATH=/usr/bin:/bin"));
+	free(t);
+	check_lookup(sl, "PATH", NULL);
+	set_entry(sl, "PATH=/sbin");
+	VERIFY0(strcmp(strlist_get(sl, 1), "PATH=/sbin"));
+
+	/*
+	 * Lots of entries, and a few big ones, without the strings moving:
+	 */
+	first = strlist_get(sl, 0);
+	if ((big = malloc(100000)) == NULL) {
+		err(1, "malloc failure");
+	}
+	(void) memset(big, 'x', 99999);
+	big[99999] = '\0';
+	(void) memcpy(big, "BIG=", 4);
+
+	for (unsigned int i = 0; i < NUM_ENTRIES; i++) {
+		(void) snprintf(buf, sizeof (buf), "VAR%u=%u", i, i);
+		set_entry(sl, buf);
+		if (i % 5000 == 0) {
+			set_entry(sl, big);
+		}
+	}
+	for (unsigned int i = 0; i < NUM_ENTRIES; i += 2) {
+		(void) snprintf(buf, sizeof (buf), "VAR%u=%u", i, i * 2);
+		set_entry(sl, buf);
+	}
+
+	VERIFY3P(strlist_get(sl, 0), ==, first);
+	VERIFY0(strcmp(first, "HOME=/root"));
+	for (unsigned int i = 0; i < NUM_ENTRIES; i++) {
+		char name[32];
+		char val[32];
+
+		(void) snprintf(name, sizeof (name), "VAR%u", i);
+		(void) snprintf(val, sizeof (val), "%u", i % 2 ? i : i * 2);
+		check_lookup(sl, name, val);
+	}
+	check_lookup(sl, "BIG", big + 4);
+	free(big);
+
+	/*
+	 * The array is NULL-terminated, with no gaps:
+	 */
+	VERIFY3P(strlist_array(sl)[strlist_contig_count(sl)], ==, NULL);
+	VERIFY3U(strlist_contig_count(sl), ==, NUM_ENTRIES + 8);
+
+	/*
+	 * Reset empties the index too:
+	 */
+	strlist_reset(sl);
+	check_lookup(sl, "HOME", NULL);
+	set_entry(sl, "HOME=/home");
+	VERIFY0(strcmp(strlist_get(sl, 0), "HOME=/home"));
+	check_lookup(sl, "HOME", "/home");
+}
+
+int
+main(int argc, char *argv[])
+{
+	strlist_t *sl;
+
+	if (strlist_alloc(&sl, 0) != 0) {
+		err(1, "strlist_alloc failure");
+	}
+	test_entries(sl);
+	strlist_free(sl);
+
+	if (strlist_alloc_arena(&sl, 0) != 0) {
+		err(1, "strlist_alloc_arena failure");
+	}
+	test_entries(sl);
+	strlist_free(sl);
+
+	return (0);
+}
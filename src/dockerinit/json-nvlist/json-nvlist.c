@@ -11,11 +11,14 @@
 
 /*
  * Copyright (c) 2017, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
+#include <string.h>
 #include <strings.h>
 #include <errno.h>
 #include <libnvpair.h>
@@ -24,77 +27,137 @@
 #include "custr.h"
 #include "json-nvlist.h"
 
-typedef enum json_type {
-	JSON_TYPE_NOTHING = 0,
-	JSON_TYPE_STRING = 1,
-	JSON_TYPE_INTEGER,
-	JSON_TYPE_DOUBLE,
-	JSON_TYPE_BOOLEAN,
-	JSON_TYPE_NULL,
-	JSON_TYPE_OBJECT,
-	JSON_TYPE_ARRAY
-} json_type_t;
+/*
+ * The parser is a loop over a small state machine, with an explicit stack of
+ * frames for the objects and arrays that are currently open.  Each value is
+ * added to the nvlist of the innermost open frame (or passed to the caller's
+ * callback) as soon as it has been read, so no frame needs to hold on to a key
+ * or a value once the parser has moved past it.
+ *
+ * Strings are scanned a word at a time for the characters that end a run of
+ * plain characters ('"', '\\', NUL or the start of a multi-byte UTF-8
+ * sequence, which is validated in place), and each run is copied into the
+ * collect buffer with a single append.  The frame stack starts out in the
+ * state structure itself and only moves to the heap for deeply nested
+ * documents.
+ *
+ * Input may arrive in chunks (see nvlist_parse_json_feed()), so every state
+ * can stop at the end of a chunk and pick up again at the start of the next
+ * one.  Strings, numbers and barewords that span chunks are accumulated in
+ * the key or collect buffer, and an escape sequence or multi-byte UTF-8
+ * character that is split between chunks is put back together in the carry
+ * buffer before it is decoded, so that every byte of the document is looked at
+ * by the same code however the input is divided up.
+ */
 
 typedef enum parse_state {
 	PARSE_ERROR = -1,
 	PARSE_DONE = 0,
 	PARSE_REST,
 	PARSE_OBJECT,
+	PARSE_KEY,
 	PARSE_KEY_STRING,
 	PARSE_COLON,
+	PARSE_VALUE,
 	PARSE_STRING,
-	PARSE_OBJECT_COMMA,
-	PARSE_ARRAY,
-	PARSE_BAREWORD,
 	PARSE_NUMBER,
-	PARSE_ARRAY_VALUE,
-	PARSE_ARRAY_COMMA
+	PARSE_BAREWORD,
+	PARSE_COMMA,
+	PARSE_ARRAY
 } parse_state_t;
 
 #define	JSON_MARKER		".__json_"
 #define	JSON_MARKER_ARRAY	JSON_MARKER "array"
 
-typedef struct parse_frame {
-	parse_state_t pf_ps;
-	nvlist_t *pf_nvl;
+#define	PARSE_FRAMES_INITIAL	32
 
-	char *pf_key;
-	void *pf_value;
-	json_type_t pf_value_type;
-	int pf_array_index;
+/*
+ * The longest escape sequence is a surrogate pair: two six-byte "\\u" escapes.
+ */
+#define	PARSE_CARRY_MAX		12
 
-	struct parse_frame *pf_next;
+typedef struct parse_frame {
+	nvlist_t *pf_nvl;
+	boolean_t pf_array;
+	uint32_t pf_array_index;
+	size_t pf_pathlen;
 } parse_frame_t;
 
-typedef struct state {
+typedef struct nvlist_parse_json_state {
+	/*
+	 * The current chunk of input.  s_offset is the position of its first
+	 * byte in the document, and s_eof is set once there is no more input
+	 * to come.
+	 */
 	const char *s_in;
 	unsigned long s_pos;
 	unsigned long s_len;
+	unsigned long s_offset;
+	boolean_t s_eof;
+
+	parse_state_t s_ps;
+
+	/*
+	 * The stack of open objects and arrays.  s_frames points either at
+	 * s_frames_initial or, if the document nests more deeply than that,
+	 * at a heap allocation.
+	 */
+	parse_frame_t *s_frames;
+	unsigned int s_depth;
+	unsigned int s_nframes;
+	parse_frame_t s_frames_initial[PARSE_FRAMES_INITIAL];
 
-	parse_frame_t *s_top;
+	/*
+	 * The outermost object or array, which is returned to the caller.
+	 */
+	nvlist_t *s_root;
 
 	nvlist_parse_json_flags_t s_flags;
 
+	/*
+	 * If the caller passed a callback, values are passed to it instead of
+	 * being added to nvlists.  s_path holds the keys of the open objects
+	 * and arrays, joined with ".", for the callback's benefit.
+	 */
+	nvlist_parse_json_cb_t *s_cb;
+	void *s_cb_arg;
+	custr_t *s_path;
+
+	/*
+	 * The name of the next value to be added to the innermost object or
+	 * array: either the last key string read, or the next array index.
+	 */
+	custr_t *s_key;
+	char s_index[16];
+
 	/*
 	 * This string buffer is used for temporary storage by the
 	 * "collect_*()" family of functions.
 	 */
 	custr_t *s_collect;
 
+	/*
+	 * An escape sequence or UTF-8 character that was cut off by the end
+	 * of a chunk, and the position in the document at which it started.
+	 */
+	char s_carry[PARSE_CARRY_MAX];
+	size_t s_ncarry;
+	unsigned long s_carry_offset;
+
 	int s_errno;
+	unsigned long s_errpos;
 	custr_t *s_errstr;
+	nvlist_parse_json_error_t *s_errout;
 } state_t;
 
-typedef void (*parse_handler_t)(state_t *);
-
 static void
 movestate(state_t *s, parse_state_t ps)
 {
 	if (s->s_flags & NVJSON_DEBUG) {
-		(void) fprintf(stderr, "nvjson: move state %d -> %d\n",
-		    s->s_top->pf_ps, ps);
+		(void) fprintf(stderr, "nvjson: move state %d -> %d (depth "
+		    "%u)\n", s->s_ps, ps, s->s_depth);
 	}
-	s->s_top->pf_ps = ps;
+	s->s_ps = ps;
 }
 
 static void
@@ -104,9 +167,10 @@ posterror(state_t *s, int erno, const char *error)
 	 * If the caller wants error messages printed to stderr, do that
 	 * first.
 	 */
+	s->s_errpos = s->s_offset + s->s_pos;
 	if (s->s_flags & NVJSON_ERRORS_TO_STDERR) {
 		(void) fprintf(stderr, "nvjson error (pos %ld, errno %d): %s\n",
-		    s->s_pos, erno, error);
+		    s->s_errpos, erno, error);
 	}
 
 	/*
@@ -122,72 +186,218 @@ posterror(state_t *s, int erno, const char *error)
 	movestate(s, PARSE_ERROR);
 }
 
-static int
-pushstate(state_t *s, parse_state_t ps, parse_state_t retps)
+static char
+popchar(state_t *s)
 {
-	parse_frame_t *n;
+	if (s->s_pos >= s->s_len) {
+		return (0);
+	}
+	return (s->s_in[s->s_pos++]);
+}
 
-	if (s->s_flags & NVJSON_DEBUG) {
-		(void) fprintf(stderr, "nvjson: push state %d -> %d (ret %d)\n",
-		    s->s_top->pf_ps, ps, retps);
+static char
+peekchar(state_t *s)
+{
+	if (s->s_pos >= s->s_len) {
+		return (0);
 	}
+	return (s->s_in[s->s_pos]);
+}
 
-	if ((n = calloc(1, sizeof (*n))) == NULL) {
-		posterror(s, errno, "pushstate calloc failure");
-		return (-1);
+static void
+discard_whitespace(state_t *s)
+{
+	while (s->s_pos < s->s_len &&
+	    isspace((unsigned char)s->s_in[s->s_pos])) {
+		s->s_pos++;
 	}
+}
 
-	/*
-	 * Store the state we'll return to when popping this
-	 * frame:
-	 */
-	s->s_top->pf_ps = retps;
+/*
+ * Skip any whitespace, and then return B_TRUE if the parser has reached the
+ * end of the current chunk and must wait for the next one before it can go
+ * on.
+ */
+static boolean_t
+need_input(state_t *s)
+{
+	discard_whitespace(s);
+	return (s->s_pos >= s->s_len && !s->s_eof);
+}
 
-	/*
-	 * Store the initial state for the new frame, and
-	 * put it on top of the stack:
-	 */
-	n->pf_ps = ps;
-	n->pf_value_type = JSON_TYPE_NOTHING;
+/*
+ * Word-at-a-time byte search: HAS_ZERO_BYTE() is non-zero if any byte of the
+ * 64-bit word is zero.  It may also flag a byte that follows a zero byte, so a
+ * word it flags is rescanned a byte at a time.
+ */
+#define	BYTES_ONES		0x0101010101010101ULL
+#define	BYTES_HIGHS		0x8080808080808080ULL
+#define	HAS_ZERO_BYTE(v)	(((v) - BYTES_ONES) & ~(v) & BYTES_HIGHS)
+
+/*
+ * If "p" (which has "len" bytes) starts with a well-formed UTF-8 sequence of
+ * more than one byte, return its length, otherwise return 0.  Overlong
+ * encodings, surrogates and code points above U+10FFFF are not well-formed.
+ */
+static size_t
+utf8_sequence(const char *p, size_t len)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	unsigned char lo = 0x80;
+	unsigned char hi = 0xbf;
+	size_t n;
+	size_t i;
+
+	if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+		n = 2;
+	} else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+		n = 3;
+		if (u[0] == 0xe0)
+			lo = 0xa0;
+		else if (u[0] == 0xed)
+			hi = 0x9f;
+	} else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+		n = 4;
+		if (u[0] == 0xf0)
+			lo = 0x90;
+		else if (u[0] == 0xf4)
+			hi = 0x8f;
+	} else {
+		return (0);
+	}
 
-	n->pf_next = s->s_top;
-	s->s_top = n;
+	if (len < n || u[1] < lo || u[1] > hi) {
+		return (0);
+	}
+	for (i = 2; i < n; i++) {
+		if (u[i] < 0x80 || u[i] > 0xbf) {
+			return (0);
+		}
+	}
 
-	return (0);
+	return (n);
 }
 
-static char
-popchar(state_t *s)
+/*
+ * Return the number of bytes at the start of "p" (which has "len" bytes)
+ * that can be copied into a string as they are: everything before the first
+ * '"', '\\', NUL or byte that isn't part of a well-formed UTF-8 sequence.
+ * Runs of ASCII are checked a word at a time, and only words that contain a
+ * character that needs a closer look are examined byte by byte.
+ */
+static size_t
+scan_string_run(const char *p, size_t len)
 {
-	if (s->s_pos > s->s_len) {
-		return (0);
+	size_t i = 0;
+	size_t n;
+
+	while (i < len) {
+		if (i + sizeof (uint64_t) <= len) {
+			uint64_t v;
+
+			(void) memcpy(&v, p + i, sizeof (v));
+			if (((v & BYTES_HIGHS) | HAS_ZERO_BYTE(v) |
+			    HAS_ZERO_BYTE(v ^ (BYTES_ONES * '"')) |
+			    HAS_ZERO_BYTE(v ^ (BYTES_ONES * '\\'))) == 0) {
+				i += sizeof (uint64_t);
+				continue;
+			}
+		}
+
+		if ((p[i] & 0x80) == 0) {
+			if (p[i] == '"' || p[i] == '\\' || p[i] == '\0') {
+				break;
+			}
+			i++;
+			continue;
+		}
+
+		if ((n = utf8_sequence(p + i, len - i)) == 0) {
+			break;
+		}
+		i += n;
 	}
-	return (s->s_in[s->s_pos++]);
+
+	return (i);
 }
 
-static char
-peekchar(state_t *s)
+/*
+ * Append the UTF-8 encoding of a code point (which must not be a surrogate)
+ * to a string.
+ */
+static int
+custr_append_utf8(custr_t *cu, uint32_t cp)
 {
-	if (s->s_pos > s->s_len) {
-		return (0);
+	char buf[4];
+	size_t n;
+
+	if (cp < 0x80) {
+		buf[0] = cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		buf[0] = 0xc0 | (cp >> 6);
+		buf[1] = 0x80 | (cp & 0x3f);
+		n = 2;
+	} else if (cp < 0x10000) {
+		buf[0] = 0xe0 | (cp >> 12);
+		buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+		buf[2] = 0x80 | (cp & 0x3f);
+		n = 3;
+	} else {
+		buf[0] = 0xf0 | (cp >> 18);
+		buf[1] = 0x80 | ((cp >> 12) & 0x3f);
+		buf[2] = 0x80 | ((cp >> 6) & 0x3f);
+		buf[3] = 0x80 | (cp & 0x3f);
+		n = 4;
 	}
-	return (s->s_in[s->s_pos]);
+
+	return (custr_append_n(cu, buf, n));
 }
 
-static void
-discard_whitespace(state_t *s)
+/*
+ * Return the value of a hex digit, or -1 if it isn't one.
+ */
+static int
+hex_digit(char c)
 {
-	while (isspace(peekchar(s))) {
-		(void) popchar(s);
+	if (c >= '0' && c <= '9') {
+		return (c - '0');
+	} else if (c >= 'a' && c <= 'f') {
+		return (c - 'a' + 10);
+	} else if (c >= 'A' && c <= 'F') {
+		return (c - 'A' + 10);
+	}
+	return (-1);
+}
+
+/*
+ * Read the four hex digits of a "\u" escape.  Returns the value, or -1 if
+ * they aren't all hex digits.
+ */
+static int32_t
+collect_hex4(state_t *s)
+{
+	int32_t val = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		int d = hex_digit(popchar(s));
+
+		if (d < 0) {
+			return (-1);
+		}
+		val = (val << 4) | d;
 	}
+
+	return (val);
 }
 
 static char *escape_pairs[] = {
 	"\"\"", "\\\\", "//", "b\b", "f\f", "n\n", "r\r", "t\t", NULL
 };
 
-static char
-collect_string_escape(state_t *s)
+static int
+collect_string_escape(state_t *s, custr_t *cu)
 {
 	int i;
 	char c = popchar(s);
@@ -198,33 +408,56 @@ collect_string_escape(state_t *s)
 	}
 
 	/*
-	 * Handle four-digit Unicode escapes up to and including \u007f.
-	 * Strings that cannot be represented as 7-bit clean ASCII are not
-	 * currently supported.
+	 * Handle four-digit Unicode escapes.  Characters outside the Basic
+	 * Multilingual Plane are written as a UTF-16 surrogate pair of two
+	 * escapes, which we combine before encoding the result as UTF-8.
 	 */
 	if (c == 'u') {
-		int res;
-		int ndigs = 0;
-		char digs[5];
+		int32_t cp;
+		int32_t lo;
 
-		/*
-		 * Deal with 4-digit unicode escape.
-		 */
-		while (ndigs < 4) {
-			if ((digs[ndigs++] = popchar(s)) == '\0') {
-				posterror(s, EPROTO, "EOF mid-escape "
-				    "sequence");
+		if ((cp = collect_hex4(s)) < 0) {
+			posterror(s, EPROTO, "malformed unicode escape");
+			return (-1);
+		}
+
+		if (cp >= 0xdc00 && cp <= 0xdfff) {
+			posterror(s, EPROTO, "unpaired low surrogate in "
+			    "unicode escape");
+			return (-1);
+		}
+
+		if (cp >= 0xd800 && cp <= 0xdbff) {
+			if (popchar(s) != '\\' || popchar(s) != 'u') {
+				posterror(s, EPROTO, "unpaired high surrogate "
+				    "in unicode escape");
+				return (-1);
+			}
+			if ((lo = collect_hex4(s)) < 0) {
+				posterror(s, EPROTO, "malformed unicode "
+				    "escape");
 				return (-1);
 			}
+			if (lo < 0xdc00 || lo > 0xdfff) {
+				posterror(s, EPROTO, "unpaired high surrogate "
+				    "in unicode escape");
+				return (-1);
+			}
+			cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
 		}
-		digs[4] = '\0';
-		if ((res = atoi(digs)) > 127) {
-			posterror(s, EPROTO, "unicode escape above 0x7f");
+
+		/*
+		 * nvlist strings are NUL-terminated, so they cannot hold an
+		 * escaped NUL.
+		 */
+		if (cp == 0) {
+			posterror(s, ENOTSUP, "unicode escape for NUL not "
+			    "supported");
 			return (-1);
 		}
 
-		if (custr_appendc(s->s_collect, res) != 0) {
-			posterror(s, errno, "custr_appendc failure");
+		if (custr_append_utf8(cu, cp) != 0) {
+			posterror(s, errno, "custr_append failure");
 			return (-1);
 		}
 		return (0);
@@ -236,7 +469,7 @@ collect_string_escape(state_t *s)
 	for (i = 0; escape_pairs[i] != NULL; i++) {
 		char *ep = escape_pairs[i];
 		if (ep[0] == c) {
-			if (custr_appendc(s->s_collect, ep[1]) != 0) {
+			if (custr_appendc(cu, ep[1]) != 0) {
 				posterror(s, errno, "custr_appendc failure");
 				return (-1);
 			}
@@ -248,15 +481,159 @@ collect_string_escape(state_t *s)
 	return (-1);
 }
 
+/*
+ * Return the number of bytes needed to decode the escape sequence or UTF-8
+ * character that starts with the "len" bytes at "p".  The answer can go up as
+ * more of it is seen: an escape for a high surrogate needs the escape for the
+ * low surrogate that follows it, too.
+ */
+static size_t
+carry_need(const char *p, size_t len)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	int32_t cp = 0;
+	size_t i;
+
+	if (p[0] != '\\') {
+		if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+			return (2);
+		} else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+			return (3);
+		} else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+			return (4);
+		}
+		return (1);
+	}
+
+	if (len < 2 || p[1] != 'u') {
+		return (2);
+	}
+	if (len < 6) {
+		return (6);
+	}
+	for (i = 2; i < 6; i++) {
+		int d = hex_digit(p[i]);
+
+		if (d < 0) {
+			return (6);
+		}
+		cp = (cp << 4) | d;
+	}
+
+	return (cp >= 0xd800 && cp <= 0xdbff ? PARSE_CARRY_MAX : 6);
+}
+
+/*
+ * Complete the escape sequence or UTF-8 character in the carry buffer with
+ * bytes from the current chunk, and append it to "cu".  Returns 0 on success,
+ * 1 if the chunk ran out before it was complete, or -1 on error.
+ */
+static int
+collect_carry(state_t *s, custr_t *cu)
+{
+	const char *in;
+	unsigned long pos;
+	unsigned long len;
+	unsigned long offset;
+	size_t n;
+	int ret = 0;
+
+	while (s->s_ncarry < carry_need(s->s_carry, s->s_ncarry)) {
+		if (s->s_pos >= s->s_len) {
+			if (!s->s_eof) {
+				return (1);
+			}
+			break;
+		}
+		s->s_carry[s->s_ncarry++] = s->s_in[s->s_pos++];
+	}
+
+	/*
+	 * Decode the carry buffer as though it were the input, so that it goes
+	 * through the same code (and any error is reported at the same place)
+	 * as it would have if it hadn't been split.
+	 */
+	in = s->s_in;
+	pos = s->s_pos;
+	len = s->s_len;
+	offset = s->s_offset;
+	s->s_in = s->s_carry;
+	s->s_pos = 0;
+	s->s_len = s->s_ncarry;
+	s->s_offset = s->s_carry_offset;
+	s->s_ncarry = 0;
+
+	if (s->s_carry[0] == '\\') {
+		s->s_pos = 1;
+		ret = collect_string_escape(s, cu);
+	} else if ((n = utf8_sequence(s->s_carry, s->s_len)) > 0) {
+		if (custr_append_n(cu, s->s_carry, n) != 0) {
+			posterror(s, errno, "custr_append failure");
+			ret = -1;
+		}
+	} else {
+		posterror(s, EILSEQ, "invalid UTF-8 in string");
+		ret = -1;
+	}
+
+	s->s_in = in;
+	s->s_pos = pos;
+	s->s_len = len;
+	s->s_offset = offset;
+
+	return (ret);
+}
+
+/*
+ * Collect the rest of a string, the opening '"' of which has already been
+ * read, into "cu".  Returns 0 once the closing '"' has been read, 1 if the
+ * chunk ran out first, or -1 on error.
+ */
 static int
-collect_string(state_t *s)
+collect_string(state_t *s, custr_t *cu)
 {
-	custr_reset(s->s_collect);
+	int ret;
+
+	if (s->s_ncarry > 0 && (ret = collect_carry(s, cu)) != 0) {
+		return (ret);
+	}
 
 	for (;;) {
-		char c;
+		const char *run = s->s_in + s->s_pos;
+		size_t avail = s->s_len - s->s_pos;
+		size_t len = scan_string_run(run, avail);
+
+		if (len > 0) {
+			if (custr_append_n(cu, run, len) != 0) {
+				posterror(s, errno, "custr_append failure");
+				return (-1);
+			}
+			s->s_pos += len;
+			run += len;
+			avail -= len;
+		}
+
+		if (!s->s_eof) {
+			if (avail == 0) {
+				return (1);
+			}
+
+			/*
+			 * Keep an escape sequence or UTF-8 character that is
+			 * cut off by the end of the chunk until the rest of it
+			 * arrives.
+			 */
+			if ((run[0] == '\\' || (run[0] & 0x80) != 0) &&
+			    carry_need(run, avail) > avail) {
+				bcopy(run, s->s_carry, avail);
+				s->s_ncarry = avail;
+				s->s_carry_offset = s->s_offset + s->s_pos;
+				s->s_pos += avail;
+				return (1);
+			}
+		}
 
-		switch (c = popchar(s)) {
+		switch (popchar(s)) {
 		case '"':
 			/*
 			 * Legal End of String.
@@ -271,543 +648,651 @@ collect_string(state_t *s)
 			/*
 			 * Escape Characters and Sequences.
 			 */
-			if (collect_string_escape(s) != 0) {
+			if (collect_string_escape(s, cu) != 0) {
 				return (-1);
 			}
 			break;
 
 		default:
-			if (custr_appendc(s->s_collect, c) != 0) {
-				posterror(s, errno, "custr_appendc failure");
-				return (-1);
-			}
-			break;
+			/*
+			 * The run stopped at a byte that doesn't start a
+			 * well-formed UTF-8 sequence.
+			 */
+			s->s_pos--;
+			posterror(s, EILSEQ, "invalid UTF-8 in string");
+			return (-1);
 		}
 	}
 }
 
+/*
+ * Collect a number (if "number" is set) or a bareword.  Returns 0 with the
+ * token in "tokp" and "lenp" once the character after it has been seen (or
+ * the input has ended), 1 if the chunk ran out first, or -1 on error.  The
+ * token is only copied into the collect buffer if it spans chunks.
+ */
 static int
-collect_bareword(state_t *s)
+collect_token(state_t *s, boolean_t number, const char **tokp, size_t *lenp)
 {
-	custr_reset(s->s_collect);
+	const char *tok = s->s_in + s->s_pos;
+	size_t avail = s->s_len - s->s_pos;
+	size_t collected = custr_len(s->s_collect);
+	size_t len = 0;
 
-	for (;;) {
-		if (!islower(peekchar(s))) {
-			return (0);
+	while (len < avail) {
+		unsigned char c = tok[len];
+
+		if (number) {
+			if (!isdigit(c) && (c != '-' || len + collected > 0)) {
+				break;
+			}
+		} else if (!islower(c)) {
+			break;
 		}
+		len++;
+	}
+	s->s_pos += len;
+
+	if (len == avail && !s->s_eof) {
+		if (custr_append_n(s->s_collect, tok, len) != 0) {
+			posterror(s, errno, "custr_append failure");
+			return (-1);
+		}
+		return (1);
+	}
 
-		if (custr_appendc(s->s_collect, popchar(s)) != 0) {
-			posterror(s, errno, "custr_appendc failure");
+	if (collected > 0) {
+		if (custr_append_n(s->s_collect, tok, len) != 0) {
+			posterror(s, errno, "custr_append failure");
 			return (-1);
 		}
+		tok = custr_cstr(s->s_collect);
+		len = custr_len(s->s_collect);
 	}
+
+	*tokp = tok;
+	*lenp = len;
+	return (0);
 }
 
-static void
-hdlr_bareword(state_t *s)
+/*
+ * Return the name under which the next value is to be stored in the
+ * innermost object or array.
+ */
+static const char *
+value_key(state_t *s)
 {
-	const char *str;
+	parse_frame_t *pf = &s->s_frames[s->s_depth - 1];
 
-	if (collect_bareword(s) != 0) {
-		return;
-	}
-
-	str = custr_cstr(s->s_collect);
-	if (strcmp(str, "true") == 0) {
-		s->s_top->pf_value_type = JSON_TYPE_BOOLEAN;
-		s->s_top->pf_value = (void *)B_TRUE;
-	} else if (strcmp(str, "false") == 0) {
-		s->s_top->pf_value_type = JSON_TYPE_BOOLEAN;
-		s->s_top->pf_value = (void *)B_FALSE;
-	} else if (strcmp(str, "null") == 0) {
-		s->s_top->pf_value_type = JSON_TYPE_NULL;
-	} else {
-		posterror(s, EPROTO, "expected 'true', 'false' or 'null'");
-		return;
+	if (pf->pf_array) {
+		(void) snprintf(s->s_index, sizeof (s->s_index), "%u",
+		    pf->pf_array_index++);
+		return (s->s_index);
 	}
 
-	movestate(s, PARSE_DONE);
+	return (custr_cstr(s->s_key));
 }
 
-/* ARGSUSED */
+/*
+ * Append a key to the path of the innermost open object or array, storing the
+ * previous length of the path in "lenp" so that it can be truncated again.
+ */
 static int
-collect_number(state_t *s, boolean_t *isint, int32_t *result,
-    double *fresult __unused)
+path_push(state_t *s, const char *key, size_t *lenp)
 {
-	boolean_t neg = B_FALSE;
-	int t;
-
-	custr_reset(s->s_collect);
+	*lenp = custr_len(s->s_path);
 
-	if (peekchar(s) == '-') {
-		neg = B_TRUE;
-		(void) popchar(s);
-	}
-	/*
-	 * Read the 'int' portion:
-	 */
-	if (!isdigit(peekchar(s))) {
-		posterror(s, EPROTO, "malformed number: expected digit (0-9)");
-		return (-1);
-	}
-	for (;;) {
-		if (!isdigit(peekchar(s))) {
-			break;
-		}
-		if (custr_appendc(s->s_collect, popchar(s)) != 0) {
-			posterror(s, errno, "custr_append failure");
-			return (-1);
-		}
-	}
-	if (peekchar(s) == '.' || peekchar(s) == 'e' || peekchar(s) == 'E') {
-		posterror(s, ENOTSUP, "do not yet support FRACs or EXPs");
+	if ((*lenp > 0 && custr_appendc(s->s_path, '.') != 0) ||
+	    custr_append(s->s_path, key) != 0) {
+		posterror(s, errno, "custr_append failure");
 		return (-1);
 	}
 
-	t = atoi(custr_cstr(s->s_collect));
-
-	*isint = B_TRUE;
-	*result = (neg == B_TRUE) ? (-t) : t;
 	return (0);
 }
 
-static void
-hdlr_number(state_t *s)
+/*
+ * Pass a value to the caller's callback.
+ */
+static int
+emit(state_t *s, nvlist_parse_json_value_t *njv)
 {
-	boolean_t isint;
-	int32_t result;
-	double fresult;
+	int ret;
 
-	if (collect_number(s, &isint, &result, &fresult) != 0) {
-		return;
-	}
+	njv->njv_path = custr_cstr(s->s_path);
 
-	if (isint == B_TRUE) {
-		s->s_top->pf_value = (void *)(uintptr_t)result;
-		s->s_top->pf_value_type = JSON_TYPE_INTEGER;
-	} else {
-		s->s_top->pf_value = malloc(sizeof (fresult));
-		bcopy(&fresult, s->s_top->pf_value, sizeof (fresult));
-		s->s_top->pf_value_type = JSON_TYPE_DOUBLE;
+	if ((ret = s->s_cb(njv, s->s_cb_arg)) != 0) {
+		posterror(s, ret, "parse stopped by callback");
+		return (-1);
 	}
 
-	movestate(s, PARSE_DONE);
+	return (0);
 }
 
+/*
+ * Store a string, number, boolean or null in the innermost object or array,
+ * or pass it to the callback.
+ */
 static void
-hdlr_rest(state_t *s)
+store_value(state_t *s, nvlist_parse_json_value_t *njv)
 {
-	char c;
-	discard_whitespace(s);
-	c = popchar(s);
-	switch (c) {
-	case '{':
-		movestate(s, PARSE_OBJECT);
-		return;
+	nvlist_t *nvl = s->s_frames[s->s_depth - 1].pf_nvl;
+	const char *key = value_key(s);
+	size_t len;
+	int ret;
 
-	case '[':
-		movestate(s, PARSE_ARRAY);
+	if (s->s_cb != NULL) {
+		if (path_push(s, key, &len) != 0) {
+			return;
+		}
+		njv->njv_key = key;
+		njv->njv_depth = s->s_depth;
+		ret = emit(s, njv);
+		(void) custr_trunc(s->s_path, len);
+		if (ret == 0) {
+			movestate(s, PARSE_COMMA);
+		}
 		return;
+	}
 
+	switch (njv->njv_type) {
+	case NVJSON_TYPE_STRING:
+		ret = nvlist_add_string(nvl, key, njv->njv_string);
+		break;
+	case NVJSON_TYPE_INTEGER:
+		ret = nvlist_add_int32(nvl, key, njv->njv_integer);
+		break;
+	case NVJSON_TYPE_BOOLEAN:
+		ret = nvlist_add_boolean_value(nvl, key, njv->njv_boolean);
+		break;
+	case NVJSON_TYPE_NULL:
+		ret = nvlist_add_boolean(nvl, key);
+		break;
 	default:
-		posterror(s, EPROTO, "EOF before object or array");
+		(void) fprintf(stderr, "no handler for value type %d\n",
+		    njv->njv_type);
+		abort();
+	}
+
+	if (ret != 0) {
+		posterror(s, ret, "nvlist_add failure");
 		return;
 	}
+
+	movestate(s, PARSE_COMMA);
 }
 
-static int
-add_empty_child(state_t *s)
+static void
+parse_bareword(state_t *s)
 {
-	/*
-	 * Here, we create an empty nvlist to represent this object
-	 * or array:
-	 */
-	nvlist_t *empty;
-	if (nvlist_alloc(&empty, NV_UNIQUE_NAME, 0) != 0) {
-		posterror(s, errno, "nvlist_alloc failure");
-		return (-1);
-	}
-	if (s->s_top->pf_next != NULL) {
-		/*
-		 * If we're a child of the frame above, we store ourselves in
-		 * that frame's nvlist:
-		 */
-		nvlist_t *nvl = s->s_top->pf_next->pf_nvl;
-		char *key = s->s_top->pf_next->pf_key;
+	nvlist_parse_json_value_t njv;
+	const char *word;
+	size_t len;
 
-		if (nvlist_add_nvlist(nvl, key, empty) != 0) {
-			posterror(s, errno, "nvlist_add_nvlist failure");
-			nvlist_free(empty);
-			return (-1);
-		}
-		nvlist_free(empty);
-		if (nvlist_lookup_nvlist(nvl, key, &empty) != 0) {
-			posterror(s, errno, "nvlist_lookup_nvlist failure");
-			return (-1);
-		}
+	switch (collect_token(s, B_FALSE, &word, &len)) {
+	case 0:
+		break;
+	case 1:
+		movestate(s, PARSE_BAREWORD);
+		return;
+	default:
+		return;
 	}
-	s->s_top->pf_nvl = empty;
-	return (0);
-}
 
-static int
-decorate_array(state_t *s)
-{
-	int idx = s->s_top->pf_array_index;
-	/*
-	 * When we are done creating an array, we store a 'length'
-	 * property on it, as well as an internal-use marker value.
-	 */
-	if (nvlist_add_boolean(s->s_top->pf_nvl, JSON_MARKER_ARRAY) != 0 ||
-	    nvlist_add_uint32(s->s_top->pf_nvl, "length", idx) != 0) {
-		posterror(s, errno, "nvlist_add failure");
-		return (-1);
+	bzero(&njv, sizeof (njv));
+	if (len == 4 && strncmp(word, "true", 4) == 0) {
+		njv.njv_type = NVJSON_TYPE_BOOLEAN;
+		njv.njv_boolean = B_TRUE;
+	} else if (len == 5 && strncmp(word, "false", 5) == 0) {
+		njv.njv_type = NVJSON_TYPE_BOOLEAN;
+		njv.njv_boolean = B_FALSE;
+	} else if (len == 4 && strncmp(word, "null", 4) == 0) {
+		njv.njv_type = NVJSON_TYPE_NULL;
+	} else {
+		posterror(s, EPROTO, "expected 'true', 'false' or 'null'");
+		return;
 	}
 
-	return (0);
+	store_value(s, &njv);
 }
 
 static void
-hdlr_array(state_t *s)
+parse_number(state_t *s)
 {
-	s->s_top->pf_value_type = JSON_TYPE_ARRAY;
+	nvlist_parse_json_value_t njv;
+	boolean_t neg = B_FALSE;
+	int64_t val = 0;
+	const char *num;
+	size_t len;
+	size_t i = 0;
 
-	if (add_empty_child(s) != 0) {
+	switch (collect_token(s, B_TRUE, &num, &len)) {
+	case 0:
+		break;
+	case 1:
+		movestate(s, PARSE_NUMBER);
+		return;
+	default:
 		return;
 	}
 
-	discard_whitespace(s);
-
-	switch (peekchar(s)) {
-	case ']':
-		(void) popchar(s);
-
-		if (decorate_array(s) != 0) {
-			return;
+	if (num[0] == '-') {
+		neg = B_TRUE;
+		i++;
+	}
+	/*
+	 * Read the 'int' portion:
+	 */
+	if (i == len) {
+		posterror(s, EPROTO, "malformed number: expected digit (0-9)");
+		return;
+	}
+	for (; i < len; i++) {
+		/*
+		 * Values that don't fit in an int32_t are clamped, as they
+		 * were when this was parsed with atoi(3C) in a 32-bit process.
+		 */
+		if (val <= INT32_MAX) {
+			val = val * 10 + (num[i] - '0');
 		}
-
-		movestate(s, PARSE_DONE);
+	}
+	if (peekchar(s) == '.' || peekchar(s) == 'e' || peekchar(s) == 'E') {
+		posterror(s, ENOTSUP, "do not yet support FRACs or EXPs");
 		return;
+	}
 
-	default:
-		movestate(s, PARSE_ARRAY_VALUE);
-		return;
+	if (neg) {
+		val = val > (int64_t)INT32_MAX + 1 ? INT32_MIN : -val;
+	} else if (val > INT32_MAX) {
+		val = INT32_MAX;
 	}
+
+	bzero(&njv, sizeof (njv));
+	njv.njv_type = NVJSON_TYPE_INTEGER;
+	njv.njv_integer = (int32_t)val;
+	store_value(s, &njv);
 }
 
 static void
-hdlr_array_comma(state_t *s)
+parse_string(state_t *s)
 {
-	discard_whitespace(s);
-
-	switch (popchar(s)) {
-	case ']':
-		if (decorate_array(s) != 0) {
-			return;
-		}
+	nvlist_parse_json_value_t njv;
 
-		movestate(s, PARSE_DONE);
-		return;
-	case ',':
-		movestate(s, PARSE_ARRAY_VALUE);
+	switch (collect_string(s, s->s_collect)) {
+	case 0:
+		break;
+	case 1:
+		movestate(s, PARSE_STRING);
 		return;
 	default:
-		posterror(s, EPROTO, "expected ',' or ']'");
 		return;
 	}
+
+	bzero(&njv, sizeof (njv));
+	njv.njv_type = NVJSON_TYPE_STRING;
+	njv.njv_string = custr_cstr(s->s_collect);
+	store_value(s, &njv);
 }
 
+/*
+ * Open a new object or array.  Its nvlist is stored in the innermost open
+ * object or array (if there is one) straight away, and then filled in as its
+ * contents are parsed.
+ */
 static void
-hdlr_array_value(state_t *s)
+push_frame(state_t *s, boolean_t array)
 {
-	char c;
-
-	/*
-	 * Generate keyname from the next array index:
-	 */
-	if (s->s_top->pf_key != NULL) {
-		(void) fprintf(stderr, "pf_key not null! was %s\n",
-		    s->s_top->pf_key);
-		abort();
-	}
-
-	if (asprintf(&s->s_top->pf_key, "%d", s->s_top->pf_array_index++) < 0) {
-		posterror(s, errno, "asprintf failure");
-		return;
+	parse_frame_t *pf;
+	nvlist_t *nvl = NULL;
+	size_t pathlen = 0;
+	int ret;
+
+	if (s->s_depth == s->s_nframes) {
+		unsigned int n = s->s_nframes * 2;
+		parse_frame_t *frames;
+
+		if (s->s_frames == s->s_frames_initial) {
+			if ((frames = calloc(n, sizeof (*frames))) != NULL) {
+				bcopy(s->s_frames, frames,
+				    s->s_nframes * sizeof (*frames));
+			}
+		} else {
+			frames = realloc(s->s_frames, n * sizeof (*frames));
+		}
+		if (frames == NULL) {
+			posterror(s, errno, "frame allocation failure");
+			return;
+		}
+		s->s_frames = frames;
+		s->s_nframes = n;
 	}
 
-	discard_whitespace(s);
-
-	/*
-	 * Select which type handler we need for the next value:
-	 */
-	switch (c = peekchar(s)) {
-	case '"':
-		(void) popchar(s);
-		(void) pushstate(s, PARSE_STRING, PARSE_ARRAY_COMMA);
-		return;
-
-	case '{':
-		(void) popchar(s);
-		(void) pushstate(s, PARSE_OBJECT, PARSE_ARRAY_COMMA);
-		return;
+	if (s->s_cb != NULL) {
+		/*
+		 * Extend the path with the key of the new object or array,
+		 * and announce it to the callback.
+		 */
+		nvlist_parse_json_value_t njv;
+		const char *key = s->s_depth == 0 ? "" : value_key(s);
 
-	case '[':
-		(void) popchar(s);
-		(void) pushstate(s, PARSE_ARRAY, PARSE_ARRAY_COMMA);
+		if (path_push(s, key, &pathlen) != 0) {
+			return;
+		}
+		bzero(&njv, sizeof (njv));
+		njv.njv_type = array ? NVJSON_TYPE_ARRAY : NVJSON_TYPE_OBJECT;
+		njv.njv_key = key;
+		njv.njv_depth = s->s_depth;
+		if (emit(s, &njv) != 0) {
+			return;
+		}
+	} else if ((ret = nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0)) != 0) {
+		posterror(s, ret, "nvlist_alloc failure");
 		return;
+	} else if (s->s_depth == 0) {
+		s->s_root = nvl;
+	} else {
+		/*
+		 * Store the empty nvlist in the enclosing object or array,
+		 * and then fill in the copy that lives there:
+		 */
+		nvlist_t *parent = s->s_frames[s->s_depth - 1].pf_nvl;
+		const char *key = value_key(s);
 
-	default:
-		if (islower(c)) {
-			(void) pushstate(s, PARSE_BAREWORD,
-			    PARSE_ARRAY_COMMA);
+		if ((ret = nvlist_add_nvlist(parent, key, nvl)) != 0) {
+			posterror(s, ret, "nvlist_add_nvlist failure");
+			nvlist_free(nvl);
 			return;
-		} else if (c == '-' || isdigit(c)) {
-			(void) pushstate(s, PARSE_NUMBER, PARSE_ARRAY_COMMA);
-			return;
-		} else {
-			posterror(s, EPROTO, "unexpected character at start "
-			    "of value");
+		}
+		nvlist_free(nvl);
+		if ((ret = nvlist_lookup_nvlist(parent, key, &nvl)) != 0) {
+			posterror(s, ret, "nvlist_lookup_nvlist failure");
 			return;
 		}
 	}
-}
 
-static void
-hdlr_object(state_t *s)
-{
-	s->s_top->pf_value_type = JSON_TYPE_OBJECT;
-
-	if (add_empty_child(s) != 0) {
-		return;
+	if (s->s_flags & NVJSON_DEBUG) {
+		(void) fprintf(stderr, "nvjson: push %s (depth %u)\n",
+		    array ? "array" : "object", s->s_depth + 1);
 	}
 
-	discard_whitespace(s);
-
-	switch (popchar(s)) {
-	case '}':
-		movestate(s, PARSE_DONE);
-		return;
-
-	case '"':
-		movestate(s, PARSE_KEY_STRING);
-		return;
+	pf = &s->s_frames[s->s_depth++];
+	pf->pf_nvl = nvl;
+	pf->pf_array = array;
+	pf->pf_array_index = 0;
+	pf->pf_pathlen = pathlen;
 
-	default:
-		posterror(s, EPROTO, "expected key or '}'");
-		return;
-	}
+	movestate(s, array ? PARSE_ARRAY : PARSE_OBJECT);
 }
 
+/*
+ * Close the innermost object or array.
+ */
 static void
-hdlr_key_string(state_t *s)
+pop_frame(state_t *s)
 {
-	if (collect_string(s) != 0) {
-		return;
+	parse_frame_t *pf = &s->s_frames[s->s_depth - 1];
+
+	if (s->s_cb != NULL) {
+		/*
+		 * The key of the object or array is the last component of
+		 * the path.
+		 */
+		nvlist_parse_json_value_t njv;
+		const char *path = custr_cstr(s->s_path);
+
+		bzero(&njv, sizeof (njv));
+		njv.njv_type = NVJSON_TYPE_END;
+		njv.njv_key = path + pf->pf_pathlen +
+		    (pf->pf_pathlen > 0 ? 1 : 0);
+		njv.njv_depth = s->s_depth - 1;
+		njv.njv_integer = pf->pf_array ? pf->pf_array_index : 0;
+		if (emit(s, &njv) != 0) {
+			return;
+		}
+		(void) custr_trunc(s->s_path, pf->pf_pathlen);
+	} else if (pf->pf_array) {
+		/*
+		 * When we are done creating an array, we store a 'length'
+		 * property on it, as well as an internal-use marker value.
+		 */
+		if (nvlist_add_boolean(pf->pf_nvl, JSON_MARKER_ARRAY) != 0 ||
+		    nvlist_add_uint32(pf->pf_nvl, "length",
+		    pf->pf_array_index) != 0) {
+			posterror(s, errno, "nvlist_add failure");
+			return;
+		}
 	}
 
-	/*
-	 * Record the key name of the next value.
-	 */
-	if ((s->s_top->pf_key = strdup(custr_cstr(s->s_collect))) == NULL) {
-		posterror(s, errno, "strdup failure");
-		return;
+	if (s->s_flags & NVJSON_DEBUG) {
+		(void) fprintf(stderr, "nvjson: pop %s (depth %u)\n",
+		    pf->pf_array ? "array" : "object", s->s_depth);
 	}
 
-	movestate(s, PARSE_COLON);
+	s->s_depth--;
+	movestate(s, s->s_depth == 0 ? PARSE_DONE : PARSE_COMMA);
 }
 
+/*
+ * Parse the value that starts at the current position, which is stored in the
+ * innermost object or array.  If a string, number or bareword runs past the
+ * end of the chunk, the parser moves to a state that carries on with it.
+ */
 static void
-hdlr_colon(state_t *s)
+parse_value(state_t *s)
 {
 	char c;
-	discard_whitespace(s);
-
-	if ((c = popchar(s)) != ':') {
-		posterror(s, EPROTO, "expected ':'");
-		return;
-	}
-
-	discard_whitespace(s);
 
 	/*
-	 * Select which type handler we need for the value after the colon:
+	 * Select which type handler we need for the next value:
 	 */
 	switch (c = peekchar(s)) {
 	case '"':
 		(void) popchar(s);
-		(void) pushstate(s, PARSE_STRING, PARSE_OBJECT_COMMA);
+		custr_reset(s->s_collect);
+		parse_string(s);
 		return;
 
 	case '{':
 		(void) popchar(s);
-		(void) pushstate(s, PARSE_OBJECT, PARSE_OBJECT_COMMA);
+		push_frame(s, B_FALSE);
 		return;
 
 	case '[':
 		(void) popchar(s);
-		(void) pushstate(s, PARSE_ARRAY, PARSE_OBJECT_COMMA);
+		push_frame(s, B_TRUE);
 		return;
 
 	default:
-		if (islower(c)) {
-			(void) pushstate(s, PARSE_BAREWORD, PARSE_OBJECT_COMMA);
-			return;
-		} else if (c == '-' || isdigit(c)) {
-			(void) pushstate(s, PARSE_NUMBER, PARSE_OBJECT_COMMA);
-			return;
+		if (islower((unsigned char)c)) {
+			custr_reset(s->s_collect);
+			parse_bareword(s);
+		} else if (c == '-' || isdigit((unsigned char)c)) {
+			custr_reset(s->s_collect);
+			parse_number(s);
 		} else {
-			(void) posterror(s, EPROTO, "unexpected character at "
-			    "start of value");
-			return;
-		}
-	}
-}
-
-static void
-hdlr_object_comma(state_t *s)
-{
-	discard_whitespace(s);
-
-	switch (popchar(s)) {
-	case '}':
-		movestate(s, PARSE_DONE);
-		return;
-
-	case ',':
-		discard_whitespace(s);
-		if (popchar(s) != '"') {
-			posterror(s, EPROTO, "expected '\"'");
-			return;
+			posterror(s, EPROTO, "unexpected character at start "
+			    "of value");
 		}
-		movestate(s, PARSE_KEY_STRING);
-		return;
-
-	default:
-		posterror(s, EPROTO, "expected ',' or '}'");
 		return;
 	}
 }
 
+/*
+ * Run the state machine until the document is complete, an error occurs, or
+ * the current chunk of input runs out.
+ */
 static void
-hdlr_string(state_t *s)
+parse(state_t *s)
 {
-	if (collect_string(s) != 0) {
-		return;
-	}
+	for (;;) {
+		switch (s->s_ps) {
+		case PARSE_ERROR:
+		case PARSE_DONE:
+			return;
 
-	s->s_top->pf_value_type = JSON_TYPE_STRING;
-	if ((s->s_top->pf_value = strdup(custr_cstr(s->s_collect))) == NULL) {
-		posterror(s, errno, "strdup failure");
-		return;
-	}
+		case PARSE_REST:
+			if (need_input(s)) {
+				return;
+			}
+			switch (popchar(s)) {
+			case '{':
+				push_frame(s, B_FALSE);
+				break;
+			case '[':
+				push_frame(s, B_TRUE);
+				break;
+			default:
+				posterror(s, EPROTO, "EOF before object or "
+				    "array");
+				break;
+			}
+			break;
 
-	movestate(s, PARSE_DONE);
-}
+		case PARSE_OBJECT:
+			if (need_input(s)) {
+				return;
+			}
+			switch (popchar(s)) {
+			case '}':
+				pop_frame(s);
+				break;
+			case '"':
+				custr_reset(s->s_key);
+				movestate(s, PARSE_KEY_STRING);
+				break;
+			default:
+				posterror(s, EPROTO, "expected key or '}'");
+				break;
+			}
+			break;
 
-static int
-store_value(state_t *s)
-{
-	nvlist_t *targ = s->s_top->pf_next->pf_nvl;
-	char *key = s->s_top->pf_next->pf_key;
-	json_type_t type = s->s_top->pf_value_type;
-	int ret = 0;
+		case PARSE_KEY:
+			/*
+			 * A ',' in an object must be followed by another key.
+			 */
+			if (need_input(s)) {
+				return;
+			}
+			if (popchar(s) != '"') {
+				posterror(s, EPROTO, "expected '\"'");
+				break;
+			}
+			custr_reset(s->s_key);
+			movestate(s, PARSE_KEY_STRING);
+			break;
 
-	switch (type) {
-	case JSON_TYPE_STRING:
-		if (nvlist_add_string(targ, key, s->s_top->pf_value) != 0) {
-			posterror(s, errno, "nvlist_add_string failure");
-			ret = -1;
-		}
-		free(s->s_top->pf_value);
-		break;
+		case PARSE_KEY_STRING:
+			/*
+			 * Record the key name of the next value.
+			 */
+			switch (collect_string(s, s->s_key)) {
+			case 0:
+				movestate(s, PARSE_COLON);
+				break;
+			case 1:
+				return;
+			}
+			break;
 
-	case JSON_TYPE_BOOLEAN:
-		if (nvlist_add_boolean_value(targ, key,
-		    (boolean_t)s->s_top->pf_value) != 0) {
-			posterror(s, errno, "nvlist_add_boolean_value "
-			    "failure");
-			ret = -1;
-		}
-		break;
+		case PARSE_COLON:
+			if (need_input(s)) {
+				return;
+			}
+			if (popchar(s) != ':') {
+				posterror(s, EPROTO, "expected ':'");
+				break;
+			}
+			movestate(s, PARSE_VALUE);
+			break;
 
-	case JSON_TYPE_NULL:
-		if (nvlist_add_boolean(targ, key) != 0) {
-			posterror(s, errno, "nvlist_add_boolean failure");
-			ret = -1;
-		}
-		break;
+		case PARSE_ARRAY:
+			if (need_input(s)) {
+				return;
+			}
+			if (peekchar(s) == ']') {
+				(void) popchar(s);
+				pop_frame(s);
+				break;
+			}
+			movestate(s, PARSE_VALUE);
+			break;
 
-	case JSON_TYPE_INTEGER:
-		if (nvlist_add_int32(targ, key,
-		    (int32_t)(uintptr_t)s->s_top->pf_value) != 0) {
-			posterror(s, errno, "nvlist_add_int32 failure");
-			ret = -1;
-		}
-		break;
+		case PARSE_VALUE:
+			if (need_input(s)) {
+				return;
+			}
+			parse_value(s);
+			break;
 
-	case JSON_TYPE_ARRAY:
-	case JSON_TYPE_OBJECT:
 		/*
-		 * Objects and arrays are already 'stored' in their target
-		 * nvlist on creation. See: hdlr_object, hdlr_array.
+		 * These are only entered if a value is split between chunks,
+		 * and the parser stays in them until the value is complete.
 		 */
-		break;
+		case PARSE_STRING:
+			parse_string(s);
+			if (s->s_ps == PARSE_STRING) {
+				return;
+			}
+			break;
 
-	default:
-		(void) fprintf(stderr, "ERROR: could not store unknown "
-		    "type %d\n", type);
-		abort();
-	}
+		case PARSE_NUMBER:
+			parse_number(s);
+			if (s->s_ps == PARSE_NUMBER) {
+				return;
+			}
+			break;
 
-	s->s_top->pf_value = NULL;
-	free(s->s_top->pf_next->pf_key);
-	s->s_top->pf_next->pf_key = NULL;
-	return (ret);
-}
+		case PARSE_BAREWORD:
+			parse_bareword(s);
+			if (s->s_ps == PARSE_BAREWORD) {
+				return;
+			}
+			break;
 
-static parse_frame_t *
-parse_frame_free(parse_frame_t *pf, boolean_t free_nvl)
-{
-	parse_frame_t *next = pf->pf_next;
-	if (pf->pf_key != NULL) {
-		free(pf->pf_key);
-	}
-	if (pf->pf_value != NULL) {
-		abort();
+		case PARSE_COMMA:
+			if (need_input(s)) {
+				return;
+			}
+			if (s->s_frames[s->s_depth - 1].pf_array) {
+				switch (popchar(s)) {
+				case ']':
+					pop_frame(s);
+					break;
+				case ',':
+					movestate(s, PARSE_VALUE);
+					break;
+				default:
+					posterror(s, EPROTO, "expected ',' or "
+					    "']'");
+					break;
+				}
+				break;
+			}
+
+			switch (popchar(s)) {
+			case '}':
+				pop_frame(s);
+				break;
+			case ',':
+				movestate(s, PARSE_KEY);
+				break;
+			default:
+				posterror(s, EPROTO, "expected ',' or '}'");
+				break;
+			}
+			break;
+
+		default:
+			(void) fprintf(stderr, "no handler for state %d\n",
+			    s->s_ps);
+			abort();
+		}
 	}
-	if (free_nvl && pf->pf_nvl != NULL) {
-		nvlist_free(pf->pf_nvl);
-	}
-	free(pf);
-	return (next);
-}
-
-static parse_handler_t hdlrs[] = {
-	NULL,				/* PARSE_DONE */
-	hdlr_rest,			/* PARSE_REST */
-	hdlr_object,			/* PARSE_OBJECT */
-	hdlr_key_string,		/* PARSE_KEY_STRING */
-	hdlr_colon,			/* PARSE_COLON */
-	hdlr_string,			/* PARSE_STRING */
-	hdlr_object_comma,		/* PARSE_OBJECT_COMMA */
-	hdlr_array,			/* PARSE_ARRAY */
-	hdlr_bareword,			/* PARSE_BAREWORD */
-	hdlr_number,			/* PARSE_NUMBER */
-	hdlr_array_value,		/* PARSE_ARRAY_VALUE */
-	hdlr_array_comma		/* PARSE_ARRAY_COMMA */
-};
-#define	NUM_PARSE_HANDLERS	(int)(sizeof (hdlrs) / sizeof (hdlrs[0]))
+}
 
-int
-nvlist_parse_json(const char *buf, size_t buflen, nvlist_t **nvlp,
-    nvlist_parse_json_flags_t flag, nvlist_parse_json_error_t *errout)
+static int
+check_flags(nvlist_parse_json_flags_t flag)
 {
-	state_t s;
-
-	/*
-	 * Check for valid flags:
-	 */
 	if ((flag & NVJSON_FORCE_INTEGER) && (flag & NVJSON_FORCE_DOUBLE)) {
 		errno = EINVAL;
 		return (-1);
@@ -816,28 +1301,33 @@ nvlist_parse_json(const char *buf, size_t buflen, nvlist_t **nvlp,
 		errno = EINVAL;
 		return (-1);
 	}
+	return (0);
+}
 
-	/*
-	 * Initialise parsing state structure:
-	 */
-	bzero(&s, sizeof (s));
-	s.s_in = buf;
-	s.s_pos = 0;
-	s.s_len = buflen;
-	s.s_flags = flag;
+/*
+ * Initialise a parsing state structure.  If this fails, the error is recorded
+ * in the state structure as a parse error would be.
+ */
+static int
+state_init(state_t *s, nvlist_parse_json_flags_t flag,
+    nvlist_parse_json_cb_t *cb, void *arg, nvlist_parse_json_error_t *errout)
+{
+	bzero(s, sizeof (*s));
+	s->s_in = "";
+	s->s_flags = flag;
+	s->s_cb = cb;
+	s->s_cb_arg = arg;
+	s->s_errout = errout;
+	s->s_frames = s->s_frames_initial;
+	s->s_nframes = PARSE_FRAMES_INITIAL;
+	s->s_ps = PARSE_REST;
 
 	/*
-	 * Allocate the collect buffer string.
+	 * Allocate the key, collect buffer and path strings.
 	 */
-	if (custr_alloc(&s.s_collect) != 0) {
-		s.s_errno = errno;
-		if (errout != NULL) {
-			(void) snprintf(errout->nje_message,
-			    sizeof (errout->nje_message),
-			    "custr alloc failure: %s",
-			    strerror(errno));
-		}
-		goto out;
+	if (custr_alloc(&s->s_collect) != 0 || custr_alloc(&s->s_key) != 0 ||
+	    (cb != NULL && custr_alloc(&s->s_path) != 0)) {
+		goto fail;
 	}
 
 	/*
@@ -845,93 +1335,160 @@ nvlist_parse_json(const char *buf, size_t buflen, nvlist_t **nvlp,
 	 * string now.
 	 */
 	if (errout != NULL) {
-		if (custr_alloc_buf(&s.s_errstr, errout->nje_message,
+		if (custr_alloc_buf(&s->s_errstr, errout->nje_message,
 		    sizeof (errout->nje_message)) != 0) {
-			s.s_errno = errno;
-			(void) snprintf(errout->nje_message,
-			    sizeof (errout->nje_message),
-			    "custr alloc failure: %s",
-			    strerror(errno));
-			goto out;
+			goto fail;
 		}
-		custr_reset(s.s_errstr);
+		custr_reset(s->s_errstr);
 	}
 
-	/*
-	 * Allocate top-most stack frame:
-	 */
-	if ((s.s_top = calloc(1, sizeof (*s.s_top))) == NULL) {
-		s.s_errno = errno;
-		goto out;
+	return (0);
+
+fail:
+	s->s_errno = errno;
+	s->s_ps = PARSE_ERROR;
+	if (errout != NULL) {
+		(void) snprintf(errout->nje_message,
+		    sizeof (errout->nje_message), "custr alloc failure: %s",
+		    strerror(s->s_errno));
 	}
+	return (-1);
+}
 
-	s.s_top->pf_ps = PARSE_REST;
-	for (;;) {
-		if (s.s_top->pf_ps < 0) {
-			/*
-			 * The parser reported an error.
-			 */
-			goto out;
-		}
-
-		if (s.s_top->pf_ps == PARSE_DONE) {
-			if (s.s_top->pf_next == NULL) {
-				/*
-				 * Last frame, so we're really
-				 * done.
-				 */
-				*nvlp = s.s_top->pf_nvl;
-				goto out;
-			} else {
-				/*
-				 * Otherwise, pop a frame and continue in
-				 * previous state.  Copy out the value we
-				 * created in the old frame:
-				 */
-				if (store_value(&s) != 0) {
-					goto out;
-				}
+/*
+ * Copy out the result of parsing so far: the error number (which is also
+ * stored in errno) and the parse position.  The custr_t for the error message
+ * was backed by the buffer in the error object, so no copying is required.
+ */
+static int
+state_result(state_t *s)
+{
+	nvlist_parse_json_error_t *errout = s->s_errout;
 
-				/*
-				 * Free old frame:
-				 */
-				s.s_top = parse_frame_free(s.s_top, B_FALSE);
-			}
-		}
+	if (errout != NULL) {
+		errout->nje_errno = s->s_errno;
+		errout->nje_pos = s->s_errno != 0 ? s->s_errpos :
+		    s->s_offset + s->s_pos;
+	}
 
-		/*
-		 * Dispatch to parser handler routine for this state:
-		 */
-		if (s.s_top->pf_ps >= NUM_PARSE_HANDLERS ||
-		    hdlrs[s.s_top->pf_ps] == NULL) {
-			(void) fprintf(stderr, "no handler for state %d\n",
-			    s.s_top->pf_ps);
-			abort();
+	errno = s->s_errno;
+	return (s->s_errno == 0 ? 0 : -1);
+}
+
+/*
+ * Free resources.  Every nested object and array belongs to the outermost
+ * one, which is only left here if parsing failed or the caller didn't want it.
+ */
+static void
+state_fini(state_t *s)
+{
+	int e = errno;
+
+	nvlist_free(s->s_root);
+	if (s->s_frames != s->s_frames_initial) {
+		free(s->s_frames);
+	}
+	custr_free(s->s_collect);
+	custr_free(s->s_key);
+	custr_free(s->s_path);
+	custr_free(s->s_errstr);
+
+	errno = e;
+}
+
+int
+nvlist_parse_json(const char *buf, size_t buflen, nvlist_t **nvlp,
+    nvlist_parse_json_flags_t flag, nvlist_parse_json_error_t *errout)
+{
+	state_t s;
+	int ret;
+
+	if (check_flags(flag) != 0) {
+		return (-1);
+	}
+
+	if (state_init(&s, flag, NULL, NULL, errout) == 0) {
+		s.s_in = buf;
+		s.s_len = buflen;
+		s.s_eof = B_TRUE;
+		parse(&s);
+
+		if (s.s_ps == PARSE_DONE) {
+			*nvlp = s.s_root;
+			s.s_root = NULL;
 		}
-		hdlrs[s.s_top->pf_ps](&s);
 	}
 
-out:
-	if (errout != NULL) {
+	ret = state_result(&s);
+	state_fini(&s);
+	return (ret);
+}
+
+int
+nvlist_parse_json_init(nvlist_parse_json_state_t **sp,
+    nvlist_parse_json_flags_t flag, nvlist_parse_json_cb_t *cb, void *arg,
+    nvlist_parse_json_error_t *errout)
+{
+	state_t *s;
+	int ret;
+
+	if (check_flags(flag) != 0) {
+		return (-1);
+	}
+
+	if ((s = malloc(sizeof (*s))) == NULL) {
+		return (-1);
+	}
+
+	if (state_init(s, flag, cb, arg, errout) != 0) {
+		ret = state_result(s);
+		state_fini(s);
+		free(s);
+		return (ret);
+	}
+
+	*sp = s;
+	return (0);
+}
+
+int
+nvlist_parse_json_feed(nvlist_parse_json_state_t *s, const char *buf,
+    size_t buflen)
+{
+	if (s->s_ps != PARSE_ERROR && s->s_ps != PARSE_DONE) {
+		s->s_in = buf;
+		s->s_pos = 0;
+		s->s_len = buflen;
+		parse(s);
+
 		/*
-		 * Copy out error number and parse position.  The custr_t for
-		 * the error message was backed by the buffer in the error
-		 * object, so no copying is required.
+		 * Unless the parse has finished, the whole chunk has been
+		 * consumed, and anything still needed from it has been copied.
 		 */
-		errout->nje_errno = s.s_errno;
-		errout->nje_pos = s.s_pos;
+		s->s_offset += s->s_pos;
+		s->s_in = "";
+		s->s_pos = 0;
+		s->s_len = 0;
 	}
 
-	/*
-	 * Free resources:
-	 */
-	while (s.s_top != NULL) {
-		s.s_top = parse_frame_free(s.s_top, s.s_errno == 0 ? B_FALSE :
-		    B_TRUE);
+	return (state_result(s));
+}
+
+int
+nvlist_parse_json_fini(nvlist_parse_json_state_t *s, nvlist_t **nvlp)
+{
+	int ret;
+
+	s->s_eof = B_TRUE;
+	parse(s);
+
+	if (s->s_ps == PARSE_DONE && nvlp != NULL) {
+		*nvlp = s->s_root;
+		s->s_root = NULL;
 	}
-	custr_free(s.s_collect);
-	custr_free(s.s_errstr);
 
-	errno = s.s_errno;
-	return (s.s_errno == 0 ? 0 : -1);
+	ret = state_result(s);
+	state_fini(s);
+	free(s);
+	return (ret);
 }
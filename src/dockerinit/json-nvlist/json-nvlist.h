@@ -11,6 +11,7 @@
 
 /*
  * Copyright (c) 2017, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 #ifndef _JSON_NVLIST_H
@@ -44,6 +45,62 @@ typedef struct nvlist_parse_json_error {
 extern int nvlist_parse_json(const char *, size_t, nvlist_t **,
     nvlist_parse_json_flags_t, nvlist_parse_json_error_t *);
 
+/*
+ * Incremental parsing.  nvlist_parse_json_init() creates a parser, each call
+ * to nvlist_parse_json_feed() parses the next chunk of the document (chunks
+ * may be split anywhere, including in the middle of a string or escape
+ * sequence), and nvlist_parse_json_fini() finishes the parse, stores the
+ * result in the nvlist_t ** argument, and frees the parser.  Each returns 0
+ * on success, or -1 with errno set (and the error object, if one was passed
+ * to nvlist_parse_json_init(), filled in; it must remain valid until fini).
+ * Once feed has failed, the parser should just be passed to fini, which fails
+ * in the same way.  Passing a NULL nvlist_t ** to fini discards the parse.
+ *
+ * If a callback is passed to nvlist_parse_json_init(), no nvlist is built.
+ * Instead, the callback is called for each value as it is parsed: once for
+ * every string, number, boolean and null, and for each object or array, once
+ * when it is opened and once (as NVJSON_TYPE_END) when it is closed.  The
+ * callback returns 0 to carry on, or an errno value to stop parsing, which
+ * then fails with that errno.  The value and its strings are only valid for
+ * the duration of the call.
+ */
+typedef struct nvlist_parse_json_state nvlist_parse_json_state_t;
+
+typedef enum nvlist_parse_json_type {
+	NVJSON_TYPE_STRING = 1,
+	NVJSON_TYPE_INTEGER,
+	NVJSON_TYPE_BOOLEAN,
+	NVJSON_TYPE_NULL,
+	NVJSON_TYPE_OBJECT,
+	NVJSON_TYPE_ARRAY,
+	NVJSON_TYPE_END
+} nvlist_parse_json_type_t;
+
+typedef struct nvlist_parse_json_value {
+	nvlist_parse_json_type_t njv_type;
+	/*
+	 * The key (or array index) of the value, and the keys of every object
+	 * and array that encloses it joined with "." (e.g., "Labels.maintainer"
+	 * or "Env.0").  Both are "" for the outermost object or array.
+	 */
+	const char *njv_key;
+	const char *njv_path;
+	unsigned int njv_depth;		/* enclosing objects and arrays */
+	const char *njv_string;		/* NVJSON_TYPE_STRING */
+	int32_t njv_integer;		/* NVJSON_TYPE_INTEGER, or the length */
+					/* of an array for NVJSON_TYPE_END */
+	boolean_t njv_boolean;		/* NVJSON_TYPE_BOOLEAN */
+} nvlist_parse_json_value_t;
+
+typedef int nvlist_parse_json_cb_t(const nvlist_parse_json_value_t *, void *);
+
+extern int nvlist_parse_json_init(nvlist_parse_json_state_t **,
+    nvlist_parse_json_flags_t, nvlist_parse_json_cb_t *, void *,
+    nvlist_parse_json_error_t *);
+extern int nvlist_parse_json_feed(nvlist_parse_json_state_t *, const char *,
+    size_t);
+extern int nvlist_parse_json_fini(nvlist_parse_json_state_t *, nvlist_t **);
+
 #ifdef __cplusplus
 }
 #endif
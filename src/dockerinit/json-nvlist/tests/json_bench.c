@@ -0,0 +1,199 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * json_bench: measure nvlist_parse_json() throughput.
+ *
+ * Usage: json_bench [-r rounds] [-c copies] file ...
+ *
+ * Each file is parsed as it is, and then as a single larger document: an
+ * array holding <copies> copies of it (default 1000), which stands in for the
+ * multi-megabyte docker:* payloads.  Each result is the best of <rounds>
+ * runs (default 5) of at least a quarter of a second, printed as
+ * "name bytes value unit".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <limits.h>
+#include <libnvpair.h>
+
+#include "json-nvlist.h"
+
+#define	DEFAULT_ROUNDS	5
+#define	DEFAULT_COPIES	1000
+#define	MIN_ROUND_NS	250000000ULL
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: json_bench [-r rounds] [-c copies] "
+	    "file ...\n");
+	exit(2);
+}
+
+static char *
+read_file(const char *path, size_t *lenp)
+{
+	FILE *f;
+	char *buf = NULL;
+	size_t cap = 0;
+	size_t len = 0;
+	size_t n;
+
+	if ((f = fopen(path, "r")) == NULL)
+		err(1, "open %s", path);
+
+	do {
+		if (len + BUFSIZ > cap) {
+			cap = cap * 2 + BUFSIZ;
+			if ((buf = realloc(buf, cap)) == NULL)
+				err(1, "realloc");
+		}
+		n = fread(buf + len, 1, BUFSIZ, f);
+		len += n;
+	} while (n > 0);
+
+	if (ferror(f))
+		err(1, "read %s", path);
+	(void) fclose(f);
+
+	*lenp = len;
+	return (buf);
+}
+
+/*
+ * Build "[doc,doc,...]" from <copies> copies of a document.
+ */
+static char *
+replicate(const char *doc, size_t len, long copies, size_t *lenp)
+{
+	size_t total = 2 + copies * (len + 1);
+	char *buf;
+	char *p;
+	long i;
+
+	if ((buf = malloc(total)) == NULL)
+		err(1, "malloc");
+
+	p = buf;
+	*p++ = '[';
+	for (i = 0; i < copies; i++) {
+		if (i > 0)
+			*p++ = ',';
+		(void) memcpy(p, doc, len);
+		p += len;
+	}
+	*p++ = ']';
+
+	*lenp = p - buf;
+	return (buf);
+}
+
+static void
+bench(const char *name, const char *buf, size_t len, int rounds)
+{
+	nvlist_parse_json_error_t nje;
+	double best = 0;
+	int r;
+
+	for (r = 0; r < rounds; r++) {
+		uint64_t start = now_ns();
+		uint64_t t;
+		long n = 0;
+		double rate;
+
+		do {
+			nvlist_t *nvl;
+
+			if (nvlist_parse_json(buf, len, &nvl,
+			    NVJSON_FORCE_INTEGER, &nje) != 0) {
+				errx(1, "%s: parse failed at %ld: %s", name,
+				    nje.nje_pos, nje.nje_message);
+			}
+			nvlist_free(nvl);
+			n++;
+		} while ((t = now_ns() - start) < MIN_ROUND_NS);
+
+		rate = (double)len * n / (t / 1e9);
+		if (rate > best)
+			best = rate;
+	}
+
+	(void) printf("%s %zu %.1f MB/s\n", name, len, best / 1e6);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int rounds = DEFAULT_ROUNDS;
+	long copies = DEFAULT_COPIES;
+	char name[PATH_MAX];
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "c:r:")) != -1) {
+		switch (opt) {
+		case 'c':
+			copies = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0 || rounds <= 0 || copies <= 0)
+		usage();
+
+	for (i = 0; i < argc; i++) {
+		size_t len;
+		size_t biglen;
+		char *doc = read_file(argv[i], &len);
+		char *big = replicate(doc, len, copies, &biglen);
+		char *base = basename(argv[i]);
+
+		bench(base, doc, len, rounds);
+		(void) snprintf(name, sizeof (name), "%s*%ld", base, copies);
+		bench(name, big, biglen, rounds);
+
+		free(big);
+		free(doc);
+	}
+
+	return (0);
+}
@@ -0,0 +1,278 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * json_fuzz: feed nvlist_parse_json() mutated copies of the corpus files.
+ *
+ * Usage: json_fuzz [-n iterations] [-s seed] file ...
+ *
+ * Each iteration picks a corpus file and applies a few random mutations to a
+ * copy of it: flipping bytes, truncating it, or splicing in fragments that
+ * exercise the tricky parts of the parser (escapes, surrogates, multi-byte
+ * UTF-8 and nesting).  The parser must either succeed, or fail with an
+ * errno and a message; run under libumem debugging (as the Makefile does)
+ * this also catches heap corruption.  The copy is then fed to the incremental
+ * parser in randomly sized chunks, which must come to the same result.  The
+ * seed is printed so a failure can be reproduced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <libnvpair.h>
+
+#include "json-nvlist.h"
+
+#define	DEFAULT_ITERATIONS	20000
+#define	MAX_MUTATIONS		4
+
+static const char *fragments[] = {
+	"\"", "\\", "\\\"", "\\u", "\\u00e9", "\\ud83d", "\\ude80",
+	"\\ud83d\\ude80", "\\u0000", "\xc3", "\xc3\xa9", "\xe2\x82\xac",
+	"\xf0\x9f\x90\xb3", "\xed\xa0\x80", "\xff", "{", "}", "[", "]", ",",
+	":", "[[[[[[[[", "]]]]]]]]", "true", "null", "-", "0", "1e5",
+	"\"\":", "\0"
+};
+#define	NUM_FRAGMENTS	(sizeof (fragments) / sizeof (fragments[0]))
+
+static uint64_t rng_state;
+
+/*
+ * xorshift64*, so that runs are repeatable across platforms.
+ */
+static uint64_t
+rng(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 0x2545F4914F6CDD1DULL);
+}
+
+static size_t
+rng_below(size_t n)
+{
+	return (n == 0 ? 0 : rng() % n);
+}
+
+static char *
+read_file(const char *path, size_t *lenp)
+{
+	FILE *f;
+	char *buf = NULL;
+	size_t cap = 0;
+	size_t len = 0;
+	size_t n;
+
+	if ((f = fopen(path, "r")) == NULL)
+		err(1, "open %s", path);
+
+	do {
+		if (len + BUFSIZ > cap) {
+			cap = cap * 2 + BUFSIZ;
+			if ((buf = realloc(buf, cap)) == NULL)
+				err(1, "realloc");
+		}
+		n = fread(buf + len, 1, BUFSIZ, f);
+		len += n;
+	} while (n > 0);
+
+	if (ferror(f))
+		err(1, "read %s", path);
+	(void) fclose(f);
+
+	*lenp = len;
+	return (buf);
+}
+
+/*
+ * Apply one mutation to buf (of length *lenp, with room for cap bytes).
+ */
+static void
+mutate(char *buf, size_t *lenp, size_t cap)
+{
+	size_t len = *lenp;
+	size_t pos = rng_below(len + 1);
+	const char *frag;
+	size_t flen;
+
+	switch (rng_below(4)) {
+	case 0:
+		/* overwrite a byte */
+		if (len > 0)
+			buf[rng_below(len)] = (char)rng();
+		break;
+
+	case 1:
+		/* truncate */
+		*lenp = pos;
+		break;
+
+	case 2:
+		/* delete a range */
+		flen = rng_below(len - pos + 1) % 16;
+		(void) memmove(buf + pos, buf + pos + flen, len - pos - flen);
+		*lenp = len - flen;
+		break;
+
+	default:
+		/* insert a fragment */
+		frag = fragments[rng_below(NUM_FRAGMENTS)];
+		flen = frag[0] == '\0' ? 1 : strlen(frag);
+		if (len + flen > cap)
+			break;
+		(void) memmove(buf + pos + flen, buf + pos, len - pos);
+		(void) memcpy(buf + pos, frag, flen);
+		*lenp = len + flen;
+		break;
+	}
+}
+
+/*
+ * Parse a document with the incremental parser, fed in chunks of random
+ * sizes (mostly small, to split as many tokens as possible).
+ */
+static int
+parse_chunked(const char *buf, size_t len, nvlist_t **nvlp,
+    nvlist_parse_json_error_t *nje)
+{
+	nvlist_parse_json_state_t *p;
+	size_t off = 0;
+
+	if (nvlist_parse_json_init(&p, NVJSON_FORCE_INTEGER, NULL, NULL,
+	    nje) != 0)
+		err(1, "nvlist_parse_json_init");
+
+	while (off < len) {
+		size_t n = 1 + rng_below(rng_below(4) == 0 ? 256 : 8);
+
+		if (n > len - off)
+			n = len - off;
+		if (nvlist_parse_json_feed(p, buf + off, n) != 0)
+			break;
+		off += n;
+	}
+
+	return (nvlist_parse_json_fini(p, nvlp));
+}
+
+int
+main(int argc, char *argv[])
+{
+	nvlist_parse_json_error_t nje;
+	nvlist_parse_json_error_t cnje;
+	long iterations = DEFAULT_ITERATIONS;
+	uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+	char **files;
+	size_t *lens;
+	size_t maxlen = 0;
+	char *buf;
+	long parsed = 0;
+	long i;
+	int nfiles;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = strtol(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			errx(2, "Usage: json_fuzz [-n iterations] [-s seed] "
+			    "file ...");
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0)
+		errx(2, "Usage: json_fuzz [-n iterations] [-s seed] file ...");
+
+	(void) printf("json_fuzz: seed 0x%llx\n", (unsigned long long)seed);
+	rng_state = seed == 0 ? 1 : seed;
+
+	nfiles = argc;
+	if ((files = calloc(nfiles, sizeof (char *))) == NULL ||
+	    (lens = calloc(nfiles, sizeof (size_t))) == NULL) {
+		err(1, "calloc");
+	}
+	for (i = 0; i < nfiles; i++) {
+		files[i] = read_file(argv[i], &lens[i]);
+		if (lens[i] > maxlen)
+			maxlen = lens[i];
+	}
+
+	maxlen += MAX_MUTATIONS * 16;
+	if ((buf = malloc(maxlen)) == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < iterations; i++) {
+		int f = rng_below(nfiles);
+		size_t len = lens[f];
+		size_t nmut = 1 + rng_below(MAX_MUTATIONS);
+		nvlist_t *nvl = NULL;
+		int ret;
+		int cret;
+		size_t m;
+
+		(void) memcpy(buf, files[f], len);
+		for (m = 0; m < nmut; m++)
+			mutate(buf, &len, maxlen);
+
+		ret = nvlist_parse_json(buf, len, &nvl, NVJSON_FORCE_INTEGER,
+		    &nje);
+		if (ret == 0) {
+			if (nvl == NULL)
+				errx(1, "iteration %ld: no nvlist returned", i);
+			nvlist_free(nvl);
+			parsed++;
+		} else if (nje.nje_errno == 0 || nje.nje_message[0] == '\0' ||
+		    nje.nje_pos < 0 || (size_t)nje.nje_pos > len) {
+			errx(1, "iteration %ld: bad error (errno %d, pos %ld, "
+			    "'%s')", i, nje.nje_errno, nje.nje_pos,
+			    nje.nje_message);
+		}
+
+		nvl = NULL;
+		cret = parse_chunked(buf, len, &nvl, &cnje);
+		nvlist_free(nvl);
+		if (cret != ret || (ret != 0 &&
+		    (cnje.nje_errno != nje.nje_errno ||
+		    cnje.nje_pos != nje.nje_pos))) {
+			errx(1, "iteration %ld: chunked parse gave errno %d at "
+			    "%ld, not errno %d at %ld", i, cret == 0 ? 0 :
+			    cnje.nje_errno, cnje.nje_pos, ret == 0 ? 0 :
+			    nje.nje_errno, nje.nje_pos);
+		}
+	}
+
+	(void) printf("json_fuzz: %ld iterations, %ld parsed\n", iterations,
+	    parsed);
+
+	for (i = 0; i < nfiles; i++)
+		free(files[i]);
+	free(files);
+	free(lens);
+	free(buf);
+
+	return (0);
+}
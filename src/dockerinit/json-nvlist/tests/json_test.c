@@ -0,0 +1,420 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * json_test: check nvlist_parse_json() against a table of small documents,
+ * and check that every document in the corpus files given as arguments
+ * parses.  Each document is also fed to the incremental parser in chunks of
+ * various sizes (and, for the table, split at every position), which must
+ * give the same result as parsing it in one go.  Finally, the callback mode
+ * is checked against a list of the values it should visit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <err.h>
+#include <errno.h>
+#include <libnvpair.h>
+
+#include "json-nvlist.h"
+
+typedef struct json_test {
+	const char *jt_input;
+	int jt_errno;		/* 0 if the input should parse */
+	const char *jt_key;	/* string to look up in the result */
+	const char *jt_value;	/* and its expected value */
+} json_test_t;
+
+static json_test_t tests[] = {
+	/*
+	 * Plain strings and the simple escapes:
+	 */
+	{ "{\"a\":\"\"}", 0, "a", "" },
+	{ "{\"a\":\"hello world\"}", 0, "a", "hello world" },
+	{ "{\"a\":\"q\\\"b\\\\s\\/\"}", 0, "a", "q\"b\\s/" },
+	{ "{\"a\":\"\\b\\f\\n\\r\\t\"}", 0, "a", "\b\f\n\r\t" },
+	{ "{\"a\":\"0123456789abcdef0123456789abcdef\\n\"}", 0, "a",
+	    "0123456789abcdef0123456789abcdef\n" },
+	{ "{\"a\\tb\":\"key\"}", 0, "a\tb", "key" },
+
+	/*
+	 * Unicode escapes, including surrogate pairs, are stored as UTF-8:
+	 */
+	{ "{\"a\":\"\\u0041\\u007e\"}", 0, "a", "A~" },
+	{ "{\"a\":\"\\u00e9\\u00E9\"}", 0, "a", "\xc3\xa9\xc3\xa9" },
+	{ "{\"a\":\"\\u07ff\\u0800\"}", 0, "a", "\xdf\xbf\xe0\xa0\x80" },
+	{ "{\"a\":\"\\u20ac\"}", 0, "a", "\xe2\x82\xac" },
+	{ "{\"a\":\"\\uffff\"}", 0, "a", "\xef\xbf\xbf" },
+	{ "{\"a\":\"\\ud83d\\ude80\"}", 0, "a", "\xf0\x9f\x9a\x80" },
+	{ "{\"a\":\"\\udbff\\udfff\"}", 0, "a", "\xf4\x8f\xbf\xbf" },
+	{ "{\"\\u00e9\":\"key\"}", 0, "\xc3\xa9", "key" },
+	{ "{\"a\":\"x\\ud800\"}", EPROTO, NULL, NULL },
+	{ "{\"a\":\"\\ud800\\u0041\"}", EPROTO, NULL, NULL },
+	{ "{\"a\":\"\\udc00\"}", EPROTO, NULL, NULL },
+	{ "{\"a\":\"\\u12\"}", EPROTO, NULL, NULL },
+	{ "{\"a\":\"\\u12g4\"}", EPROTO, NULL, NULL },
+	{ "{\"a\":\"\\u0000\"}", ENOTSUP, NULL, NULL },
+	{ "{\"a\":\"\\u00", EPROTO, NULL, NULL },
+
+	/*
+	 * Raw UTF-8 is copied as it is, as long as it is well-formed:
+	 */
+	{ "{\"a\":\"Z\xc3\xbcrich\"}", 0, "a", "Z\xc3\xbcrich" },
+	{ "{\"a\":\"\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81"
+	    "\xaf\"}", 0, "a", "\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81"
+	    "\xa1\xe3\x81\xaf" },
+	{ "{\"a\":\"\xf0\x9f\x90\xb3 ready\"}", 0, "a",
+	    "\xf0\x9f\x90\xb3 ready" },
+	{ "{\"a\":\"raw \xc3\xa9 and \\u00e9\"}", 0, "a",
+	    "raw \xc3\xa9 and \xc3\xa9" },
+
+	/*
+	 * Ill-formed UTF-8: a lone continuation byte, overlong encodings, a
+	 * surrogate, a code point above U+10FFFF and a truncated sequence.
+	 */
+	{ "{\"a\":\"\x80\"}", EILSEQ, NULL, NULL },
+	{ "{\"a\":\"\xc0\xaf\"}", EILSEQ, NULL, NULL },
+	{ "{\"a\":\"\xe0\x80\xaf\"}", EILSEQ, NULL, NULL },
+	{ "{\"a\":\"\xed\xa0\x80\"}", EILSEQ, NULL, NULL },
+	{ "{\"a\":\"\xf4\x90\x80\x80\"}", EILSEQ, NULL, NULL },
+	{ "{\"a\":\"\xe2\x82\"}", EILSEQ, NULL, NULL },
+	{ "{\"a\":\"\xff\"}", EILSEQ, NULL, NULL },
+	{ "{\"\xfe\":\"key\"}", EILSEQ, NULL, NULL },
+
+	/*
+	 * Other values, and structure:
+	 */
+	{ "[\"zero\", \"one\"]", 0, "1", "one" },
+	{ " { \"a\" : [ 1 , -2 , true , false , null , { } , [ ] ] } ", 0,
+	    NULL, NULL },
+	{ "{\"a\":1", EPROTO, NULL, NULL },
+	{ "{\"a\":tru}", EPROTO, NULL, NULL },
+	{ "{\"a\":1.5}", ENOTSUP, NULL, NULL },
+	{ "{\"a\":\"x\\q\"}", EPROTO, NULL, NULL },
+	{ "{\"a\" 1}", EPROTO, NULL, NULL },
+	{ "[1 2]", EPROTO, NULL, NULL },
+	{ "\"a\"", EPROTO, NULL, NULL },
+	{ "", EPROTO, NULL, NULL },
+	{ NULL, 0, NULL, NULL }
+};
+
+/*
+ * The document for the callback test, and the values it should be visited
+ * as ("type path key value").
+ */
+static const char *cb_input =
+	"{\"a\":{\"b\":[1,\"x\",true,null,[]]},\"c\":false,\"d\":\"\u00e9\"}";
+
+static const char *cb_expected =
+	"object   0\n"
+	"object a a 1\n"
+	"array a.b b 2\n"
+	"integer a.b.0 0 3 1\n"
+	"string a.b.1 1 3 x\n"
+	"boolean a.b.2 2 3 1\n"
+	"null a.b.3 3 3\n"
+	"array a.b.4 4 3\n"
+	"end a.b.4 4 3 0\n"
+	"end a.b b 2 5\n"
+	"end a a 1 0\n"
+	"boolean c c 1 0\n"
+	"string d d 1 \xc3\xa9\n"
+	"end   0 0\n";
+
+typedef struct cb_log {
+	char cl_buf[1024];
+	size_t cl_len;
+	const char *cl_stop;	/* path at which to stop parsing */
+} cb_log_t;
+
+static char *
+read_file(const char *path, size_t *lenp)
+{
+	FILE *f;
+	char *buf = NULL;
+	size_t cap = 0;
+	size_t len = 0;
+	size_t n;
+
+	if ((f = fopen(path, "r")) == NULL)
+		err(1, "open %s", path);
+
+	do {
+		if (len + BUFSIZ > cap) {
+			cap = cap * 2 + BUFSIZ;
+			if ((buf = realloc(buf, cap)) == NULL)
+				err(1, "realloc");
+		}
+		n = fread(buf + len, 1, BUFSIZ, f);
+		len += n;
+	} while (n > 0);
+
+	if (ferror(f))
+		err(1, "read %s", path);
+	(void) fclose(f);
+
+	*lenp = len;
+	return (buf);
+}
+
+/*
+ * Feed a document to the incremental parser "chunk" bytes at a time, or split
+ * in two at "split" if "chunk" is 0.
+ */
+static int
+parse_chunked(const char *buf, size_t len, size_t chunk, size_t split,
+    nvlist_t **nvlp, nvlist_parse_json_cb_t *cb, void *arg,
+    nvlist_parse_json_error_t *nje)
+{
+	nvlist_parse_json_state_t *p;
+	size_t off = 0;
+
+	if (nvlist_parse_json_init(&p, NVJSON_FORCE_INTEGER, cb, arg,
+	    nje) != 0)
+		err(1, "nvlist_parse_json_init");
+
+	while (off < len) {
+		size_t n = chunk == 0 ? (off < split ? split : len - off) :
+		    chunk;
+
+		if (n > len - off)
+			n = len - off;
+		if (nvlist_parse_json_feed(p, buf + off, n) != 0)
+			break;
+		off += n;
+	}
+
+	return (nvlist_parse_json_fini(p, nvlp));
+}
+
+/*
+ * Return the JSON representation of an nvlist (or the error) for comparing
+ * parse results.
+ */
+static char *
+result_string(int ret, nvlist_t *nvl, nvlist_parse_json_error_t *nje)
+{
+	char *str = NULL;
+	size_t len = 0;
+	FILE *f;
+
+	if ((f = open_memstream(&str, &len)) == NULL)
+		err(1, "open_memstream");
+	if (ret != 0) {
+		(void) fprintf(f, "error %d at %ld: %s", nje->nje_errno,
+		    nje->nje_pos, nje->nje_message);
+	} else if (nvlist_print_json(f, nvl) != 0) {
+		err(1, "nvlist_print_json");
+	}
+	(void) fclose(f);
+
+	return (str);
+}
+
+/*
+ * Parse a document in one go and then in chunks, and count the number of
+ * chunked parses that came out differently.
+ */
+static int
+check_chunked(const char *name, const char *buf, size_t len, boolean_t splits)
+{
+	static size_t chunks[] = { 1, 2, 3, 7, 64, 4096 };
+	nvlist_parse_json_error_t nje;
+	nvlist_t *nvl = NULL;
+	char *expected;
+	char *got;
+	size_t i;
+	int fails = 0;
+	int ret;
+
+	ret = nvlist_parse_json(buf, len, &nvl, NVJSON_FORCE_INTEGER, &nje);
+	expected = result_string(ret, nvl, &nje);
+	nvlist_free(nvl);
+
+	for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]) +
+	    (splits ? len + 1 : 0); i++) {
+		size_t chunk = i < sizeof (chunks) / sizeof (chunks[0]) ?
+		    chunks[i] : 0;
+		size_t split = chunk == 0 ? i - sizeof (chunks) /
+		    sizeof (chunks[0]) : 0;
+
+		nvl = NULL;
+		ret = parse_chunked(buf, len, chunk, split, &nvl, NULL, NULL,
+		    &nje);
+		got = result_string(ret, nvl, &nje);
+		nvlist_free(nvl);
+
+		if (strcmp(got, expected) != 0) {
+			warnx("%s: parse in chunks of %zu (split at %zu) "
+			    "gave '%.200s', not '%.200s'", name, chunk, split,
+			    got, expected);
+			fails++;
+		}
+		free(got);
+	}
+
+	free(expected);
+	return (fails);
+}
+
+static int
+log_value(const nvlist_parse_json_value_t *njv, void *arg)
+{
+	static const char *types[] = { NULL, "string", "integer", "boolean",
+	    "null", "object", "array", "end" };
+	cb_log_t *cl = arg;
+	char *p = cl->cl_buf + cl->cl_len;
+	size_t left = sizeof (cl->cl_buf) - cl->cl_len;
+	int n;
+
+	if (cl->cl_stop != NULL && strcmp(njv->njv_path, cl->cl_stop) == 0)
+		return (ECANCELED);
+
+	n = snprintf(p, left, "%s %s %s %u", types[njv->njv_type],
+	    njv->njv_path, njv->njv_key, njv->njv_depth);
+	switch (njv->njv_type) {
+	case NVJSON_TYPE_STRING:
+		n += snprintf(p + n, left - n, " %s", njv->njv_string);
+		break;
+	case NVJSON_TYPE_INTEGER:
+	case NVJSON_TYPE_END:
+		n += snprintf(p + n, left - n, " %d", njv->njv_integer);
+		break;
+	case NVJSON_TYPE_BOOLEAN:
+		n += snprintf(p + n, left - n, " %d", njv->njv_boolean);
+		break;
+	default:
+		break;
+	}
+	n += snprintf(p + n, left - n, "\n");
+
+	cl->cl_len += n;
+	if (cl->cl_len >= sizeof (cl->cl_buf))
+		errx(1, "callback log overflow");
+
+	return (0);
+}
+
+/*
+ * Check that the callback mode visits the values in cb_input, however the
+ * input is split up, and that the callback can stop the parse.
+ */
+static int
+check_callback(void)
+{
+	nvlist_parse_json_error_t nje;
+	size_t len = strlen(cb_input);
+	cb_log_t cl;
+	int fails = 0;
+	size_t i;
+
+	for (i = 0; i <= len; i++) {
+		bzero(&cl, sizeof (cl));
+		if (parse_chunked(cb_input, len, i == len ? 1 : 0, i, NULL,
+		    log_value, &cl, &nje) != 0) {
+			warnx("callback parse failed: %s", nje.nje_message);
+			fails++;
+		} else if (strcmp(cl.cl_buf, cb_expected) != 0) {
+			warnx("callback parse (split at %zu) visited:\n%s",
+			    i, cl.cl_buf);
+			fails++;
+		}
+	}
+
+	bzero(&cl, sizeof (cl));
+	cl.cl_stop = "c";
+	if (parse_chunked(cb_input, len, 0, len, NULL, log_value, &cl,
+	    &nje) == 0 || nje.nje_errno != ECANCELED) {
+		warnx("callback failed to stop the parse");
+		fails++;
+	}
+
+	return (fails);
+}
+
+int
+main(int argc, char *argv[])
+{
+	nvlist_parse_json_error_t nje;
+	json_test_t *jt;
+	nvlist_t *nvl;
+	char *val;
+	int fails = 0;
+	int i;
+
+	for (jt = tests; jt->jt_input != NULL; jt++) {
+		int ret;
+
+		nvl = NULL;
+		ret = nvlist_parse_json(jt->jt_input, strlen(jt->jt_input),
+		    &nvl, NVJSON_FORCE_INTEGER, &nje);
+
+		if (jt->jt_errno != 0) {
+			if (ret == 0 || nje.nje_errno != jt->jt_errno) {
+				warnx("'%s': expected errno %d, got %d (%s)",
+				    jt->jt_input, jt->jt_errno, ret == 0 ? 0 :
+				    nje.nje_errno, nje.nje_message);
+				fails++;
+			}
+			nvlist_free(nvl);
+			fails += check_chunked(jt->jt_input, jt->jt_input,
+			    strlen(jt->jt_input), B_TRUE);
+			continue;
+		}
+
+		if (ret != 0) {
+			warnx("'%s': parse failed: %s", jt->jt_input,
+			    nje.nje_message);
+			fails++;
+			continue;
+		}
+
+		if (jt->jt_key != NULL && (nvlist_lookup_string(nvl,
+		    jt->jt_key, &val) != 0 || strcmp(val, jt->jt_value) != 0)) {
+			warnx("'%s': wrong value for key '%s'", jt->jt_input,
+			    jt->jt_key);
+			fails++;
+		}
+		nvlist_free(nvl);
+
+		fails += check_chunked(jt->jt_input, jt->jt_input,
+		    strlen(jt->jt_input), B_TRUE);
+	}
+
+	fails += check_callback();
+
+	for (i = 1; i < argc; i++) {
+		size_t len;
+		char *buf = read_file(argv[i], &len);
+
+		if (nvlist_parse_json(buf, len, &nvl, NVJSON_FORCE_INTEGER,
+		    &nje) != 0) {
+			warnx("%s: parse failed at %ld: %s", argv[i],
+			    nje.nje_pos, nje.nje_message);
+			fails++;
+		} else {
+			nvlist_free(nvl);
+		}
+		fails += check_chunked(argv[i], buf, len, B_FALSE);
+		free(buf);
+	}
+
+	if (fails > 0)
+		errx(1, "%d failures", fails);
+
+	return (0);
+}
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  *
  * Portions based on Public Domain work obtained from:
@@ -14,93 +15,136 @@
 static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
     "abcdefghijklmnopqrstuvwxyz0123456789+/";
 
+/*
+ * The value of each character in the BASE64 alphabet, B64_PAD for the '='
+ * filler character, or B64_INVALID.  Any value with either of the top two
+ * bits set is not a 6-bit digit, so a group of four characters can be checked
+ * by OR-ing their values together.
+ */
+#define	B64_INVALID	0xff
+#define	B64_PAD		0xfe
+
+static const uint8_t base64_values[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+    0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfe, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+    0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
 void
-base64_encode(uint8_t *input, size_t len, string_t *output)
+base64_encode(const char *input, size_t len, string_t *output)
 {
-	char tmp[5];
-	unsigned int i = 0;
-
-	tmp[4] = '\0';
-	dynstr_append(output, "");
-
-	while (i < len) {
-		uint32_t c = input[i++] << 16;
-		if (i < len)
-			c |= input[i] << 8;
-		i++;
-		if (i < len)
-			c |= input[i];
-		i++;
-
-		tmp[0] = base64[(c & 0x00fc0000) >> 18];
-		tmp[1] = base64[(c & 0x0003f000) >> 12];
-		tmp[2] = i > len + 1 ? '=' : base64[(c & 0x00000fc0) >> 6];
-		tmp[3] = i > len ? '=' : base64[c & 0x0000003f];
-
-		dynstr_append(output, tmp);
+	const uint8_t *in = (const uint8_t *)input;
+	const uint8_t *end = in + len - len % 3;
+	char *out = dynstr_reserve(output, (len + 2) / 3 * 4);
+	char *start = out;
+
+	for (; in < end; in += 3) {
+		uint32_t c = in[0] << 16 | in[1] << 8 | in[2];
+
+		out[0] = base64[c >> 18];
+		out[1] = base64[(c >> 12) & 0x3f];
+		out[2] = base64[(c >> 6) & 0x3f];
+		out[3] = base64[c & 0x3f];
+		out += 4;
 	}
-}
 
-static int
-decode_one(char c)
-{
-	if (c >= 'A' && c <= 'Z')
-		return (c - 'A');
-	if (c >= 'a' && c <= 'z')
-		return (c - 'a' + 26);
-	if (c >= '0' && c <= '9')
-		return (c - '0' + 52);
-	if (c == '+')
-		return (62);
-	if (c == '/')
-		return (63);
-	if (c == '=')
-		return (-1);
-
-	return (-2);
+	/*
+	 * Encode the last one or two bytes, if any, with filler:
+	 */
+	if (len % 3 != 0) {
+		uint32_t c = in[0] << 16;
+
+		if (len % 3 == 2)
+			c |= in[1] << 8;
+
+		out[0] = base64[c >> 18];
+		out[1] = base64[(c >> 12) & 0x3f];
+		out[2] = len % 3 == 2 ? base64[(c >> 6) & 0x3f] : '=';
+		out[3] = '=';
+		out += 4;
+	}
+
+	dynstr_commit(output, out - start);
 }
 
 int
 base64_decode(const char *input, size_t len, string_t *output)
 {
-	int typ[4];
-	uint8_t buf[4];
-	unsigned int i, j;
-
-	buf[3] = '\0';
-	dynstr_append(output, "");
+	const uint8_t *in = (const uint8_t *)input;
+	const uint8_t *end = in + len;
+	char *out = dynstr_reserve(output, len / 4 * 3);
+	char *start = out;
+	uint8_t a, b, c, d;
 
 	/*
 	 * Valid encoded strings are a multiple of 4 characters long:
 	 */
 	if (len % 4 != 0)
-		return (-1);
-
-	for (i = 0; i < len; i += 4) {
-		for (j = 0; j < 4; j++)
-			typ[j] = decode_one(input[i + j]);
-
-		/*
-		 * Filler must be contiguous on the right of the input
-		 * string, and at most two bytes:
-		 */
-		if (typ[0] == -1 || typ[1] == -1)
-			return (-1);
-		if (typ[2] == -1 && typ[3] != -1)
-			return (-1);
-
-		buf[0] = (typ[0] << 2) | (typ[1] >> 4);
-		if (typ[2] != -1)
-			buf[1] = ((typ[1] & 0x0f) << 4) | (typ[2] >>2);
-		else
-			buf[1] = '\0';
-		if (typ[3] != -1)
-			buf[2] = ((typ[2] & 0x03) << 6) | typ[3];
-		else
-			buf[2] = '\0';
-
-		dynstr_append(output, (const char *) buf);
+		goto fail;
+
+	for (; in < end; in += 4) {
+		a = base64_values[in[0]];
+		b = base64_values[in[1]];
+		c = base64_values[in[2]];
+		d = base64_values[in[3]];
+
+		if ((a | b | c | d) & 0xc0) {
+			/*
+			 * Filler must be contiguous on the right of the input
+			 * string, and at most two bytes:
+			 */
+			if (in + 4 != end || (a | b) & 0xc0)
+				goto fail;
+			if (c == B64_PAD && d == B64_PAD) {
+				*out++ = a << 2 | b >> 4;
+				break;
+			}
+			if (c & 0xc0 || d != B64_PAD)
+				goto fail;
+			*out++ = a << 2 | b >> 4;
+			*out++ = b << 4 | c >> 2;
+			break;
+		}
+
+		out[0] = a << 2 | b >> 4;
+		out[1] = b << 4 | c >> 2;
+		out[2] = c << 6 | d;
+		out += 3;
 	}
 
+	dynstr_commit(output, out - start);
 	return (0);
+
+fail:
+	dynstr_commit(output, 0);
+	return (-1);
 }
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -8,6 +9,7 @@
 #include <stdint.h>
 
 #include "dynstr.h"
+#include "crc32.h"
 
 /*
  * Pre-generated CRC32 Table from Polynomial 0xEDB88320:
@@ -58,17 +60,71 @@ static uint32_t crc32_table[] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/*
+ * Tables for "slice-by-8": crc32_slices[k][b] is the CRC contribution of byte
+ * b followed by k zero bytes.  That lets us fold eight bytes of input into
+ * the CRC with eight independent table lookups, rather than a chain of eight
+ * dependent ones.  crc32_slices[0] is just crc32_table.
+ *
+ * The tables are filled in on first use.  Doing so twice (e.g. from two
+ * threads at once) is harmless, as every pass stores the same values.
+ */
+static uint32_t crc32_slices[8][256];
+static volatile int crc32_slices_ready = 0;
+
+static void
+crc32_init_slices(void)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < 256; i++)
+		crc32_slices[0][i] = crc32_table[i];
+
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			uint32_t c = crc32_slices[k - 1][i];
+
+			crc32_slices[k][i] = crc32_table[c & 0xff] ^ (c >> 8);
+		}
+	}
+
+	crc32_slices_ready = 1;
+}
+
+static uint32_t
+crc32_read32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+	    (uint32_t)p[3] << 24);
+}
+
 uint32_t
 crc32_calc(const char *cstr, size_t len)
 {
+	const uint8_t *p = (const uint8_t *)cstr;
+	const uint8_t *end = p + len;
 	uint32_t crc = 0xffffffff;
-	unsigned int i;
 
-	for (i = 0; i < len; i++) {
-		uint8_t b = (uint8_t) cstr[i];
+	if (!crc32_slices_ready)
+		crc32_init_slices();
 
-		crc = crc32_table[(crc ^ b) & 0xff] ^ ((crc) >> 8);
+	while (end - p >= 8) {
+		uint32_t lo = crc32_read32(p) ^ crc;
+		uint32_t hi = crc32_read32(p + 4);
+
+		crc = crc32_slices[7][lo & 0xff] ^
+		    crc32_slices[6][(lo >> 8) & 0xff] ^
+		    crc32_slices[5][(lo >> 16) & 0xff] ^
+		    crc32_slices[4][lo >> 24] ^
+		    crc32_slices[3][hi & 0xff] ^
+		    crc32_slices[2][(hi >> 8) & 0xff] ^
+		    crc32_slices[1][(hi >> 16) & 0xff] ^
+		    crc32_slices[0][hi >> 24];
+		p += 8;
 	}
 
+	for (; p < end; p++)
+		crc = crc32_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+
 	return (~crc);
 }
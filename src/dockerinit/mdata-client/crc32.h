@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -10,9 +11,10 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
-uint32_t crc32_calc(const char *, int);
+uint32_t crc32_calc(const char *, size_t);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -7,6 +8,7 @@
 #include <err.h>
 #include <string.h>
 
+#include "common.h"
 #include "dynstr.h"
 
 struct string {
@@ -39,38 +41,73 @@ dynstr_cstr(string_t *str)
 	return (str->str_data);
 }
 
+/*
+ * Make room for at least "len" more characters (and the terminating NUL).
+ * The buffer doubles in size as it grows, so that building up a large string
+ * a piece at a time takes a bounded number of copies.
+ */
+static void
+dynstr_grow(string_t *str, size_t len)
+{
+	size_t datalen = str->str_datalen;
+
+	if (str->str_strlen + len < datalen)
+		return;
+
+	if (datalen == 0)
+		datalen = STRING_CHUNK_SIZE;
+	while (str->str_strlen + len >= datalen)
+		datalen *= 2;
+
+	str->str_data = realloc(str->str_data, datalen);
+	if (str->str_data == NULL)
+		err(1, "could not allocate memory for string");
+	str->str_datalen = datalen;
+}
+
 void
 dynstr_appendc(string_t *str, char newc)
 {
-	int chunksz = STRING_CHUNK_SIZE;
-
-	if (str->str_strlen + 1 >= str->str_datalen) {
-		str->str_datalen += chunksz;
-		str->str_data = realloc(str->str_data, str->str_datalen);
-		if (str->str_data == NULL)
-			err(1, "could not allocate memory for string");
-	}
+	dynstr_grow(str, 1);
 	str->str_data[str->str_strlen++] = newc;
 	str->str_data[str->str_strlen] = '\0';
 }
 
 void
-dynstr_append(string_t *str, const char *news)
+dynstr_append_len(string_t *str, const char *news, size_t len)
 {
-	int len = strlen(news);
-	int chunksz = STRING_CHUNK_SIZE;
-
-	while (chunksz < len)
-		chunksz *= 2;
-
-	if (len + str->str_strlen >= str->str_datalen) {
-		str->str_datalen += chunksz;
-		str->str_data = realloc(str->str_data, str->str_datalen);
-		if (str->str_data == NULL)
-			err(1, "could not allocate memory for string");
-	}
-	strcpy(str->str_data + str->str_strlen, news);
+	dynstr_grow(str, len);
+	memcpy(str->str_data + str->str_strlen, news, len);
 	str->str_strlen += len;
+	str->str_data[str->str_strlen] = '\0';
+}
+
+/*
+ * Make room for "len" more bytes at the end of the string, and return a
+ * pointer to that space.  Once the caller has filled in some or all of it,
+ * dynstr_commit() adds those bytes to the string.  Until then, the string is
+ * not NUL-terminated.
+ */
+char *
+dynstr_reserve(string_t *str, size_t len)
+{
+	dynstr_grow(str, len);
+	return (str->str_data + str->str_strlen);
+}
+
+void
+dynstr_commit(string_t *str, size_t len)
+{
+	VERIFY(str->str_strlen + len < str->str_datalen);
+
+	str->str_strlen += len;
+	str->str_data[str->str_strlen] = '\0';
+}
+
+void
+dynstr_append(string_t *str, const char *news)
+{
+	dynstr_append_len(str, news, strlen(news));
 }
 
 string_t *
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -15,7 +16,10 @@ typedef struct string string_t;
 string_t *dynstr_new(void);
 void dynstr_free(string_t *str);
 void dynstr_append(string_t *, const char *);
+void dynstr_append_len(string_t *, const char *, size_t);
 void dynstr_appendc(string_t *, char);
+char *dynstr_reserve(string_t *, size_t);
+void dynstr_commit(string_t *, size_t);
 void dynstr_reset(string_t *str);
 size_t dynstr_len(string_t *str);
 const char *dynstr_cstr(string_t *str);
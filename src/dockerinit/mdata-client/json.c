@@ -0,0 +1,171 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dynstr.h"
+#include "json.h"
+
+/*
+ * Append the "len" bytes at "str" to "out" as a quoted JSON string.  Bytes
+ * outside ASCII are copied as they are, so "str" should be UTF-8.
+ */
+void
+json_append_string(string_t *out, const char *str, size_t len)
+{
+	char esc[7];
+	size_t run = 0;
+	size_t i;
+
+	dynstr_appendc(out, '"');
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)str[i];
+
+		if (c != '"' && c != '\\' && c >= 0x20)
+			continue;
+
+		dynstr_append_len(out, str + run, i - run);
+		run = i + 1;
+		if (c < 0x20) {
+			(void) snprintf(esc, sizeof (esc), "\\u%04x", c);
+			dynstr_append(out, esc);
+		} else {
+			dynstr_appendc(out, '\\');
+			dynstr_appendc(out, c);
+		}
+	}
+	dynstr_append_len(out, str + run, len - run);
+	dynstr_appendc(out, '"');
+}
+
+const char *
+json_skip_ws(const char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+		p++;
+
+	return (p);
+}
+
+static int
+json_parse_hex4(const char *p, uint32_t *out)
+{
+	uint32_t v = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		char c = p[i];
+
+		v <<= 4;
+		if (c >= '0' && c <= '9')
+			v |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			v |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			v |= c - 'A' + 10;
+		else
+			return (-1);
+	}
+
+	*out = v;
+	return (0);
+}
+
+static void
+json_append_utf8(string_t *out, uint32_t cp)
+{
+	if (cp < 0x80) {
+		dynstr_appendc(out, cp);
+	} else if (cp < 0x800) {
+		dynstr_appendc(out, 0xc0 | (cp >> 6));
+		dynstr_appendc(out, 0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		dynstr_appendc(out, 0xe0 | (cp >> 12));
+		dynstr_appendc(out, 0x80 | ((cp >> 6) & 0x3f));
+		dynstr_appendc(out, 0x80 | (cp & 0x3f));
+	} else {
+		dynstr_appendc(out, 0xf0 | (cp >> 18));
+		dynstr_appendc(out, 0x80 | ((cp >> 12) & 0x3f));
+		dynstr_appendc(out, 0x80 | ((cp >> 6) & 0x3f));
+		dynstr_appendc(out, 0x80 | (cp & 0x3f));
+	}
+}
+
+/*
+ * Parse the JSON string starting at the opening quote at *pp, appending its
+ * (UTF-8) contents to "out", and leave *pp just past the closing quote.
+ * Returns -1 if the string is malformed or unterminated.
+ *
+ * Surrogate pairs are combined, and a lone surrogate becomes U+FFFD, which is
+ * what the agent would send in its place if asked for the value with GET.
+ */
+int
+json_parse_string(const char **pp, string_t *out)
+{
+	const char *p = *pp;
+	uint32_t cp, lo;
+
+	if (*p++ != '"')
+		return (-1);
+
+	for (;;) {
+		const char *run = p;
+
+		while (*p != '"' && *p != '\\' && *p != '\0' &&
+		    (unsigned char)*p >= 0x20)
+			p++;
+		dynstr_append_len(out, run, p - run);
+
+		if (*p == '"') {
+			*pp = p + 1;
+			return (0);
+		}
+		if (*p != '\\')
+			return (-1);
+
+		switch (p[1]) {
+		case '"':
+		case '\\':
+		case '/':
+			dynstr_appendc(out, p[1]);
+			break;
+		case 'b':
+			dynstr_appendc(out, '\b');
+			break;
+		case 'f':
+			dynstr_appendc(out, '\f');
+			break;
+		case 'n':
+			dynstr_appendc(out, '\n');
+			break;
+		case 'r':
+			dynstr_appendc(out, '\r');
+			break;
+		case 't':
+			dynstr_appendc(out, '\t');
+			break;
+		case 'u':
+			if (json_parse_hex4(p + 2, &cp) != 0)
+				return (-1);
+			p += 4;
+			if (cp >= 0xd800 && cp <= 0xdbff && p[2] == '\\' &&
+			    p[3] == 'u' && json_parse_hex4(p + 4, &lo) == 0 &&
+			    lo >= 0xdc00 && lo <= 0xdfff) {
+				cp = 0x10000 + ((cp - 0xd800) << 10) +
+				    (lo - 0xdc00);
+				p += 6;
+			} else if (cp >= 0xd800 && cp <= 0xdfff) {
+				cp = 0xfffd;
+			}
+			json_append_utf8(out, cp);
+			break;
+		default:
+			return (-1);
+		}
+		p += 2;
+	}
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _JSON_H
+#define	_JSON_H
+
+#include "dynstr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Just enough JSON for the GETMANY command, which sends an array of key names
+ * and gets back an object mapping keys to values, all of them strings.
+ */
+void json_append_string(string_t *, const char *, size_t);
+int json_parse_string(const char **, string_t *);
+const char *json_skip_ws(const char *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JSON_H */
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -37,7 +38,7 @@ print_response(mdata_response_t mdr, string_t *data)
 
 	switch (mdr) {
 	case MDR_SUCCESS:
-		fprintf(stdout, "%s", cstr);
+		(void) fwrite(cstr, 1, len, stdout);
 		if (len < 1 || cstr[len - 1] != '\n')
 			fprintf(stdout, "\n");
 		return (MDEC_SUCCESS);
@@ -0,0 +1,534 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+/*
+ * mdata-mux: hold one connection to the metadata service, and share it
+ * between many short-lived local clients.
+ *
+ * Each run of mdata-get (and friends) normally opens its own connection and
+ * negotiates the protocol before sending a single request; on KVM and bhyve
+ * guests, every run also has to take its turn on the one serial port.  Instead,
+ * mdata-mux connects and negotiates once, then listens on a UNIX socket and
+ * speaks the same protocol as the metadata agent to whatever connects to it:
+ * point the client tools at it with MDATA_SOCKET_PATH.
+ *
+ * Requests from every client are queued as they arrive, and sent on in
+ * batches with proto_execute_many().  Over the V2 protocol a batch is
+ * pipelined, with proto.c giving each request its own request ID, so that
+ * the whole batch costs about one round trip to the host.  Each response is
+ * then passed back to the client that asked, under the client's own request
+ * ID.  The empty line a client sends to reset the connection and NEGOTIATE
+ * are answered here, without involving the host.  V2 is only offered to
+ * clients if the host supports it.
+ *
+ * V1 requests carry no request ID, so a client must wait for each response
+ * before sending another request, as the client tools always do.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <err.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include "common.h"
+#include "dynstr.h"
+#include "plat.h"
+#include "proto.h"
+#include "base64.h"
+#include "crc32.h"
+#include "plat/unix_common.h"
+
+#define	MUX_MAX_CLIENTS		128
+#define	MUX_BATCH_MAX		64
+#define	MUX_READ_SIZE		(64 * 1024)
+
+typedef enum mdata_exit_codes {
+	MDEC_SUCCESS = 0,
+	MDEC_NOTFOUND = 1,
+	MDEC_ERROR = 2,
+	MDEC_USAGE_ERROR = 3,
+	MDEC_TRY_AGAIN = 10
+} mdata_exit_codes_t;
+
+/*
+ * Clients live in a fixed array, indexed the same as their pollfd.  The
+ * generation number changes whenever a slot is reused, so that responses for
+ * a client that has since gone away are not sent to its replacement.
+ */
+typedef struct mux_client {
+	unsigned int mc_gen;
+	string_t *mc_line;		/* partial request line */
+} mux_client_t;
+
+/*
+ * A request waiting to be sent to the host.  V1 requests have no request ID.
+ */
+typedef struct mux_request {
+	unsigned int mr_client;
+	unsigned int mr_gen;
+	string_t *mr_reqid;
+	string_t *mr_command;
+	string_t *mr_argument;		/* NULL if there is no argument */
+	struct mux_request *mr_next;
+} mux_request_t;
+
+static mdata_proto_t *mdp;
+
+static struct pollfd pfds[1 + MUX_MAX_CLIENTS];
+static mux_client_t clients[1 + MUX_MAX_CLIENTS];
+static unsigned int nclients;
+
+static mux_request_t *queue_head;
+static mux_request_t **queue_tail = &queue_head;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: mdata-mux [-u upstream_socket] socket_path\n");
+	exit(MDEC_USAGE_ERROR);
+}
+
+static void
+client_drop(unsigned int i)
+{
+	(void) close(pfds[i].fd);
+	pfds[i].fd = -1;
+	pfds[i].revents = 0;
+	dynstr_free(clients[i].mc_line);
+	clients[i].mc_line = NULL;
+	clients[i].mc_gen++;
+	nclients--;
+}
+
+static void
+client_send(unsigned int i, string_t *out)
+{
+	if (unix_send(pfds[i].fd, out) != 0)
+		client_drop(i);
+}
+
+/*
+ * Frame a response as the agent would, for a V2 (if reqid is set) or V1
+ * request.
+ */
+static void
+client_respond(unsigned int i, string_t *reqid, const char *code,
+    string_t *data)
+{
+	string_t *out = dynstr_new();
+	string_t *body;
+	char hdr[32];
+	const char *cstr, *lf;
+
+	if (reqid != NULL) {
+		body = dynstr_new();
+		dynstr_append_len(body, dynstr_cstr(reqid), dynstr_len(reqid));
+		dynstr_append(body, " ");
+		dynstr_append(body, code);
+		if (data != NULL && dynstr_len(data) > 0) {
+			dynstr_append(body, " ");
+			base64_encode(dynstr_cstr(data), dynstr_len(data),
+			    body);
+		}
+		(void) snprintf(hdr, sizeof (hdr), "V2 %u %08x ",
+		    (unsigned int)dynstr_len(body),
+		    crc32_calc(dynstr_cstr(body), dynstr_len(body)));
+		dynstr_append(out, hdr);
+		dynstr_append_len(out, dynstr_cstr(body), dynstr_len(body));
+		dynstr_append(out, "\n");
+		dynstr_free(body);
+
+	} else if (strcmp(code, "SUCCESS") == 0 && data != NULL) {
+		/*
+		 * V1 sends the value a line at a time, doubling any leading
+		 * "." so that the terminating "." line is unambiguous:
+		 */
+		dynstr_append(out, "SUCCESS\n");
+		cstr = dynstr_cstr(data);
+		do {
+			if ((lf = strchr(cstr, '\n')) == NULL)
+				lf = cstr + strlen(cstr);
+			if (*cstr == '.')
+				dynstr_append(out, ".");
+			dynstr_append_len(out, cstr, lf - cstr);
+			dynstr_append(out, "\n");
+			cstr = lf + 1;
+		} while (*lf != '\0');
+		dynstr_append(out, ".\n");
+
+	} else {
+		dynstr_append(out, code);
+		dynstr_append(out, "\n");
+	}
+
+	client_send(i, out);
+	dynstr_free(out);
+}
+
+static void
+request_free(mux_request_t *mr)
+{
+	if (mr->mr_reqid != NULL)
+		dynstr_free(mr->mr_reqid);
+	dynstr_free(mr->mr_command);
+	if (mr->mr_argument != NULL)
+		dynstr_free(mr->mr_argument);
+	free(mr);
+}
+
+static void
+request_enqueue(unsigned int i, const char *reqid, size_t reqidlen,
+    const char *command, size_t commandlen, const char *argument,
+    size_t argumentlen)
+{
+	mux_request_t *mr;
+
+	if ((mr = calloc(1, sizeof (*mr))) == NULL)
+		err(MDEC_ERROR, "could not allocate request");
+
+	mr->mr_client = i;
+	mr->mr_gen = clients[i].mc_gen;
+	if (reqid != NULL) {
+		mr->mr_reqid = dynstr_new();
+		dynstr_append_len(mr->mr_reqid, reqid, reqidlen);
+	}
+	mr->mr_command = dynstr_new();
+	dynstr_append_len(mr->mr_command, command, commandlen);
+	if (argument != NULL) {
+		mr->mr_argument = dynstr_new();
+		dynstr_append_len(mr->mr_argument, argument, argumentlen);
+	}
+
+	*queue_tail = mr;
+	queue_tail = &mr->mr_next;
+}
+
+/*
+ * Unbox a V2 request frame (the part of the line after "V2 ") and queue it.
+ * Like the agent, we drop frames that don't parse without a response.
+ */
+static void
+client_request_v2(unsigned int i, const char *frame)
+{
+	string_t *arg;
+	const char *endp;
+	const char *reqid, *command, *b64;
+	unsigned long clen;
+	uint32_t crc;
+
+	clen = strtoul(frame, (char **)&endp, 10);
+	if (clen == 0 || *endp != ' ')
+		return;
+	crc = strtoul(endp, (char **)&endp, 16);
+	if (*endp++ != ' ')
+		return;
+	if (strlen(endp) != clen || crc32_calc(endp, clen) != crc)
+		return;
+
+	reqid = endp;
+	if ((command = strchr(reqid, ' ')) == NULL || command == reqid)
+		return;
+	command++;
+	if ((b64 = strchr(command, ' ')) == NULL) {
+		request_enqueue(i, reqid, command - 1 - reqid, command,
+		    strlen(command), NULL, 0);
+		return;
+	}
+
+	arg = dynstr_new();
+	if (base64_decode(b64 + 1, strlen(b64 + 1), arg) == 0) {
+		request_enqueue(i, reqid, command - 1 - reqid, command,
+		    b64 - command, dynstr_cstr(arg), dynstr_len(arg));
+	}
+	dynstr_free(arg);
+}
+
+static void
+client_request(unsigned int i, char *line)
+{
+	size_t len = strlen(line);
+	char *arg;
+
+	/*
+	 * Like the agent, ignore trailing whitespace (e.g. a CR):
+	 */
+	while (len > 0 && isspace((unsigned char)line[len - 1]))
+		line[--len] = '\0';
+
+	if ((arg = strchr(line, ' ')) != NULL)
+		*arg++ = '\0';
+
+	if (*line == '\0') {
+		/*
+		 * This is the reset a client sends when it connects.
+		 */
+		client_respond(i, NULL, "invalid command", NULL);
+
+	} else if (strcmp(line, "NEGOTIATE") == 0) {
+		client_respond(i, NULL, proto_version(mdp) == 2 &&
+		    arg != NULL && strcmp(arg, "V2") == 0 ? "V2_OK" : "FAILURE",
+		    NULL);
+
+	} else if (strcmp(line, "V2") == 0) {
+		if (proto_version(mdp) == 2 && arg != NULL)
+			client_request_v2(i, arg);
+		else
+			client_respond(i, NULL, "invalid command", NULL);
+
+	} else {
+		request_enqueue(i, NULL, 0, line, strlen(line), arg,
+		    arg != NULL ? strlen(arg) : 0);
+	}
+}
+
+static void
+client_read(unsigned int i, char *buf)
+{
+	mux_client_t *mc = &clients[i];
+	char *start, *lf;
+	ssize_t sz;
+
+	if ((sz = read(pfds[i].fd, buf, MUX_READ_SIZE)) <= 0) {
+		if (sz == -1 && (errno == EINTR || errno == EAGAIN))
+			return;
+		client_drop(i);
+		return;
+	}
+
+	/*
+	 * Handle each complete line, keeping any partial one for the next
+	 * read.  A response may fail to send and drop the client, so check
+	 * that it is still here after each one.
+	 */
+	for (start = buf; (lf = memchr(start, '\n', buf + sz - start)) !=
+	    NULL; start = lf + 1) {
+		dynstr_append_len(mc->mc_line, start, lf - start);
+		client_request(i, (char *)dynstr_cstr(mc->mc_line));
+		if (mc->mc_line == NULL)
+			return;
+		dynstr_reset(mc->mc_line);
+	}
+	dynstr_append_len(mc->mc_line, start, buf + sz - start);
+}
+
+static void
+client_accept(int lfd)
+{
+	unsigned int i;
+	int fd;
+
+	if ((fd = accept(lfd, NULL, NULL)) == -1) {
+		if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED)
+			warn("accept");
+		return;
+	}
+
+	/*
+	 * Writes go through unix_send(), which expects a non-blocking socket
+	 * and gives up on a client that stops reading.
+	 */
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+		warn("fcntl");
+		(void) close(fd);
+		return;
+	}
+
+	for (i = 1; i <= MUX_MAX_CLIENTS && pfds[i].fd != -1; i++)
+		;
+	VERIFY(i <= MUX_MAX_CLIENTS);
+
+	pfds[i].fd = fd;
+	pfds[i].events = POLLIN;
+	pfds[i].revents = 0;
+	clients[i].mc_line = dynstr_new();
+	nclients++;
+}
+
+static const char *
+response_code(mdata_response_t mdr)
+{
+	switch (mdr) {
+	case MDR_SUCCESS:
+		return ("SUCCESS");
+	case MDR_NOTFOUND:
+		return ("NOTFOUND");
+	case MDR_INVALID_COMMAND:
+		return ("invalid command");
+	default:
+		return ("FAILURE");
+	}
+}
+
+/*
+ * Send the oldest queued requests to the host as one batch, and pass each
+ * response back to the client that asked for it.
+ */
+static void
+dispatch(void)
+{
+	mdata_request_t mdq[MUX_BATCH_MAX];
+	mux_request_t *mrs[MUX_BATCH_MAX];
+	mux_request_t *mr;
+	size_t n = 0;
+	size_t j;
+
+	while (n < MUX_BATCH_MAX && (mr = queue_head) != NULL) {
+		if ((queue_head = mr->mr_next) == NULL)
+			queue_tail = &queue_head;
+
+		/*
+		 * Don't bother the host for a client that has gone away:
+		 */
+		if (pfds[mr->mr_client].fd == -1 ||
+		    clients[mr->mr_client].mc_gen != mr->mr_gen) {
+			request_free(mr);
+			continue;
+		}
+
+		mrs[n] = mr;
+		mdq[n].mdq_command = dynstr_cstr(mr->mr_command);
+		mdq[n].mdq_argument = mr->mr_argument != NULL ?
+		    dynstr_cstr(mr->mr_argument) : NULL;
+		n++;
+	}
+
+	if (n == 0)
+		return;
+
+	/*
+	 * proto_execute_many() resets the connection and tries again until it
+	 * succeeds, unless the host has become permanently unreachable.  In
+	 * that case, exit and leave it to whatever started us to try again.
+	 */
+	if (proto_execute_many(mdp, mdq, n) != 0)
+		errx(MDEC_ERROR, "lost connection to metadata service");
+
+	for (j = 0; j < n; j++) {
+		mr = mrs[j];
+
+		if (pfds[mr->mr_client].fd != -1 &&
+		    clients[mr->mr_client].mc_gen == mr->mr_gen) {
+			client_respond(mr->mr_client, mr->mr_reqid,
+			    response_code(mdq[j].mdq_response),
+			    mdq[j].mdq_response_data);
+		}
+
+		dynstr_free(mdq[j].mdq_response_data);
+		request_free(mr);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sockaddr_un ua;
+	char *upstream = NULL;
+	char *errmsg = NULL;
+	char *buf;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "u:")) != -1) {
+		switch (opt) {
+		case 'u':
+			upstream = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 1)
+		usage();
+
+	if (strlen(argv[optind]) >= sizeof (ua.sun_path))
+		errx(MDEC_USAGE_ERROR, "socket path too long");
+	bzero(&ua, sizeof (ua));
+	ua.sun_family = AF_UNIX;
+	(void) strcpy(ua.sun_path, argv[optind]);
+
+	/*
+	 * We may well have been started from a shell where MDATA_SOCKET_PATH
+	 * already points at where we're about to listen, so only use it to
+	 * reach the host if asked to:
+	 */
+	if (upstream != NULL) {
+		if (strcmp(upstream, ua.sun_path) == 0)
+			errx(MDEC_USAGE_ERROR, "cannot use %s as both the "
+			    "upstream and listening socket", upstream);
+		if (setenv("MDATA_SOCKET_PATH", upstream, 1) != 0)
+			err(MDEC_ERROR, "setenv");
+	} else if (unsetenv("MDATA_SOCKET_PATH") != 0) {
+		err(MDEC_ERROR, "unsetenv");
+	}
+
+	(void) signal(SIGPIPE, SIG_IGN);
+
+	/*
+	 * Connect to the host before we start listening, so that clients
+	 * don't find the socket until we can serve them:
+	 */
+	if (proto_init(&mdp, &errmsg) != 0) {
+		errx(MDEC_ERROR, "could not initialise protocol: %s",
+		    errmsg != NULL ? errmsg : "?");
+	}
+
+	/*
+	 * Anyone who can connect to the socket can read and write metadata
+	 * through us, so keep it to our own user:
+	 */
+	(void) umask(077);
+	(void) unlink(ua.sun_path);
+
+	if ((pfds[0].fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(MDEC_ERROR, "socket");
+	if (bind(pfds[0].fd, (struct sockaddr *)&ua, sizeof (ua)) == -1)
+		err(MDEC_ERROR, "bind %s", ua.sun_path);
+	if (listen(pfds[0].fd, 64) == -1)
+		err(MDEC_ERROR, "listen");
+
+	for (i = 1; i <= MUX_MAX_CLIENTS; i++)
+		pfds[i].fd = -1;
+
+	if ((buf = malloc(MUX_READ_SIZE)) == NULL)
+		err(MDEC_ERROR, "malloc");
+
+	for (;;) {
+		/*
+		 * Stop accepting while we're full, and don't wait for more
+		 * input while there are requests to send:
+		 */
+		pfds[0].events = nclients < MUX_MAX_CLIENTS ? POLLIN : 0;
+
+		if (poll(pfds, 1 + MUX_MAX_CLIENTS,
+		    queue_head != NULL ? 0 : -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(MDEC_ERROR, "poll");
+		}
+
+		for (i = 1; i <= MUX_MAX_CLIENTS; i++) {
+			if (pfds[i].fd != -1 && pfds[i].revents != 0)
+				client_read(i, buf);
+		}
+
+		if (pfds[0].revents & POLLIN)
+			client_accept(pfds[0].fd);
+
+		dispatch();
+	}
+
+	return (MDEC_SUCCESS);
+}
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -30,18 +31,14 @@
 typedef struct mdata_plat {
 	int mpl_epoll;
 	int mpl_conn;
+	unix_recvbuf_t mpl_recvbuf;
 } mdata_plat_t;
 
 
 int
 plat_send(mdata_plat_t *mpl, string_t *data)
 {
-	int len = dynstr_len(data);
-
-	if (write(mpl->mpl_conn, dynstr_cstr(data), len) != len)
-		return (-1);
-
-	return (0);
+	return (unix_send(mpl->mpl_conn, data));
 }
 
 int
@@ -50,6 +47,12 @@ plat_recv(mdata_plat_t *mpl, string_t *data, int timeout_ms)
 	for (;;) {
 		struct epoll_event event;
 
+		/*
+		 * The last read may have brought in more than one line:
+		 */
+		if (unix_recv_line(&mpl->mpl_recvbuf, data) == 0)
+			return (0);
+
 		if (epoll_wait(mpl->mpl_epoll, &event, 1, timeout_ms) == -1) {
 			fprintf(stderr, "epoll error: %d\n", errno);
 			if (errno == EINTR) {
@@ -63,18 +66,15 @@ plat_recv(mdata_plat_t *mpl, string_t *data, int timeout_ms)
 			return (-1);
 		}
 
-		if (event.events & EPOLLIN) {
-			char buf[2];
-			ssize_t sz;
-
-			if ((sz = read(mpl->mpl_conn, buf, 1)) > 0) {
-				if (buf[0] == '\n') {
-					return (0);
-				} else {
-					buf[1] = '\0';
-					dynstr_append(data, buf);
-				}
-			}
+		/*
+		 * Read as much as is available; if that includes the end of
+		 * the line we can return it, otherwise wait for more.
+		 */
+		if ((event.events & EPOLLIN) &&
+		    unix_recv_fill(&mpl->mpl_recvbuf, mpl->mpl_conn) > 0) {
+			if (unix_recv_line(&mpl->mpl_recvbuf, data) == 0)
+				return (0);
+			continue;
 		}
 		if (event.events & EPOLLERR) {
 			fprintf(stderr, "POLLERR\n");
@@ -136,6 +136,7 @@ plat_init(mdata_plat_t **mplout, char **errmsg, int *permfail)
 {
 	mdata_plat_t *mpl = NULL;
 	struct epoll_event event;
+	const char *sockpath;
 
 	if ((mpl = calloc(1, sizeof (*mpl))) == NULL) {
 		*errmsg = "Could not allocate memory.";
@@ -151,7 +152,16 @@ plat_init(mdata_plat_t **mplout, char **errmsg, int *permfail)
 		goto bail;
 	}
 
-	if (unix_open_serial(SERIAL_DEVICE, &mpl->mpl_conn, errmsg,
+	/*
+	 * MDATA_SOCKET_PATH names a UNIX socket to use in place of the
+	 * serial device, e.g. to talk to a local metadata server for testing:
+	 */
+	if ((sockpath = getenv("MDATA_SOCKET_PATH")) != NULL) {
+		if (unix_open_socket(sockpath, &mpl->mpl_conn, errmsg,
+		    permfail) != 0) {
+			goto bail;
+		}
+	} else if (unix_open_serial(SERIAL_DEVICE, &mpl->mpl_conn, errmsg,
 	    permfail) != 0) {
 		goto bail;
 	}
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -16,9 +17,6 @@
 #include <errno.h>
 #include <termios.h>
 #include <zone.h>
-#include <sys/socket.h>
-#include <sys/un.h>
-#include <sys/filio.h>
 #include <port.h>
 
 #include "common.h"
@@ -38,6 +36,7 @@ static char *zone_md_socket_paths[] = {
 struct mdata_plat {
 	int mpl_port;
 	int mpl_conn;
+	unix_recvbuf_t mpl_recvbuf;
 };
 
 static int
@@ -114,10 +113,7 @@ open_md_ngz(int *outfd, char **errmsg, int *permfail)
 	 * We're in a non-global zone, so try and connect to the
 	 * metadata socket:
 	 */
-	long on = 1L;
-	int fd;
 	const char *sockpath;
-	struct sockaddr_un ua;
 
 	/*
 	 * This is not always a permanent failure, because the metadata
@@ -129,36 +125,7 @@ open_md_ngz(int *outfd, char **errmsg, int *permfail)
 		return (-1);
 	}
 
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		*errmsg = "Could not open metadata socket.";
-		*permfail = 1;
-		return (-1);
-	}
-
-	/*
-	 * Enable non-blocking I/O on the socket so that we can time-out
-	 * when we want to:
-	 */
-	if (ioctl(fd, (int)FIONBIO, &on) != 0) {
-		*errmsg = "Could not set non-blocking I/O on socket.";
-		(void) close(fd);
-		*permfail = 1;
-		return (-1);
-	}
-
-	bzero(&ua, sizeof (ua));
-	ua.sun_family = AF_UNIX;
-	strcpy(ua.sun_path, sockpath);
-
-	if (connect(fd, (struct sockaddr *)&ua, sizeof (ua)) == -1) {
-		(void) close(fd);
-		*errmsg = "Could not connect metadata socket.";
-		return (-1);
-	}
-
-	*outfd = fd;
-
-	return (0);
+	return (unix_open_socket(sockpath, outfd, errmsg, permfail));
 }
 
 static int
@@ -175,12 +142,7 @@ open_md_gz(int *outfd, char **errmsg, int *permfail)
 int
 plat_send(mdata_plat_t *mpl, string_t *data)
 {
-	int len = dynstr_len(data);
-
-	if (write(mpl->mpl_conn, dynstr_cstr(data), len) != len)
-		return (-1);
-
-	return (0);
+	return (unix_send(mpl->mpl_conn, data));
 }
 
 int
@@ -190,6 +152,12 @@ plat_recv(mdata_plat_t *mpl, string_t *data, int timeout_ms)
 	timespec_t tv;
 
 	for (;;) {
+		/*
+		 * The last read may have brought in more than one line:
+		 */
+		if (unix_recv_line(&mpl->mpl_recvbuf, data) == 0)
+			return (0);
+
 		if (port_associate(mpl->mpl_port, PORT_SOURCE_FD, mpl->mpl_conn,
 		    POLLIN | POLLERR | POLLHUP , NULL) != 0) {
 			fprintf(stderr, "port_associate error: %s\n",
@@ -211,18 +179,15 @@ plat_recv(mdata_plat_t *mpl, string_t *data, int timeout_ms)
 			return (-1);
 		}
 
-		if (pev.portev_events & POLLIN) {
-			char buf[2];
-			ssize_t sz;
-
-			if ((sz = read(mpl->mpl_conn, buf, 1)) > 0) {
-				if (buf[0] == '\n') {
-					return (0);
-				} else {
-					buf[1] = '\0';
-					dynstr_append(data, buf);
-				}
-			}
+		/*
+		 * Read as much as is available; if that includes the end of
+		 * the line we can return it, otherwise wait for more.
+		 */
+		if ((pev.portev_events & POLLIN) &&
+		    unix_recv_fill(&mpl->mpl_recvbuf, mpl->mpl_conn) > 0) {
+			if (unix_recv_line(&mpl->mpl_recvbuf, data) == 0)
+				return (0);
+			continue;
 		}
 		if (pev.portev_events & POLLERR) {
 			fprintf(stderr, "POLLERR\n");
@@ -284,6 +249,7 @@ int
 plat_init(mdata_plat_t **mplout, char **errmsg, int *permfail)
 {
 	char *product;
+	const char *sockpath;
 	boolean_t smartdc_hvm_guest = B_FALSE;
 	mdata_plat_t *mpl = NULL;
 
@@ -301,6 +267,19 @@ plat_init(mdata_plat_t **mplout, char **errmsg, int *permfail)
 		goto bail;
 	}
 
+	/*
+	 * MDATA_SOCKET_PATH names a UNIX socket to use in place of the
+	 * usual metadata device, e.g. to talk to a local metadata server for
+	 * testing:
+	 */
+	if ((sockpath = getenv("MDATA_SOCKET_PATH")) != NULL) {
+		if (unix_open_socket(sockpath, &mpl->mpl_conn, errmsg,
+		    permfail) != 0) {
+			goto bail;
+		}
+		goto wrapfd;
+	}
+
 	if (getzoneid() != GLOBAL_ZONEID) {
 		if (open_md_ngz(&mpl->mpl_conn, errmsg, permfail) != 0)
 			goto bail;
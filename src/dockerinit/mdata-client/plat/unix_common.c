@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -15,10 +16,14 @@
 #include <err.h>
 #include <errno.h>
 #include <termios.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "common.h"
 #include "plat.h"
 #include "dynstr.h"
+#include "plat/unix_common.h"
 
 int
 unix_is_interactive(void)
@@ -113,3 +118,127 @@ unix_open_serial(char *devpath, int *outfd, char **errmsg, int *permfail)
 
 	return (0);
 }
+
+int
+unix_open_socket(const char *sockpath, int *outfd, char **errmsg,
+    int *permfail)
+{
+	int fd;
+	int flags;
+	struct sockaddr_un ua;
+
+	if (strlen(sockpath) >= sizeof (ua.sun_path)) {
+		*errmsg = "Metadata socket path too long.";
+		*permfail = 1;
+		return (-1);
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		*errmsg = "Could not open metadata socket.";
+		*permfail = 1;
+		return (-1);
+	}
+
+	/*
+	 * Enable non-blocking I/O on the socket so that we can time-out
+	 * when we want to:
+	 */
+	if ((flags = fcntl(fd, F_GETFL)) == -1 ||
+	    fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		*errmsg = "Could not set non-blocking I/O on socket.";
+		(void) close(fd);
+		*permfail = 1;
+		return (-1);
+	}
+
+	bzero(&ua, sizeof (ua));
+	ua.sun_family = AF_UNIX;
+	strcpy(ua.sun_path, sockpath);
+
+	if (connect(fd, (struct sockaddr *)&ua, sizeof (ua)) == -1) {
+		(void) close(fd);
+		*errmsg = "Could not connect metadata socket.";
+		return (-1);
+	}
+
+	*outfd = fd;
+
+	return (0);
+}
+
+/*
+ * Write all of "data" to the connection.  A metadata socket is non-blocking,
+ * so a large request may take several writes, with a wait for the peer to
+ * read some of it in between.
+ */
+int
+unix_send(int fd, string_t *data)
+{
+	const char *buf = dynstr_cstr(data);
+	size_t len = dynstr_len(data);
+	struct pollfd pfd;
+	ssize_t sz;
+
+	while (len > 0) {
+		if ((sz = write(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return (-1);
+
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, UNIX_SEND_TIMEOUT_MS) != 1 &&
+			    errno != EINTR)
+				return (-1);
+			continue;
+		}
+		buf += sz;
+		len -= sz;
+	}
+
+	return (0);
+}
+
+/*
+ * Move the next line out of the receive buffer and onto the end of "data",
+ * without the terminating linefeed, and return 0.  If the buffer holds only
+ * part of a line, move that part to "data" instead and return -1; the caller
+ * should then refill the buffer and call us again to get the rest.
+ */
+int
+unix_recv_line(unix_recvbuf_t *urb, string_t *data)
+{
+	char *start = urb->urb_data + urb->urb_start;
+	size_t avail = urb->urb_end - urb->urb_start;
+	char *lf;
+
+	if ((lf = memchr(start, '\n', avail)) != NULL) {
+		dynstr_append_len(data, start, lf - start);
+		urb->urb_start += lf - start + 1;
+		return (0);
+	}
+
+	dynstr_append_len(data, start, avail);
+	urb->urb_start = urb->urb_end = 0;
+	return (-1);
+}
+
+/*
+ * Read as much as will fit into the receive buffer, which unix_recv_line()
+ * will have emptied.  Returns the result of the read(2).
+ */
+ssize_t
+unix_recv_fill(unix_recvbuf_t *urb, int fd)
+{
+	ssize_t sz;
+
+	VERIFY(urb->urb_start == urb->urb_end);
+
+	if ((sz = read(fd, urb->urb_data, sizeof (urb->urb_data))) > 0) {
+		urb->urb_start = 0;
+		urb->urb_end = sz;
+	}
+
+	return (sz);
+}
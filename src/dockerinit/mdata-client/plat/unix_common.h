@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -10,11 +11,40 @@
 extern "C" {
 #endif
 
+#include <sys/types.h>
+
 #include "plat.h"
 #include "dynstr.h"
 
+/*
+ * Size of the per-connection receive buffer, and so the most we will read(2)
+ * from the metadata connection at once.
+ */
+#define	UNIX_RECVBUF_SIZE	(64 * 1024)
+
+/*
+ * How long unix_send() will wait for the peer to accept more of a request.
+ */
+#define	UNIX_SEND_TIMEOUT_MS	45000
+
+/*
+ * Receive buffer for a metadata connection.  Bytes urb_start to urb_end of
+ * urb_data have been read from the connection but not yet returned by
+ * unix_recv_line().
+ */
+typedef struct unix_recvbuf {
+	size_t urb_start;
+	size_t urb_end;
+	char urb_data[UNIX_RECVBUF_SIZE];
+} unix_recvbuf_t;
+
 /*int unix_raw_mode(int fd, char **errmsg);*/
 int unix_open_serial(char *devpath, int *outfd, char **errmsg, int *permfail);
+int unix_open_socket(const char *sockpath, int *outfd, char **errmsg,
+    int *permfail);
+int unix_send(int fd, string_t *data);
+int unix_recv_line(unix_recvbuf_t *urb, string_t *data);
+ssize_t unix_recv_fill(unix_recvbuf_t *urb, int fd);
 int unix_send_reset(mdata_plat_t *mpl);
 int unix_is_interactive(void);
 
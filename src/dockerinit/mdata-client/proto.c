@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -21,6 +22,7 @@
 #include "reqid.h"
 #include "crc32.h"
 #include "base64.h"
+#include "json.h"
 
 /*
  * Receive timeout used prior to V2 negotiation:
@@ -48,35 +50,59 @@ typedef enum mdata_proto_version {
 
 typedef struct mdata_command {
 	char mdc_reqid[REQID_LEN];
-	string_t *mdc_request;
+	const char *mdc_name;
+	const char *mdc_argument;
 	string_t *mdc_response_data;
 	mdata_response_t mdc_response;
+	int mdc_sent;
 	int mdc_done;
 } mdata_command_t;
 
+/*
+ * A call to proto_execute_many() makes mdp_commands the list of commands to
+ * run.  With the V2 protocol, every command is sent at once and responses
+ * are matched to commands by request ID as they arrive.  The V1 protocol has
+ * no request IDs, so commands are sent one at a time; mdp_command is the one
+ * awaiting a response.
+ */
 struct mdata_proto {
 	mdata_plat_t *mdp_plat;
+	mdata_command_t *mdp_commands;
+	size_t mdp_ncommands;
+	size_t mdp_nsent;		/* commands sent but not yet done */
 	mdata_command_t *mdp_command;
 	mdata_proto_state_t mdp_state;
 	mdata_proto_version_t mdp_version;
 	boolean_t mdp_in_reset;
+	boolean_t mdp_no_getmany;	/* host refused GETMANY */
 	char *mdp_errmsg;
 	char *mdp_parse_errmsg;
 };
 
 static int proto_send(mdata_proto_t *mdp);
 static int proto_recv(mdata_proto_t *mdp);
+static void proto_make_request_v2(const char *command, const char *argument,
+    string_t *output, const char *reqidbuf);
+static void proto_make_request_v1(const char *command, const char *argument,
+    string_t *output);
 
 static int
 proto_negotiate(mdata_proto_t *mdp)
 {
 	mdata_command_t *mdcsave;
+	size_t ncsave;
 	mdata_response_t mdr;
 	string_t *rdata = NULL;
 	int ret = -1;
 
-	mdcsave = mdp->mdp_command;
-	mdp->mdp_command = NULL;
+	/*
+	 * We may be resetting the connection part way through running
+	 * commands, so set those aside while we negotiate:
+	 */
+	mdcsave = mdp->mdp_commands;
+	ncsave = mdp->mdp_ncommands;
+	mdp->mdp_commands = NULL;
+	mdp->mdp_ncommands = 0;
 
 	/*
 	 * Assume Protocol Version 1 until we negotiate up to Version 2.
@@ -90,7 +116,8 @@ proto_negotiate(mdata_proto_t *mdp)
 		ret = 0;
 	}
 
-	mdp->mdp_command = mdcsave;
+	mdp->mdp_commands = mdcsave;
+	mdp->mdp_ncommands = ncsave;
 	if (rdata != NULL)
 		dynstr_free(rdata);
 	return (ret);
@@ -141,14 +168,38 @@ retry:
 		goto retry;
 	}
 
+	/*
+	 * This may be a different host, so give GETMANY another try:
+	 */
+	mdp->mdp_no_getmany = B_FALSE;
+
 	mdp->mdp_in_reset = B_FALSE;
 	mdp->mdp_errmsg = NULL;
 	return (0);
 }
 
+/*
+ * Find the command, sent but not yet done, with this request ID:
+ */
+static mdata_command_t *
+proto_find_command(mdata_proto_t *mdp, const char *request_id)
+{
+	size_t i;
+
+	for (i = 0; i < mdp->mdp_ncommands; i++) {
+		mdata_command_t *mdc = &mdp->mdp_commands[i];
+
+		if (mdc->mdc_sent && !mdc->mdc_done &&
+		    strcmp(mdc->mdc_reqid, request_id) == 0)
+			return (mdc);
+	}
+
+	return (NULL);
+}
+
 static int
 proto_parse_v2(mdata_proto_t *mdp, string_t *input, string_t *request_id,
-    string_t *command, string_t *response_data)
+    string_t *command, mdata_command_t **mdcp)
 {
 	const char *endp = dynstr_cstr(input);
 	unsigned long clen;
@@ -209,6 +260,11 @@ proto_parse_v2(mdata_proto_t *mdp, string_t *input, string_t *request_id,
 		mdp->mdp_parse_errmsg = "missing request id";
 		return (-1);
 	}
+	if ((*mdcp = proto_find_command(mdp, dynstr_cstr(request_id))) ==
+	    NULL) {
+		mdp->mdp_parse_errmsg = "unexpected request id";
+		return (-1);
+	}
 
 	/*
 	 * Skip whitespace:
@@ -236,7 +292,9 @@ proto_parse_v2(mdata_proto_t *mdp, string_t *input, string_t *request_id,
 	/*
 	 * Read the Response Data:
 	 */
-	if (base64_decode(endp, strlen(endp), response_data) == -1) {
+	dynstr_reset((*mdcp)->mdc_response_data);
+	if (base64_decode(endp, strlen(endp), (*mdcp)->mdc_response_data) ==
+	    -1) {
 		mdp->mdp_parse_errmsg = "base64 error";
 		return (-1);
 	}
@@ -244,47 +302,45 @@ proto_parse_v2(mdata_proto_t *mdp, string_t *input, string_t *request_id,
 	return (0);
 }
 
+static void
+proto_command_done(mdata_proto_t *mdp, mdata_command_t *mdc,
+    mdata_response_t response)
+{
+	mdc->mdc_response = response;
+	mdc->mdc_done = 1;
+
+	if (--mdp->mdp_nsent == 0)
+		mdp->mdp_state = MDPS_READY;
+}
+
 static void
 process_input(mdata_proto_t *mdp, string_t *input)
 {
 	const char *cstr = dynstr_cstr(input);
 	string_t *command, *request_id;
+	mdata_command_t *mdc = mdp->mdp_command;
 
 	switch (mdp->mdp_state) {
 	case MDPS_MESSAGE_V2:
 		command = dynstr_new();
 		request_id = dynstr_new();
 
-		dynstr_reset(mdp->mdp_command->mdc_response_data);
-
 		if (proto_parse_v2(mdp, input, request_id, command,
-		    mdp->mdp_command->mdc_response_data) == -1) {
+		    &mdc) == -1) {
 			/*
 			 * XXX Presently, drop frames that we can't
-			 * parse.
-			 */
-
-		} else if (strcmp(dynstr_cstr(request_id),
-		    mdp->mdp_command->mdc_reqid) != 0) {
-			/*
-			 * XXX Presently, drop frames that are not for
-			 * the currently outstanding request.
+			 * parse, or that are not for a request we have
+			 * outstanding.
 			 */
 
 		} else if (strcmp(dynstr_cstr(command), "NOTFOUND") == 0) {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_response = MDR_NOTFOUND;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_NOTFOUND);
 
 		} else if (strcmp(dynstr_cstr(command), "SUCCESS") == 0) {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_response = MDR_SUCCESS;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_SUCCESS);
 
 		} else {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_response = MDR_UNKNOWN;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_UNKNOWN);
 		}
 
 		dynstr_free(command);
@@ -293,39 +349,30 @@ process_input(mdata_proto_t *mdp, string_t *input)
 
 	case MDPS_MESSAGE_HEADER:
 		if (strcmp(cstr, "NOTFOUND") == 0) {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_response = MDR_NOTFOUND;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_NOTFOUND);
 
 		} else if (strcmp(cstr, "SUCCESS") == 0) {
 			mdp->mdp_state = MDPS_MESSAGE_DATA;
-			mdp->mdp_command->mdc_response = MDR_SUCCESS;
+			mdc->mdc_response = MDR_SUCCESS;
 
 		} else if (strcmp(cstr, "V2_OK") == 0) {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_response = MDR_V2_OK;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_V2_OK);
 
 		} else if (strcmp(cstr, "invalid command") == 0) {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_response = MDR_INVALID_COMMAND;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_INVALID_COMMAND);
 
 		} else {
-			mdp->mdp_state = MDPS_READY;
-			dynstr_append(mdp->mdp_command->mdc_response_data, cstr);
-			mdp->mdp_command->mdc_response = MDR_UNKNOWN;
-			mdp->mdp_command->mdc_done = 1;
+			dynstr_append(mdc->mdc_response_data, cstr);
+			proto_command_done(mdp, mdc, MDR_UNKNOWN);
 
 		}
 		break;
 
 	case MDPS_MESSAGE_DATA:
 		if (strcmp(cstr, ".") == 0) {
-			mdp->mdp_state = MDPS_READY;
-			mdp->mdp_command->mdc_done = 1;
+			proto_command_done(mdp, mdc, MDR_SUCCESS);
 		} else {
-			string_t *respdata = mdp->mdp_command->mdc_response_data;
+			string_t *respdata = mdc->mdc_response_data;
 			int offs = cstr[0] == '.' ? 1 : 0;
 			if (dynstr_len(respdata) > 0)
 				dynstr_append(respdata, "\n");
@@ -342,14 +389,63 @@ process_input(mdata_proto_t *mdp, string_t *input)
 	}
 }
 
+/*
+ * Send the commands that are not yet done: all of them at once with the V2
+ * protocol, or just the first with V1.
+ */
 static int
 proto_send(mdata_proto_t *mdp)
 {
-	VERIFY(mdp->mdp_command);
+	string_t *requests = dynstr_new();
+	size_t i;
+	int ret = -1;
+
+	mdp->mdp_nsent = 0;
+	mdp->mdp_command = NULL;
+
+	for (i = 0; i < mdp->mdp_ncommands; i++) {
+		mdata_command_t *mdc = &mdp->mdp_commands[i];
+
+		if (mdc->mdc_done)
+			continue;
+
+		/*
+		 * (Re-)generate request string to send to remote peer:
+		 */
+		switch (mdp->mdp_version) {
+		case MDPV_VERSION_1:
+			proto_make_request_v1(mdc->mdc_name, mdc->mdc_argument,
+			    requests);
+			break;
+		case MDPV_VERSION_2:
+			/*
+			 * Responses are matched to requests by ID, so make
+			 * sure that each request in flight has its own:
+			 */
+			do {
+				(void) reqid(mdc->mdc_reqid);
+			} while (proto_find_command(mdp, mdc->mdc_reqid) !=
+			    NULL);
+			proto_make_request_v2(mdc->mdc_name, mdc->mdc_argument,
+			    requests, mdc->mdc_reqid);
+			break;
+		default:
+			ABORT("unknown protocol version");
+		}
+
+		mdc->mdc_sent = 1;
+		mdp->mdp_nsent++;
+		if (mdp->mdp_version == MDPV_VERSION_1) {
+			mdp->mdp_command = mdc;
+			break;
+		}
+	}
 
-	if (plat_send(mdp->mdp_plat, mdp->mdp_command->mdc_request) == -1) {
+	VERIFY(mdp->mdp_nsent > 0);
+
+	if (plat_send(mdp->mdp_plat, requests) == -1) {
 		mdp->mdp_state = MDPS_ERROR;
-		return (-1);
+		goto bail;
 	}
 
 	/*
@@ -366,7 +462,11 @@ proto_send(mdata_proto_t *mdp)
 		ABORT("unknown protocol version");
 	}
 
-	return (0);
+	ret = 0;
+
+bail:
+	dynstr_free(requests);
+	return (ret);
 }
 
 static int
@@ -375,7 +475,7 @@ proto_recv(mdata_proto_t *mdp)
 	int ret = -1;
 	string_t *line = dynstr_new();
 
-	for (;;) {
+	while (mdp->mdp_nsent > 0) {
 		int recv_timeout_ms = mdp->mdp_version == MDPV_VERSION_2 ?
 		    RECV_TIMEOUT_MS_V2 : RECV_TIMEOUT_MS;
 
@@ -386,9 +486,6 @@ proto_recv(mdata_proto_t *mdp)
 
 		process_input(mdp, line);
 		dynstr_reset(line);
-
-		if (mdp->mdp_command->mdc_done)
-			break;
 	}
 
 	ret = 0;
@@ -423,7 +520,7 @@ bail:
  */
 static void
 proto_make_request_v2(const char *command, const char *argument,
-    string_t *output, char *reqidbuf)
+    string_t *output, const char *reqidbuf)
 {
 	char strbuf[23 + 1 + 8 + 1]; /* strlen(UINT64_MAX) + ' ' + %08x + \0 */
 	string_t *body = dynstr_new();
@@ -433,7 +530,7 @@ proto_make_request_v2(const char *command, const char *argument,
 	 * use when generating the Content Length and CRC32 checksum for
 	 * the message HEADER.
 	 */
-	dynstr_append(body, reqid(reqidbuf));
+	dynstr_append(body, reqidbuf);
 	dynstr_append(body, " ");
 	dynstr_append(body, command);
 	if (argument != NULL) {
@@ -468,52 +565,61 @@ proto_make_request_v1(const char *command, const char *argument,
 	dynstr_append(output, "\n");
 }
 
+/*
+ * Run "count" commands, returning 0 once every one of them has a response.
+ * Over the V2 protocol all of the requests are sent together, so the whole
+ * batch costs about one round trip to the host rather than one per command.
+ */
 int
-proto_execute(mdata_proto_t *mdp, const char *command, const char *argument,
-    mdata_response_t *response, string_t **response_data)
+proto_execute_many(mdata_proto_t *mdp, mdata_request_t *mdq, size_t count)
 {
-	mdata_command_t mdc;
-
-	/*
-	 * Initialise new command structure:
-	 */
-	bzero(&mdc, sizeof (mdc));
-	mdc.mdc_request = dynstr_new();
-	mdc.mdc_response_data = dynstr_new();
-	mdc.mdc_response = MDR_PENDING;
-	mdc.mdc_done = 0;
+	mdata_command_t *mdc;
+	size_t i;
+	int ret = -1;
 
-	VERIFY0(mdp->mdp_command);
-	mdp->mdp_command = &mdc;
+	VERIFY(count > 0);
 
-retry:
 	/*
-	 * (Re-)generate request string to send to remote peer:
+	 * Initialise new command structures:
 	 */
-	dynstr_reset(mdc.mdc_request);
-	switch (mdp->mdp_version) {
-	case MDPV_VERSION_1:
-		proto_make_request_v1(command, argument, mdc.mdc_request);
-		break;
-	case MDPV_VERSION_2:
-		proto_make_request_v2(command, argument, mdc.mdc_request,
-		    mdc.mdc_reqid);
-		break;
-	default:
-		ABORT("unknown protocol version");
+	if ((mdc = calloc(count, sizeof (*mdc))) == NULL)
+		return (-1);
+	for (i = 0; i < count; i++) {
+		mdc[i].mdc_name = mdq[i].mdq_command;
+		mdc[i].mdc_argument = mdq[i].mdq_argument;
+		mdc[i].mdc_response_data = dynstr_new();
+		mdc[i].mdc_response = MDR_PENDING;
 	}
 
-	/*
-	 * Attempt to send the request to the remote peer:
-	 */
-	if (mdp->mdp_state == MDPS_ERROR || proto_send(mdp) != 0 ||
-	    proto_recv(mdp) != 0) {
+	VERIFY0(mdp->mdp_commands);
+	mdp->mdp_commands = mdc;
+	mdp->mdp_ncommands = count;
+
+	for (;;) {
+		for (i = 0; i < count && mdc[i].mdc_done; i++)
+			;
+		if (i == count)
+			break;
+
+		/*
+		 * Attempt to send the requests to the remote peer, and
+		 * wait for the responses:
+		 */
+		if (mdp->mdp_state != MDPS_ERROR && proto_send(mdp) == 0 &&
+		    proto_recv(mdp) == 0)
+			continue;
+
 		/*
 		 * Discard existing response data and reset the command
-		 * state:
+		 * state for anything not yet done:
 		 */
-		dynstr_reset(mdp->mdp_command->mdc_response_data);
-		mdc.mdc_response = MDR_PENDING;
+		for (i = 0; i < count; i++) {
+			if (mdc[i].mdc_done)
+				continue;
+			dynstr_reset(mdc[i].mdc_response_data);
+			mdc[i].mdc_response = MDR_PENDING;
+			mdc[i].mdc_sent = 0;
+		}
 
 		/*
 		 * If the command we're trying to send is part of a
@@ -540,11 +646,6 @@ retry:
 			 *    "%s\n", mdp->mdp_errmsg);
 			 */
 			goto bail;
-		} else {
-			/*
-			 * We were able to reset OK, so keep trying.
-			 */
-			goto retry;
 		}
 	}
 
@@ -552,20 +653,163 @@ retry:
 		ABORT("proto state not MDPS_READY\n");
 
 	/*
-	 * We were able to send a command and receive a response.
-	 * Examine the response and decide what to do:
+	 * We were able to send every command and receive a response to
+	 * each.  Pass the responses back to the caller to examine:
 	 */
-	*response = mdc.mdc_response;
-	*response_data = mdc.mdc_response_data;
-	dynstr_free(mdc.mdc_request);
-	mdp->mdp_command = NULL;
-	return (0);
+	for (i = 0; i < count; i++) {
+		mdq[i].mdq_response = mdc[i].mdc_response;
+		mdq[i].mdq_response_data = mdc[i].mdc_response_data;
+	}
+	ret = 0;
 
 bail:
-	dynstr_free(mdc.mdc_request);
-	dynstr_free(mdc.mdc_response_data);
+	if (ret != 0) {
+		for (i = 0; i < count; i++)
+			dynstr_free(mdc[i].mdc_response_data);
+	}
+	free(mdc);
+	mdp->mdp_commands = NULL;
+	mdp->mdp_ncommands = 0;
 	mdp->mdp_command = NULL;
-	return (-1);
+	return (ret);
+}
+
+/*
+ * Parse the response to GETMANY, a JSON object that maps each key that has a
+ * value to that value, into a response for each of the GET requests.
+ */
+static int
+proto_parse_getmany(const char *json, mdata_request_t *mdq, size_t count)
+{
+	const char *p = json_skip_ws(json);
+	string_t *key = dynstr_new();
+	string_t *value = dynstr_new();
+	size_t i;
+	int ret = -1;
+
+	for (i = 0; i < count; i++) {
+		mdq[i].mdq_response = MDR_NOTFOUND;
+		mdq[i].mdq_response_data = dynstr_new();
+	}
+
+	if (*p++ != '{')
+		goto bail;
+
+	for (p = json_skip_ws(p); *p != '}'; p = json_skip_ws(p + 1)) {
+		dynstr_reset(key);
+		dynstr_reset(value);
+
+		if (json_parse_string(&p, key) != 0)
+			goto bail;
+		p = json_skip_ws(p);
+		if (*p++ != ':')
+			goto bail;
+		p = json_skip_ws(p);
+		if (json_parse_string(&p, value) != 0)
+			goto bail;
+
+		for (i = 0; i < count; i++) {
+			if (strlen(mdq[i].mdq_argument) != dynstr_len(key) ||
+			    strcmp(mdq[i].mdq_argument, dynstr_cstr(key)) != 0)
+				continue;
+
+			mdq[i].mdq_response = MDR_SUCCESS;
+			dynstr_reset(mdq[i].mdq_response_data);
+			dynstr_append_len(mdq[i].mdq_response_data,
+			    dynstr_cstr(value), dynstr_len(value));
+		}
+
+		p = json_skip_ws(p);
+		if (*p == '}')
+			break;
+		if (*p != ',')
+			goto bail;
+	}
+
+	if (*json_skip_ws(p + 1) != '\0')
+		goto bail;
+
+	ret = 0;
+
+bail:
+	if (ret != 0) {
+		for (i = 0; i < count; i++) {
+			dynstr_free(mdq[i].mdq_response_data);
+			mdq[i].mdq_response_data = NULL;
+		}
+	}
+	dynstr_free(key);
+	dynstr_free(value);
+	return (ret);
+}
+
+/*
+ * GET the key named by the mdq_argument of each of "count" requests, filling
+ * in the responses as proto_execute_many() would.
+ *
+ * If the host speaks V2, we first try asking for every key at once with the
+ * GETMANY command, which takes a JSON array of key names.  Hosts that don't
+ * support GETMANY answer FAILURE as for any unknown command; we remember that
+ * until the connection is reset, and send a GET for each key instead.  The
+ * GETs are pipelined, so they still take only about one round trip.
+ */
+int
+proto_get_many(mdata_proto_t *mdp, mdata_request_t *mdq, size_t count)
+{
+	mdata_request_t getmany;
+	string_t *keys;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < count; i++)
+		mdq[i].mdq_command = "GET";
+
+	if (count < 2 || mdp->mdp_version != MDPV_VERSION_2 ||
+	    mdp->mdp_no_getmany)
+		return (proto_execute_many(mdp, mdq, count));
+
+	keys = dynstr_new();
+	dynstr_appendc(keys, '[');
+	for (i = 0; i < count; i++) {
+		if (i > 0)
+			dynstr_appendc(keys, ',');
+		json_append_string(keys, mdq[i].mdq_argument,
+		    strlen(mdq[i].mdq_argument));
+	}
+	dynstr_appendc(keys, ']');
+
+	getmany.mdq_command = "GETMANY";
+	getmany.mdq_argument = dynstr_cstr(keys);
+	ret = proto_execute_many(mdp, &getmany, 1);
+	dynstr_free(keys);
+	if (ret != 0)
+		return (-1);
+
+	ret = getmany.mdq_response == MDR_SUCCESS ? proto_parse_getmany(
+	    dynstr_cstr(getmany.mdq_response_data), mdq, count) : -1;
+	dynstr_free(getmany.mdq_response_data);
+	if (ret == 0)
+		return (0);
+
+	mdp->mdp_no_getmany = B_TRUE;
+	return (proto_execute_many(mdp, mdq, count));
+}
+
+int
+proto_execute(mdata_proto_t *mdp, const char *command, const char *argument,
+    mdata_response_t *response, string_t **response_data)
+{
+	mdata_request_t mdq;
+
+	mdq.mdq_command = command;
+	mdq.mdq_argument = argument;
+
+	if (proto_execute_many(mdp, &mdq, 1) != 0)
+		return (-1);
+
+	*response = mdq.mdq_response;
+	*response_data = mdq.mdq_response_data;
+	return (0);
 }
 
 int
@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2013, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  * See LICENSE file for copyright and license details.
  */
 
@@ -21,10 +22,25 @@ typedef enum mdata_response {
 
 typedef struct mdata_proto mdata_proto_t;
 
+/*
+ * A command for proto_execute_many().  The caller fills in the command and
+ * (optional) argument, and on success gets back the response and response
+ * data, which the caller must free with dynstr_free().  For proto_get_many(),
+ * the argument is the key to GET, and the command is filled in for you.
+ */
+typedef struct mdata_request {
+	const char *mdq_command;
+	const char *mdq_argument;
+	mdata_response_t mdq_response;
+	string_t *mdq_response_data;
+} mdata_request_t;
+
 int proto_init(mdata_proto_t **, char **);
 int proto_version(mdata_proto_t *);
 int proto_execute(mdata_proto_t *, const char *, const char *, mdata_response_t *,
     string_t **);
+int proto_execute_many(mdata_proto_t *, mdata_request_t *, size_t);
+int proto_get_many(mdata_proto_t *, mdata_request_t *, size_t);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+/*
+ * crc32_test: check crc32_calc() against a bitwise CRC32, and optionally
+ * measure its throughput.
+ *
+ * Usage: crc32_test [-b] [-r rounds] [size ...]
+ *
+ * Without -b, checks the standard check value, a V2 frame as agent.js would
+ * checksum it, and buffers of every length up to 1K (and some larger ones) at
+ * every alignment, exiting non-zero on the first mismatch.
+ *
+ * With -b, times crc32_calc() over buffers of each size (default 64, 1K, 64K
+ * and 1M; a K or M suffix is allowed), along with the bytewise table lookup
+ * it replaced.  The result is the best of <rounds> runs, printed as
+ * "name size value unit".
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32.h"
+
+#define	DEFAULT_ROUNDS	3
+#define	BENCH_BYTES	(256 * 1024 * 1024)
+#define	CRC32_POLY	0xedb88320
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: crc32_test [-b] [-r rounds] [size ...]\n");
+	exit(2);
+}
+
+static long
+parse_size(const char *str)
+{
+	char *endp;
+	long size = strtol(str, &endp, 10);
+
+	if (*endp == 'K' || *endp == 'k') {
+		size *= 1024;
+		endp++;
+	} else if (*endp == 'M' || *endp == 'm') {
+		size *= 1024 * 1024;
+		endp++;
+	}
+	if (size <= 0 || *endp != '\0')
+		usage();
+
+	return (size);
+}
+
+/*
+ * The reference: one bit at a time, straight from the polynomial.
+ */
+static uint32_t
+crc32_bitwise(const char *buf, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+	size_t i;
+	int b;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint8_t)buf[i];
+		for (b = 0; b < 8; b++)
+			crc = (crc >> 1) ^ (CRC32_POLY & -(crc & 1));
+	}
+
+	return (~crc);
+}
+
+/*
+ * What crc32_calc() did before slice-by-8, for comparison in the benchmark.
+ */
+static uint32_t crc32_bytewise_table[256];
+
+static uint32_t
+crc32_bytewise(const char *buf, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		crc = crc32_bytewise_table[(crc ^ (uint8_t)buf[i]) & 0xff] ^
+		    (crc >> 8);
+	}
+
+	return (~crc);
+}
+
+static void
+check(const char *what, const char *buf, size_t len, uint32_t expected)
+{
+	uint32_t crc = crc32_calc(buf, len);
+
+	if (crc != expected) {
+		errx(1, "%s (len %u): got %08x, expected %08x", what,
+		    (unsigned int)len, crc, expected);
+	}
+}
+
+static void
+test(void)
+{
+	static const char frame[] = "dc4fae17 SUCCESS W10=";
+	static const size_t large[] = { 4095, 4096, 4097, 65536 + 7,
+	    1024 * 1024 + 3 };
+	char *buf;
+	size_t len, off;
+	unsigned int i;
+
+	check("check value", "123456789", 9, 0xcbf43926);
+	check("V2 frame", frame, strlen(frame), 0x265ae1d8);
+	check("empty", "", 0, 0);
+
+	if ((buf = malloc(1024 * 1024 + 16)) == NULL)
+		err(1, "malloc");
+	for (i = 0; i < 1024 * 1024 + 16; i++)
+		buf[i] = (char)(rand() & 0xff);
+
+	for (len = 0; len <= 1024; len++) {
+		for (off = 0; off < 8; off++) {
+			check("random", buf + off, len,
+			    crc32_bitwise(buf + off, len));
+		}
+	}
+	for (i = 0; i < sizeof (large) / sizeof (large[0]); i++) {
+		for (off = 0; off < 8; off++) {
+			check("random", buf + off, large[i],
+			    crc32_bitwise(buf + off, large[i]));
+		}
+	}
+
+	free(buf);
+	printf("crc32_test: ok\n");
+}
+
+static void
+bench(long size, int rounds)
+{
+	long count = BENCH_BYTES / size;
+	uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+	uint64_t start;
+	uint64_t t;
+	volatile uint32_t sink;
+	char *buf;
+	long i;
+	int r;
+
+	if (count == 0)
+		count = 1;
+
+	if ((buf = malloc(size)) == NULL)
+		err(1, "malloc");
+	for (i = 0; i < size; i++)
+		buf[i] = (char)(rand() & 0xff);
+
+	for (r = 0; r < rounds; r++) {
+		start = now_ns();
+		for (i = 0; i < count; i++)
+			sink = crc32_calc(buf, size);
+		if ((t = now_ns() - start) < best[0])
+			best[0] = t;
+
+		start = now_ns();
+		for (i = 0; i < count; i++)
+			sink = crc32_bytewise(buf, size);
+		if ((t = now_ns() - start) < best[1])
+			best[1] = t;
+	}
+	(void) sink;
+
+	printf("crc32_rate %ld %.1f MB/s\n", size,
+	    (double)size * count / (1024 * 1024) / (best[0] / 1e9));
+	printf("crc32_bytewise_rate %ld %.1f MB/s\n", size,
+	    (double)size * count / (1024 * 1024) / (best[1] / 1e9));
+
+	free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+	static long default_sizes[] = { 64, 1024, 64 * 1024, 1024 * 1024 };
+	int rounds = DEFAULT_ROUNDS;
+	int do_bench = 0;
+	uint32_t c;
+	int opt;
+	int i, b;
+
+	while ((opt = getopt(argc, argv, "br:")) != -1) {
+		switch (opt) {
+		case 'b':
+			do_bench = 1;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (rounds <= 0)
+		usage();
+
+	srand(1);
+
+	if (!do_bench) {
+		test();
+		return (0);
+	}
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (b = 0; b < 8; b++)
+			c = (c >> 1) ^ (CRC32_POLY & -(c & 1));
+		crc32_bytewise_table[i] = c;
+	}
+
+	if (optind == argc) {
+		for (i = 0; i < 4; i++)
+			bench(default_sizes[i], rounds);
+	} else {
+		for (i = optind; i < argc; i++)
+			bench(parse_size(argv[i]), rounds);
+	}
+
+	return (0);
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+/*
+ * getmany_test: check proto_get_many() against a local mdata_server.
+ *
+ * Usage: getmany_test
+ *
+ * Fetches a set of keys (with awkward names and values, missing keys and a
+ * duplicate) from an mdata_server started from the same directory as this
+ * program, once as a current agent, once as an agent that predates GETMANY
+ * (-g), and once as one that predates V2 (-1).  Every key must come back the
+ * same as with a GET, and the server's log of requests (-v) must show that
+ * GETMANY was used where it is supported, tried only once where it isn't,
+ * and not tried at all over V1.  Also checks the JSON string helpers.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "dynstr.h"
+#include "json.h"
+#include "proto.h"
+
+static const char *test_keys[] = {
+	"plain",
+	"nosuchkey",
+	"multi",
+	"we\"ird\\key",
+	"unicode",
+	"bytes:100000",
+	"plain",
+	"empty"
+};
+
+#define	NKEYS	(sizeof (test_keys) / sizeof (test_keys[0]))
+
+static const char multi_value[] = "line 1\nline \"2\"\t\\\x01\n.";
+
+static void
+check_json(void)
+{
+	static const char escaped[] = "\"caf\\u00e9 \\ud83d\\ude00 \\ud800 "
+	    "\\\"\\\\\\/\\b\\f\\n\\r\\t\" trailing";
+	static const char expected[] = "caf\xc3\xa9 \xf0\x9f\x98\x80 "
+	    "\xef\xbf\xbd \"\\/\b\f\n\r\t";
+	string_t *str = dynstr_new();
+	string_t *back = dynstr_new();
+	const char *p;
+	char all[255];
+	int i;
+
+	p = escaped;
+	if (json_parse_string(&p, str) != 0 ||
+	    strcmp(dynstr_cstr(str), expected) != 0 ||
+	    strcmp(p, " trailing") != 0)
+		errx(1, "json_parse_string: wrong result");
+
+	p = "\"unterminated";
+	if (json_parse_string(&p, str) == 0)
+		errx(1, "json_parse_string: accepted unterminated string");
+	p = "\"bad \\x escape\"";
+	if (json_parse_string(&p, str) == 0)
+		errx(1, "json_parse_string: accepted bad escape");
+
+	/*
+	 * Every byte but NUL should survive a round trip:
+	 */
+	for (i = 0; i < 255; i++)
+		all[i] = (char)(i + 1);
+	dynstr_reset(str);
+	json_append_string(str, all, sizeof (all));
+	p = dynstr_cstr(str);
+	if (json_parse_string(&p, back) != 0 || *p != '\0' ||
+	    dynstr_len(back) != sizeof (all) ||
+	    memcmp(dynstr_cstr(back), all, sizeof (all)) != 0)
+		errx(1, "json_append_string: round trip failed");
+
+	dynstr_free(str);
+	dynstr_free(back);
+}
+
+static pid_t
+start_server(const char *argv0, const char *sockpath, const char *logpath,
+    const char *mode)
+{
+	char server[1024];
+	const char *slash = strrchr(argv0, '/');
+	char multi[64];
+	char *args[16];
+	struct stat st;
+	pid_t pid;
+	int fd;
+	int i = 0;
+
+	(void) snprintf(server, sizeof (server), "%.*smdata_server",
+	    slash == NULL ? 0 : (int)(slash - argv0 + 1), argv0);
+	(void) snprintf(multi, sizeof (multi), "multi=%s", multi_value);
+
+	args[i++] = server;
+	args[i++] = "-v";
+	if (mode != NULL)
+		args[i++] = (char *)mode;
+	args[i++] = "-k";
+	args[i++] = "plain=value";
+	args[i++] = "-k";
+	args[i++] = multi;
+	args[i++] = "-k";
+	args[i++] = "we\"ird\\key=weird=value";
+	args[i++] = "-k";
+	args[i++] = "unicode=\xe2\x98\x83 \xf0\x9f\x98\x80";
+	args[i++] = "-k";
+	args[i++] = "empty=";
+	args[i++] = (char *)sockpath;
+	args[i] = NULL;
+
+	(void) unlink(sockpath);
+
+	if ((pid = fork()) == -1)
+		err(1, "fork");
+	if (pid == 0) {
+		if ((fd = open(logpath, O_WRONLY | O_CREAT | O_TRUNC,
+		    0644)) == -1 || dup2(fd, 2) == -1)
+			err(1, "could not redirect stderr to %s", logpath);
+		(void) execv(server, args);
+		err(1, "exec %s", server);
+	}
+
+	for (i = 0; i < 500; i++) {
+		if (stat(sockpath, &st) == 0)
+			return (pid);
+		(void) usleep(10 * 1000);
+	}
+
+	errx(1, "%s did not create %s", server, sockpath);
+	return (-1);
+}
+
+/*
+ * Count the requests for a command in the server log.
+ */
+static int
+count_requests(const char *logpath, const char *command)
+{
+	char line[256];
+	char want[64];
+	FILE *f;
+	int n = 0;
+
+	(void) snprintf(want, sizeof (want), "mdata_server: request %s\n",
+	    command);
+
+	if ((f = fopen(logpath, "r")) == NULL)
+		err(1, "fopen %s", logpath);
+	while (fgets(line, sizeof (line), f) != NULL) {
+		if (strcmp(line, want) == 0)
+			n++;
+	}
+	(void) fclose(f);
+
+	return (n);
+}
+
+static void
+check_results(const char *mode, mdata_request_t *mdq)
+{
+	size_t i;
+
+	for (i = 0; i < NKEYS; i++) {
+		const char *want = NULL;
+		const char *got = dynstr_cstr(mdq[i].mdq_response_data);
+
+		if (strcmp(test_keys[i], "plain") == 0)
+			want = "value";
+		else if (strcmp(test_keys[i], "multi") == 0)
+			want = multi_value;
+		else if (strcmp(test_keys[i], "we\"ird\\key") == 0)
+			want = "weird=value";
+		else if (strcmp(test_keys[i], "unicode") == 0)
+			want = "\xe2\x98\x83 \xf0\x9f\x98\x80";
+		else if (strcmp(test_keys[i], "empty") == 0)
+			want = "";
+
+		if (strcmp(test_keys[i], "bytes:100000") == 0) {
+			if (mdq[i].mdq_response != MDR_SUCCESS ||
+			    dynstr_len(mdq[i].mdq_response_data) != 100000)
+				errx(1, "%s: wrong result for %s", mode,
+				    test_keys[i]);
+		} else if (want == NULL) {
+			if (mdq[i].mdq_response != MDR_NOTFOUND)
+				errx(1, "%s: found %s", mode, test_keys[i]);
+		} else if (mdq[i].mdq_response != MDR_SUCCESS ||
+		    strcmp(got, want) != 0) {
+			errx(1, "%s: wrong result for %s: \"%s\"", mode,
+			    test_keys[i], got);
+		}
+
+		dynstr_free(mdq[i].mdq_response_data);
+	}
+}
+
+int
+main(int argc __UNUSED, char **argv)
+{
+	static const struct {
+		const char *mode;	/* server option */
+		int getmany;		/* GETMANY requests expected */
+		int get;		/* GET requests expected */
+	} modes[] = {
+		{ NULL, 2, 0 },
+		{ "-g", 1, 2 * NKEYS },
+		{ "-1", 0, 2 * NKEYS }
+	};
+	char sockpath[64];
+	char logpath[64];
+	mdata_request_t mdq[NKEYS];
+	mdata_proto_t *mdp;
+	char *errmsg = NULL;
+	unsigned int m;
+	size_t i;
+	int round;
+	pid_t pid;
+
+	check_json();
+
+	(void) snprintf(sockpath, sizeof (sockpath), "/tmp/getmany_test.%d",
+	    (int)getpid());
+	(void) snprintf(logpath, sizeof (logpath), "/tmp/getmany_test.%d.log",
+	    (int)getpid());
+	if (setenv("MDATA_SOCKET_PATH", sockpath, 1) != 0)
+		err(1, "setenv");
+
+	for (m = 0; m < sizeof (modes) / sizeof (modes[0]); m++) {
+		const char *mode = modes[m].mode != NULL ? modes[m].mode :
+		    "default";
+
+		pid = start_server(argv[0], sockpath, logpath, modes[m].mode);
+
+		if (proto_init(&mdp, &errmsg) != 0) {
+			(void) kill(pid, SIGTERM);
+			errx(1, "could not connect to mdata_server: %s",
+			    errmsg != NULL ? errmsg : "?");
+		}
+
+		/*
+		 * Twice, so that we see whether a refusal is remembered:
+		 */
+		for (round = 0; round < 2; round++) {
+			for (i = 0; i < NKEYS; i++)
+				mdq[i].mdq_argument = test_keys[i];
+			if (proto_get_many(mdp, mdq, NKEYS) != 0)
+				errx(1, "%s: proto_get_many failed", mode);
+			check_results(mode, mdq);
+		}
+
+		(void) kill(pid, SIGTERM);
+		(void) waitpid(pid, NULL, 0);
+
+		if (count_requests(logpath, "GETMANY") != modes[m].getmany ||
+		    count_requests(logpath, "GET") != modes[m].get) {
+			errx(1, "%s: expected %d GETMANY and %d GET requests, "
+			    "got %d and %d", mode, modes[m].getmany,
+			    modes[m].get, count_requests(logpath, "GETMANY"),
+			    count_requests(logpath, "GET"));
+		}
+	}
+
+	(void) unlink(sockpath);
+	(void) unlink(logpath);
+
+	printf("getmany_test: ok\n");
+	return (0);
+}
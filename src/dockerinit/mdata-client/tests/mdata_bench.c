@@ -0,0 +1,262 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+/*
+ * mdata_bench: measure GET throughput against a local mdata_server.
+ *
+ * Usage: mdata_bench [-1g] [-l latency_ms] [-r rounds] [size ...]
+ *
+ * Starts the mdata_server from the same directory as this program on a
+ * temporary socket, connects to it with the client protocol code (via
+ * MDATA_SOCKET_PATH), and times GETs of "bytes:<size>" keys for each size
+ * (default 1K, 16K, 256K, 1M and 8M; a K or M suffix is allowed).  The -1,
+ * -g and -l options are passed on to the server.
+ *
+ * Each size is fetched enough times to move at least 64MB, first with one
+ * proto_execute() call per GET (get_*), and then in batches of keys passed
+ * to proto_get_many() (getmany_*), which uses the GETMANY command unless the
+ * server was started with -g.  The result is the best of <rounds> runs,
+ * printed as "name size value unit".
+ */
+
+#include <err.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "dynstr.h"
+#include "proto.h"
+
+#define	DEFAULT_ROUNDS	3
+#define	BENCH_BYTES	(64 * 1024 * 1024)
+#define	BENCH_BATCH	16
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: mdata_bench [-1g] [-l latency_ms] [-r rounds] "
+	    "[size ...]\n");
+	exit(2);
+}
+
+static long
+parse_size(const char *str)
+{
+	char *endp;
+	long size = strtol(str, &endp, 10);
+
+	if (*endp == 'K' || *endp == 'k') {
+		size *= 1024;
+		endp++;
+	} else if (*endp == 'M' || *endp == 'm') {
+		size *= 1024 * 1024;
+		endp++;
+	}
+	if (size <= 0 || *endp != '\0')
+		usage();
+
+	return (size);
+}
+
+static pid_t
+start_server(const char *argv0, const char *sockpath, int v1, int no_getmany,
+    const char *latency)
+{
+	char server[1024];
+	const char *slash = strrchr(argv0, '/');
+	char *args[7];
+	struct stat st;
+	pid_t pid;
+	int i = 0;
+
+	(void) snprintf(server, sizeof (server), "%.*smdata_server",
+	    slash == NULL ? 0 : (int)(slash - argv0 + 1), argv0);
+
+	args[i++] = server;
+	if (v1)
+		args[i++] = "-1";
+	if (no_getmany)
+		args[i++] = "-g";
+	if (latency != NULL) {
+		args[i++] = "-l";
+		args[i++] = (char *)latency;
+	}
+	args[i++] = (char *)sockpath;
+	args[i] = NULL;
+
+	(void) unlink(sockpath);
+
+	if ((pid = fork()) == -1)
+		err(1, "fork");
+	if (pid == 0) {
+		(void) execv(server, args);
+		err(1, "exec %s", server);
+	}
+
+	/*
+	 * Wait for the server to start listening, rather than have the client
+	 * back off and retry:
+	 */
+	for (i = 0; i < 500; i++) {
+		if (stat(sockpath, &st) == 0)
+			return (pid);
+		(void) usleep(10 * 1000);
+	}
+
+	errx(1, "%s did not create %s", server, sockpath);
+	return (-1);
+}
+
+static void
+report(const char *name, long size, uint64_t ns, long count)
+{
+	printf("%s_rate %ld %.1f MB/s\n", name, size,
+	    (double)size * count / (1024 * 1024) / (ns / 1e9));
+	printf("%s_latency %ld %.1f us/op\n", name, size, ns / 1e3 / count);
+}
+
+static void
+bench(mdata_proto_t *mdp, long size, int rounds)
+{
+	char key[32];
+	long count = BENCH_BYTES / size;
+	uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+	uint64_t start;
+	uint64_t t;
+	mdata_response_t mdr;
+	mdata_request_t mdq[BENCH_BATCH];
+	char batchkeys[BENCH_BATCH][32];
+	string_t *data;
+	long i;
+	int j;
+	int r;
+
+	/* a whole number of batches, and at least one */
+	count = (count + BENCH_BATCH - 1) / BENCH_BATCH * BENCH_BATCH;
+
+	(void) snprintf(key, sizeof (key), "bytes:%ld", size);
+	for (j = 0; j < BENCH_BATCH; j++) {
+		(void) snprintf(batchkeys[j], sizeof (batchkeys[j]),
+		    "bytes:%ld.%d", size, j);
+	}
+
+	for (r = 0; r < rounds; r++) {
+		start = now_ns();
+		for (i = 0; i < count; i++) {
+			if (proto_execute(mdp, "GET", key, &mdr, &data) != 0)
+				errx(1, "GET %s failed", key);
+			if (mdr != MDR_SUCCESS ||
+			    dynstr_len(data) != (size_t)size)
+				errx(1, "GET %s: bad response", key);
+			dynstr_free(data);
+		}
+		if ((t = now_ns() - start) < best[0])
+			best[0] = t;
+
+		start = now_ns();
+		for (i = 0; i < count; i += BENCH_BATCH) {
+			for (j = 0; j < BENCH_BATCH; j++)
+				mdq[j].mdq_argument = batchkeys[j];
+			if (proto_get_many(mdp, mdq, BENCH_BATCH) != 0)
+				errx(1, "GET %s failed", key);
+			for (j = 0; j < BENCH_BATCH; j++) {
+				if (mdq[j].mdq_response != MDR_SUCCESS ||
+				    dynstr_len(mdq[j].mdq_response_data) !=
+				    (size_t)size)
+					errx(1, "GET %s: bad response", key);
+				dynstr_free(mdq[j].mdq_response_data);
+			}
+		}
+		if ((t = now_ns() - start) < best[1])
+			best[1] = t;
+	}
+
+	report("get", size, best[0], count);
+	report("getmany", size, best[1], count);
+}
+
+int
+main(int argc, char **argv)
+{
+	static long default_sizes[] = { 1024, 16 * 1024, 256 * 1024,
+	    1024 * 1024, 8 * 1024 * 1024 };
+	char sockpath[64];
+	int rounds = DEFAULT_ROUNDS;
+	int v1 = 0;
+	int no_getmany = 0;
+	char *latency = NULL;
+	mdata_proto_t *mdp;
+	char *errmsg = NULL;
+	pid_t pid;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "1gl:r:")) != -1) {
+		switch (opt) {
+		case '1':
+			v1 = 1;
+			break;
+		case 'g':
+			no_getmany = 1;
+			break;
+		case 'l':
+			latency = optarg;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (rounds <= 0)
+		usage();
+
+	(void) snprintf(sockpath, sizeof (sockpath), "/tmp/mdata_bench.%d",
+	    (int)getpid());
+	pid = start_server(argv[0], sockpath, v1, no_getmany, latency);
+
+	if (setenv("MDATA_SOCKET_PATH", sockpath, 1) != 0)
+		err(1, "setenv");
+	if (proto_init(&mdp, &errmsg) != 0) {
+		(void) kill(pid, SIGTERM);
+		errx(1, "could not connect to mdata_server: %s",
+		    errmsg != NULL ? errmsg : "?");
+	}
+
+	if (optind == argc) {
+		for (i = 0; i < 5; i++)
+			bench(mdp, default_sizes[i], rounds);
+	} else {
+		for (i = optind; i < argc; i++)
+			bench(mdp, parse_size(argv[i]), rounds);
+	}
+
+	(void) kill(pid, SIGTERM);
+	(void) waitpid(pid, NULL, 0);
+	(void) unlink(sockpath);
+
+	return (0);
+}
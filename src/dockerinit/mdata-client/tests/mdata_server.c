@@ -0,0 +1,550 @@
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ * See LICENSE file for copyright and license details.
+ */
+
+/*
+ * mdata_server: a stand-in for the metadata agent, for testing and
+ * benchmarking the client without a hypervisor.
+ *
+ * Usage: mdata_server [-1gv] [-l latency_ms] [-k key=value ...] socket_path
+ *
+ * Listens on a UNIX socket at socket_path and answers the same V1 and V2
+ * requests as the SmartOS metadata agent (vm/lib/metadata/agent.js), in the
+ * same way: GET, KEYS and NEGOTIATE, plus PUT, DELETE and GETMANY over V2.
+ * With -1 it answers like an agent that predates V2, and so refuses to
+ * negotiate, and with -g like one that predates GETMANY.  With -l it waits
+ * that long before answering whatever requests arrive in each read, to stand
+ * in for the round trip over a serial port.  With -v it reports each
+ * connection it accepts and each request on stderr.
+ *
+ * Keys start out as given with -k and can be changed with PUT and DELETE.
+ * A GET of "bytes:<n>" (or "bytes:<n>.<anything>") that isn't otherwise set
+ * returns <n> bytes of generated text, so that clients can be tested with
+ * values of any size.
+ *
+ * Pass the socket path to the client tools in MDATA_SOCKET_PATH.
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "dynstr.h"
+#include "base64.h"
+#include "crc32.h"
+#include "json.h"
+
+#define	MAX_CLIENTS	64
+#define	READ_SIZE	(64 * 1024)
+
+typedef struct mds_key {
+	char *mk_name;
+	string_t *mk_value;
+	struct mds_key *mk_next;
+} mds_key_t;
+
+static mds_key_t *keys;
+static boolean_t v1_only = B_FALSE;
+static boolean_t no_getmany = B_FALSE;
+static unsigned int latency_ms = 0;
+static boolean_t verbose = B_FALSE;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: mdata_server [-1gv] [-l latency_ms] "
+	    "[-k key=value ...] socket_path\n");
+	exit(2);
+}
+
+static mds_key_t *
+key_find(const char *name)
+{
+	mds_key_t *mk;
+
+	for (mk = keys; mk != NULL; mk = mk->mk_next) {
+		if (strcmp(mk->mk_name, name) == 0)
+			return (mk);
+	}
+
+	return (NULL);
+}
+
+static void
+key_set(const char *name, const char *value, size_t len)
+{
+	mds_key_t *mk;
+
+	if ((mk = key_find(name)) == NULL) {
+		if ((mk = calloc(1, sizeof (*mk))) == NULL ||
+		    (mk->mk_name = strdup(name)) == NULL)
+			err(1, "could not allocate key");
+		mk->mk_value = dynstr_new();
+		mk->mk_next = keys;
+		keys = mk;
+	}
+
+	dynstr_reset(mk->mk_value);
+	dynstr_append_len(mk->mk_value, value, len);
+}
+
+static boolean_t
+key_delete(const char *name)
+{
+	mds_key_t **mkp;
+	mds_key_t *mk;
+
+	for (mkp = &keys; (mk = *mkp) != NULL; mkp = &mk->mk_next) {
+		if (strcmp(mk->mk_name, name) == 0) {
+			*mkp = mk->mk_next;
+			free(mk->mk_name);
+			dynstr_free(mk->mk_value);
+			free(mk);
+			return (B_TRUE);
+		}
+	}
+
+	return (B_FALSE);
+}
+
+/*
+ * Look up a key for GET, generating the value for "bytes:<n>" keys.
+ * Returns B_FALSE if the key doesn't exist.
+ */
+static boolean_t
+key_get(const char *name, string_t *out)
+{
+	mds_key_t *mk;
+	unsigned long n, i;
+	char *endp;
+	char buf[4096];
+
+	if ((mk = key_find(name)) != NULL) {
+		dynstr_append_len(out, dynstr_cstr(mk->mk_value),
+		    dynstr_len(mk->mk_value));
+		return (B_TRUE);
+	}
+
+	if (strncmp(name, "bytes:", 6) != 0)
+		return (B_FALSE);
+	errno = 0;
+	n = strtoul(name + 6, &endp, 10);
+	if (errno != 0 || endp == name + 6 || (*endp != '\0' && *endp != '.'))
+		return (B_FALSE);
+
+	for (i = 0; i < sizeof (buf); i++)
+		buf[i] = 'a' + i % 26;
+	for (i = 0; i < n; i += sizeof (buf)) {
+		dynstr_append_len(out, buf, n - i < sizeof (buf) ?
+		    n - i : sizeof (buf));
+	}
+
+	return (B_TRUE);
+}
+
+static void
+getmany_add(string_t *out, const char *name, size_t len)
+{
+	string_t *value = dynstr_new();
+
+	if (strlen(name) == len && key_get(name, value)) {
+		dynstr_append(out, dynstr_len(out) > 1 ? "," : "");
+		json_append_string(out, name, len);
+		dynstr_append(out, ":");
+		json_append_string(out, dynstr_cstr(value), dynstr_len(value));
+	}
+
+	dynstr_free(value);
+}
+
+/*
+ * Answer GETMANY as agent.js does: given a JSON array of key names, return a
+ * JSON object mapping those that exist to their values, or with no key names,
+ * every key that KEYS would list.
+ */
+static int
+getmany(const char *arg, string_t *out)
+{
+	string_t *name = dynstr_new();
+	const char *p = json_skip_ws(arg);
+	mds_key_t *mk;
+	int ret = -1;
+
+	dynstr_append(out, "{");
+
+	if (*p == '\0') {
+		for (mk = keys; mk != NULL; mk = mk->mk_next)
+			getmany_add(out, mk->mk_name, strlen(mk->mk_name));
+		ret = 0;
+		goto out;
+	}
+
+	if (*p++ != '[')
+		goto out;
+	for (p = json_skip_ws(p); *p != ']'; p = json_skip_ws(p + 1)) {
+		dynstr_reset(name);
+		if (json_parse_string(&p, name) != 0)
+			goto out;
+		getmany_add(out, dynstr_cstr(name), dynstr_len(name));
+
+		p = json_skip_ws(p);
+		if (*p == ']')
+			break;
+		if (*p != ',')
+			goto out;
+	}
+	if (*json_skip_ws(p + 1) != '\0')
+		goto out;
+	ret = 0;
+
+out:
+	dynstr_append(out, "}");
+	dynstr_free(name);
+	return (ret);
+}
+
+static void
+write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t sz;
+
+	while (len > 0) {
+		if ((sz = write(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			/*
+			 * The client went away; we'll notice when we next
+			 * poll it.
+			 */
+			return;
+		}
+		buf += sz;
+		len -= sz;
+	}
+}
+
+/*
+ * Send a response with the given code (e.g. SUCCESS, NOTFOUND or FAILURE) and
+ * optional value, framed as agent.js would for a V1 or V2 (if reqid is set)
+ * request.
+ */
+static void
+respond(int fd, const char *reqid, const char *code, string_t *value)
+{
+	string_t *out = dynstr_new();
+	string_t *body;
+	char hdr[64];
+	const char *cstr, *lf;
+
+	if (reqid != NULL) {
+		body = dynstr_new();
+		dynstr_append(body, reqid);
+		dynstr_append(body, " ");
+		dynstr_append(body, code);
+		if (value != NULL && dynstr_len(value) > 0) {
+			dynstr_append(body, " ");
+			base64_encode(dynstr_cstr(value), dynstr_len(value),
+			    body);
+		}
+		(void) snprintf(hdr, sizeof (hdr), "V2 %u %08x ",
+		    (unsigned int)dynstr_len(body),
+		    crc32_calc(dynstr_cstr(body), dynstr_len(body)));
+		dynstr_append(out, hdr);
+		dynstr_append_len(out, dynstr_cstr(body), dynstr_len(body));
+		dynstr_append(out, "\n");
+		dynstr_free(body);
+
+	} else if (strcmp(code, "SUCCESS") == 0 && value != NULL) {
+		/*
+		 * V1 sends the value a line at a time, doubling any leading
+		 * "." so that the terminating "." line is unambiguous:
+		 */
+		dynstr_append(out, "SUCCESS\n");
+		cstr = dynstr_cstr(value);
+		do {
+			if ((lf = strchr(cstr, '\n')) == NULL)
+				lf = cstr + strlen(cstr);
+			if (*cstr == '.')
+				dynstr_append(out, ".");
+			dynstr_append_len(out, cstr, lf - cstr);
+			dynstr_append(out, "\n");
+			cstr = lf + 1;
+		} while (*lf != '\0');
+		dynstr_append(out, ".\n");
+
+	} else {
+		dynstr_append(out, code);
+		dynstr_append(out, "\n");
+	}
+
+	write_all(fd, dynstr_cstr(out), dynstr_len(out));
+	dynstr_free(out);
+}
+
+/*
+ * Unbox a V2 request frame, returning the request ID, command and (decoded)
+ * argument.  Frames that don't parse are dropped without a response, as
+ * agent.js does.
+ */
+static int
+parse_v2(char *frame, char **reqid, char **cmd, string_t *arg)
+{
+	char *endp;
+	unsigned long clen;
+	uint32_t crc;
+	char *body;
+	char *b64;
+
+	clen = strtoul(frame, &endp, 10);
+	if (clen == 0 || *endp != ' ')
+		return (-1);
+	crc = strtoul(endp, &endp, 16);
+	if (*endp != ' ')
+		return (-1);
+	body = endp + 1;
+	if (strlen(body) != clen || crc32_calc(body, clen) != crc)
+		return (-1);
+
+	*reqid = body;
+	if ((endp = strchr(body, ' ')) == NULL)
+		return (-1);
+	*endp++ = '\0';
+	*cmd = endp;
+	if ((b64 = strchr(endp, ' ')) != NULL)
+		*b64++ = '\0';
+	else
+		b64 = "";
+
+	return (base64_decode(b64, strlen(b64), arg));
+}
+
+static void
+handle_request(int fd, char *line)
+{
+	char *cmd = line;
+	char *arg;
+	char *reqid = NULL;
+	string_t *argstr = dynstr_new();
+	string_t *value = dynstr_new();
+	mds_key_t *mk;
+	char *sp;
+	size_t len = strlen(line);
+
+	/*
+	 * Like agent.js, ignore trailing whitespace (e.g. a CR):
+	 */
+	while (len > 0 && isspace((unsigned char)line[len - 1]))
+		line[--len] = '\0';
+
+	if ((arg = strchr(line, ' ')) != NULL)
+		*arg++ = '\0';
+
+	if (*cmd == '\0') {
+		respond(fd, NULL, "invalid command", NULL);
+		goto out;
+	}
+
+	if (strcmp(cmd, "V2") == 0 && !v1_only) {
+		if (arg == NULL || parse_v2(arg, &reqid, &cmd, argstr) != 0)
+			goto out;
+		arg = (char *)dynstr_cstr(argstr);
+	}
+
+	if (verbose)
+		fprintf(stderr, "mdata_server: request %s\n", cmd);
+
+	if (strcmp(cmd, "NEGOTIATE") == 0 && reqid == NULL && !v1_only &&
+	    arg != NULL) {
+		respond(fd, NULL, strcmp(arg, "V2") == 0 ? "V2_OK" : "FAILURE",
+		    NULL);
+
+	} else if (strcmp(cmd, "GET") == 0 && arg != NULL && *arg != '\0') {
+		if (key_get(arg, value))
+			respond(fd, reqid, "SUCCESS", value);
+		else
+			respond(fd, reqid, "NOTFOUND", NULL);
+
+	} else if (strcmp(cmd, "GETMANY") == 0 && reqid != NULL &&
+	    !no_getmany) {
+		if (getmany(arg, value) == 0)
+			respond(fd, reqid, "SUCCESS", value);
+		else
+			respond(fd, reqid, "FAILURE", NULL);
+
+	} else if (strcmp(cmd, "KEYS") == 0) {
+		for (mk = keys; mk != NULL; mk = mk->mk_next) {
+			if (dynstr_len(value) > 0)
+				dynstr_append(value, "\n");
+			dynstr_append(value, mk->mk_name);
+		}
+		respond(fd, reqid, "SUCCESS", value);
+
+	} else if (strcmp(cmd, "PUT") == 0 && reqid != NULL) {
+		/*
+		 * The PUT argument is itself a BASE64-encoded key and
+		 * value, separated by a space:
+		 */
+		if ((sp = strchr(arg, ' ')) == NULL ||
+		    base64_decode(arg, sp - arg, value) != 0) {
+			respond(fd, reqid, "FAILURE", NULL);
+			goto out;
+		}
+		dynstr_reset(argstr);
+		if (base64_decode(sp + 1, strlen(sp + 1), argstr) != 0) {
+			respond(fd, reqid, "FAILURE", NULL);
+			goto out;
+		}
+		key_set(dynstr_cstr(value), dynstr_cstr(argstr),
+		    dynstr_len(argstr));
+		dynstr_reset(value);
+		dynstr_append(value, "OK");
+		respond(fd, reqid, "SUCCESS", value);
+
+	} else if (strcmp(cmd, "DELETE") == 0 && reqid != NULL &&
+	    *arg != '\0') {
+		(void) key_delete(arg);
+		dynstr_append(value, "OK");
+		respond(fd, reqid, "SUCCESS", value);
+
+	} else if (reqid != NULL) {
+		respond(fd, reqid, "FAILURE", NULL);
+
+	} else {
+		respond(fd, NULL, "invalid command", NULL);
+	}
+
+out:
+	dynstr_free(argstr);
+	dynstr_free(value);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pollfd pfds[1 + MAX_CLIENTS];
+	string_t *lines[1 + MAX_CLIENTS];
+	struct sockaddr_un ua;
+	char *buf;
+	char *eq;
+	int nfds = 1;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "1gk:l:v")) != -1) {
+		switch (opt) {
+		case '1':
+			v1_only = B_TRUE;
+			break;
+		case 'g':
+			no_getmany = B_TRUE;
+			break;
+		case 'v':
+			verbose = B_TRUE;
+			break;
+		case 'l':
+			latency_ms = atoi(optarg);
+			break;
+		case 'k':
+			if ((eq = strchr(optarg, '=')) == NULL)
+				usage();
+			*eq++ = '\0';
+			key_set(optarg, eq, strlen(eq));
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 1)
+		usage();
+
+	if (strlen(argv[optind]) >= sizeof (ua.sun_path))
+		errx(1, "socket path too long");
+	bzero(&ua, sizeof (ua));
+	ua.sun_family = AF_UNIX;
+	strcpy(ua.sun_path, argv[optind]);
+
+	(void) signal(SIGPIPE, SIG_IGN);
+	(void) unlink(ua.sun_path);
+
+	if ((pfds[0].fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	if (bind(pfds[0].fd, (struct sockaddr *)&ua, sizeof (ua)) == -1)
+		err(1, "bind %s", ua.sun_path);
+	if (listen(pfds[0].fd, 16) == -1)
+		err(1, "listen");
+	pfds[0].events = POLLIN;
+
+	if ((buf = malloc(READ_SIZE)) == NULL)
+		err(1, "malloc");
+
+	for (;;) {
+		if (poll(pfds, nfds, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "poll");
+		}
+
+		for (i = nfds - 1; i > 0; i--) {
+			ssize_t sz;
+			char *start, *lf;
+
+			if (pfds[i].revents == 0)
+				continue;
+
+			if ((sz = read(pfds[i].fd, buf, READ_SIZE)) <= 0) {
+				(void) close(pfds[i].fd);
+				dynstr_free(lines[i]);
+				pfds[i] = pfds[nfds - 1];
+				lines[i] = lines[nfds - 1];
+				nfds--;
+				continue;
+			}
+
+			if (latency_ms > 0 && memchr(buf, '\n', sz) != NULL)
+				(void) usleep(latency_ms * 1000);
+
+			/*
+			 * Handle each complete line, keeping any partial one
+			 * for the next read:
+			 */
+			for (start = buf; (lf = memchr(start, '\n',
+			    buf + sz - start)) != NULL; start = lf + 1) {
+				dynstr_append_len(lines[i], start, lf - start);
+				handle_request(pfds[i].fd,
+				    (char *)dynstr_cstr(lines[i]));
+				dynstr_reset(lines[i]);
+			}
+			dynstr_append_len(lines[i], start, buf + sz - start);
+		}
+
+		if ((pfds[0].revents & POLLIN) && nfds < 1 + MAX_CLIENTS) {
+			if ((pfds[nfds].fd = accept(pfds[0].fd, NULL,
+			    NULL)) == -1) {
+				warn("accept");
+				continue;
+			}
+			pfds[nfds].events = POLLIN;
+			pfds[nfds].revents = 0;
+			lines[nfds] = dynstr_new();
+			dynstr_append(lines[nfds], "");
+			nfds++;
+			if (verbose)
+				fprintf(stderr, "mdata_server: connection\n");
+		}
+	}
+
+	return (0);
+}
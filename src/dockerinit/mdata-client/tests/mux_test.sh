@@ -0,0 +1,149 @@
+#!/bin/bash
+#
+# Copyright 2026 Edgecast Cloud LLC.
+# See LICENSE file for copyright and license details.
+#
+
+#
+# mux_test.sh: run the client tools through mdata-mux, with mdata_server
+# standing in for the metadata agent, and check that:
+#
+#   - get, list, put and delete work as they do against the agent directly,
+#     including values with several lines and leading dots (V1 framing)
+#   - many clients at once all get their own answers
+#   - mdata-mux only ever makes one connection to the agent
+#   - with an agent that only speaks V1, the clients fall back to V1 too
+#
+# Run from the top of mdata-client after a build ("make test").
+#
+
+set -o errexit
+set -o pipefail
+
+DIR=$(mktemp -d /tmp/mux_test.XXXXXX)
+AGENT=$DIR/agent.sock
+MUX=$DIR/mux.sock
+PIDS=
+
+function cleanup
+{
+	[[ -n $PIDS ]] && kill $PIDS 2>/dev/null
+	wait 2>/dev/null
+	rm -rf $DIR
+}
+trap cleanup EXIT
+
+function fail
+{
+	echo "mux_test: FAIL: $*" >&2
+	exit 1
+}
+
+function wait_for_socket
+{
+	local i
+
+	for (( i = 0; i < 500; i++ )); do
+		[[ -S $1 ]] && return 0
+		sleep 0.01
+	done
+	fail "$1 did not appear"
+}
+
+#
+# Start mdata_server with the given options, and mdata-mux in front of it.
+#
+function start
+{
+	PIDS=
+	rm -f $AGENT $MUX
+	./tests/mdata_server -v "$@" $AGENT 2>$DIR/agent.log &
+	PIDS="$PIDS $!"
+	wait_for_socket $AGENT
+	./mdata-mux -u $AGENT $MUX &
+	PIDS="$PIDS $!"
+	wait_for_socket $MUX
+}
+
+function stop
+{
+	kill $PIDS
+	wait 2>/dev/null || true
+	PIDS=
+}
+
+function agent_connections
+{
+	grep -c connection $DIR/agent.log || true
+}
+
+export MDATA_SOCKET_PATH=$MUX
+
+#
+# V2 agent
+#
+start -l 10 -k color=blue -k multi=$'.one\ntwo\n..three'
+
+[[ $(./mdata-get color) == blue ]] || fail "get color"
+[[ $(./mdata-get multi) == $'.one\ntwo\n..three' ]] || fail "get multi"
+./mdata-get nosuchkey 2>/dev/null && fail "get nosuchkey succeeded"
+[[ $? == 1 ]] || fail "get nosuchkey exit status"
+
+./mdata-put shape square || fail "put shape"
+[[ $(./mdata-get shape) == square ]] || fail "get shape"
+./mdata-list | grep -qx shape || fail "list shape"
+./mdata-delete shape || fail "delete shape"
+./mdata-get shape 2>/dev/null && fail "get deleted shape succeeded"
+
+#
+# A value too large for one read, on either side of the mux:
+#
+head -c 300000 /dev/urandom | base64 > $DIR/big
+./mdata-put big < $DIR/big || fail "put big"
+./mdata-get big > $DIR/big.out || fail "get big"
+cmp -s $DIR/big $DIR/big.out || fail "big value differs"
+
+#
+# Many clients at once, each of which must get its own value back:
+#
+GETS=
+for (( i = 1; i <= 100; i++ )); do
+	./mdata-get bytes:$(( i * 37 )) > $DIR/out.$i &
+	GETS="$GETS $!"
+done
+wait $GETS || true
+for (( i = 1; i <= 100; i++ )); do
+	[[ $(head -c -1 $DIR/out.$i | wc -c) == $(( i * 37 )) ]] ||
+	    fail "concurrent get $i"
+done
+
+[[ $(agent_connections) == 1 ]] ||
+    fail "mux made $(agent_connections) connections to the agent"
+
+stop
+
+#
+# V1-only agent: get and list still work, put needs V2.
+#
+start -1 -k color=red
+
+[[ $(./mdata-get color) == red ]] || fail "V1 get color"
+./mdata-list | grep -qx color || fail "V1 list"
+./mdata-put shape circle 2>/dev/null && fail "V1 put succeeded"
+
+GETS=
+for (( i = 1; i <= 20; i++ )); do
+	./mdata-get color > $DIR/out.$i &
+	GETS="$GETS $!"
+done
+wait $GETS || true
+for (( i = 1; i <= 20; i++ )); do
+	[[ $(cat $DIR/out.$i) == red ]] || fail "V1 concurrent get $i"
+done
+
+[[ $(agent_connections) == 1 ]] ||
+    fail "mux made $(agent_connections) connections to the V1 agent"
+
+stop
+
+echo "mux_test: ok"
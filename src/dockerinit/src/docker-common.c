@@ -6,6 +6,7 @@
 
 /*
  * Copyright (c) 2015, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 /*
@@ -34,6 +35,7 @@
 #include <libinetutil.h>
 #include <libnvpair.h>
 #include <limits.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -54,11 +56,13 @@
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include "../json-nvlist/json-nvlist.h"
 #include "../mdata-client/base64.h"
 #include "../mdata-client/common.h"
 #include "../mdata-client/dynstr.h"
+#include "../mdata-client/json.h"
 #include "../mdata-client/plat.h"
 #include "../mdata-client/proto.h"
 #include "strlist.h"
@@ -77,7 +81,6 @@ extern struct passwd *pwd;
 extern struct group *grp;
 
 char fallback[] = "1970-01-01T00:00:00.000Z";
-char timestamp[32];
 
 /*
  * The callback function type for forEachStringInArray().  This function
@@ -96,12 +99,16 @@ static void forEachStringInArray(const char *, nvlist_t *, forEachStringCb_t *,
   void *, void *);
 static int getPathList(strlist_t *, strlist_t *, const char *);
 
+/*
+ * Write the current time into buf (of at least TIMESTAMP_LEN bytes) and return
+ * it.  This uses no static data, so that several boot phases can log at once.
+ */
 char *
-getTimestamp()
+getTimestamp(char *buf)
 {
     char fmt[32];
     struct timeval tv;
-    struct tm *tm;
+    struct tm tm;
 
     /*
      * XXX we don't call fatal() or dlog() because we don't want to create a
@@ -112,20 +119,20 @@ getTimestamp()
         perror("gettimeofday()");
         return (fallback);
     }
-    if ((tm = gmtime(&tv.tv_sec)) == NULL) {
-        perror("gmtime()");
+    if (gmtime_r(&tv.tv_sec, &tm) == NULL) {
+        perror("gmtime_r()");
         return (fallback);
     }
-    if (strftime(fmt, sizeof (fmt), "%Y-%m-%dT%H:%M:%S.%%03uZ", tm) == 0) {
+    if (strftime(fmt, sizeof (fmt), "%Y-%m-%dT%H:%M:%S.%%03uZ", &tm) == 0) {
         perror("strftime()");
         return (fallback);
     }
-    if (snprintf(timestamp, sizeof (timestamp), fmt, (tv.tv_usec / 1000)) < 0) {
+    if (snprintf(buf, TIMESTAMP_LEN, fmt, (tv.tv_usec / 1000)) < 0) {
         perror("snprintf()");
         return (fallback);
     }
 
-    return (timestamp);
+    return (buf);
 }
 
 /*
@@ -140,13 +147,16 @@ getTimestamp()
 void
 fatal(dockerinit_err_t code, char *fmt, ...)
 {
+     char ts[TIMESTAMP_LEN];
      va_list ap;
      va_start(ap, fmt);
 
+     flockfile(log_stream);
      (void) fprintf(log_stream, "%s FATAL (code: %d): ",
-         getTimestamp(), (int)code);
+         getTimestamp(ts), (int)code);
      (void) vfprintf(log_stream, fmt, ap);
      fflush(log_stream);
+     funlockfile(log_stream);
      va_end(ap);
 
     if (code == ERR_UNEXPECTED) {
@@ -156,43 +166,249 @@ fatal(dockerinit_err_t code, char *fmt, ...)
     }
 }
 
+/*
+ * Log a line to log_stream.  The stream is locked for the whole line, so lines
+ * from boot phases running at the same time don't get mixed up.
+ */
 void
 dlog(const char *fmt, ...)
 {
+     char ts[TIMESTAMP_LEN];
      va_list ap;
      va_start(ap, fmt);
-     (void) fprintf(log_stream, "%s ", getTimestamp());
+     flockfile(log_stream);
+     (void) fprintf(log_stream, "%s ", getTimestamp(ts));
      (void) vfprintf(log_stream, fmt, ap);
      fflush(log_stream);
+     funlockfile(log_stream);
      va_end(ap);
 }
 
 /*
- * Contact the hypervisor metadata agent and request the value for the provided
- * key name.  Returns a C string if a value is found, NULL if no value is
- * found, or aborts the program on any other condition.  The caller is expected
- * to call free(3C) on the returned string.
+ * Boot tracing.  traceBegin() records when something starts and traceEnd()
+ * when it finishes, and traceJson() turns the lot into a JSON trace, with one
+ * "complete" event per span in the Trace Event Format that trace viewers
+ * read.  Times are in microseconds since traceInit().  Tracing never fails:
+ * if we can't allocate a span, it just isn't recorded.
+ */
+typedef struct trace_span {
+    const char *ts_cat;
+    const char *ts_name;
+    char *ts_detail;
+    hrtime_t ts_start;
+    hrtime_t ts_end;
+    unsigned int ts_thread;
+} trace_span_t;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_span_t *trace_spans = NULL;
+static size_t trace_len = 0;
+static size_t trace_alloc = 0;
+static hrtime_t trace_origin = 0;
+static char trace_started[TIMESTAMP_LEN] = "";
+
+void
+traceInit(void)
+{
+    char ts[TIMESTAMP_LEN];
+
+    trace_origin = gethrtime();
+    (void) strlcpy(trace_started, getTimestamp(ts), sizeof (trace_started));
+}
+
+long long
+traceElapsedMs(void)
+{
+    return ((long long)NSEC2MSEC(gethrtime() - trace_origin));
+}
+
+/*
+ * Start a span, and return the id to pass to traceEnd().  "cat" and "name"
+ * must be string constants; "detail" (which may be NULL) is copied.
+ */
+int
+traceBegin(const char *cat, const char *name, const char *detail)
+{
+    trace_span_t *ts;
+    int id = -1;
+
+    pthread_mutex_lock(&trace_lock);
+
+    if (trace_len == trace_alloc) {
+        size_t nalloc = trace_alloc == 0 ? 64 : trace_alloc * 2;
+
+        if ((ts = realloc(trace_spans, nalloc * sizeof (trace_span_t))) ==
+            NULL) {
+            goto out;
+        }
+        trace_spans = ts;
+        trace_alloc = nalloc;
+    }
+
+    ts = &trace_spans[trace_len];
+    ts->ts_cat = cat;
+    ts->ts_name = name;
+    ts->ts_detail = detail != NULL ? strdup(detail) : NULL;
+    ts->ts_thread = (unsigned int)pthread_self();
+    ts->ts_start = gethrtime();
+    ts->ts_end = 0;
+    id = (int)trace_len++;
+
+out:
+    pthread_mutex_unlock(&trace_lock);
+    return (id);
+}
+
+void
+traceEnd(int id)
+{
+    if (id < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    trace_spans[id].ts_end = gethrtime();
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Return the trace so far as a JSON string, which the caller must free(3C).
+ * Spans that haven't ended yet are treated as ending now.
  */
 char *
-mdataGet(const char *keyname)
+traceJson(void)
 {
-    char *errmsg = NULL;
-    string_t *mdata = NULL;
-    mdata_response_t mdr;
+    string_t *str = dynstr_new();
+    hrtime_t now = gethrtime();
+    char num[128];
     char *out;
 
+    pthread_mutex_lock(&trace_lock);
+
+    dynstr_append(str, "{\"traceEvents\":[");
+    for (size_t i = 0; i < trace_len; i++) {
+        trace_span_t *ts = &trace_spans[i];
+        hrtime_t end = ts->ts_end != 0 ? ts->ts_end : now;
+
+        dynstr_append(str, i == 0 ? "\n{\"name\":" : ",\n{\"name\":");
+        json_append_string(str, ts->ts_name, strlen(ts->ts_name));
+        dynstr_append(str, ",\"cat\":");
+        json_append_string(str, ts->ts_cat, strlen(ts->ts_cat));
+        (void) snprintf(num, sizeof (num), ",\"ph\":\"X\",\"ts\":%lld,"
+            "\"dur\":%lld,\"pid\":%d,\"tid\":%u",
+            (long long)(ts->ts_start - trace_origin) / 1000,
+            (long long)(end - ts->ts_start) / 1000, (int)getpid(),
+            ts->ts_thread);
+        dynstr_append(str, num);
+        if (ts->ts_detail != NULL) {
+            dynstr_append(str, ",\"args\":{\"detail\":");
+            json_append_string(str, ts->ts_detail, strlen(ts->ts_detail));
+            dynstr_appendc(str, '}');
+        }
+        dynstr_appendc(str, '}');
+    }
+
+    (void) snprintf(num, sizeof (num), "\n],\"displayTimeUnit\":\"ms\","
+        "\"otherData\":{\"started\":\"%s\",\"elapsed_us\":%lld}}\n",
+        trace_started, (long long)(now - trace_origin) / 1000);
+    dynstr_append(str, num);
+
+    pthread_mutex_unlock(&trace_lock);
+
+    if ((out = strdup(dynstr_cstr(str))) == NULL) {
+        fatal(ERR_STRDUP, "strdup failure\n");
+    }
+    dynstr_free(str);
+
+    return (out);
+}
+
+/*
+ * Write the trace so far to "path".  Failure is logged but otherwise ignored.
+ */
+void
+traceWrite(const char *path)
+{
+    char *json = traceJson();
+    size_t len = strlen(json);
+    size_t off = 0;
+    ssize_t ret;
+    int fd;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        0644)) == -1) {
+        dlog("WARN failed to open trace file %s: %s\n", path,
+            strerror(errno));
+        free(json);
+        return;
+    }
+
+    while (off < len) {
+        if ((ret = write(fd, json + off, len - off)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            dlog("WARN failed to write trace file %s: %s\n", path,
+                strerror(errno));
+            break;
+        }
+        off += ret;
+    }
+
+    (void) close(fd);
+    free(json);
+}
+
+/*
+ * Values fetched ahead of time by mdataPrefetch().  mdataGet() hands these out
+ * instead of asking the metadata agent again.  A NULL mce_value means the key
+ * was not found.  Only mdataPut() and mdataDelete() update an entry, so a key
+ * whose value is changed from outside the zone should not be prefetched.
+ */
+typedef struct mdata_cache_entry {
+    char *mce_key;
+    char *mce_value;
+} mdata_cache_entry_t;
+
+static mdata_cache_entry_t *mdata_cache = NULL;
+static size_t mdata_cache_len = 0;
+
+/*
+ * dockerinit runs some of its boot phases at the same time, so the connection
+ * to the metadata agent and the cache above are protected by this lock.
+ */
+static pthread_mutex_t mdata_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Connect to the metadata agent, if we haven't already.  This opens the
+ * descriptors that dockerinit closes before exec, so it must be called before
+ * anything else that might open a file in another thread.
+ */
+void
+mdataInit(void)
+{
+    char *errmsg = NULL;
+    int span;
+
     if (initialized_proto == 0) {
+        span = traceBegin("mdata", "init", NULL);
         if (proto_init(&mdp, &errmsg) != 0) {
             fatal(ERR_MDATA_INIT, "could not initialize metadata: %s\n",
                 errmsg);
         }
         initialized_proto = 1;
+        traceEnd(span);
     }
+}
 
-    if (proto_execute(mdp, "GET", keyname, &mdr, &mdata) != 0) {
-        fatal(ERR_UNEXPECTED, "failed to get metadata for '%s': unknown "
-          "error\n", keyname);
-    }
+/*
+ * Turn the response to a GET into the value to return from mdataGet(), and
+ * free the response data.
+ */
+static char *
+mdataGetResult(const char *keyname, mdata_response_t mdr, string_t *mdata)
+{
+    char *out;
 
     switch (mdr) {
     case MDR_SUCCESS:
@@ -228,21 +444,148 @@ mdataGet(const char *keyname)
     return (NULL);
 }
 
+static mdata_cache_entry_t *
+mdataCacheFind(const char *keyname)
+{
+    for (size_t i = 0; i < mdata_cache_len; i++) {
+        if (mdata_cache[i].mce_key != NULL &&
+            strcmp(mdata_cache[i].mce_key, keyname) == 0) {
+            return (&mdata_cache[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+/*
+ * Forget any prefetched value for keyname, e.g. because we've changed it.
+ */
+static void
+mdataCacheDrop(const char *keyname)
+{
+    mdata_cache_entry_t *mce;
+
+    if ((mce = mdataCacheFind(keyname)) != NULL) {
+        free(mce->mce_key);
+        free(mce->mce_value);
+        mce->mce_key = NULL;
+        mce->mce_value = NULL;
+    }
+}
+
+/*
+ * GET each of the keys in the NULL-terminated list at once, and keep the
+ * values for later calls to mdataGet().  This is a single GETMANY request if
+ * the metadata agent supports it, or else pipelined GETs, so it takes about
+ * one round trip to the agent rather than one per key.  With an agent that
+ * only supports the V1 protocol, the keys are fetched one at a time as before.
+ * Aborts the program on any error, as mdataGet() does.
+ */
+void
+mdataPrefetch(const char * const *keynames)
+{
+    mdata_request_t *mdq;
+    size_t count = 0;
+    int span;
+
+    while (keynames[count] != NULL) {
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mdata_lock);
+    mdataInit();
+
+    if ((mdq = calloc(count, sizeof (mdata_request_t))) == NULL ||
+        (mdata_cache = realloc(mdata_cache, (mdata_cache_len + count) *
+        sizeof (mdata_cache_entry_t))) == NULL) {
+        fatal(ERR_NO_MEMORY, "failed to allocate metadata cache: %s\n",
+            strerror(errno));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        mdq[i].mdq_argument = keynames[i];
+    }
+
+    span = traceBegin("mdata", "prefetch", NULL);
+    if (proto_get_many(mdp, mdq, count) != 0) {
+        fatal(ERR_UNEXPECTED, "failed to prefetch metadata: unknown "
+          "error\n");
+    }
+    traceEnd(span);
+
+    for (size_t i = 0; i < count; i++) {
+        mdata_cache_entry_t *mce;
+
+        mdataCacheDrop(keynames[i]);
+
+        mce = &mdata_cache[mdata_cache_len++];
+        if ((mce->mce_key = strdup(keynames[i])) == NULL) {
+            fatal(ERR_STRDUP, "strdup failure\n");
+        }
+        mce->mce_value = mdataGetResult(keynames[i], mdq[i].mdq_response,
+            mdq[i].mdq_response_data);
+    }
+    pthread_mutex_unlock(&mdata_lock);
+
+    free(mdq);
+}
+
+/*
+ * Contact the hypervisor metadata agent and request the value for the provided
+ * key name, unless it has already been fetched by mdataPrefetch().  Returns a
+ * C string if a value is found, NULL if no value is found, or aborts the
+ * program on any other condition.  The caller is expected to call free(3C) on
+ * the returned string.
+ */
+char *
+mdataGet(const char *keyname)
+{
+    string_t *mdata = NULL;
+    mdata_response_t mdr;
+    mdata_cache_entry_t *mce;
+    char *out = NULL;
+    int span;
+
+    pthread_mutex_lock(&mdata_lock);
+
+    if ((mce = mdataCacheFind(keyname)) != NULL) {
+        if (mce->mce_value != NULL &&
+            (out = strdup(mce->mce_value)) == NULL) {
+            fatal(ERR_STRDUP, "strdup failure\n");
+        }
+        pthread_mutex_unlock(&mdata_lock);
+        return (out);
+    }
+
+    mdataInit();
+
+    span = traceBegin("mdata", "get", keyname);
+    if (proto_execute(mdp, "GET", keyname, &mdr, &mdata) != 0) {
+        fatal(ERR_UNEXPECTED, "failed to get metadata for '%s': unknown "
+          "error\n", keyname);
+    }
+    traceEnd(span);
+
+    out = mdataGetResult(keyname, mdr, mdata);
+    pthread_mutex_unlock(&mdata_lock);
+
+    return (out);
+}
+
 void
 mdataPut(const char *keyname, const char *value)
 {
     string_t *data;
-    char *errmsg = NULL;
     mdata_response_t mdr;
     string_t *req = dynstr_new();
+    int span;
 
-    if (initialized_proto == 0) {
-        if (proto_init(&mdp, &errmsg) != 0) {
-            fatal(ERR_MDATA_INIT, "could not initialize metadata: %s\n",
-                errmsg);
-        }
-        initialized_proto = 1;
-    }
+    pthread_mutex_lock(&mdata_lock);
+    mdataInit();
+    mdataCacheDrop(keyname);
 
     base64_encode(keyname, strlen(keyname), req);
     dynstr_appendc(req, ' ');
@@ -252,9 +595,12 @@ mdataPut(const char *keyname, const char *value)
         fatal(ERR_MDATA_TOO_OLD, "mdata protocol must be >= 2 for PUT");
     }
 
+    span = traceBegin("mdata", "put", keyname);
     if (proto_execute(mdp, "PUT", dynstr_cstr(req), &mdr, &data) != 0) {
         fatal(ERR_MDATA_FAIL, "failed to PUT");
     }
+    traceEnd(span);
+    pthread_mutex_unlock(&mdata_lock);
 
     dynstr_free(req);
 
@@ -265,24 +611,23 @@ void
 mdataDelete(const char *keyname)
 {
     string_t *data;
-    char *errmsg = NULL;
     mdata_response_t mdr;
+    int span;
 
-    if (initialized_proto == 0) {
-        if (proto_init(&mdp, &errmsg) != 0) {
-            fatal(ERR_MDATA_INIT, "could not initialize metadata: %s\n",
-                errmsg);
-        }
-        initialized_proto = 1;
-    }
+    pthread_mutex_lock(&mdata_lock);
+    mdataInit();
+    mdataCacheDrop(keyname);
 
     if (proto_version(mdp) < 2) {
         fatal(ERR_MDATA_TOO_OLD, "mdata protocol must be >= 2 for DELETE");
     }
 
+    span = traceBegin("mdata", "delete", keyname);
     if (proto_execute(mdp, "DELETE", keyname, &mdr, &data) != 0) {
         fatal(ERR_MDATA_FAIL, "failed to DELETE");
     }
+    traceEnd(span);
+    pthread_mutex_unlock(&mdata_lock);
 
     dlog("MDATA DELETE %s\n", keyname);
 }
@@ -297,17 +642,14 @@ cbEachEnvEntry(const char *array_name __unused, unsigned int idx
   __unused, const char *val, void *arg0, void *arg1 __unused)
 {
     strlist_t *env = arg0;
-    char *env_name = NULL;
-    char *env_val = NULL;
 
-    if (splitEnvEntry(val, &env_name, &env_val) == ENV_IGNORE_ENTRY) {
+    if (splitEnvEntry(val, NULL, NULL) == ENV_IGNORE_ENTRY) {
         return;
     }
 
-    insertOrReplaceEnv(env, env_name, env_val);
-
-    free(env_name);
-    free(env_val);
+    if (strlist_set_entry(env, val) != 0) {
+        fatal(ERR_NO_MEMORY, "strlist failure: %s\n", strerror(errno));
+    }
 }
 
 int
@@ -650,52 +992,22 @@ splitEnvEntry(const char *input, char **name, char **value)
     return (ENV_OK);
 }
 
+/*
+ * Insert "name=value" into the environment, replacing any existing entry with
+ * the same name.  The strlist keeps an index of entry names, so this does not
+ * need to walk the whole list.
+ */
 static void
 insertOrReplaceEnv(strlist_t *sl, const char *name, const char *value)
 {
-    boolean_t found = B_FALSE;
-    unsigned int idx;
     int ret, e;
     char *insval;
 
-    /*
-     * Check for an existing environment entry by this name:
-     */
-    for (idx = 0; strlist_get(sl, idx) != NULL; idx++) {
-        char *sname;
-
-        if (splitEnvEntry(strlist_get(sl, idx), &sname, NULL)
-	    == ENV_IGNORE_ENTRY) {
-            continue;
-        }
-        if (strcmp(sname, name) == 0) {
-            found = B_TRUE;
-        }
-        free(sname);
-
-        if (found) {
-            break;
-        }
-    }
-
-    /*
-     * Construct the full value to insert:
-     */
     if (asprintf(&insval, "%s=%s", name, value) < 0) {
         fatal(ERR_STRDUP, "asprintf failure: %s\n", strerror(errno));
     }
 
-    if (found) {
-        /*
-         * Replace the existing entry with this new entry.
-         */
-        ret = strlist_set(sl, idx, insval);
-    } else {
-        /*
-         * Append the new entry to the end of the list.
-         */
-        ret = strlist_set_tail(sl, insval);
-    }
+    ret = strlist_set_entry(sl, insval);
 
     e = errno;
     free(insval);
@@ -755,8 +1067,7 @@ forEachStringInArray(const char *array_name, nvlist_t *array_nvl,
 static int
 getPathList(strlist_t *env, strlist_t *path, const char *working_directory)
 {
-    char *r = NULL;
-    boolean_t dofree = B_TRUE;
+    const char *r;
     custr_t *cu = NULL;
     custr_t *searchdir = NULL;
 
@@ -767,31 +1078,13 @@ getPathList(strlist_t *env, strlist_t *path, const char *working_directory)
     /*
      * Check environment array for PATH value.
      */
-    for (unsigned int idx = 0; strlist_get(env, idx) != NULL; idx++) {
-        char *sname;
-        char *svalue;
-
-        if (splitEnvEntry(strlist_get(env, idx), &sname, &svalue)
-	    == ENV_IGNORE_ENTRY) {
-            continue;
-        }
-        if (strcmp(sname, "PATH") != 0) {
-            free(sname);
-            free(svalue);
-            continue;
-        }
-
-        free(sname);
-        r = svalue;
-        break;
-    }
+    r = strlist_lookup(env, "PATH");
 
     /*
      * If no PATH was found, fall back to the default:
      */
     if (r == NULL) {
         r = DEFAULT_PATH;
-        dofree = B_FALSE;
     }
 
     /*
@@ -851,7 +1144,6 @@ getPathList(strlist_t *env, strlist_t *path, const char *working_directory)
         }
     }
 
-    free(dofree ? r : NULL);
     custr_free(cu);
     custr_free(searchdir);
     return (0);
@@ -6,6 +6,7 @@
 
 /*
  * Copyright (c) 2017, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 /*
@@ -36,6 +37,7 @@
 #define DEFAULT_PATH "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin" \
     ":/sbin:/bin"
 #define DEFAULT_TERM "xterm"
+#define TIMESTAMP_LEN 32
 
 typedef enum {
     ARRAY_CMD,
@@ -103,7 +105,8 @@ typedef enum {
     ERR_MOUNT_DEVSHM,
     ERR_INVALID_NFS_VOLUMES,
     ERR_MOUNT_NFS_VOLUME,
-    ERR_UNKNOWN_VOLUME_TYPE
+    ERR_UNKNOWN_VOLUME_TYPE,
+    ERR_THREAD
 } dockerinit_err_t;
 
 typedef enum {
@@ -123,11 +126,19 @@ void dlog(const char *fmt, ...);
 custr_t *execName(const char *cmd, strlist_t *, const char *);
 void fatal(dockerinit_err_t code, char *fmt, ...);
 void getMdataArray(const char *key, nvlist_t **nvl, uint32_t *len);
-char *getTimestamp();
+char *getTimestamp(char *);
 void getUserGroupData();
 void mdataDelete(const char *keyname);
 char *mdataGet(const char *);
+void mdataInit(void);
+void mdataPrefetch(const char * const *);
 void mdataPut(const char *keyname, const char *value);
 void setupWorkdir();
+int traceBegin(const char *, const char *, const char *);
+long long traceElapsedMs(void);
+void traceEnd(int);
+void traceInit(void);
+char *traceJson(void);
+void traceWrite(const char *);
 
 #endif /* DOCKER_COMMON_H */
@@ -6,6 +6,7 @@
 
 /*
  * Copyright (c) 2015, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 /*
@@ -104,7 +105,7 @@ main(int argc, char *argv[])
             argc);
     }
 
-    if (strlist_alloc(&env, 0) != 0) {
+    if (strlist_alloc_arena(&env, 0) != 0) {
         fatal(ERR_NO_MEMORY, "failed to allocate string lists: %s",
           strerror(errno));
     }
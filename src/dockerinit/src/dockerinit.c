@@ -7,6 +7,7 @@
 /*
  * Copyright 2020 Joyent, Inc.
  * Copyright 2024 H. William Welliver III <william@welliver.org>
+ * Copyright 2026 Edgecast Cloud LLC.
  */
 
 /*
@@ -38,6 +39,7 @@
 #include <libinetutil.h>
 #include <libnvpair.h>
 #include <limits.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -62,6 +64,7 @@
 #include <sys/socket.h>
 #include <sys/sockio.h>
 #include <sys/syscall.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/zfd.h>
@@ -83,6 +86,7 @@
 #define NFS_MOUNT "/usr/lib/fs/nfs/mount"
 
 #define LOGFILE "/var/log/sdc-dockerinit.log"
+#define TRACEFILE "/var/log/sdc-dockerinit-trace.json"
 #define RTMBUFSZ sizeof (struct rt_msghdr) + (3 * sizeof (struct sockaddr_in))
 #define ATTACH_CHECK_INTERVAL 200000 // 200ms
 #define ZFD_OPEN_RETRIES 300 /* retries to open a zfd device (10 / second) */
@@ -90,6 +94,13 @@
 /* This comes from a private header in illumos-joyent */
 #define B_START_NFS_LOCKD 131
 
+/* An NFS mount in progress */
+typedef struct nfs_mount {
+    pid_t nm_pid;
+    const char *nm_mountpoint;
+    int nm_span;
+} nfs_mount_t;
+
 int addRoute(const char *, const char *, const char *, int, boolean_t);
 void closeIpadmHandle();
 static void execCmdline(strlist_t *, strlist_t *, const char *);
@@ -109,9 +120,10 @@ void setupLinkLocalRoute(nvlist_t *data);
 void setupLinkLocalRoutes();
 void setupGateways();
 void setupInterfaces();
-static void doNfsMount(const char *nfsvolume, const char *mountpoint,
-    boolean_t readonly);
-static void mountNfsVolume(nvlist_t *data);
+static void startNfsMount(nfs_mount_t *nm, const char *nfsvolume,
+    const char *mountpoint, boolean_t readonly);
+static void waitNfsMount(nfs_mount_t *nm);
+static void mountNfsVolume(nvlist_t *data, nfs_mount_t *nm);
 static void mountNfsVolumes();
 static void makeMux(int stdid, int logid, boolean_t use_flowcon);
 static void setupTerminal(boolean_t ctty);
@@ -164,6 +176,40 @@ struct LoggerEnvVar logger_vars[] = {
     {"DOCKERLOG_CMD", "docker:cmd"}
 };
 
+/*
+ * The metadata keys read while setting up the container, which we fetch all
+ * at once with mdataPrefetch() to save a round trip to the metadata agent for
+ * each one.  This includes every key in logger_vars[], and docker:boot_trace,
+ * which is read just before we exec the command.  A prefetched value is
+ * never refreshed, so keys that are polled for changes, like
+ * docker:wait_for_attach in waitIfAttaching(), must not be listed here.
+ */
+static const char *const prefetch_keys[] = {
+    "sdc:brand",
+    "sdc:nics",
+    "sdc:routes",
+    "sdc:hostname",
+    "sdc:alias",
+    "sdc:create_timestamp",
+    "docker:noipmgmtd",
+    "docker:nfsvolumes",
+    "docker:user",
+    "docker:workdir",
+    "docker:linkEnv",
+    "docker:env",
+    "docker:entrypoint",
+    "docker:cmd",
+    "docker:open_stdin",
+    "docker:tty",
+    "docker:logdriver",
+    "docker:logconfig",
+    "docker:id",
+    "docker:imageid",
+    "docker:imagename",
+    "docker:boot_trace",
+    NULL
+};
+
 void
 makePath(const char *base, char *out, size_t outsz)
 {
@@ -212,7 +258,7 @@ runIpmgmtd(void)
 
     dlog("INFO started ipmgmtd[%d]\n", (int)pid);
 
-    while (wait(&status) != pid) {
+    while (waitpid(pid, &status, 0) != pid) {
         /* EMPTY */;
     }
 
@@ -1322,15 +1368,20 @@ setupNetworking()
     closeIpadmHandle();
 }
 
+/*
+ * Start mounting nfsvolume on mountpoint, filling in nm for waitNfsMount().
+ */
 static void
-doNfsMount(const char *nfsvolume, const char *mountpoint, boolean_t readonly)
+startNfsMount(nfs_mount_t *nm, const char *nfsvolume, const char *mountpoint,
+    boolean_t readonly)
 {
     pid_t pid;
-    int status;
     int ret;
     int tmplfd;
 
     dlog("INFO mounting %s on %s\n", nfsvolume, mountpoint);
+    nm->nm_mountpoint = mountpoint;
+    nm->nm_span = traceBegin("nfs", "mount", mountpoint);
 
     /* ensure the directory exists */
     ret = mkdir(mountpoint, 0755);
@@ -1375,7 +1426,16 @@ doNfsMount(const char *nfsvolume, const char *mountpoint, boolean_t readonly)
 
     dlog("INFO started mount[%d]\n", (int)pid);
 
-    while (wait(&status) != pid) {
+    nm->nm_pid = pid;
+}
+
+static void
+waitNfsMount(nfs_mount_t *nm)
+{
+    pid_t pid = nm->nm_pid;
+    int status;
+
+    while (waitpid(pid, &status, 0) != pid) {
         /* EMPTY */;
     }
 
@@ -1392,10 +1452,31 @@ doNfsMount(const char *nfsvolume, const char *mountpoint, boolean_t readonly)
         fatal(ERR_EXEC_FAILED, "mount[%d] failed in unknown way\n",
             (int)pid);
     }
+
+    traceEnd(nm->nm_span);
+}
+
+/*
+ * Returns B_TRUE if one of the two paths is the same as, or beneath, the
+ * other, in which case the mounts on them have to be done in order.
+ */
+static boolean_t
+nfsMountsNested(const char *a, const char *b)
+{
+    size_t alen = strlen(a);
+    size_t blen = strlen(b);
+    const char *longer = alen > blen ? a : b;
+    size_t n = alen > blen ? blen : alen;
+
+    if (strncmp(a, b, n) != 0) {
+        return (B_FALSE);
+    }
+
+    return (alen == blen || longer[n] == '/' || (n > 0 && a[n - 1] == '/'));
 }
 
 static void
-mountNfsVolume(nvlist_t *data)
+mountNfsVolume(nvlist_t *data, nfs_mount_t *nm)
 {
     boolean_t readonly;
     char *nfsvolume, *mountpoint;
@@ -1409,7 +1490,7 @@ mountNfsVolume(nvlist_t *data)
             if (ret != 0) {
                 readonly = B_FALSE;
             }
-            doNfsMount(nfsvolume, mountpoint, readonly);
+            startNfsMount(nm, nfsvolume, mountpoint, readonly);
             return;
         }
     }
@@ -1417,12 +1498,21 @@ mountNfsVolume(nvlist_t *data)
     fatal(ERR_INVALID_NFS_VOLUMES, "invalid nfsvolumes");
 }
 
+/*
+ * Mount each of the volumes in docker:nfsvolumes.  The mounts run at the same
+ * time, except that a volume mounted on or beneath the mountpoint of one
+ * that's still being mounted waits for the mounts in progress to finish.
+ */
 static void
 mountNfsVolumes()
 {
     char *json;
     nvlist_t *data, *nvl;
     nvpair_t *pair;
+    nfs_mount_t *mounts;
+    uint_t count = 0;
+    uint_t running = 0;
+    uint_t i;
 
     if ((json = mdataGet("docker:nfsvolumes")) == NULL) {
         dlog("No docker:nfsvolumes, nothing to mount\n");
@@ -1438,19 +1528,51 @@ mountNfsVolumes()
 
     for (pair = nvlist_next_nvpair(nvl, NULL); pair != NULL;
       pair = nvlist_next_nvpair(nvl, pair)) {
-        if (nvpair_type(pair) == DATA_TYPE_NVLIST) {
-            if (nvpair_value_nvlist(pair, &data) != 0) {
-                fatal(ERR_PARSE_JSON, "failed to parse nvpair json"
-                    " for NFS volume: %s\n", strerror(errno));
+        count++;
+    }
+    if ((mounts = calloc(count + 1, sizeof (nfs_mount_t))) == NULL) {
+        fatal(ERR_NO_MEMORY, "failed to allocate NFS mount list: %s\n",
+            strerror(errno));
+    }
+
+    for (pair = nvlist_next_nvpair(nvl, NULL); pair != NULL;
+      pair = nvlist_next_nvpair(nvl, pair)) {
+        char *mountpoint;
+
+        if (nvpair_type(pair) != DATA_TYPE_NVLIST) {
+            continue;
+        }
+        if (nvpair_value_nvlist(pair, &data) != 0) {
+            fatal(ERR_PARSE_JSON, "failed to parse nvpair json"
+                " for NFS volume: %s\n", strerror(errno));
+        }
+
+        /* mountNfsVolume() will complain if there's no mountpoint */
+        for (i = 0; i < running; i++) {
+            if (nvlist_lookup_string(data, "mountpoint", &mountpoint) == 0 &&
+                nfsMountsNested(mountpoint, mounts[i].nm_mountpoint)) {
+                break;
+            }
+        }
+        if (i < running) {
+            for (i = 0; i < running; i++) {
+                waitNfsMount(&mounts[i]);
             }
-            mountNfsVolume(data);
+            running = 0;
         }
+
+        mountNfsVolume(data, &mounts[running++]);
+    }
+
+    for (i = 0; i < running; i++) {
+        waitNfsMount(&mounts[i]);
     }
 
      /* Attempt to start lx_lockd if one is not already running. */
     dlog("DEBUG attempting to start lx_lockd");
     (void) syscall(SYS_brand, B_START_NFS_LOCKD);
 
+    free(mounts);
     nvlist_free(nvl);
 }
 
@@ -1523,21 +1645,246 @@ waitIfAttaching()
     }
 }
 
+/*
+ * Setting up the container is split into phases, each of which runs in its
+ * own thread as soon as the phases it depends on have finished:
+ *
+ *   phase      depends on          does
+ *   metadata   -                   mdataPrefetch()
+ *   ipmgmtd    -                   runIpmgmtd()
+ *   zfd        -                   zfd_ready()
+ *   brand      metadata            brand-specific mounts
+ *   hostname   metadata            setupHostname()
+ *   network    metadata, ipmgmtd   setupNetworking(), killIpmgmtd()
+ *   nfs        brand, network      mountNfsVolumes()
+ *   env        brand, hostname,    getUserGroupData(), setupWorkdir(),
+ *              nfs                 buildCmdEnv()
+ *   cmdline    env, nfs            buildCmdline()
+ *
+ * The environment and command line wait for the NFS volumes, since the user's
+ * passwd and group files, the working directory and the command may all be on
+ * one of them.  Waiting for the zfd devices used to happen in main() just
+ * before getTtyStatus(); it's deliberately a phase of its own now, so that the
+ * wait overlaps with the rest of the setup, and it has finished by the time
+ * setupTerminal() and setupLogging() open the devices.  Each phase calls
+ * fatal() if anything goes wrong, so there's no error handling here.  Each
+ * phase is a span in the boot trace, and its start and finish are also logged
+ * relative to the start of dockerinit.
+ */
+typedef enum {
+    PHASE_METADATA,
+    PHASE_IPMGMTD,
+    PHASE_ZFD,
+    PHASE_BRAND,
+    PHASE_HOSTNAME,
+    PHASE_NETWORK,
+    PHASE_NFS,
+    PHASE_ENV,
+    PHASE_CMDLINE,
+    PHASE_COUNT
+} boot_phase_id_t;
+
+#define PHASE_BIT(id) (1U << (id))
+
+typedef struct boot_phase {
+    const char *bp_name;
+    void (*bp_func)(void);
+    uint_t bp_deps;
+} boot_phase_t;
+
+static uint_t phases_done = 0;
+static pthread_mutex_t phase_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t phase_cv = PTHREAD_COND_INITIALIZER;
+
+/* what the phases build for execCmdline() */
+static strlist_t *cmd_env = NULL;
+static strlist_t *cmd_line = NULL;
+static custr_t *cmd_workdir = NULL;
+
+static void
+phaseMetadata(void)
+{
+    mdataPrefetch(prefetch_keys);
+}
+
+static void
+phaseIpmgmtd(void)
+{
+    mkdir("/var/run", 0755);
+    mkdir("/var/run/network", 0755);
+
+    /* NOTE: will call fatal() if there's a problem */
+    runIpmgmtd();
+}
+
+static void
+phaseZfd(void)
+{
+    zfd_ready();
+}
+
+static void
+phaseBrand(void)
+{
+    switch (getBrand()) {
+        case BRAND_LX:
+            mountLXDevShm();
+            setupMtab();
+            break;
+        case BRAND_JOYENT_MINIMAL:
+            /*
+             * joyent-minimal brand mounts /proc for us so we don't need to,
+             * but without /proc being lxproc, we need to mount /dev/fd
+             */
+            mountOSDevFD();
+            /* no need for /etc/mtab updates here either */
+            break;
+        default:
+            fatal(ERR_UNEXPECTED, "unsupported brand after getBrand()\n");
+            break;
+    }
+}
+
+static void
+phaseHostname(void)
+{
+    setupHostname();
+}
+
+static void
+phaseNetwork(void)
+{
+    dlog("INFO setting up networking\n");
+
+    setupNetworking();
+
+    /* kill ipmgmtd if we don't need it any more */
+    killIpmgmtd();
+
+    dlog("INFO network setup complete\n");
+}
+
+static void
+phaseNfs(void)
+{
+    /* EXPERIMENTAL */
+    mountNfsVolumes();
+}
+
+static void
+phaseEnv(void)
+{
+    int span;
+
+    /* NOTE: all of these will call fatal() if there's a problem */
+    span = traceBegin("setup", "user", NULL);
+    getUserGroupData();
+    traceEnd(span);
+
+    span = traceBegin("setup", "workdir", NULL);
+    setupWorkdir(&cmd_workdir);
+    traceEnd(span);
+
+    span = traceBegin("setup", "env", NULL);
+    if (buildCmdEnv(cmd_env) != 0) {
+        fatal(ERR_UNEXPECTED, "buildCmdEnv() failed: %s\n", strerror(errno));
+    }
+    traceEnd(span);
+}
+
+static void
+phaseCmdline(void)
+{
+    if (buildCmdline(cmd_line) != 0) {
+        fatal(ERR_UNEXPECTED, "buildCmdline() failed: %s\n", strerror(errno));
+    }
+}
+
+static pthread_t boot_threads[PHASE_COUNT];
+static boot_phase_t boot_phases[PHASE_COUNT] = {
+    [PHASE_METADATA] = { "metadata", phaseMetadata, 0 },
+    [PHASE_IPMGMTD] = { "ipmgmtd", phaseIpmgmtd, 0 },
+    [PHASE_ZFD] = { "zfd", phaseZfd, 0 },
+    [PHASE_BRAND] = { "brand", phaseBrand, PHASE_BIT(PHASE_METADATA) },
+    [PHASE_HOSTNAME] = { "hostname", phaseHostname,
+        PHASE_BIT(PHASE_METADATA) },
+    [PHASE_NETWORK] = { "network", phaseNetwork,
+        PHASE_BIT(PHASE_METADATA) | PHASE_BIT(PHASE_IPMGMTD) },
+    [PHASE_NFS] = { "nfs", phaseNfs,
+        PHASE_BIT(PHASE_BRAND) | PHASE_BIT(PHASE_NETWORK) },
+    [PHASE_ENV] = { "env", phaseEnv,
+        PHASE_BIT(PHASE_BRAND) | PHASE_BIT(PHASE_HOSTNAME) |
+        PHASE_BIT(PHASE_NFS) },
+    [PHASE_CMDLINE] = { "cmdline", phaseCmdline,
+        PHASE_BIT(PHASE_ENV) | PHASE_BIT(PHASE_NFS) }
+};
+
+static void *
+runPhase(void *arg)
+{
+    boot_phase_t *bp = arg;
+    long long start, end;
+    int span;
+
+    pthread_mutex_lock(&phase_lock);
+    while ((phases_done & bp->bp_deps) != bp->bp_deps) {
+        pthread_cond_wait(&phase_cv, &phase_lock);
+    }
+    pthread_mutex_unlock(&phase_lock);
+
+    start = traceElapsedMs();
+    span = traceBegin("phase", bp->bp_name, NULL);
+    bp->bp_func();
+    traceEnd(span);
+    end = traceElapsedMs();
+
+    dlog("PHASE %s ran from %lldms to %lldms (%lldms)\n", bp->bp_name, start,
+        end, end - start);
+
+    pthread_mutex_lock(&phase_lock);
+    phases_done |= PHASE_BIT(bp - boot_phases);
+    pthread_cond_broadcast(&phase_cv);
+    pthread_mutex_unlock(&phase_lock);
+
+    return (NULL);
+}
+
+static void
+runBootPhases(void)
+{
+    int err;
+    int i;
+
+    for (i = 0; i < PHASE_COUNT; i++) {
+        if ((err = pthread_create(&boot_threads[i], NULL, runPhase,
+            &boot_phases[i])) != 0) {
+            fatal(ERR_THREAD, "failed to start %s phase: %s\n",
+                boot_phases[i].bp_name, strerror(err));
+        }
+    }
+
+    for (i = 0; i < PHASE_COUNT; i++) {
+        (void) pthread_join(boot_threads[i], NULL);
+    }
+}
+
 int
 main(int __attribute__((unused)) argc, char __attribute__((unused)) *argv[])
 {
     boolean_t ctty = B_FALSE;
+    char *publish;
     int ret;
+    int span;
     int tmpfd;
-    strlist_t *env = NULL;
-    strlist_t *cmdline = NULL;
-    custr_t *workdir = NULL;
+
+    traceInit();
 
     /*
      * Allocate objects for constructing the environment to pass to the
      * process to be started.
      */
-    if (strlist_alloc(&env, 0) != 0 || strlist_alloc(&cmdline, 0) != 0) {
+    if (strlist_alloc_arena(&cmd_env, 0) != 0 ||
+        strlist_alloc(&cmd_line, 0) != 0) {
         fatal(ERR_NO_MEMORY, "failed to allocate string lists: %s",
             strerror(errno));
     }
@@ -1571,63 +1918,46 @@ main(int __attribute__((unused)) argc, char __attribute__((unused)) *argv[])
         fatal(ERR_FDOPEN_LOG, "failed to fdopen(2): %s\n", strerror(errno));
     }
 
-    switch (getBrand()) {
-        case BRAND_LX:
-            mountLXDevShm();
-            setupMtab();
-            break;
-        case BRAND_JOYENT_MINIMAL:
-            /*
-             * joyent-minimal brand mounts /proc for us so we don't need to,
-             * but without /proc being lxproc, we need to mount /dev/fd
-             */
-            mountOSDevFD();
-            /* no need for /etc/mtab updates here either */
-            break;
-        default:
-            fatal(ERR_UNEXPECTED, "unsupported brand after getBrand()\n");
-            break;
-    }
-
-    dlog("INFO setting up networking\n");
-
-    mkdir("/var/run", 0755);
-    mkdir("/var/run/network", 0755);
-
-    /* NOTE: will call fatal() if there's a problem */
-    runIpmgmtd();
-
-    setupNetworking();
-
-    /* kill ipmgmtd if we don't need it any more */
-    killIpmgmtd();
-
-    dlog("INFO network setup complete\n");
-
-    /* EXPERIMENTAL */
-    mountNfsVolumes();
-
-    /* NOTE: all of these will call fatal() if there's a problem */
-    setupHostname();
-    getUserGroupData();
-    setupWorkdir(&workdir);
+    /*
+     * Connect to the metadata agent before starting the boot phases, so that
+     * the descriptors it uses are the ones we close below.
+     */
+    mdataInit();
 
-    if (buildCmdEnv(env) != 0) {
-        fatal(ERR_UNEXPECTED, "buildCmdEnv() failed: %s\n", strerror(errno));
-    }
-    if (buildCmdline(cmdline) != 0) {
-        fatal(ERR_UNEXPECTED, "buildCmdline() failed: %s\n", strerror(errno));
-    }
+    runBootPhases();
+    dlog("INFO boot phases complete after %lldms\n", traceElapsedMs());
 
     /*
-     * In case we're going to read from stdin w/ attach, we want to open the zfd
-     * _now_ so it won't return EOF on reads.
+     * The zfd phase has already waited for the zfd devices to show up, so
+     * this only sets up the terminal and logging on them.  That still has to
+     * happen before waitIfAttaching(): in case we're going to read from stdin
+     * w/ attach, stdin must be open on the zfd so it won't return EOF.
      */
+    span = traceBegin("setup", "terminal", NULL);
     ctty = getTtyStatus();
-    zfd_ready();
     setupTerminal(ctty);
     setupLogging(ctty);
+    traceEnd(span);
+
+    span = traceBegin("setup", "attach", NULL);
     waitIfAttaching();
+    traceEnd(span);
+
+    /*
+     * Record the boot trace while we can still talk to the metadata agent.
+     * If asked to, we also publish it there, so that boot times can be
+     * collected without logging in to each zone.
+     */
+    traceEnd(traceBegin("exec", "exec", strlist_get(cmd_line, 0)));
+    traceWrite(TRACEFILE);
+    if ((publish = mdataGet("docker:boot_trace")) != NULL &&
+        strcmp(publish, "true") == 0) {
+        char *json = traceJson();
+
+        mdataPut("__dockerinit_boot_trace", json);
+        free(json);
+    }
+    free(publish);
 
     /* cleanup mess from mdata-client */
     close(4); /* /dev/urandom from mdata-client */
@@ -1644,7 +1974,8 @@ main(int __attribute__((unused)) argc, char __attribute__((unused)) *argv[])
             strerror(errno));
     }
 
-    execCmdline(cmdline, env, custr_cstr(workdir));
+    dlog("INFO executing command after %lldms\n", traceElapsedMs());
+    execCmdline(cmd_line, cmd_env, custr_cstr(cmd_workdir));
 
     /* NOTREACHED */
     abort();
@@ -21,8 +21,15 @@
  * CDDL HEADER END
  *
  * Copyright (c) 2018, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  *
- * cc -Wall -Wextra fswatcher.c -o fswatcher -lthread -lnvpair -lavl
+ * cc -Wall -Wextra fswatcher.c fswatcher_port.c fswatcher_table.c \
+ *     -o fswatcher -lnvpair
+ *
+ * On Linux (with the OpenZFS libnvpair):
+ *
+ * cc -Wall -Wextra -D_GNU_SOURCE fswatcher.c fswatcher_inotify.c \
+ *     fswatcher_table.c -o fswatcher -lpthread -lnvpair
  *
  */
 
@@ -36,6 +43,8 @@
  * <KEY> WATCH <pathname>\n
  * <KEY> UNWATCH <pathname>\n
  * <KEY> STATUS\n
+ * <KEY> WATCHMANY <count>\n<pathname>\n...
+ * <KEY> UNWATCHMANY <count>\n<pathname>\n...
  *
  * The first will cause <pathname> to be added to the watch list. The second
  * will cause the watch for the specified path to be removed.  The third will
@@ -44,9 +53,21 @@
  * the caller to know which response by `fswatcher` is related to which command
  * given since commands are processed asynchronously.
  *
+ * WATCHMANY and UNWATCHMANY are batch versions of WATCH and UNWATCH.  The
+ * command line is followed by exactly <count> lines, each containing a single
+ * pathname (the entire line, minus the trailing newline, is used).  Every
+ * pathname is processed in order, and a single "response" message is emitted
+ * for the whole batch with the per-path results in "data.results".  <count>
+ * must be in the range 1-MAX_BATCH_PATHS (inclusive).
+ *
  * NOTE: 0 is a special key that will be used in output for errors which were
  * not directly the result of a command.
  *
+ * Filesystem events come from one of the backends described in
+ * fswatcher_backend.h: event ports on illumos, or inotify on Linux.  Every
+ * backend reports events using the event ports FILE_* names below, so the
+ * output is the same on every platform.
+ *
  * "pathname" can be any type of file that event ports supports (file,
  * directory, pipe, etc. see port_associate(3C) for a full list).  This program
  * cannot watch symlinks, but instead will watch the source file of a symlink.
@@ -58,6 +79,16 @@
  * until an UNWATCH command for the file is received from the user, or an event
  * indicates that the file can no longer be watched (like FILE_DELETE).
  *
+ * With -d <ms>, events are debounced: the first event for a file starts a
+ * window of <ms> milliseconds, and any further events for the same file seen
+ * in that window are merged into it.  A single "event" message is printed
+ * when the window closes, with "changes" set to the union of every event seen
+ * and "count" set to the number of events merged.  The file is still rewatched
+ * immediately after every event, so no changes are missed.  Events that end
+ * the watch ("final" is true) are never delayed: any pending events for the
+ * file are merged into them and they are printed right away.  Pending events
+ * for a file are also printed before it is unwatched.
+ *
  * On stdout you will see JSON messages that look like the following but are
  * on a single line:
  *
@@ -88,6 +119,10 @@
  *   - code
  *             A positive integer code for an error.
  *             Included for "response" and "error" messages.
+ *   - count
+ *             The number of events merged into this message, which is always
+ *             1 unless -d is given.
+ *             Included for "event" messages.
  *   - final
  *             true when the event being printed is the last without re-watch.
  *             Included for "event" messages.
@@ -104,8 +139,61 @@
  *             Indicates whether a command was a "SUCCESS" or "FAILURE"
  *             Included for "response" messages.
  *
+ * "ready" messages also include a "commands" array listing every command
+ * understood by this program, so callers can detect support for the batch
+ * commands.
+ *
+ * Responses to WATCHMANY and UNWATCHMANY have "result" set to "SUCCESS" only
+ * if every pathname in the batch succeeded, and include a "data" object like:
+ *
+ *  {
+ *     "results": [
+ *         {
+ *             "pathname": "/path/one",
+ *             "code": <number>,
+ *             "result": "SUCCESS|FAIL",
+ *             "message": "human readable string"
+ *         },
+ *         ...
+ *     ],
+ *     "results_count": <number>
+ *  }
+ *
+ * Where the entries of "results" are in the same order the pathnames were
+ * given.
+ *
  * Current values for "code" are in the ErrorCodes enum below.
  *
+ * BINARY OUTPUT
+ *
+ * With -b, every message is instead written as a binary record, so the
+ * reader doesn't have to scan for newlines or parse JSON.  All integers are
+ * little-endian, and all offsets are from the start of the record.  A record
+ * is a 56 byte header:
+ *
+ *   offset  size  field
+ *        0     4  length of the whole record, including this field
+ *        4     1  type: 1 ready, 2 event, 3 response, 4 error
+ *        5     1  flags: 0x01 final (events only)
+ *        6     2  reserved (0)
+ *        8     8  key (responses and errors only)
+ *       16     8  time: seconds
+ *       24     4  time: nanoseconds
+ *       28     4  changes as a bitmask of FILE_* flags ("revents")
+ *       32     4  count (events only)
+ *       36     4  code (responses and errors only)
+ *       40     2  pathname offset (0 if there is no pathname)
+ *       42     2  pathname length
+ *       44     2  message offset (0 if there is no message)
+ *       46     2  message length
+ *       48     4  data offset (0 if there is no data)
+ *       52     4  data length
+ *
+ * followed by the pathname, message and data bytes (without terminating
+ * NULs).  "result" is "SUCCESS" if code is 0 and "FAIL" otherwise.  The data
+ * is the JSON form of the "data" object for responses, and of an object
+ * holding the "commands" array for "ready" messages.
+ *
  * EXIT STATUS
  *
  *   Under normal operation, fswatcher will run until stdin is closed or a fatal
@@ -122,28 +210,72 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <port.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
-#include <sys/debug.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <thread.h>
 #include <time.h>
 #include <unistd.h>
 
-#include <sys/avl.h>
 #include <libnvpair.h>
 
+#include "fswatcher_backend.h"
+#include "fswatcher_table.h"
+
+#ifdef __sun
+#include <sys/debug.h>
+#else
+#ifndef VERIFY3S
+#define	VERIFY3S(l, op, r)	VERIFY((l)op(r))
+#define	VERIFY3U(l, op, r)	VERIFY((l)op(r))
+#define	VERIFY3P(l, op, r)	VERIFY((l)op(r))
+#endif
+#ifndef VERIFY
+#define	VERIFY(x)	((void)((x) || (abort(), 0)))
+#endif
+#ifndef __unused
+#define	__unused	__attribute__((__unused__))
+#endif
+#endif
+
 #define MAX_STAT_RETRY 10  /* number of times to retry stat() before abort() */
 #define SYSTEM_KEY 0       /* reserved key for system events */
 
-/* longest command is '<KEY> UNWATCH <path>' */
+/* longest command is '<KEY> <COMMAND> <path>', longest COMMAND UNWATCHMANY */
 #define MAX_KEY_LEN 20     /* number of digits 0-UINT64_MAX */
-#define MAX_CMD_LEN (MAX_KEY_LEN + 1 + 7 + 1 + PATH_MAX + 1)
+#define MAX_NAME_LEN 11    /* strlen("UNWATCHMANY") */
+#define MAX_CMD_LEN (MAX_KEY_LEN + 1 + MAX_NAME_LEN + 1 + PATH_MAX + 1)
+
+#define MAX_BATCH_PATHS 1024 /* max pathnames for WATCHMANY/UNWATCHMANY */
+
+#define MAX_DEBOUNCE_MS 60000 /* max window for -d */
+
+#define OUTPUT_RING_SIZE 4096 /* messages queued for stdout (power of 2) */
+#define OUTPUT_STDIN_BACKLOG 4096 /* overflow messages before stdin waits */
+#define OUTPUT_BUFSZ (64 * 1024) /* stdout buffer size */
+
+/* binary record layout for -b, see the top of this file */
+#define REC_HDR_LEN	56
+#define REC_OFF_LEN	0
+#define REC_OFF_TYPE	4
+#define REC_OFF_FLAGS	5
+#define REC_OFF_KEY	8
+#define REC_OFF_SEC	16
+#define REC_OFF_NSEC	24
+#define REC_OFF_EVENTS	28
+#define REC_OFF_COUNT	32
+#define REC_OFF_CODE	36
+#define REC_OFF_PATH	40
+#define REC_OFF_MSG	44
+#define REC_OFF_DATA	48
+#define REC_FLAG_FINAL	0x01
 
 /*
  * Like VERIFY0, but instead of calling abort(), will print an error message
@@ -166,7 +298,7 @@ enum ErrorCodes {
 	ERR_INVALID_COMMAND = 1, /* failed to parse command from stdin line */
 	ERR_INVALID_KEY,         /* key parsed from command is invalid */
 	ERR_UNKNOWN_COMMAND,     /* line parsable, but command unknown */
-	ERR_CANNOT_ASSOCIATE     /* port_associate(3c) failed */
+	ERR_CANNOT_ASSOCIATE     /* backend_associate() failed */
 };
 
 /*
@@ -178,41 +310,197 @@ enum ResultCodes {
 };
 
 /*
- * file_obj structs are held in memory for every file that is currently being
- * watched.  This way we can 1. verify that incoming events are for files being
- * watched, and 2. unwatch files at a later time if the user wants.
+ * files_tree_node structs are held in memory for every file that is currently
+ * being watched.  This way we can 1. verify that incoming events are for files
+ * being watched, and 2. unwatch files at a later time if the user wants.
  *
- * These structs are stored in a global AVL tree that uses the filename (and a
- * hash of it) as the key.
+ * These structs are stored in a global hash table keyed by filename (see
+ * fswatcher_table.h), and the filenames are interned in files_arena.  Each
+ * holds the backend's state for the watch.
  */
-static avl_tree_t files_tree;
+static table_t files_table;
+static arena_t files_arena;
 struct files_tree_node {
-	struct file_obj fobj;
+	backend_watch_t *watch;
 	char *name;
-	unsigned long name_hash;
-	avl_node_t avl_node;
+	uint64_t name_hash;
+
+	/* debounced events not yet printed (-d only) */
+	int pending_events;
+	uint32_t pending_count;
+	uint64_t pending_deadline;
+	struct files_tree_node *pending_next;
+	struct files_tree_node *pending_prev;
+
+	/* next on the dead list, once unwatched */
+	struct files_tree_node *dead_next;
+};
+
+/*
+ * With -d, nodes that have pending (debounced) events are kept on this list
+ * in the order their windows close.  Since every window is the same length,
+ * this is just the order in which their first event was seen, so nodes are
+ * appended to the tail and the head always has the earliest deadline.
+ *
+ * Only the event thread adds nodes to this list, and only it prints pending
+ * events when their window closes.  Nodes may be removed by either thread
+ * (when they are unwatched), which at worst causes the event thread to wake
+ * up early and find nothing to do.
+ */
+static struct files_tree_node *pending_head = NULL;
+static struct files_tree_node *pending_tail = NULL;
+static uint32_t pending_nodes = 0;
+
+/*
+ * Nodes that have been unwatched but not yet freed.  The event thread fetches
+ * events from the backend without files_mutex held, and an event may refer to
+ * a watch's pathname (as the event ports backend's do, through portev_user)
+ * until backend_get() has copied it.  So a node is only freed by the event
+ * thread, with files_mutex held, after the batch that was fetched while it was
+ * being unwatched has been handled.  Nodes unwatched while the event thread is
+ * blocked waiting for events stay on this list until the next event arrives.
+ */
+static struct files_tree_node *dead_head = NULL;
+
+/*
+ * This program has 3 threads:
+ *
+ * 1. stdin, which reads and processes user commands
+ * 2. events, which reads batches of filesystem events from the backend and
+ *    processes them
+ * 3. output, which writes messages to stdout
+ *
+ * The stdin and events threads take the global "files_mutex" while they
+ * process a command or a batch of events.  This protects the files table, the
+ * debounce list, the batch results and the backend watches.  Neither thread
+ * does any blocking I/O with files_mutex held, apart from the stat(2) needed
+ * to (re)arm a watch: every message they generate is built as an nvlist and
+ * handed to the output thread through the output ring below, or the overflow
+ * list behind it when the ring is full.  Only once it has dropped files_mutex
+ * does a thread wait for the overflow to drain, and the stdin thread lets far
+ * more build up than the events thread does.  This way a slow reader on stdout
+ * holds up the processing of events, but not of commands.
+ */
+static pthread_mutex_t files_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Messages generated by the stdin and events threads are held in output_msg_t
+ * structs until the output thread prints them.  The message type values are
+ * also used as the "type" byte of binary records.
+ */
+typedef enum msg_type {
+	MSG_READY = 1,
+	MSG_EVENT,
+	MSG_RESPONSE,
+	MSG_ERROR
+} msg_type_t;
+
+static const char *msg_type_names[] = {
+	NULL,
+	"ready",
+	"event",
+	"response",
+	"error"
 };
 
+typedef struct output_msg {
+	msg_type_t om_type;
+	struct timespec om_time;	/* CLOCK_MONOTONIC when created */
+	uint64_t om_key;		/* response and error only */
+	uint32_t om_code;		/* response and error only */
+	int om_events;			/* event only: FILE_* flags */
+	uint32_t om_count;		/* event only */
+	boolean_t om_final;		/* event only */
+	char *om_pathname;		/* NULL if none */
+	char *om_message;		/* NULL if none */
+	nvlist_t *om_data;		/* response only: NULL if none */
+	struct output_msg *om_next;	/* on the overflow list */
+} output_msg_t;
+
 /*
- * This programs has 2 main threads running that block on new events from:
+ * The output ring is a bounded lock-free queue of nvlists waiting to be
+ * printed by the output thread.  Each slot has a sequence number saying whether
+ * it is free for the producer claiming position "pos" (os_seq == pos) or holds
+ * a message ready for the consumer (os_seq == pos + 1), so producers can claim
+ * slots with a single atomic increment of output_tail.
  *
- * 1. stdin (user commands)
- * 2. event ports (filesystem events)
+ * output_items counts messages in the ring and output_space counts free slots,
+ * so the output thread sleeps while the ring is empty.  Messages are usually
+ * enqueued with files_mutex held, so they leave in the order their events and
+ * commands were processed.
  *
- * When an event is received from either, this global "work_mutex" is acquired.
- * This way, no other locks are necessary, and whatever method is currently
- * processing its event can safely access members of the AVL tree and write
- * to stdout/stderr.
+ * Producers don't wait for space: a message that doesn't fit goes on the
+ * overflow list, and so does every message after it until the list is empty
+ * again, so the order is kept.  The output thread moves messages from the list
+ * into the ring as it makes room.  Producers wait for the list to shrink in
+ * output_throttle(), without files_mutex held.
  */
-static mutex_t work_mutex = DEFAULTMUTEX;
+struct output_slot {
+	uint32_t os_seq;
+	output_msg_t *os_msg;	/* NULL tells the output thread to exit */
+};
+static struct output_slot output_ring[OUTPUT_RING_SIZE];
+static uint32_t output_tail = 0;	/* next position for producers */
+static uint32_t output_head = 0;	/* next position for output thread */
+static uint64_t output_waits = 0;	/* times producers were throttled */
+static sem_t output_items;
+static sem_t output_space;
+static pthread_t output_thread;
+
+static output_msg_t *overflow_head = NULL;
+static output_msg_t *overflow_tail = NULL;
+static uint32_t overflow_count = 0;	/* written with overflow_mutex held */
+static pthread_mutex_t overflow_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t overflow_cv = PTHREAD_COND_INITIALIZER;
 
-/* global event port handle */
-static int port = -1;
+/*
+ * While a WATCHMANY or UNWATCHMANY command is being processed, the per-path
+ * responses generated by print_response() are collected here instead of being
+ * printed.  They are emitted as a single "response" message by
+ * print_batch_response() once every pathname in the batch has been handled.
+ *
+ * batch_results is non-NULL only while a batch is being processed, and is
+ * protected by files_mutex like everything else.
+ */
+static nvlist_t **batch_results = NULL;
+static uint_t batch_count = 0;
+static uint_t batch_size = 0;
+
+/* Map event port file event flags (used by every backend) to strings */
+struct flag_names {
+	int fn_flag;
+	char *fn_name;
+};
+static struct flag_names flags[] = {
+	{ FILE_ACCESS, "FILE_ACCESS" },
+	{ FILE_ATTRIB, "FILE_ATTRIB" },
+	{ FILE_DELETE, "FILE_DELETE" },
+	{ FILE_EXCEPTION, "FILE_EXCEPTION" },
+	{ FILE_MODIFIED, "FILE_MODIFIED" },
+	{ FILE_RENAME_FROM, "FILE_RENAME_FROM" },
+	{ FILE_RENAME_TO, "FILE_RENAME_TO" },
+	{ FILE_TRUNC, "FILE_TRUNC" },
+	{ FILE_NOFOLLOW, "FILE_NOFOLLOW" },
+	{ MOUNTEDOVER, "MOUNTEDOVER" },
+	{ UNMOUNTED, "UNMOUNTED" }
+};
+#define NUM_FLAGS (sizeof (flags) / sizeof (flags[0]))
+
+/* commands understood on stdin, advertised in the "ready" message */
+static char *commands[] = {
+	"WATCH",
+	"UNWATCH",
+	"STATUS",
+	"WATCHMANY",
+	"UNWATCHMANY"
+};
 
 /* CLI args */
 static struct {
+	boolean_t opt_b; /* -b, binary output */
 	boolean_t opt_j; /* -j, json output */
 	boolean_t opt_r; /* -r, print ready event */
+	uint64_t opt_d;  /* -d, debounce window in nanoseconds (0 = off) */
 } opts;
 
 /*
@@ -222,171 +510,523 @@ static void
 usage(FILE *s)
 {
 	fprintf(s,
-	    "Usage: fswatcher [-hrj]\n"
+	    "Usage: fswatcher [-bhrj] [-d ms]\n"
 	    "\n"
-	    "Watch files using event ports with commands sent to\n"
+	    "Watch files using %s with commands sent to\n"
 	    "stdin and event notifications sent to stdout.\n"
 	    "\n"
 	    "Options\n"
+	    "  -b             binary output (length-prefixed records)\n"
+	    "  -d <ms>        merge events for the same file within <ms>\n"
+	    "                 milliseconds into one event (max %d)\n"
 	    "  -h             print this message and exit\n"
 	    "  -j             JSON output\n"
-	    "  -r             print 'ready' event at start\n");
+	    "  -r             print 'ready' event at start\n",
+	    backend_name, MAX_DEBOUNCE_MS);
 }
 
 /*
- * The unique key for the files_tree_node objects are the filenames.  When a
- * node is created, a hash is calculated for the filename to make comparisons
- * fast.  Only if the hash matches is a full string (strcmp) comparison done.
+ * Returns the current monotonic time in nanoseconds.
  */
-static int
-files_tree_node_comparator(const void *l, const void *r)
+static uint64_t
+now_ns(void)
 {
-	const struct files_tree_node *ltn = l;
-	const struct files_tree_node *rtn = r;
-	int ret;
+	struct timespec tv;
 
-	/* first check filename hash */
-	if (ltn->name_hash < rtn->name_hash)
-		return (-1);
-	else if (ltn->name_hash > rtn->name_hash)
-		return (1);
+	if (clock_gettime(CLOCK_MONOTONIC, &tv) != 0)
+		err(1, "clock_gettime CLOCK_MONOTONIC");
 
-	/* hashes are the same, do string comparison */
-	ret = strcmp(ltn->name, rtn->name);
+	return ((uint64_t)tv.tv_sec * 1000000000ULL + tv.tv_nsec);
+}
 
-	if (ret < 0)
-		return (-1);
-	else if (ret > 0)
-		return (1);
+/*
+ * Allocate a message of the given type, with "time" set to the current time
+ * and copies of pathname and message (either of which may be NULL).  Exits
+ * the program if allocation fails.
+ *
+ * The message is freed by the output thread once it has been printed.
+ */
+static output_msg_t *
+make_msg(msg_type_t type, const char *pathname, const char *message)
+{
+	size_t plen = pathname != NULL ? strlen(pathname) + 1 : 0;
+	size_t mlen = message != NULL ? strlen(message) + 1 : 0;
+	output_msg_t *om;
+	char *p;
+
+	/* the strings are stored just after the struct */
+	if ((om = calloc(1, sizeof (output_msg_t) + plen + mlen)) == NULL)
+		err(1, "calloc message");
+	p = (char *)(om + 1);
+
+	om->om_type = type;
+	if (clock_gettime(CLOCK_MONOTONIC, &om->om_time) != 0)
+		err(1, "clock_gettime CLOCK_MONOTONIC");
 
-	return (0);
+	if (pathname != NULL) {
+		om->om_pathname = p;
+		(void) memcpy(p, pathname, plen);
+		p += plen;
+	}
+	if (message != NULL) {
+		om->om_message = p;
+		(void) memcpy(p, message, mlen);
+	}
+
+	return (om);
 }
 
 /*
- * Simple hashing algorithm pulled from http://www.cse.yorku.ca/~oz/hash.html
- *
- * This function is used primarily to make lookups in the AVL tree faster.
- * Since the tree is keyed off of a files pathname, the pathname string as well
- * as a hash of the string is stored in the tree.
- *
- * There is nothing inherently special or particularly useful about the "djb2"
- * hashing algorithm, really any quick hashing algorithm will work here, since
- * when a hash collision is detected a full strcmp() is performed.
+ * Free a message and its data.
  */
-static unsigned long
-djb2(char *str)
+static void
+free_msg(output_msg_t *om)
 {
-	unsigned long hash = 5381;
-	int c;
-	while ((c = *str++))
-		hash = ((hash << 5) + hash) + c;
-	return (hash);
+	nvlist_free(om->om_data);
+	free(om);
 }
 
 /*
- * Allocate an nvlist with "type" set to the type argument given, and "time"
- * set to the current time.  This function handles any error checking needed
- * and will exit the program if anything fails.
+ * Build the nvlist printed for a message with -j (or without -b).  This
+ * function handles any error checking needed and will exit the program if
+ * anything fails.
  *
  * nvlist must be freed by the caller
  */
 static nvlist_t *
-make_nvlist(char *type)
+msg_to_nvlist(const output_msg_t *om)
 {
 	uint64_t time[2];
 	nvlist_t *nvl;
-	struct timespec tv;
+	uint_t i;
+	uint_t count = 0;
+	char *changes[NUM_FLAGS];
 
 	ENSURE0(nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0));
 
-	/* get the current hrtime */
-	if (clock_gettime(CLOCK_MONOTONIC, &tv) != 0)
-		err(1, "clock_gettime CLOCK_MONOTONIC");
-	time[0] = tv.tv_sec;
-	time[1] = tv.tv_nsec;
+	time[0] = om->om_time.tv_sec;
+	time[1] = om->om_time.tv_nsec;
 
-	ENSURE0(nvlist_add_string(nvl, "type", type));
+	ENSURE0(nvlist_add_string(nvl, "type", msg_type_names[om->om_type]));
 	ENSURE0(nvlist_add_uint64_array(nvl, "time", time, 2));
 
+	switch (om->om_type) {
+	case MSG_READY:
+		ENSURE0(nvlist_add_string_array(nvl, "commands", commands,
+		    sizeof (commands) / sizeof (commands[0])));
+		break;
+	case MSG_EVENT:
+		for (i = 0; i < NUM_FLAGS; i++) {
+			if ((om->om_events & flags[i].fn_flag) != 0) {
+				changes[count++] = flags[i].fn_name;
+			}
+		}
+
+		ENSURE0(nvlist_add_string_array(nvl, "changes", changes,
+		    count));
+		ENSURE0(nvlist_add_string(nvl, "pathname", om->om_pathname));
+		ENSURE0(nvlist_add_int32(nvl, "revents", om->om_events));
+		ENSURE0(nvlist_add_uint32(nvl, "count", om->om_count));
+		ENSURE0(nvlist_add_boolean_value(nvl, "final", om->om_final));
+		break;
+	case MSG_RESPONSE:
+	case MSG_ERROR:
+		ENSURE0(nvlist_add_uint64(nvl, "key", om->om_key));
+		ENSURE0(nvlist_add_uint32(nvl, "code", om->om_code));
+		if (om->om_pathname != NULL) {
+			ENSURE0(nvlist_add_string(nvl, "pathname",
+			    om->om_pathname));
+		}
+		if (om->om_message != NULL) {
+			ENSURE0(nvlist_add_string(nvl, "message",
+			    om->om_message));
+		}
+		if (om->om_type == MSG_ERROR)
+			break;
+
+		ENSURE0(nvlist_add_string(nvl, "result",
+		    om->om_code == RESULT_SUCCESS ? "SUCCESS" : "FAIL"));
+		if (om->om_data != NULL) {
+			ENSURE0(nvlist_add_nvlist(nvl, "data", om->om_data));
+		}
+		break;
+	default:
+		abort();
+	}
+
 	return (nvl);
 }
 
 /*
- * Print an nvlist to stdout.  Will use the proper function to print
- * based on -j being set or not.
- *
- * This function handles fflushing stdout.
+ * Store little-endian integers for binary records.
+ */
+static void
+put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+}
+
+/*
+ * Write a message to stdout as a binary record (-b).  See the top of this
+ * file for the layout.  Only called from the output thread.
+ */
+static void
+write_record(const output_msg_t *om)
+{
+	uint8_t hdr[REC_HDR_LEN];
+	nvlist_t *data = om->om_data;
+	nvlist_t *ready_data = NULL;
+	char *json = NULL;
+	size_t jlen = 0;
+	size_t plen = 0;
+	size_t mlen = 0;
+	uint32_t off = REC_HDR_LEN;
+	FILE *f;
+
+	if (om->om_pathname != NULL)
+		plen = strlen(om->om_pathname);
+	if (om->om_message != NULL)
+		mlen = strlen(om->om_message);
+
+	/* the "ready" message's command list is sent as data */
+	if (om->om_type == MSG_READY) {
+		ENSURE0(nvlist_alloc(&ready_data, NV_UNIQUE_NAME, 0));
+		ENSURE0(nvlist_add_string_array(ready_data, "commands",
+		    commands, sizeof (commands) / sizeof (commands[0])));
+		data = ready_data;
+	}
+
+	if (data != NULL) {
+		if ((f = open_memstream(&json, &jlen)) == NULL)
+			err(1, "open_memstream");
+		nvlist_print_json(f, data);
+		if (fclose(f) != 0)
+			err(1, "fclose memstream");
+	}
+
+	(void) memset(hdr, 0, sizeof (hdr));
+	put32(hdr + REC_OFF_LEN, REC_HDR_LEN + plen + mlen + jlen);
+	hdr[REC_OFF_TYPE] = om->om_type;
+	hdr[REC_OFF_FLAGS] = om->om_final ? REC_FLAG_FINAL : 0;
+	put32(hdr + REC_OFF_KEY, om->om_key & 0xffffffff);
+	put32(hdr + REC_OFF_KEY + 4, om->om_key >> 32);
+	put32(hdr + REC_OFF_SEC, (uint64_t)om->om_time.tv_sec & 0xffffffff);
+	put32(hdr + REC_OFF_SEC + 4, (uint64_t)om->om_time.tv_sec >> 32);
+	put32(hdr + REC_OFF_NSEC, om->om_time.tv_nsec);
+	put32(hdr + REC_OFF_EVENTS, om->om_events);
+	put32(hdr + REC_OFF_COUNT, om->om_count);
+	put32(hdr + REC_OFF_CODE, om->om_code);
+	if (om->om_pathname != NULL) {
+		put16(hdr + REC_OFF_PATH, off);
+		put16(hdr + REC_OFF_PATH + 2, plen);
+		off += plen;
+	}
+	if (om->om_message != NULL) {
+		put16(hdr + REC_OFF_MSG, off);
+		put16(hdr + REC_OFF_MSG + 2, mlen);
+		off += mlen;
+	}
+	if (data != NULL) {
+		put32(hdr + REC_OFF_DATA, off);
+		put32(hdr + REC_OFF_DATA + 4, jlen);
+	}
+
+	(void) fwrite(hdr, sizeof (hdr), 1, stdout);
+	if (plen > 0)
+		(void) fwrite(om->om_pathname, 1, plen, stdout);
+	if (mlen > 0)
+		(void) fwrite(om->om_message, 1, mlen, stdout);
+	if (jlen > 0)
+		(void) fwrite(json, 1, jlen, stdout);
+
+	free(json);
+	nvlist_free(ready_data);
+}
+
+/*
+ * Print a message to stdout in the format selected by -b or -j.  Only called
+ * from the output thread.
  */
 static void
-print_nvlist(nvlist_t *nvl)
+write_msg(const output_msg_t *om)
 {
+	nvlist_t *nvl;
+
+	if (opts.opt_b) {
+		write_record(om);
+		return;
+	}
+
+	nvl = msg_to_nvlist(om);
 	if (opts.opt_j)
 		nvlist_print_json(stdout, nvl);
 	else
 		nvlist_print(stdout, nvl);
-	printf("\n");
+	(void) putchar('\n');
+	nvlist_free(nvl);
+}
 
-	fflush(stdout);
+/*
+ * sem_wait(3C), retrying if interrupted.
+ */
+static void
+sem_wait_nointr(sem_t *sem)
+{
+	while (sem_wait(sem) != 0) {
+		if (errno != EINTR)
+			err(1, "sem_wait");
+	}
 }
 
 /*
- * Handle creating and printing an "event" message.
+ * Put a message in a slot of the output ring, which the caller has already
+ * taken from output_space.
  */
 static void
-print_event(int event, char *pathname, boolean_t is_final)
+output_put(output_msg_t *om)
 {
-	nvlist_t *nvl = make_nvlist("event");
-	uint_t i;
-	uint_t count = 0;
+	struct output_slot *os;
+	uint32_t pos;
+
+	pos = __atomic_fetch_add(&output_tail, 1, __ATOMIC_RELAXED);
+	os = &output_ring[pos & (OUTPUT_RING_SIZE - 1)];
+
+	/* the slot's previous message may still be being taken out */
+	while (__atomic_load_n(&os->os_seq, __ATOMIC_ACQUIRE) != pos)
+		(void) sched_yield();
+
+	os->os_msg = om;
+	__atomic_store_n(&os->os_seq, pos + 1, __ATOMIC_RELEASE);
+
+	if (sem_post(&output_items) != 0)
+		err(1, "sem_post");
+}
+
+/*
+ * Add a message to the output ring, or to the overflow list if the ring is
+ * full or the list isn't empty.  Never blocks on the output thread.  The output
+ * thread takes ownership of om.
+ */
+static void
+output_enqueue(output_msg_t *om)
+{
+	/* the list only fills up with files_mutex held, so this is stable */
+	if (__atomic_load_n(&overflow_count, __ATOMIC_ACQUIRE) == 0 &&
+	    sem_trywait(&output_space) == 0) {
+		output_put(om);
+		return;
+	}
+
+	pthread_mutex_lock(&overflow_mutex);
+	if (overflow_count == 0 && sem_trywait(&output_space) == 0) {
+		output_put(om);
+	} else {
+		om->om_next = NULL;
+		if (overflow_tail != NULL)
+			overflow_tail->om_next = om;
+		else
+			overflow_head = om;
+		overflow_tail = om;
+		__atomic_store_n(&overflow_count, overflow_count + 1,
+		    __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&overflow_mutex);
+}
+
+/*
+ * Move messages from the overflow list into the ring while there is room.
+ * Only called from the output thread, after it has taken a message out.
+ */
+static void
+output_refill(void)
+{
+	output_msg_t *om;
+
+	if (__atomic_load_n(&overflow_count, __ATOMIC_ACQUIRE) == 0)
+		return;
+
+	pthread_mutex_lock(&overflow_mutex);
+	while ((om = overflow_head) != NULL &&
+	    sem_trywait(&output_space) == 0) {
+		overflow_head = om->om_next;
+		if (overflow_head == NULL)
+			overflow_tail = NULL;
+		output_put(om);
+		__atomic_store_n(&overflow_count, overflow_count - 1,
+		    __ATOMIC_RELEASE);
+	}
+	(void) pthread_cond_broadcast(&overflow_cv);
+	pthread_mutex_unlock(&overflow_mutex);
+}
+
+/*
+ * Wait until no more than limit messages are on the overflow list.  Called
+ * without files_mutex held, so that only the calling thread is held up.
+ */
+static void
+output_throttle(uint32_t limit)
+{
+	if (__atomic_load_n(&overflow_count, __ATOMIC_ACQUIRE) <= limit)
+		return;
+
+	(void) __atomic_add_fetch(&output_waits, 1, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&overflow_mutex);
+	while (overflow_count > limit)
+		(void) pthread_cond_wait(&overflow_cv, &overflow_mutex);
+	pthread_mutex_unlock(&overflow_mutex);
+}
+
+/*
+ * Take the next message off the output ring.  Only called from the output
+ * thread, after a successful wait on output_items.
+ */
+static output_msg_t *
+output_dequeue(void)
+{
+	struct output_slot *os;
+	output_msg_t *om;
+	uint32_t pos = output_head;
+
+	os = &output_ring[pos & (OUTPUT_RING_SIZE - 1)];
+
+	/* the producer may not have finished filling in the slot */
+	while (__atomic_load_n(&os->os_seq, __ATOMIC_ACQUIRE) != pos + 1)
+		(void) sched_yield();
+
+	om = os->os_msg;
+	__atomic_store_n(&os->os_seq, pos + OUTPUT_RING_SIZE,
+	    __ATOMIC_RELEASE);
+	__atomic_store_n(&output_head, pos + 1, __ATOMIC_RELEASE);
+
+	if (sem_post(&output_space) != 0)
+		err(1, "sem_post");
+
+	return (om);
+}
+
+/*
+ * The number of messages waiting to be printed, in the ring and on the
+ * overflow list.
+ */
+static uint32_t
+output_depth(void)
+{
+	return (__atomic_load_n(&output_tail, __ATOMIC_RELAXED) -
+	    __atomic_load_n(&output_head, __ATOMIC_RELAXED) +
+	    __atomic_load_n(&overflow_count, __ATOMIC_RELAXED));
+}
+
+/*
+ * Output thread waits here for messages.  Messages are written to stdout,
+ * which is fully buffered, and stdout is flushed only once the ring is empty
+ * so a burst of messages is written with as few write(2) calls as possible.
+ */
+static void *
+wait_for_output(void *arg __unused)
+{
+	output_msg_t *om;
+
+	for (;;) {
+		sem_wait_nointr(&output_items);
 
-	/* Map event port file event flags to strings */
-	struct flag_names {
-		int fn_flag;
-		char *fn_name;
-	};
-	static struct flag_names flags[] = {
-		{ FILE_ACCESS, "FILE_ACCESS" },
-		{ FILE_ATTRIB, "FILE_ATTRIB" },
-		{ FILE_DELETE, "FILE_DELETE" },
-		{ FILE_EXCEPTION, "FILE_EXCEPTION" },
-		{ FILE_MODIFIED, "FILE_MODIFIED" },
-		{ FILE_RENAME_FROM, "FILE_RENAME_FROM" },
-		{ FILE_RENAME_TO, "FILE_RENAME_TO" },
-		{ FILE_TRUNC, "FILE_TRUNC" },
-		{ FILE_NOFOLLOW, "FILE_NOFOLLOW" },
-		{ MOUNTEDOVER, "MOUNTEDOVER" },
-		{ UNMOUNTED, "UNMOUNTED" }
-	};
-	static const uint_t num_flags = (sizeof (flags) / sizeof (flags[0]));
-	char *changes[num_flags];
-
-	for (i = 0; i < num_flags; i++) {
-		if ((event & flags[i].fn_flag) != 0) {
-			changes[count++] = flags[i].fn_name;
+		for (;;) {
+			if ((om = output_dequeue()) == NULL) {
+				(void) fflush(stdout);
+				return (NULL);
+			}
+			output_refill();
+
+			write_msg(om);
+			free_msg(om);
+
+			/* keep going without flushing while the ring is busy */
+			if (sem_trywait(&output_items) != 0)
+				break;
 		}
+
+		(void) fflush(stdout);
 	}
+}
 
-	ENSURE0(nvlist_add_string_array(nvl, "changes", changes, count));
-	ENSURE0(nvlist_add_string(nvl, "pathname", pathname));
-	ENSURE0(nvlist_add_int32(nvl, "revents", event));
-	ENSURE0(nvlist_add_boolean_value(nvl, "final", is_final));
+/*
+ * Set up the output ring and stdout buffering.
+ */
+static void
+output_init(void)
+{
+	uint32_t i;
 
-	print_nvlist(nvl);
+	for (i = 0; i < OUTPUT_RING_SIZE; i++)
+		output_ring[i].os_seq = i;
 
-	nvlist_free(nvl);
+	if (sem_init(&output_items, 0, 0) != 0 ||
+	    sem_init(&output_space, 0, OUTPUT_RING_SIZE) != 0) {
+		err(1, "sem_init");
+	}
+
+	if (setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFSZ) != 0)
+		err(1, "setvbuf");
 }
 
 /*
- * Handle creating and printing a "ready" message.
+ * Wait for every message queued so far to be written, and stop the output
+ * thread.
  */
 static void
-print_ready()
+output_fini(void)
 {
-	nvlist_t *nvl = make_nvlist("ready");
+	output_throttle(0);
+	sem_wait_nointr(&output_space);
+	output_put(NULL);
+	(void) pthread_join(output_thread, NULL);
+}
 
-	print_nvlist(nvl);
+/*
+ * Queue a message to be printed to stdout by the output thread, in the format
+ * selected by -b or -j.
+ *
+ * The message is freed once it has been printed.
+ */
+static void
+print_msg(output_msg_t *om)
+{
+	output_enqueue(om);
+}
 
-	nvlist_free(nvl);
+/*
+ * Handle creating and printing an "event" message.
+ */
+static void
+print_event(int event, uint32_t event_count, char *pathname,
+    boolean_t is_final)
+{
+	output_msg_t *om = make_msg(MSG_EVENT, pathname, NULL);
+
+	om->om_events = event;
+	om->om_count = event_count;
+	om->om_final = is_final;
+
+	print_msg(om);
+}
+
+/*
+ * Handle creating and printing a "ready" message.
+ */
+static void
+print_ready()
+{
+	print_msg(make_msg(MSG_READY, NULL, NULL));
 }
 
 /*
@@ -398,7 +1038,7 @@ print_error(uint64_t key, uint32_t code, const char *message_fmt, ...)
 {
 	va_list arg_ptr;
 	char message[4096];
-	nvlist_t *nvl = make_nvlist("error");
+	output_msg_t *om;
 
 	va_start(arg_ptr, message_fmt);
 	if (vsnprintf(message, sizeof (message), message_fmt, arg_ptr) < 0) {
@@ -407,18 +1047,19 @@ print_error(uint64_t key, uint32_t code, const char *message_fmt, ...)
 	}
 	va_end(arg_ptr);
 
-	ENSURE0(nvlist_add_uint64(nvl, "key", key));
-	ENSURE0(nvlist_add_uint32(nvl, "code", code));
-	ENSURE0(nvlist_add_string(nvl, "message", message));
-
-	print_nvlist(nvl);
+	om = make_msg(MSG_ERROR, NULL, message);
+	om->om_key = key;
+	om->om_code = code;
 
-	nvlist_free(nvl);
+	print_msg(om);
 }
 
 /*
  * print_response() takes a key, code (RESULT_SUCCESS||RESULT_FAILURE), pathname
  * and message and handles creating and printing a "result" message.
+ *
+ * If a batch command is being processed, the result is instead added to
+ * batch_results (without a key) to be printed later by print_batch_response().
  */
 static void
 print_response(uint64_t key, uint32_t code, const char *pathname,
@@ -426,7 +1067,8 @@ print_response(uint64_t key, uint32_t code, const char *pathname,
 {
 	va_list arg_ptr;
 	char message[4096];
-	nvlist_t *nvl = make_nvlist("response");
+	nvlist_t *nvl;
+	output_msg_t *om;
 
 	va_start(arg_ptr, message_fmt);
 	if (vsnprintf(message, sizeof (message), message_fmt, arg_ptr) < 0) {
@@ -435,16 +1077,65 @@ print_response(uint64_t key, uint32_t code, const char *pathname,
 	}
 	va_end(arg_ptr);
 
-	ENSURE0(nvlist_add_uint64(nvl, "key", key));
-	ENSURE0(nvlist_add_uint32(nvl, "code", code));
-	ENSURE0(nvlist_add_string(nvl, "pathname", pathname));
-	ENSURE0(nvlist_add_string(nvl, "message", message));
-	ENSURE0(nvlist_add_string(nvl, "result",
-	    code == RESULT_SUCCESS ? "SUCCESS" : "FAIL"));
+	if (batch_results != NULL) {
+		VERIFY3U(batch_count, <, batch_size);
 
-	print_nvlist(nvl);
+		ENSURE0(nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0));
+		ENSURE0(nvlist_add_string(nvl, "pathname", pathname));
+		ENSURE0(nvlist_add_uint32(nvl, "code", code));
+		ENSURE0(nvlist_add_string(nvl, "message", message));
+		ENSURE0(nvlist_add_string(nvl, "result",
+		    code == RESULT_SUCCESS ? "SUCCESS" : "FAIL"));
 
-	nvlist_free(nvl);
+		batch_results[batch_count++] = nvl;
+		return;
+	}
+
+	om = make_msg(MSG_RESPONSE, pathname, message);
+	om->om_key = key;
+	om->om_code = code;
+
+	print_msg(om);
+}
+
+/*
+ * Only called from stdin thread.  Prints a single "response" message for a
+ * completed batch command, made up of the per-path results collected in
+ * batch_results, and frees them.
+ */
+static void
+print_batch_response(uint64_t key, const char *cmd)
+{
+	uint_t i;
+	uint_t nfailed = 0;
+	uint32_t code;
+	char message[64];
+	output_msg_t *om;
+	nvlist_t *data_nvl = fnvlist_alloc();
+
+	for (i = 0; i < batch_count; i++) {
+		ENSURE0(nvlist_lookup_uint32(batch_results[i], "code", &code));
+		if (code != RESULT_SUCCESS)
+			nfailed++;
+	}
+	code = nfailed == 0 ? RESULT_SUCCESS : RESULT_FAILURE;
+
+	(void) snprintf(message, sizeof (message), "%s: %u/%u paths failed",
+	    cmd, nfailed, batch_count);
+
+	ENSURE0(nvlist_add_nvlist_array(data_nvl, "results", batch_results,
+	    batch_count));
+	ENSURE0(nvlist_add_uint32(data_nvl, "results_count", batch_count));
+
+	om = make_msg(MSG_RESPONSE, NULL, message);
+	om->om_key = key;
+	om->om_code = code;
+	om->om_data = data_nvl;
+
+	print_msg(om);
+
+	for (i = 0; i < batch_count; i++)
+		nvlist_free(batch_results[i]);
 }
 
 /*
@@ -459,24 +1150,22 @@ print_status(uint64_t key)
 	char **filenames;
 	struct files_tree_node *ftn;
 	ulong_t i = 0;
-	nvlist_t *nvl = make_nvlist("response");
+	uint32_t cursor = 0;
+	output_msg_t *om = make_msg(MSG_RESPONSE, NULL, NULL);
 	nvlist_t *data_nvl = fnvlist_alloc();
 
-	ENSURE0(nvlist_add_uint64(nvl, "key", key));
-	ENSURE0(nvlist_add_uint32(nvl, "code", RESULT_SUCCESS));
-	ENSURE0(nvlist_add_string(nvl, "result", "SUCCESS"));
+	om->om_key = key;
+	om->om_code = RESULT_SUCCESS;
 
-	/* get all nodes in the avl tree */
-	numnodes = avl_numnodes(&files_tree);
+	/* get all nodes in the table */
+	numnodes = files_table.t_count;
 	filenames = calloc(numnodes, sizeof (char *));
 
 	if (filenames == NULL)
 		err(1, "calloc");
 
-	/* walk the avl tree and add each filename */
-	for (ftn = avl_first(&files_tree); ftn != NULL;
-	    ftn = AVL_NEXT(&files_tree, ftn)) {
-
+	/* walk the table and add each filename */
+	while ((ftn = table_next(&files_table, &cursor)) != NULL) {
 		filenames[i++] = ftn->name;
 	}
 
@@ -487,59 +1176,169 @@ print_status(uint64_t key)
 	ENSURE0(nvlist_add_string_array(data_nvl, "files", filenames, i));
 	ENSURE0(nvlist_add_uint32(data_nvl, "files_count", numnodes));
 	ENSURE0(nvlist_add_int32(data_nvl, "pid", getpid()));
+	ENSURE0(nvlist_add_uint64(data_nvl, "debounce_ms",
+	    opts.opt_d / 1000000));
+	ENSURE0(nvlist_add_uint32(data_nvl, "pending_count", pending_nodes));
+	ENSURE0(nvlist_add_uint64(data_nvl, "arena_bytes",
+	    files_arena.a_bytes));
+	ENSURE0(nvlist_add_uint32(data_nvl, "queue_depth", output_depth()));
+	ENSURE0(nvlist_add_uint32(data_nvl, "queue_size", OUTPUT_RING_SIZE));
+	ENSURE0(nvlist_add_uint64(data_nvl, "queue_waits",
+	    __atomic_load_n(&output_waits, __ATOMIC_RELAXED)));
 
-	ENSURE0(nvlist_add_nvlist(nvl, "data", data_nvl));
+	om->om_data = data_nvl;
 
-	print_nvlist(nvl);
+	print_msg(om);
 
-	nvlist_free(data_nvl);
-	nvlist_free(nvl);
 	free(filenames);
 }
 
 /*
  * find_handle() takes a pathname and returns the files_tree_node struct from
- * the files_tree treeh. returns NULL if no pathname matches.
+ * the files_table table. returns NULL if no pathname matches.
  */
 static struct files_tree_node *
 find_handle(char *pathname)
 {
-	struct files_tree_node lookup;
-
-	lookup.name = pathname;
-	lookup.name_hash = djb2(pathname);
-
-	return (avl_find(&files_tree, &lookup, NULL));
+	return (table_find(&files_table, pathname,
+	    path_hash(pathname, strlen(pathname))));
 }
 
 /*
- * add_handle() inserts a files_tree_node struct into the files_tree tree.
+ * add_handle() inserts a files_tree_node struct into the files_table table.
  */
 static void
 add_handle(struct files_tree_node *ftn)
 {
-	avl_add(&files_tree, ftn);
+	table_add(&files_table, ftn->name, ftn->name_hash, ftn);
 }
 
 /*
- * remove_handle() removes a files_tree_node struct from the files_tree tree.
+ * remove_handle() removes a files_tree_node struct from the files_table
+ * table.
  */
 static void
 remove_handle(struct files_tree_node *ftn)
 {
-	avl_remove(&files_tree, ftn);
+	VERIFY3P(table_remove(&files_table, ftn->name, ftn->name_hash), ==,
+	    ftn);
+}
+
+/*
+ * pending_add() records an event for ftn to be printed when its debounce
+ * window closes, starting the window if this is the first pending event.
+ */
+static void
+pending_add(struct files_tree_node *ftn, int revents)
+{
+	if (ftn->pending_count++ == 0) {
+		ftn->pending_deadline = now_ns() + opts.opt_d;
+		ftn->pending_next = NULL;
+		ftn->pending_prev = pending_tail;
+		if (pending_tail != NULL)
+			pending_tail->pending_next = ftn;
+		else
+			pending_head = ftn;
+		pending_tail = ftn;
+		pending_nodes++;
+	}
+	ftn->pending_events |= revents;
+}
+
+/*
+ * pending_remove() takes ftn off the pending list (if it is on it) and clears
+ * its pending events without printing them.
+ */
+static void
+pending_remove(struct files_tree_node *ftn)
+{
+	if (ftn->pending_count == 0)
+		return;
+
+	if (ftn->pending_prev != NULL)
+		ftn->pending_prev->pending_next = ftn->pending_next;
+	else
+		pending_head = ftn->pending_next;
+	if (ftn->pending_next != NULL)
+		ftn->pending_next->pending_prev = ftn->pending_prev;
+	else
+		pending_tail = ftn->pending_prev;
+
+	ftn->pending_events = 0;
+	ftn->pending_count = 0;
+	ftn->pending_next = NULL;
+	ftn->pending_prev = NULL;
+	pending_nodes--;
+}
+
+/*
+ * pending_flush() prints any pending events for ftn as a single non-final
+ * event.
+ */
+static void
+pending_flush(struct files_tree_node *ftn)
+{
+	int revents = ftn->pending_events;
+	uint32_t count = ftn->pending_count;
+
+	if (count == 0)
+		return;
+
+	pending_remove(ftn);
+	print_event(revents, count, ftn->name, B_FALSE);
+}
+
+/*
+ * pending_expire() prints pending events for every node whose window has
+ * closed.  Returns the time (in nanoseconds) until the next window closes, or
+ * 0 if there are no pending events left.
+ */
+static uint64_t
+pending_expire(void)
+{
+	uint64_t now;
+
+	if (pending_head == NULL)
+		return (0);
+
+	now = now_ns();
+	while (pending_head != NULL && pending_head->pending_deadline <= now)
+		pending_flush(pending_head);
+
+	if (pending_head == NULL)
+		return (0);
+
+	return (pending_head->pending_deadline - now);
 }
 
 /*
- * destroy_handle() removes and frees a files_tree_node struct from the
- * files_tree tree.
+ * destroy_handle() removes a files_tree_node struct from the files_table
+ * table, and puts it on the dead list to be freed by reap_handles().
  */
 static void
 destroy_handle(struct files_tree_node *ftn)
 {
+	pending_remove(ftn);
 	remove_handle(ftn);
-	free(ftn->name);
-	free(ftn);
+	ftn->dead_next = dead_head;
+	dead_head = ftn;
+}
+
+/*
+ * reap_handles() frees the nodes on the dead list.  Only the event thread
+ * calls this, between batches of events.
+ */
+static void
+reap_handles(void)
+{
+	struct files_tree_node *ftn;
+
+	while ((ftn = dead_head) != NULL) {
+		dead_head = ftn->dead_next;
+		backend_watch_free(ftn->watch);
+		arena_free(&files_arena, ftn->name);
+		free(ftn);
+	}
 }
 
 /*
@@ -625,7 +1424,7 @@ get_stat(char *pathname, struct stat *sb)
 
 /*
  * check_and_rearm_event() is called to (re)arm watches. This can either be
- * because of an event (in which case revents should be pe.portev_events) or to
+ * because of an event (in which case revents should be be_events) or to
  * initially arm in which case revents should be 0.
  *
  * It also performs the required stat() and in case this is a re-arm prints
@@ -643,7 +1442,6 @@ check_and_rearm_event(uint64_t key, char *name, int revents,
 	struct stat sb;
 	int stat_ret;
 	int pa_ret;
-	struct file_obj *fobjp;
 
 	/* ftn may be passed as an argument.  if not, we look for it. */
 	if (ftn == NULL) {
@@ -682,22 +1480,20 @@ check_and_rearm_event(uint64_t key, char *name, int revents,
 	}
 
 	if (is_final) {
-		/* We're not going to re-watch the file, so cleanup */
+		/*
+		 * We're not going to re-watch the file, so cleanup.  Any
+		 * debounced events are merged into this one.
+		 */
 		if (revents != 0) {
-			print_event(revents, name, B_TRUE);
+			print_event(revents | ftn->pending_events,
+			    ftn->pending_count + 1, name, B_TRUE);
 		}
 		destroy_handle(ftn);
 		return;
 	}
 
 	/* (re)register watch */
-	fobjp = &ftn->fobj;
-	fobjp->fo_atime = sb.st_atim;
-	fobjp->fo_mtime = sb.st_mtim;
-	fobjp->fo_ctime = sb.st_ctim;
-
-	pa_ret = port_associate(port, PORT_SOURCE_FILE, (uintptr_t)fobjp,
-	    FILE_MODIFIED|FILE_TRUNC, name);
+	pa_ret = backend_associate(ftn->watch, &sb, FILE_MODIFIED|FILE_TRUNC);
 
 	if (key != SYSTEM_KEY) {
 		/*
@@ -707,14 +1503,14 @@ check_and_rearm_event(uint64_t key, char *name, int revents,
 		VERIFY3S(revents, ==, 0);
 		if (pa_ret == -1) {
 			print_response(key, RESULT_FAILURE, name,
-			    "port_associate(3c) failed with errno %d: %s",
-			    errno, strerror(errno));
+			    "%s failed with errno %d: %s",
+			    backend_associate_name, errno, strerror(errno));
 			destroy_handle(ftn);
 			return;
 		}
 
 		print_response(key, RESULT_SUCCESS, name,
-		    "port_associate(3c) started watching path");
+		    "%s started watching path", backend_associate_name);
 		return;
 	}
 
@@ -723,12 +1519,20 @@ check_and_rearm_event(uint64_t key, char *name, int revents,
 	 * being seen.
 	 */
 	VERIFY3S(revents, !=, 0);
-	print_event(revents, name, B_FALSE);
+	if (opts.opt_d > 0 && pa_ret == 0) {
+		/* printed by pending_expire() when the window closes */
+		pending_add(ftn, revents);
+		return;
+	}
+
+	print_event(revents | ftn->pending_events, ftn->pending_count + 1,
+	    name, B_FALSE);
+	pending_remove(ftn);
 
 	if (pa_ret == -1) {
 		print_error(key, ERR_CANNOT_ASSOCIATE,
-		    "port_associate(3c) failed for '%s', errno %d: %s",
-		    name, errno, strerror(errno));
+		    "%s failed for '%s', errno %d: %s",
+		    backend_associate_name, name, errno, strerror(errno));
 		destroy_handle(ftn);
 	}
 }
@@ -741,8 +1545,10 @@ watch_path(char *pathname, uint64_t key)
 {
 	struct files_tree_node *ftn;
 	char *dupname;
+	size_t len = strlen(pathname);
+	uint64_t hash = path_hash(pathname, len);
 
-	if (find_handle(pathname) != NULL) {
+	if (table_find(&files_table, pathname, hash) != NULL) {
 		print_response(key, RESULT_SUCCESS, pathname,
 		    "already watching");
 		return;
@@ -756,13 +1562,15 @@ watch_path(char *pathname, uint64_t key)
 	 * Copy the pathname given here as we need to hold onto it for as long
 	 * as the file is being watched.
 	 */
-	dupname = strdup(pathname);
-	if (dupname == NULL)
-		err(1, "strdup new watcher");
+	dupname = arena_strdup(&files_arena, pathname, len);
 
-	ftn->fobj.fo_name = dupname;
+	ftn->watch = backend_watch_alloc(dupname);
 	ftn->name = dupname;
-	ftn->name_hash = djb2(dupname);
+	ftn->name_hash = hash;
+	ftn->pending_events = 0;
+	ftn->pending_count = 0;
+	ftn->pending_next = NULL;
+	ftn->pending_prev = NULL;
 
 	add_handle(ftn);
 
@@ -775,8 +1583,8 @@ watch_path(char *pathname, uint64_t key)
 static void
 unwatch_path(char *pathname, uint64_t key)
 {
-	struct file_obj *fobjp;
 	int ret;
+	int ret_errno;
 	struct files_tree_node *ftn;
 
 	ftn = find_handle(pathname);
@@ -786,9 +1594,9 @@ unwatch_path(char *pathname, uint64_t key)
 		return;
 	}
 
-	fobjp = &ftn->fobj;
 	/*
-	 * From the man page, there are 5 possible errors for port_dissociate():
+	 * From the man page, there are 5 possible errors for port_dissociate()
+	 * (the other backends map their errors onto these):
 	 *
 	 * EBADF
 	 *          The port identifier is not valid.
@@ -811,14 +1619,18 @@ unwatch_path(char *pathname, uint64_t key)
 	 * same file, so in every case we assume that the file is no longer
 	 * associated and remove the handle.
 	 */
-	ret = port_dissociate(port, PORT_SOURCE_FILE, (uintptr_t)fobjp);
+	ret = backend_dissociate(ftn->watch);
+	ret_errno = errno;
+
+	/* don't lose debounced events for this file */
+	pending_flush(ftn);
 
 	destroy_handle(ftn);
 
 	if (ret == -1) {
 		print_response(key, RESULT_FAILURE, pathname,
-		    "failed to unregister '%s' (errno %d): %s", pathname, errno,
-		    strerror(errno));
+		    "failed to unregister '%s' (errno %d): %s", pathname,
+		    ret_errno, strerror(ret_errno));
 	} else {
 		print_response(key, RESULT_SUCCESS, pathname,
 		    "no longer watching '%s'", pathname);
@@ -826,10 +1638,49 @@ unwatch_path(char *pathname, uint64_t key)
 }
 
 /*
- * Process one line of stdin
+ * Only called from stdin thread.  Watches or unwatches (based on do_watch)
+ * every pathname given, and emits a single response for the whole batch.
  */
 static void
-process_stdin_line(char *str)
+process_batch(uint64_t key, const char *cmd, char **paths, uint_t npaths,
+    boolean_t do_watch)
+{
+	uint_t i;
+
+	VERIFY3P(batch_results, ==, NULL);
+
+	batch_results = calloc(npaths, sizeof (nvlist_t *));
+	if (batch_results == NULL)
+		err(1, "calloc");
+	batch_count = 0;
+	batch_size = npaths;
+
+	for (i = 0; i < npaths; i++) {
+		if (paths[i][0] == '\0') {
+			print_response(key, RESULT_FAILURE, paths[i],
+			    "invalid pathname");
+		} else if (do_watch) {
+			watch_path(paths[i], key);
+		} else {
+			unwatch_path(paths[i], key);
+		}
+	}
+
+	VERIFY3U(batch_count, ==, npaths);
+	print_batch_response(key, cmd);
+
+	free(batch_results);
+	batch_results = NULL;
+	batch_count = 0;
+	batch_size = 0;
+}
+
+/*
+ * Process one line of stdin.  For batch commands, paths and npaths are the
+ * pathname lines that followed the command (see read_batch_paths()).
+ */
+static void
+process_stdin_line(char *str, char **paths, uint_t npaths)
 {
 	char cmd[MAX_CMD_LEN + 1];
 	char path[MAX_CMD_LEN + 1];
@@ -884,12 +1735,132 @@ process_stdin_line(char *str)
 		}
 
 		print_status(key);
+	} else if (strcmp("WATCHMANY", cmd) == 0 ||
+	    strcmp("UNWATCHMANY", cmd) == 0) {
+		if (path[0] == '\0') {
+			print_error(SYSTEM_KEY, ERR_INVALID_COMMAND,
+			    "invalid command line - %s requires count", cmd);
+			return;
+		}
+
+		if (npaths == 0 || npaths > MAX_BATCH_PATHS || paths == NULL) {
+			print_error(key, ERR_INVALID_COMMAND,
+			    "invalid count for %s: must be 1-%d", cmd,
+			    MAX_BATCH_PATHS);
+			return;
+		}
+
+		process_batch(key, cmd, paths, npaths,
+		    strcmp("WATCHMANY", cmd) == 0);
 	} else {
 		print_error(key, ERR_UNKNOWN_COMMAND, "unknown command '%s'",
 		    cmd);
 	}
 }
 
+/*
+ * Called when stdin can no longer be read.  Exits the program.
+ */
+static void
+stdin_done(void)
+{
+	/* stdin closed or error */
+	if (feof(stdin)) {
+		/* write out any messages still queued before exiting */
+		pthread_mutex_lock(&files_mutex);
+		output_fini();
+		errx(0, "stdin closed");
+	} else {
+		perror("stdin fgets");
+		abort();
+	}
+}
+
+/*
+ * Only called from stdin thread.  If str is a batch command (WATCHMANY or
+ * UNWATCHMANY), read the <count> pathname lines that follow it from stdin.
+ *
+ * This is done before files_mutex is taken so a slow writer on stdin cannot
+ * hold up event processing while a batch is being sent.
+ *
+ * Returns an array of pathnames (to be freed by free_batch_paths()) and sets
+ * npathsp to the count given.  If the line is not a batch command, NULL is
+ * returned and npathsp is set to 0.  If the count is larger than
+ * MAX_BATCH_PATHS, the pathnames are read and discarded (to keep stdin in
+ * sync) and NULL is returned, which process_stdin_line() reports as an error.
+ */
+static char **
+read_batch_paths(const char *str, uint_t *npathsp)
+{
+	char cmd[MAX_CMD_LEN + 1];
+	char line[MAX_CMD_LEN + 1];
+	unsigned long long key;
+	unsigned int npaths;
+	char **paths = NULL;
+	uint_t i;
+
+	*npathsp = 0;
+
+	if (strlen(str) > MAX_CMD_LEN ||
+	    sscanf(str, "%llu %s %u", &key, cmd, &npaths) != 3 ||
+	    (strcmp("WATCHMANY", cmd) != 0 &&
+	    strcmp("UNWATCHMANY", cmd) != 0)) {
+		return (NULL);
+	}
+
+	if (npaths > 0 && npaths <= MAX_BATCH_PATHS) {
+		paths = calloc(npaths, sizeof (char *));
+		if (paths == NULL)
+			err(1, "calloc");
+	}
+
+	for (i = 0; i < npaths; i++) {
+		size_t len;
+
+		if (fgets(line, sizeof (line), stdin) == NULL)
+			stdin_done();
+
+		len = strlen(line);
+		if (len > 0 && line[len - 1] == '\n') {
+			line[--len] = '\0';
+		} else if (!feof(stdin)) {
+			/*
+			 * The line was too long to be a pathname: discard the
+			 * rest of it and mark this entry as invalid.
+			 */
+			int c;
+			while ((c = getchar()) != EOF && c != '\n')
+				;
+			line[0] = '\0';
+		}
+
+		if (paths == NULL)
+			continue;
+
+		if ((paths[i] = strdup(line)) == NULL)
+			err(1, "strdup batch path");
+	}
+
+	*npathsp = npaths;
+	return (paths);
+}
+
+/*
+ * Free pathnames returned by read_batch_paths().
+ */
+static void
+free_batch_paths(char **paths, uint_t npaths)
+{
+	uint_t i;
+
+	if (paths == NULL)
+		return;
+
+	for (i = 0; i < npaths; i++)
+		free(paths[i]);
+	free(paths);
+}
+
 /*
  * Worker thread waits here for stdin data.
  */
@@ -897,59 +1868,75 @@ static void *
 wait_for_stdin(void *arg __unused)
 {
 	char str[MAX_CMD_LEN + 1];
+	char **paths;
+	uint_t npaths;
 
 	/* read stdin line-by-line indefinitely */
 	while (fgets(str, sizeof (str), stdin) != NULL) {
-		mutex_lock(&work_mutex);
-		process_stdin_line(str);
-		mutex_unlock(&work_mutex);
+		paths = read_batch_paths(str, &npaths);
+
+		pthread_mutex_lock(&files_mutex);
+		process_stdin_line(str, paths, npaths);
+		pthread_mutex_unlock(&files_mutex);
 
+		free_batch_paths(paths, npaths);
+		output_throttle(OUTPUT_STDIN_BACKLOG);
 		str[0] = '\0';
 	}
 
-	/* stdin closed or error */
-	if (feof(stdin)) {
-		errx(0, "stdin closed");
-	} else {
-		perror("stdin fgets");
-		abort();
-	}
+	stdin_done();
+	return (NULL);
 }
 
 /*
- * Worker thread waits here for event port events.
+ * Worker thread waits here for backend events.  Events are read and processed
+ * in batches of up to BACKEND_MAX_EVENTS, taking files_mutex once per batch.
+ * While stdout is behind, no more events are fetched until the messages that
+ * overflowed the output ring have been moved into it.
+ *
+ * With -d, this thread also prints debounced events when their window closes,
+ * so it only blocks in backend_get() until the earliest pending window closes.
  */
 static void *
 wait_for_events(void *arg __unused)
 {
-	port_event_t pe;
+	static backend_event_t evs[BACKEND_MAX_EVENTS];
+	struct timespec ts;
+	uint64_t wait = 0;
+	uint_t nget;
+	uint_t i;
+	int ret;
 
-	while (!port_get(port, &pe, NULL)) {
-		mutex_lock(&work_mutex);
+	for (;;) {
+		ts.tv_sec = wait / 1000000000ULL;
+		ts.tv_nsec = wait % 1000000000ULL;
 
-		switch (pe.portev_source) {
-		case PORT_SOURCE_FILE:
-			/* call handler for filesystem event */
-			check_and_rearm_event(0, (char *)pe.portev_user,
-			    pe.portev_events, NULL);
+		ret = backend_get(evs, BACKEND_MAX_EVENTS, &nget,
+		    wait > 0 ? &ts : NULL);
+		if (ret != 0 && errno != ETIME && errno != EINTR)
 			break;
-		default:
-			/*
-			 * Something's seriously wrong if we get events with a
-			 * port source other than FILE, since that's all we're
-			 * adding. So abort and hope there's enough state in
-			 * the core.
-			 */
-			fprintf(stderr, "event from unexpected source: %d",
-			    pe.portev_source);
-			abort();
+
+		pthread_mutex_lock(&files_mutex);
+
+		/* call handler for each filesystem event */
+		for (i = 0; i < nget; i++) {
+			check_and_rearm_event(0, evs[i].be_name,
+			    evs[i].be_events, NULL);
 		}
 
-		mutex_unlock(&work_mutex);
+		wait = pending_expire();
+
+		/* nothing fetched from now on can refer to these */
+		reap_handles();
+
+		pthread_mutex_unlock(&files_mutex);
+
+		/* let stdout catch up before fetching any more events */
+		output_throttle(0);
 	}
 
 	/* should not be reached */
-	perror("wait_for_events thread exited (port_get)");
+	perror("wait_for_events thread exited (backend_get)");
 	abort();
 }
 
@@ -957,26 +1944,49 @@ wait_for_events(void *arg __unused)
  * Create a thread using the given thread_func and exit the process if thread
  * creation fails.
  */
-static void
+static pthread_t
 create_thread(void *(*thread_func)(void *))
 {
 	int rc;
-	thread_t tid;
+	pthread_t tid;
 
-	if ((rc = thr_create(NULL, 0, thread_func, NULL, 0, &tid)) != 0) {
-		errx(1, "thr_create: %s", strerror(rc));
+	if ((rc = pthread_create(&tid, NULL, thread_func, NULL)) != 0) {
+		errx(1, "pthread_create: %s", strerror(rc));
 	}
+
+	return (tid);
 }
 
 int
 main(int argc, char **argv)
 {
 	int opt;
+	long ms;
+	char *ep;
+	pthread_t events_thread;
+	pthread_t stdin_thread;
 
+	opts.opt_b = B_FALSE;
 	opts.opt_j = B_FALSE;
 	opts.opt_r = B_FALSE;
-	while ((opt = getopt(argc, argv, "hjr")) != -1) {
+	opts.opt_d = 0;
+	while ((opt = getopt(argc, argv, "bd:hjr")) != -1) {
 		switch (opt) {
+		case 'b':
+			opts.opt_b = B_TRUE;
+			break;
+		case 'd':
+			errno = 0;
+			ms = strtol(optarg, &ep, 10);
+			if (errno != 0 || *ep != '\0' || ep == optarg ||
+			    ms < 0 || ms > MAX_DEBOUNCE_MS) {
+				fprintf(stderr, "fswatcher: invalid -d value: "
+				    "%s\n", optarg);
+				usage(stderr);
+				return (1);
+			}
+			opts.opt_d = (uint64_t)ms * 1000000ULL;
+			break;
 		case 'h':
 			usage(stdout);
 			return (0);
@@ -994,38 +2004,48 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	/* create event port globally */
-	if ((port = port_create()) == -1) {
-		err(1, "port_create");
+	if (opts.opt_b && opts.opt_j) {
+		fprintf(stderr,
+		    "fswatcher: -b and -j are mutually exclusive\n");
+		usage(stderr);
+		return (1);
 	}
 
-	/* initialize the AVL tree to hold all files currently being watched */
-	avl_create(&files_tree, files_tree_node_comparator,
-	    sizeof (struct files_tree_node),
-	    offsetof(struct files_tree_node, avl_node));
+	/* initialize the source of filesystem events */
+	backend_init();
+
+	/* initialize the output ring and start writing messages to stdout */
+	output_init();
+	output_thread = create_thread(wait_for_output);
+
+	/* initialize the table to hold all files currently being watched */
+	table_init(&files_table);
 
 	/*
 	 * If the caller wants a "ready" event to be emitted, we grab the
 	 * global mutex here, and unlock it after the threads are created.
 	 */
 	if (opts.opt_r) {
-		mutex_lock(&work_mutex);
+		pthread_mutex_lock(&files_mutex);
 	}
 
-	/* create worker threads to process stdin and event ports */
-	create_thread(wait_for_events);
-	create_thread(wait_for_stdin);
+	/* create worker threads to process stdin and backend events */
+	events_thread = create_thread(wait_for_events);
+	stdin_thread = create_thread(wait_for_stdin);
 
 	/* alert that we are ready for input */
 	if (opts.opt_r) {
 		print_ready();
-		mutex_unlock(&work_mutex);
+		pthread_mutex_unlock(&files_mutex);
 	}
 
-	/* do nothing while threads handle the load */
-	while (thr_join(0, NULL, NULL) == 0) {
-		/* pass */
-	}
+	/*
+	 * do nothing while threads handle the load.  None of the threads
+	 * return: the program exits from one of them when stdin is closed or a
+	 * fatal error occurs.
+	 */
+	pthread_join(stdin_thread, NULL);
+	pthread_join(events_thread, NULL);
 
 	return (0);
 }
@@ -0,0 +1,138 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+#ifndef _FSWATCHER_BACKEND_H
+#define	_FSWATCHER_BACKEND_H
+
+/*
+ * Interface between the fswatcher engine (fswatcher.c) and the source of
+ * filesystem events.  Exactly one backend is linked into the program:
+ *
+ *   fswatcher_port.c     event ports (illumos)
+ *   fswatcher_inotify.c  inotify(7) and epoll(7) (Linux)
+ *
+ * Every backend implements the semantics of a PORT_SOURCE_FILE association
+ * (see port_associate(3C)): a watch is armed by backend_associate(), fires
+ * at most once, and must be re-armed by the engine after every event.  Events
+ * are reported using the event ports FILE_* flags on all platforms, so the
+ * engine and its stdout protocol are the same everywhere.
+ *
+ * Locking: backend_associate(), backend_dissociate() and backend_watch_free()
+ * are only called with the engine's files_mutex held.  backend_get() is only
+ * called from the event thread, without files_mutex held, and so must be safe
+ * to call concurrently with the other functions.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __sun
+#include <port.h>
+#else
+/*
+ * The event ports file event flags, with the same values as <sys/port.h> on
+ * illumos.
+ */
+#define	FILE_ACCESS		0x00000001
+#define	FILE_MODIFIED		0x00000002
+#define	FILE_ATTRIB		0x00000004
+#define	FILE_TRUNC		0x00100000
+#define	FILE_NOFOLLOW		0x10000000
+#define	FILE_DELETE		0x00000010
+#define	FILE_RENAME_TO		0x00000020
+#define	FILE_RENAME_FROM	0x00000040
+#define	UNMOUNTED		0x20000000
+#define	MOUNTEDOVER		0x40000000
+#define	FILE_EXCEPTION		(UNMOUNTED|FILE_DELETE|FILE_RENAME_TO|\
+				FILE_RENAME_FROM|MOUNTEDOVER)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* most events returned by a single call to backend_get() */
+#define	BACKEND_MAX_EVENTS	256
+
+/* per-pathname watch state, defined by each backend */
+typedef struct backend_watch backend_watch_t;
+
+/*
+ * An event returned by backend_get().  be_name is a copy of the pathname given
+ * to backend_watch_alloc(), owned by the backend, and is only valid until the
+ * next call to backend_get().
+ *
+ * backend_get() may read the pathnames of the watches its events are for
+ * after the event thread has stopped holding files_mutex, so the engine only
+ * frees watches (and their pathnames) from the event thread, between calls to
+ * backend_get().
+ */
+typedef struct backend_event {
+	int be_events;		/* FILE_* flags */
+	char *be_name;		/* pathname the event is for */
+} backend_event_t;
+
+/* names used in messages, e.g. "port_associate(3c)" */
+extern const char *backend_name;
+extern const char *backend_associate_name;
+extern const char *backend_dissociate_name;
+
+/*
+ * Initialize the backend.  Exits the program on failure.
+ */
+void backend_init(void);
+
+/*
+ * Allocate watch state for pathname, which must remain valid until the watch
+ * is freed.  Exits the program on failure.
+ */
+backend_watch_t *backend_watch_alloc(char *pathname);
+
+/*
+ * Free watch state.  The watch must not be armed.
+ */
+void backend_watch_free(backend_watch_t *bw);
+
+/*
+ * Arm (or re-arm) a watch for the given FILE_* events.  sb is the result of
+ * a stat(2) of the pathname taken just before this call: like event ports, if
+ * the file has been modified since then an event will be delivered
+ * immediately.  Returns 0 on success or -1 with errno set.
+ */
+int backend_associate(backend_watch_t *bw, const struct stat *sb, int events);
+
+/*
+ * Disarm a watch.  Returns 0 on success or -1 with errno set (ENOENT if the
+ * watch was not armed).  The watch is disarmed in either case.
+ */
+int backend_dissociate(backend_watch_t *bw);
+
+/*
+ * Block until at least one event is available, or until timeout has elapsed
+ * (a NULL timeout blocks indefinitely), and then return as many events as are
+ * available, up to max (which is at most BACKEND_MAX_EVENTS), in evs.  The
+ * number of events returned is stored in ngetp.  Returns 0 on success, or -1
+ * with errno set (ETIME if the timeout elapsed) and *ngetp set to 0.  The
+ * watches the events are for are no longer armed.
+ */
+int backend_get(backend_event_t *evs, unsigned int max, unsigned int *ngetp,
+    const struct timespec *timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FSWATCHER_BACKEND_H */
@@ -0,0 +1,328 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * fswatcher_bench: benchmark harness for fswatcher.
+ *
+ * Usage: fswatcher_bench [-n files] [-l samples] [-d dir] [fswatcher [args]]
+ *
+ * Starts fswatcher (default "./fswatcher -r -j", or the given command line),
+ * creates <files> files in a scratch directory and watches all of them using
+ * WATCHMANY, and then measures:
+ *
+ *   setup       time taken to watch every file
+ *   latency     time from modifying a single file to its event being read
+ *               from fswatcher's stdout, for <samples> files one at a time
+ *   throughput  events per second when every file is modified at once
+ *
+ * Results are printed to stdout one per line as "name value unit", so they
+ * can be compared across builds to catch regressions in the event path.  The
+ * same harness runs against every fswatcher backend.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define	DEFAULT_FILES	10000
+#define	DEFAULT_SAMPLES	1000
+#define	BATCH_SIZE	1024	/* MAX_BATCH_PATHS in fswatcher.c */
+
+static char *default_cmd[] = { "./fswatcher", "-r", "-j", NULL };
+
+static FILE *to_fsw;		/* fswatcher stdin */
+static FILE *from_fsw;		/* fswatcher stdout */
+static pid_t fsw_pid;
+
+static char *dir;
+static long nfiles = DEFAULT_FILES;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: fswatcher_bench [-n files] [-l samples] "
+	    "[-d dir] [fswatcher [args]]\n");
+	exit(2);
+}
+
+static void
+file_path(char *buf, size_t len, long i)
+{
+	(void) snprintf(buf, len, "%s/f.%ld", dir, i);
+}
+
+/*
+ * Start fswatcher with its stdin and stdout connected to us.
+ */
+static void
+start_fswatcher(char **argv)
+{
+	int in[2];
+	int out[2];
+
+	if (pipe(in) != 0 || pipe(out) != 0)
+		err(1, "pipe");
+
+	if ((fsw_pid = fork()) == -1)
+		err(1, "fork");
+
+	if (fsw_pid == 0) {
+		if (dup2(in[0], 0) == -1 || dup2(out[1], 1) == -1)
+			err(1, "dup2");
+		(void) close(in[0]);
+		(void) close(in[1]);
+		(void) close(out[0]);
+		(void) close(out[1]);
+		execvp(argv[0], argv);
+		err(1, "exec %s", argv[0]);
+	}
+
+	(void) close(in[0]);
+	(void) close(out[1]);
+
+	if ((to_fsw = fdopen(in[1], "w")) == NULL ||
+	    (from_fsw = fdopen(out[0], "r")) == NULL) {
+		err(1, "fdopen");
+	}
+}
+
+/*
+ * Read the next line of fswatcher output and return its type ("ready",
+ * "event", etc.).  If the line has a pathname, its file index is stored in
+ * idxp (or -1).
+ */
+static const char *
+read_message(char **linep, size_t *lenp, long *idxp)
+{
+	static const char *types[] = { "ready", "event", "response", "error" };
+	char needle[32];
+	char *p;
+	size_t i;
+
+	if (getline(linep, lenp, from_fsw) == -1)
+		errx(1, "fswatcher exited unexpectedly");
+
+	*idxp = -1;
+	if ((p = strstr(*linep, "\"pathname\":\"")) != NULL &&
+	    (p = strstr(p, "/f.")) != NULL) {
+		*idxp = strtol(p + 3, NULL, 10);
+	}
+
+	for (i = 0; i < sizeof (types) / sizeof (types[0]); i++) {
+		(void) snprintf(needle, sizeof (needle), "\"type\":\"%s\"",
+		    types[i]);
+		if (strstr(*linep, needle) != NULL)
+			return (types[i]);
+	}
+
+	errx(1, "unrecognised fswatcher output: %s", *linep);
+	return (NULL);
+}
+
+static void
+modify_file(long i)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	file_path(path, sizeof (path), i);
+	if ((fd = open(path, O_WRONLY | O_APPEND)) == -1)
+		err(1, "open %s", path);
+	if (write(fd, "x", 1) != 1)
+		err(1, "write %s", path);
+	(void) close(fd);
+}
+
+static int
+cmp_u64(const void *l, const void *r)
+{
+	uint64_t a = *(const uint64_t *)l;
+	uint64_t b = *(const uint64_t *)r;
+
+	return (a < b ? -1 : a > b ? 1 : 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	char template[] = "/tmp/fswatcher_bench.XXXXXX";
+	char path[PATH_MAX];
+	char *line = NULL;
+	size_t linelen = 0;
+	long nsamples = DEFAULT_SAMPLES;
+	uint64_t *lat;
+	uint64_t start;
+	uint64_t total;
+	uint8_t *seen;
+	const char *type;
+	long idx;
+	long remaining;
+	long i;
+	long j;
+	int opt;
+	int fd;
+
+	while ((opt = getopt(argc, argv, "+d:l:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'l':
+			nsamples = strtol(optarg, NULL, 10);
+			break;
+		case 'n':
+			nfiles = strtol(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (nfiles <= 0 || nsamples <= 0)
+		usage();
+	if (nsamples > nfiles)
+		nsamples = nfiles;
+
+	if (dir == NULL && (dir = mkdtemp(template)) == NULL)
+		err(1, "mkdtemp");
+
+	for (i = 0; i < nfiles; i++) {
+		file_path(path, sizeof (path), i);
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+			err(1, "create %s", path);
+		(void) close(fd);
+	}
+
+	(void) signal(SIGPIPE, SIG_IGN);
+	start_fswatcher(argc > 0 ? argv : default_cmd);
+
+	type = read_message(&line, &linelen, &idx);
+	if (strcmp(type, "ready") != 0)
+		errx(1, "expected ready message, got %s", type);
+
+	/*
+	 * setup: watch every file.  Each response is read before the next batch
+	 * is sent, since a response can be larger than the pipe buffer.
+	 */
+	start = now_ns();
+	for (i = 0; i < nfiles; i += BATCH_SIZE) {
+		long n = nfiles - i < BATCH_SIZE ? nfiles - i : BATCH_SIZE;
+
+		fprintf(to_fsw, "%ld WATCHMANY %ld\n", i + 1, n);
+		for (j = i; j < i + n; j++) {
+			file_path(path, sizeof (path), j);
+			fprintf(to_fsw, "%s\n", path);
+		}
+		(void) fflush(to_fsw);
+
+		type = read_message(&line, &linelen, &idx);
+		if (strcmp(type, "response") != 0 ||
+		    strstr(line, "\"result\":\"SUCCESS\"") == NULL) {
+			errx(1, "failed to watch files: %s", line);
+		}
+	}
+	total = now_ns() - start;
+	printf("files %ld\n", nfiles);
+	printf("setup %.3f ms\n", total / 1e6);
+	printf("setup_per_file %.3f us\n", total / 1e3 / nfiles);
+
+	/* latency: modify one file at a time and wait for its event */
+	if ((lat = calloc(nsamples, sizeof (uint64_t))) == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < nsamples; i++) {
+		long f = i * (nfiles / nsamples);
+
+		start = now_ns();
+		modify_file(f);
+		do {
+			type = read_message(&line, &linelen, &idx);
+		} while (strcmp(type, "event") != 0 || idx != f);
+		lat[i] = now_ns() - start;
+	}
+
+	qsort(lat, nsamples, sizeof (uint64_t), cmp_u64);
+	for (total = 0, i = 0; i < nsamples; i++)
+		total += lat[i];
+	printf("latency_samples %ld\n", nsamples);
+	printf("latency_min %.1f us\n", lat[0] / 1e3);
+	printf("latency_avg %.1f us\n", total / 1e3 / nsamples);
+	printf("latency_p50 %.1f us\n", lat[nsamples / 2] / 1e3);
+	printf("latency_p99 %.1f us\n", lat[nsamples * 99 / 100] / 1e3);
+	printf("latency_max %.1f us\n", lat[nsamples - 1] / 1e3);
+
+	/* throughput: modify every file and wait for all of the events */
+	if ((seen = calloc(nfiles, 1)) == NULL)
+		err(1, "calloc");
+
+	start = now_ns();
+	for (i = 0; i < nfiles; i++)
+		modify_file(i);
+
+	for (remaining = nfiles; remaining > 0; ) {
+		type = read_message(&line, &linelen, &idx);
+		if (strcmp(type, "event") != 0 || idx < 0 || idx >= nfiles)
+			continue;
+		if (!seen[idx]) {
+			seen[idx] = 1;
+			remaining--;
+		}
+	}
+	total = now_ns() - start;
+	printf("throughput_events %ld\n", nfiles);
+	printf("throughput_time %.3f ms\n", total / 1e6);
+	printf("throughput %.0f events/s\n", nfiles / (total / 1e9));
+
+	/* closing stdin causes fswatcher to exit */
+	(void) fclose(to_fsw);
+	(void) waitpid(fsw_pid, NULL, 0);
+
+	for (i = 0; i < nfiles; i++) {
+		file_path(path, sizeof (path), i);
+		(void) unlink(path);
+	}
+	if (strcmp(dir, template) == 0)
+		(void) rmdir(dir);
+
+	free(seen);
+	free(lat);
+	free(line);
+
+	return (0);
+}
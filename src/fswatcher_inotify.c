@@ -0,0 +1,567 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * inotify(7) backend for fswatcher.  See fswatcher_backend.h.
+ *
+ * This exists so that the fswatcher engine can be run, profiled and
+ * benchmarked on Linux.  It emulates PORT_SOURCE_FILE associations on top of
+ * inotify watches as follows:
+ *
+ * - inotify watches are persistent and per-inode, while associations fire
+ *   once and are per-pathname.  Each backend_watch_t is "armed" by
+ *   backend_associate() and disarmed when an event is delivered for it; events
+ *   seen for a disarmed watch are dropped.  Multiple pathnames for the same
+ *   inode (e.g. hard links) share an inotify watch descriptor, so the
+ *   watches are kept in a table hashed by descriptor.
+ *
+ * - backend_associate() always calls inotify_add_watch(2) on the pathname,
+ *   so if the pathname now refers to a different file (e.g. after a rename
+ *   over it) the new file is watched, as port_associate(3C) would do.
+ *
+ * - Like port_associate(3C), if the file was modified between the stat(2)
+ *   given to backend_associate() and the watch being added, an event is
+ *   queued immediately.  Queued events are kept on a list and the event
+ *   thread is woken up through an eventfd registered with epoll(7) alongside
+ *   the inotify descriptor.
+ *
+ * - inotify events are translated to FILE_* flags:
+ *
+ *     IN_MODIFY                     FILE_MODIFIED (FILE_TRUNC if it shrank)
+ *     IN_CREATE, IN_DELETE,
+ *     IN_MOVED_FROM, IN_MOVED_TO    FILE_MODIFIED (directory entries changed)
+ *     IN_ATTRIB, IN_DELETE_SELF,    FILE_DELETE if the pathname is gone,
+ *     IN_IGNORED                    FILE_RENAME_TO if it is a different file,
+ *                                   otherwise ignored (IN_ATTRIB) or
+ *                                   FILE_DELETE
+ *     IN_MOVE_SELF                  FILE_RENAME_FROM
+ *     IN_UNMOUNT                    UNMOUNTED
+ *     IN_Q_OVERFLOW                 FILE_MODIFIED for every armed watch
+ *
+ *   IN_ATTRIB is needed because unlink(2) of a file that is still open does
+ *   not generate IN_DELETE_SELF until the last reference goes away, whereas
+ *   event ports report FILE_DELETE immediately.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "fswatcher_backend.h"
+
+#define	WD_BUCKETS	4096		/* buckets in the descriptor table */
+#define	INOTIFY_BUFSZ	(64 * 1024)	/* bytes read from inotify at once */
+
+#define	INOTIFY_MASK	(IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+			IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | \
+			IN_MOVE_SELF)
+
+struct backend_watch {
+	char *bw_name;			/* pathname being watched */
+	int bw_wd;			/* inotify descriptor, -1 if none */
+	int bw_armed;			/* waiting for an event */
+	int bw_pending;			/* FILE_* flags queued for delivery */
+	int bw_queued;			/* on the pending list */
+	dev_t bw_dev;			/* stat(2) at time of association */
+	ino_t bw_ino;
+	off_t bw_size;
+	struct timespec bw_mtime;
+	backend_watch_t *bw_wd_next;	/* next watch in descriptor bucket */
+	backend_watch_t *bw_pend_next;	/* next watch on pending list */
+};
+
+const char *backend_name = "inotify";
+const char *backend_associate_name = "inotify_add_watch(2)";
+const char *backend_dissociate_name = "inotify_rm_watch(2)";
+
+/*
+ * All backend state is protected by backend_lock, since backend_get() runs
+ * concurrently with the other backend functions.
+ */
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int inotify_fd = -1;
+static int epoll_fd = -1;
+static int wake_fd = -1;
+
+static backend_watch_t *wd_table[WD_BUCKETS];
+
+static backend_watch_t *pending_head = NULL;
+static backend_watch_t *pending_tail = NULL;
+
+/* copies of the pathnames for the events last returned by backend_get() */
+static char *event_names = NULL;
+static size_t event_names_len = 0;
+
+void
+backend_init(void)
+{
+	struct epoll_event ee;
+
+	if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+		err(1, "inotify_init1");
+	if ((wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		err(1, "eventfd");
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		err(1, "epoll_create1");
+
+	(void) memset(&ee, 0, sizeof (ee));
+	ee.events = EPOLLIN;
+
+	ee.data.fd = inotify_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ee) != 0)
+		err(1, "epoll_ctl inotify");
+
+	ee.data.fd = wake_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ee) != 0)
+		err(1, "epoll_ctl eventfd");
+}
+
+backend_watch_t *
+backend_watch_alloc(char *pathname)
+{
+	backend_watch_t *bw;
+
+	if ((bw = calloc(1, sizeof (backend_watch_t))) == NULL)
+		err(1, "calloc backend watch");
+
+	bw->bw_name = pathname;
+	bw->bw_wd = -1;
+
+	return (bw);
+}
+
+static backend_watch_t **
+wd_bucket(int wd)
+{
+	return (&wd_table[(unsigned int)wd % WD_BUCKETS]);
+}
+
+/*
+ * Returns 1 if any watch is using the inotify descriptor wd.
+ */
+static int
+wd_in_use(int wd)
+{
+	backend_watch_t *bw;
+
+	for (bw = *wd_bucket(wd); bw != NULL; bw = bw->bw_wd_next) {
+		if (bw->bw_wd == wd)
+			return (1);
+	}
+
+	return (0);
+}
+
+/*
+ * Remove a watch from the descriptor table, and remove the inotify watch
+ * itself if nothing else is using it.  Called with backend_lock held.
+ */
+static void
+wd_unlink(backend_watch_t *bw, int rm_watch)
+{
+	backend_watch_t **bwp;
+	int wd = bw->bw_wd;
+
+	if (wd == -1)
+		return;
+
+	for (bwp = wd_bucket(wd); *bwp != NULL; bwp = &(*bwp)->bw_wd_next) {
+		if (*bwp == bw) {
+			*bwp = bw->bw_wd_next;
+			break;
+		}
+	}
+
+	bw->bw_wd = -1;
+	bw->bw_wd_next = NULL;
+
+	if (rm_watch && !wd_in_use(wd))
+		(void) inotify_rm_watch(inotify_fd, wd);
+}
+
+static void
+wd_link(backend_watch_t *bw, int wd)
+{
+	backend_watch_t **bwp = wd_bucket(wd);
+
+	bw->bw_wd = wd;
+	bw->bw_wd_next = *bwp;
+	*bwp = bw;
+}
+
+/*
+ * Queue FILE_* events for delivery to an armed watch.  Called with
+ * backend_lock held.
+ */
+static void
+queue_event(backend_watch_t *bw, int events)
+{
+	uint64_t one = 1;
+
+	if (!bw->bw_armed || events == 0)
+		return;
+
+	bw->bw_pending |= events;
+
+	if (bw->bw_queued)
+		return;
+
+	bw->bw_queued = 1;
+	bw->bw_pend_next = NULL;
+	if (pending_tail == NULL) {
+		pending_head = bw;
+	} else {
+		pending_tail->bw_pend_next = bw;
+	}
+	pending_tail = bw;
+
+	/* wake up backend_get() if it is waiting in epoll_wait() */
+	(void) write(wake_fd, &one, sizeof (one));
+}
+
+/*
+ * Remove a watch from the pending list.  Called with backend_lock held.
+ */
+static void
+dequeue_event(backend_watch_t *bw)
+{
+	backend_watch_t *prev = NULL;
+	backend_watch_t *cur;
+
+	if (!bw->bw_queued)
+		return;
+
+	for (cur = pending_head; cur != NULL; cur = cur->bw_pend_next) {
+		if (cur == bw)
+			break;
+		prev = cur;
+	}
+
+	if (cur != NULL) {
+		if (prev == NULL) {
+			pending_head = bw->bw_pend_next;
+		} else {
+			prev->bw_pend_next = bw->bw_pend_next;
+		}
+		if (pending_tail == bw)
+			pending_tail = prev;
+	}
+
+	bw->bw_queued = 0;
+	bw->bw_pending = 0;
+	bw->bw_pend_next = NULL;
+}
+
+void
+backend_watch_free(backend_watch_t *bw)
+{
+	(void) pthread_mutex_lock(&backend_lock);
+	dequeue_event(bw);
+	wd_unlink(bw, 1);
+	(void) pthread_mutex_unlock(&backend_lock);
+
+	free(bw);
+}
+
+int
+backend_associate(backend_watch_t *bw, const struct stat *sb,
+    int events __attribute__((unused)))
+{
+	struct stat now;
+	int wd;
+
+	(void) pthread_mutex_lock(&backend_lock);
+
+	if ((wd = inotify_add_watch(inotify_fd, bw->bw_name,
+	    INOTIFY_MASK)) == -1) {
+		int e = errno;
+		(void) pthread_mutex_unlock(&backend_lock);
+		errno = e;
+		return (-1);
+	}
+
+	if (wd != bw->bw_wd) {
+		wd_unlink(bw, 1);
+		wd_link(bw, wd);
+	}
+
+	bw->bw_dev = sb->st_dev;
+	bw->bw_ino = sb->st_ino;
+	bw->bw_size = sb->st_size;
+	bw->bw_mtime = sb->st_mtim;
+	bw->bw_armed = 1;
+
+	/*
+	 * Catch any changes made between the caller's stat(2) and the watch
+	 * being added, which port_associate(3C) would report immediately.
+	 */
+	if (stat(bw->bw_name, &now) != 0) {
+		queue_event(bw, FILE_DELETE);
+	} else if (now.st_dev != bw->bw_dev || now.st_ino != bw->bw_ino) {
+		queue_event(bw, FILE_RENAME_TO);
+	} else if (now.st_mtim.tv_sec != bw->bw_mtime.tv_sec ||
+	    now.st_mtim.tv_nsec != bw->bw_mtime.tv_nsec) {
+		queue_event(bw, now.st_size < bw->bw_size ?
+		    FILE_TRUNC : FILE_MODIFIED);
+	}
+
+	(void) pthread_mutex_unlock(&backend_lock);
+
+	return (0);
+}
+
+int
+backend_dissociate(backend_watch_t *bw)
+{
+	int armed;
+
+	(void) pthread_mutex_lock(&backend_lock);
+	armed = bw->bw_armed;
+	bw->bw_armed = 0;
+	dequeue_event(bw);
+	wd_unlink(bw, 1);
+	(void) pthread_mutex_unlock(&backend_lock);
+
+	if (!armed) {
+		errno = ENOENT;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Translate an inotify event mask into FILE_* flags for one watch.  Called
+ * with backend_lock held.
+ */
+static int
+translate_mask(backend_watch_t *bw, uint32_t mask)
+{
+	struct stat sb;
+	int events = 0;
+
+	if (mask & IN_MODIFY) {
+		if (stat(bw->bw_name, &sb) == 0 && sb.st_size < bw->bw_size) {
+			events |= FILE_TRUNC;
+		} else {
+			events |= FILE_MODIFIED;
+		}
+	}
+
+	if (mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+		events |= FILE_MODIFIED;
+
+	/*
+	 * The file may have been removed, or replaced by another file (e.g.
+	 * through rename(2)) which is reported as FILE_RENAME_TO like event
+	 * ports do.  A change in attributes alone is ignored.
+	 */
+	if (mask & (IN_ATTRIB | IN_DELETE_SELF | IN_IGNORED)) {
+		if (stat(bw->bw_name, &sb) != 0) {
+			events |= FILE_DELETE;
+		} else if (sb.st_dev != bw->bw_dev || sb.st_ino != bw->bw_ino) {
+			events |= FILE_RENAME_TO;
+		} else if (mask & (IN_DELETE_SELF | IN_IGNORED)) {
+			events |= FILE_DELETE;
+		}
+	}
+
+	if (mask & IN_MOVE_SELF)
+		events |= FILE_RENAME_FROM;
+
+	if (mask & IN_UNMOUNT)
+		events |= UNMOUNTED;
+
+	return (events);
+}
+
+/*
+ * Process a single inotify event.  Called with backend_lock held.
+ */
+static void
+process_inotify_event(const struct inotify_event *ie)
+{
+	backend_watch_t *bw;
+	backend_watch_t *next;
+	int i;
+
+	if (ie->mask & IN_Q_OVERFLOW) {
+		/*
+		 * Events were lost.  Deliver a modification to everything
+		 * armed so that the engine re-stats and re-arms every file.
+		 */
+		for (i = 0; i < WD_BUCKETS; i++) {
+			for (bw = wd_table[i]; bw != NULL;
+			    bw = bw->bw_wd_next) {
+				queue_event(bw, FILE_MODIFIED);
+			}
+		}
+		return;
+	}
+
+	for (bw = *wd_bucket(ie->wd); bw != NULL; bw = next) {
+		next = bw->bw_wd_next;
+
+		if (bw->bw_wd != ie->wd)
+			continue;
+
+		queue_event(bw, translate_mask(bw, ie->mask));
+
+		/* the kernel has already removed the inotify watch */
+		if (ie->mask & IN_IGNORED)
+			wd_unlink(bw, 0);
+	}
+}
+
+/*
+ * Read and process everything available from the inotify descriptor.
+ */
+static void
+read_inotify_events(void)
+{
+	static char buf[INOTIFY_BUFSZ]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ie;
+	ssize_t len;
+	char *p;
+
+	for (;;) {
+		len = read(inotify_fd, buf, sizeof (buf));
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return;
+			err(1, "read inotify");
+		}
+
+		(void) pthread_mutex_lock(&backend_lock);
+		for (p = buf; p < buf + len;
+		    p += sizeof (struct inotify_event) + ie->len) {
+			ie = (const struct inotify_event *)p;
+			process_inotify_event(ie);
+		}
+		(void) pthread_mutex_unlock(&backend_lock);
+	}
+}
+
+/*
+ * Pop up to max watches off the pending list and fill in evs, copying their
+ * pathnames into event_names.  Returns the number of events.  Called with
+ * backend_lock held.
+ */
+static unsigned int
+pop_events(backend_event_t *evs, unsigned int max)
+{
+	backend_watch_t *bw;
+	unsigned int n;
+	unsigned int i;
+	size_t len = 0;
+	size_t off = 0;
+
+	for (n = 0, bw = pending_head; n < max && bw != NULL;
+	    n++, bw = bw->bw_pend_next) {
+		len += strlen(bw->bw_name) + 1;
+	}
+
+	if (len > event_names_len) {
+		if ((event_names = realloc(event_names, len)) == NULL)
+			err(1, "realloc event names");
+		event_names_len = len;
+	}
+
+	for (i = 0; i < n; i++) {
+		bw = pending_head;
+		pending_head = bw->bw_pend_next;
+		if (pending_head == NULL)
+			pending_tail = NULL;
+
+		len = strlen(bw->bw_name) + 1;
+		(void) memcpy(event_names + off, bw->bw_name, len);
+
+		evs[i].be_events = bw->bw_pending;
+		evs[i].be_name = event_names + off;
+		off += len;
+
+		bw->bw_armed = 0;
+		bw->bw_queued = 0;
+		bw->bw_pending = 0;
+		bw->bw_pend_next = NULL;
+	}
+
+	return (n);
+}
+
+int
+backend_get(backend_event_t *evs, unsigned int max, unsigned int *ngetp,
+    const struct timespec *timeout)
+{
+	struct epoll_event ees[2];
+	uint64_t count;
+	int timeout_ms = -1;
+	unsigned int found;
+	int n;
+	int i;
+
+	*ngetp = 0;
+	if (max > BACKEND_MAX_EVENTS)
+		max = BACKEND_MAX_EVENTS;
+
+	if (timeout != NULL) {
+		timeout_ms = timeout->tv_sec * 1000 +
+		    (timeout->tv_nsec + 999999) / 1000000;
+	}
+
+	for (;;) {
+		(void) pthread_mutex_lock(&backend_lock);
+		found = pop_events(evs, max);
+		(void) pthread_mutex_unlock(&backend_lock);
+
+		if (found > 0) {
+			*ngetp = found;
+			return (0);
+		}
+
+		n = epoll_wait(epoll_fd, ees, 2, timeout_ms);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+
+		if (n == 0) {
+			errno = ETIME;
+			return (-1);
+		}
+
+		for (i = 0; i < n; i++) {
+			if (ees[i].data.fd == wake_fd) {
+				(void) read(wake_fd, &count, sizeof (count));
+			} else {
+				read_inotify_events();
+			}
+		}
+	}
+}
@@ -0,0 +1,154 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * Event ports backend for fswatcher.  See fswatcher_backend.h.
+ *
+ * This is a thin wrapper around PORT_SOURCE_FILE associations, which have
+ * exactly the semantics the engine expects.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <port.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fswatcher_backend.h"
+
+struct backend_watch {
+	struct file_obj bw_fobj;
+};
+
+const char *backend_name = "event ports";
+const char *backend_associate_name = "port_associate(3c)";
+const char *backend_dissociate_name = "port_dissociate(3c)";
+
+/* global event port handle */
+static int port = -1;
+
+/* copies of the pathnames for the events last returned by backend_get() */
+static char *event_names = NULL;
+static size_t event_names_len = 0;
+
+void
+backend_init(void)
+{
+	if ((port = port_create()) == -1) {
+		err(1, "port_create");
+	}
+}
+
+backend_watch_t *
+backend_watch_alloc(char *pathname)
+{
+	backend_watch_t *bw;
+
+	if ((bw = calloc(1, sizeof (backend_watch_t))) == NULL)
+		err(1, "calloc backend watch");
+
+	bw->bw_fobj.fo_name = pathname;
+
+	return (bw);
+}
+
+void
+backend_watch_free(backend_watch_t *bw)
+{
+	free(bw);
+}
+
+int
+backend_associate(backend_watch_t *bw, const struct stat *sb, int events)
+{
+	struct file_obj *fobjp = &bw->bw_fobj;
+
+	fobjp->fo_atime = sb->st_atim;
+	fobjp->fo_mtime = sb->st_mtim;
+	fobjp->fo_ctime = sb->st_ctim;
+
+	return (port_associate(port, PORT_SOURCE_FILE, (uintptr_t)fobjp,
+	    events, fobjp->fo_name));
+}
+
+int
+backend_dissociate(backend_watch_t *bw)
+{
+	return (port_dissociate(port, PORT_SOURCE_FILE,
+	    (uintptr_t)&bw->bw_fobj));
+}
+
+/*
+ * Drain up to max events with a single port_getn(3C).  The pathnames are
+ * copied into event_names, since the engine may free a watch (and its
+ * pathname) once it has handled the batch.  Until then, portev_user stays
+ * valid even if the watch is unwatched in the meantime, as the engine doesn't
+ * free unwatched watches until the event thread has finished the batch.
+ */
+int
+backend_get(backend_event_t *evs, unsigned int max, unsigned int *ngetp,
+    const struct timespec *timeout)
+{
+	static port_event_t pes[BACKEND_MAX_EVENTS];
+	uint_t nget = 1;
+	uint_t i;
+	size_t len = 0;
+	size_t off = 0;
+	int ret;
+
+	*ngetp = 0;
+	if (max > BACKEND_MAX_EVENTS)
+		max = BACKEND_MAX_EVENTS;
+
+	ret = port_getn(port, pes, max, &nget, (struct timespec *)timeout);
+
+	/* port_getn(3C) can return events along with ETIME */
+	if (ret != 0 && (errno != ETIME || nget == 0))
+		return (-1);
+
+	for (i = 0; i < nget; i++) {
+		if (pes[i].portev_source != PORT_SOURCE_FILE) {
+			/*
+			 * Something's seriously wrong if we get events with a
+			 * port source other than FILE, since that's all we're
+			 * adding. So abort and hope there's enough state in
+			 * the core.
+			 */
+			fprintf(stderr, "event from unexpected source: %d",
+			    pes[i].portev_source);
+			abort();
+		}
+		len += strlen(pes[i].portev_user) + 1;
+	}
+
+	if (len > event_names_len) {
+		if ((event_names = realloc(event_names, len)) == NULL)
+			err(1, "realloc event names");
+		event_names_len = len;
+	}
+
+	for (i = 0; i < nget; i++) {
+		len = strlen(pes[i].portev_user) + 1;
+		(void) memcpy(event_names + off, pes[i].portev_user, len);
+
+		evs[i].be_events = pes[i].portev_events;
+		evs[i].be_name = event_names + off;
+		off += len;
+	}
+
+	*ngetp = nget;
+	return (0);
+}
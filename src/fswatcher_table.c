@@ -0,0 +1,355 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * Pathname index for fswatcher.  See fswatcher_table.h.
+ */
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fswatcher_table.h"
+
+#define	TABLE_MIN_SLOTS		1024	/* initial size, power of 2 */
+#define	ARENA_CHUNK_SIZE	(64 * 1024)
+
+/*
+ * Each string in the arena is in a block preceded by the size of the block,
+ * so that arena_free() can put it on the free list for that size.  Blocks are
+ * carved from chunks, which are never freed.  A freed block holds the next
+ * block on its free list just after its size.  Strings too long for any block
+ * are malloc'd on their own, with a size of 0.
+ */
+struct arena_chunk {
+	arena_chunk_t *ac_next;
+	size_t ac_size;			/* bytes in ac_data */
+	size_t ac_used;			/* bytes handed out from ac_data */
+	char *ac_data;
+};
+
+#define	ARENA_HDR	sizeof (size_t)
+
+/*
+ * XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ *
+ * Words are read in native byte order, which is all that's needed here since
+ * hashes are never stored or compared across machines.
+ */
+#define	XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define	XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define	XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define	XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define	XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+static inline uint64_t
+xxh_rotl(uint64_t x, int r)
+{
+	return ((x << r) | (x >> (64 - r)));
+}
+
+static inline uint64_t
+xxh_read64(const unsigned char *p)
+{
+	uint64_t v;
+
+	(void) memcpy(&v, p, sizeof (v));
+	return (v);
+}
+
+static inline uint32_t
+xxh_read32(const unsigned char *p)
+{
+	uint32_t v;
+
+	(void) memcpy(&v, p, sizeof (v));
+	return (v);
+}
+
+static inline uint64_t
+xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = xxh_rotl(acc, 31);
+	return (acc * XXH_PRIME64_1);
+}
+
+static inline uint64_t
+xxh_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh_round(0, val);
+	return (acc * XXH_PRIME64_1 + XXH_PRIME64_4);
+}
+
+uint64_t
+path_hash(const char *name, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)name;
+	const unsigned char *end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64_t v2 = XXH_PRIME64_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = -XXH_PRIME64_1;
+
+		do {
+			v1 = xxh_round(v1, xxh_read64(p));
+			v2 = xxh_round(v2, xxh_read64(p + 8));
+			v3 = xxh_round(v3, xxh_read64(p + 16));
+			v4 = xxh_round(v4, xxh_read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+
+		h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) +
+		    xxh_rotl(v4, 18);
+		h = xxh_merge(h, v1);
+		h = xxh_merge(h, v2);
+		h = xxh_merge(h, v3);
+		h = xxh_merge(h, v4);
+	} else {
+		h = XXH_PRIME64_5;
+	}
+
+	h += len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh_round(0, xxh_read64(p));
+		h = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+		h = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * XXH_PRIME64_5;
+		h = xxh_rotl(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+
+	return (h);
+}
+
+static table_slot_t *
+slots_alloc(uint32_t nslots)
+{
+	table_slot_t *slots;
+
+	if ((slots = calloc(nslots, sizeof (table_slot_t))) == NULL)
+		err(1, "calloc table");
+
+	return (slots);
+}
+
+void
+table_init(table_t *t)
+{
+	t->t_slots = slots_alloc(TABLE_MIN_SLOTS);
+	t->t_mask = TABLE_MIN_SLOTS - 1;
+	t->t_count = 0;
+}
+
+/*
+ * Return the slot holding name, or the empty slot where it would go.
+ */
+static table_slot_t *
+table_lookup(const table_t *t, const char *name, uint64_t hash)
+{
+	table_slot_t *ts;
+	uint32_t i;
+
+	for (i = hash & t->t_mask; ; i = (i + 1) & t->t_mask) {
+		ts = &t->t_slots[i];
+		if (ts->ts_name == NULL)
+			return (ts);
+		if (ts->ts_hash == hash && strcmp(ts->ts_name, name) == 0)
+			return (ts);
+	}
+}
+
+/*
+ * Double the number of slots.  The stored hashes are used to place every
+ * entry, so no pathname is rehashed.
+ */
+static void
+table_grow(table_t *t)
+{
+	table_slot_t *old = t->t_slots;
+	uint32_t nold = t->t_mask + 1;
+	uint32_t i;
+	uint32_t j;
+
+	if (nold > UINT32_MAX / 2)
+		errx(1, "table too large");
+
+	t->t_slots = slots_alloc(nold * 2);
+	t->t_mask = nold * 2 - 1;
+
+	for (i = 0; i < nold; i++) {
+		if (old[i].ts_name == NULL)
+			continue;
+
+		for (j = old[i].ts_hash & t->t_mask;
+		    t->t_slots[j].ts_name != NULL; j = (j + 1) & t->t_mask)
+			;
+		t->t_slots[j] = old[i];
+	}
+
+	free(old);
+}
+
+void *
+table_find(const table_t *t, const char *name, uint64_t hash)
+{
+	return (table_lookup(t, name, hash)->ts_value);
+}
+
+void
+table_add(table_t *t, const char *name, uint64_t hash, void *value)
+{
+	table_slot_t *ts;
+
+	/* keep the load factor at or below 3/4 */
+	if ((uint64_t)(t->t_count + 1) * 4 > (uint64_t)(t->t_mask + 1) * 3)
+		table_grow(t);
+
+	ts = table_lookup(t, name, hash);
+	if (ts->ts_name != NULL)
+		errx(1, "table_add: '%s' already present", name);
+
+	ts->ts_hash = hash;
+	ts->ts_name = name;
+	ts->ts_value = value;
+	t->t_count++;
+}
+
+void *
+table_remove(table_t *t, const char *name, uint64_t hash)
+{
+	table_slot_t *ts = table_lookup(t, name, hash);
+	void *value = ts->ts_value;
+	uint32_t i;
+	uint32_t j;
+	uint32_t home;
+
+	if (ts->ts_name == NULL)
+		return (NULL);
+
+	/*
+	 * Backward shift deletion: walk the run of slots following the one
+	 * being emptied, and move back any entry whose home slot isn't between
+	 * the hole and its current position.  This leaves the table exactly as
+	 * if the entry had never been added.
+	 */
+	i = j = ts - t->t_slots;
+	for (;;) {
+		j = (j + 1) & t->t_mask;
+		if (t->t_slots[j].ts_name == NULL)
+			break;
+
+		home = t->t_slots[j].ts_hash & t->t_mask;
+		if (((j - home) & t->t_mask) >= ((j - i) & t->t_mask)) {
+			t->t_slots[i] = t->t_slots[j];
+			i = j;
+		}
+	}
+
+	t->t_slots[i].ts_hash = 0;
+	t->t_slots[i].ts_name = NULL;
+	t->t_slots[i].ts_value = NULL;
+	t->t_count--;
+
+	return (value);
+}
+
+void *
+table_next(const table_t *t, uint32_t *cursor)
+{
+	while (*cursor <= t->t_mask) {
+		table_slot_t *ts = &t->t_slots[(*cursor)++];
+
+		if (ts->ts_name != NULL)
+			return (ts->ts_value);
+	}
+
+	return (NULL);
+}
+
+char *
+arena_strdup(arena_t *a, const char *str, size_t len)
+{
+	arena_chunk_t *ac = a->a_chunks;
+	size_t need = ARENA_HDR + len + 1;
+	size_t cls = (need - 1) / ARENA_CLASS_SIZE;
+	size_t size = (cls + 1) * ARENA_CLASS_SIZE;
+	char *p;
+
+	if (cls >= ARENA_CLASSES) {
+		if ((p = malloc(need)) == NULL)
+			err(1, "malloc arena string");
+		a->a_bytes += need;
+		size = 0;
+	} else if ((p = a->a_free[cls]) != NULL) {
+		(void) memcpy(&a->a_free[cls], p + ARENA_HDR, sizeof (char *));
+	} else {
+		if (ac == NULL || ac->ac_size - ac->ac_used < size) {
+			if ((ac = malloc(sizeof (arena_chunk_t))) == NULL ||
+			    (ac->ac_data = malloc(ARENA_CHUNK_SIZE)) == NULL) {
+				err(1, "malloc arena chunk");
+			}
+			ac->ac_size = ARENA_CHUNK_SIZE;
+			ac->ac_used = 0;
+			ac->ac_next = a->a_chunks;
+			a->a_chunks = ac;
+			a->a_bytes += ARENA_CHUNK_SIZE;
+		}
+		p = ac->ac_data + ac->ac_used;
+		ac->ac_used += size;
+	}
+
+	(void) memcpy(p, &size, ARENA_HDR);
+	p += ARENA_HDR;
+	(void) memcpy(p, str, len);
+	p[len] = '\0';
+
+	return (p);
+}
+
+void
+arena_free(arena_t *a, char *str)
+{
+	char *p = str - ARENA_HDR;
+	size_t cls;
+	size_t size;
+
+	(void) memcpy(&size, p, ARENA_HDR);
+
+	if (size == 0) {
+		a->a_bytes -= ARENA_HDR + strlen(str) + 1;
+		free(p);
+		return;
+	}
+
+	cls = size / ARENA_CLASS_SIZE - 1;
+	(void) memcpy(p + ARENA_HDR, &a->a_free[cls], sizeof (char *));
+	a->a_free[cls] = p;
+}
@@ -0,0 +1,119 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+#ifndef _FSWATCHER_TABLE_H
+#define	_FSWATCHER_TABLE_H
+
+/*
+ * Pathname index for fswatcher: a hash table mapping pathnames to the
+ * engine's per-file state, and an arena the pathnames are interned in.
+ *
+ * The table uses open addressing with linear probing.  Each slot holds the
+ * full 64-bit hash of its pathname, so a probe only has to compare strings
+ * when the hashes match, and growing the table never rehashes a pathname.
+ * Removal uses backward shift deletion, so there are no tombstones and probe
+ * lengths stay short however many pathnames have been watched and unwatched.
+ *
+ * Neither the table nor the arena does any locking.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct table_slot {
+	uint64_t ts_hash;
+	const char *ts_name;		/* NULL if the slot is empty */
+	void *ts_value;
+} table_slot_t;
+
+typedef struct table {
+	table_slot_t *t_slots;
+	uint32_t t_mask;		/* number of slots - 1 */
+	uint32_t t_count;		/* slots in use */
+} table_t;
+
+/*
+ * Strings are kept in blocks of a multiple of ARENA_CLASS_SIZE bytes, up to
+ * ARENA_CLASSES times that, which is enough for any pathname of up to
+ * MAXPATHLEN bytes.
+ */
+#define	ARENA_CLASS_SIZE	32
+#define	ARENA_CLASSES		36
+
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct arena {
+	arena_chunk_t *a_chunks;	/* every chunk, newest first */
+	char *a_free[ARENA_CLASSES];	/* freed blocks of each size */
+	size_t a_bytes;			/* size of chunks and long strings */
+} arena_t;
+
+/*
+ * 64-bit hash of a pathname (XXH64 with a seed of 0).
+ */
+uint64_t path_hash(const char *name, size_t len);
+
+/*
+ * Initialize an empty table.  Exits the program on allocation failure, as do
+ * table_add() and arena_strdup().
+ */
+void table_init(table_t *t);
+
+/*
+ * Return the value stored for name (with hash path_hash(name)), or NULL.
+ */
+void *table_find(const table_t *t, const char *name, uint64_t hash);
+
+/*
+ * Add a pathname that must not already be in the table.  name is not copied
+ * and must remain valid until it is removed.
+ */
+void table_add(table_t *t, const char *name, uint64_t hash, void *value);
+
+/*
+ * Remove a pathname, returning its value (or NULL if it wasn't found).
+ */
+void *table_remove(table_t *t, const char *name, uint64_t hash);
+
+/*
+ * Iterate over the values in the table: start with *cursor set to 0 and call
+ * until NULL is returned.  The table must not be modified while iterating.
+ */
+void *table_next(const table_t *t, uint32_t *cursor);
+
+/*
+ * Copy len bytes of str (plus a terminating NUL) into the arena.  The copy
+ * remains valid until it is passed to arena_free().  An arena must start out
+ * zeroed.
+ */
+char *arena_strdup(arena_t *a, const char *str, size_t len);
+
+/*
+ * Free a string returned by arena_strdup().  Its block is reused for the next
+ * string that needs a block of the same size.  The arena never shrinks: it
+ * holds as many blocks of each size as were ever in use at once, and a_bytes
+ * is at most that plus less than one block of waste at the end of each chunk.
+ */
+void arena_free(arena_t *a, char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FSWATCHER_TABLE_H */
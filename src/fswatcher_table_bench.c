@@ -0,0 +1,335 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * fswatcher_table_bench: micro-benchmark for the fswatcher pathname index.
+ *
+ * Usage: fswatcher_table_bench [-r rounds] [count ...]
+ *
+ * For each count (default 10000, 25000, 50000 and 100000) this builds a table
+ * of that many pathnames shaped like the ones vminfod watches, and times the
+ * same steps as fswatcher.c's add_handle(), find_handle() and destroy_handle()
+ * (minus the backend):
+ *
+ *   add        allocate a node, hash and intern the pathname, insert it
+ *   find_hit   hash a watched pathname and look it up
+ *   find_miss  hash a pathname that isn't watched and look it up
+ *   churn      remove and re-add a watched pathname
+ *   destroy    remove a pathname, free it from the arena and free the node
+ *
+ * Each result is the best of <rounds> runs, printed as "name count value unit",
+ * so the per-operation cost can be checked to stay flat as the count grows.
+ *
+ * It also prints "arena_growth count value %": how much the arena grows over
+ * 10 cycles of adding count new pathnames and destroying all but every 64th,
+ * so that long-lived pathnames are scattered among short-lived ones, as
+ * watches come and go in vminfod.  It fails if the arena more than doubles,
+ * which it would if the space of destroyed pathnames weren't reused.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fswatcher_table.h"
+
+#define	DEFAULT_ROUNDS	5
+
+struct bench_node {
+	char *name;
+	uint64_t name_hash;
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(1, "clock_gettime");
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: fswatcher_table_bench [-r rounds] "
+	    "[count ...]\n");
+	exit(2);
+}
+
+/*
+ * Generate count pathnames like "/zones/<uuid>/config/metadata.json", with
+ * the uuid derived from the index (and prefix to tell hits from misses).
+ */
+static char **
+make_paths(long count, unsigned int prefix)
+{
+	static const char *files[] = {
+		"config/metadata.json",
+		"config/routes.json",
+		"config/tags.json",
+		"lastexited"
+	};
+	char buf[128];
+	char **paths;
+	long i;
+
+	if ((paths = calloc(count, sizeof (char *))) == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < count; i++) {
+		uint64_t v = (uint64_t)i * 0x9E3779B97F4A7C15ULL;
+
+		(void) snprintf(buf, sizeof (buf),
+		    "/zones/%08x-%04x-%04x-%04x-%012llx/%s", prefix,
+		    (unsigned int)(v >> 48), (unsigned int)(v >> 32) & 0xffff,
+		    (unsigned int)(i & 0xffff), (unsigned long long)i,
+		    files[i % 4]);
+		if ((paths[i] = strdup(buf)) == NULL)
+			err(1, "strdup");
+	}
+
+	return (paths);
+}
+
+static void
+free_paths(char **paths, long count)
+{
+	long i;
+
+	for (i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+}
+
+static struct bench_node *
+node_add(table_t *t, arena_t *a, const char *path)
+{
+	struct bench_node *bn;
+	size_t len = strlen(path);
+
+	if ((bn = malloc(sizeof (struct bench_node))) == NULL)
+		err(1, "malloc");
+
+	bn->name_hash = path_hash(path, len);
+	bn->name = arena_strdup(a, path, len);
+	table_add(t, bn->name, bn->name_hash, bn);
+
+	return (bn);
+}
+
+static struct bench_node *
+node_find(table_t *t, const char *path)
+{
+	return (table_find(t, path, path_hash(path, strlen(path))));
+}
+
+static void
+node_destroy(table_t *t, arena_t *a, struct bench_node *bn)
+{
+	if (table_remove(t, bn->name, bn->name_hash) != bn)
+		errx(1, "removed the wrong node for %s", bn->name);
+	arena_free(a, bn->name);
+	free(bn);
+}
+
+static void
+report(const char *name, long count, uint64_t ns, long ops)
+{
+	printf("%s %ld %.1f ns/op\n", name, count, (double)ns / ops);
+}
+
+#define	REUSE_CYCLES	10
+#define	REUSE_KEEP	64
+
+static void
+check_reuse(long count)
+{
+	struct bench_node **kept;
+	struct bench_node **nodes;
+	table_t table;
+	arena_t arena;
+	size_t first = 0;
+	long nkept = 0;
+	long i;
+	int c;
+
+	if ((nodes = calloc(count, sizeof (struct bench_node *))) == NULL ||
+	    (kept = calloc(REUSE_CYCLES * (count / REUSE_KEEP + 1),
+	    sizeof (struct bench_node *))) == NULL) {
+		err(1, "calloc");
+	}
+
+	table_init(&table);
+	(void) memset(&arena, 0, sizeof (arena));
+
+	for (c = 0; c < REUSE_CYCLES; c++) {
+		char **paths = make_paths(count, 0x1000 + c);
+
+		for (i = 0; i < count; i++)
+			nodes[i] = node_add(&table, &arena, paths[i]);
+		for (i = 0; i < count; i++) {
+			if (i % REUSE_KEEP == 0)
+				kept[nkept++] = nodes[i];
+			else
+				node_destroy(&table, &arena, nodes[i]);
+		}
+		if (c == 0)
+			first = arena.a_bytes;
+
+		free_paths(paths, count);
+	}
+
+	printf("arena_growth %ld %.1f %%\n", count,
+	    100.0 * (arena.a_bytes - first) / first);
+	if (arena.a_bytes > 2 * first) {
+		errx(1, "arena grew from %zu to %zu bytes", first,
+		    arena.a_bytes);
+	}
+
+	for (i = 0; i < nkept; i++)
+		node_destroy(&table, &arena, kept[i]);
+	free(table.t_slots);
+	free(kept);
+	free(nodes);
+}
+
+static void
+bench(long count, int rounds)
+{
+	char **hits = make_paths(count, 0x5a5a5a5a);
+	char **misses = make_paths(count, 0xa5a5a5a5);
+	struct bench_node **nodes;
+	uint64_t best[5] = { UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX,
+	    UINT64_MAX };
+	uint64_t start;
+	uint64_t t;
+	table_t table;
+	arena_t arena;
+	size_t peak = 0;
+	long i;
+	int r;
+
+	if ((nodes = calloc(count, sizeof (struct bench_node *))) == NULL)
+		err(1, "calloc");
+
+	/* the arena is shared by all rounds, to check that it's reused */
+	(void) memset(&arena, 0, sizeof (arena));
+
+	for (r = 0; r < rounds; r++) {
+		table_init(&table);
+
+		start = now_ns();
+		for (i = 0; i < count; i++)
+			nodes[i] = node_add(&table, &arena, hits[i]);
+		if ((t = now_ns() - start) < best[0])
+			best[0] = t;
+		if (r == 0)
+			peak = arena.a_bytes;
+
+		start = now_ns();
+		for (i = 0; i < count; i++) {
+			if (node_find(&table, hits[i]) != nodes[i])
+				errx(1, "lookup failed for %s", hits[i]);
+		}
+		if ((t = now_ns() - start) < best[1])
+			best[1] = t;
+
+		start = now_ns();
+		for (i = 0; i < count; i++) {
+			if (node_find(&table, misses[i]) != NULL)
+				errx(1, "unexpected match for %s", misses[i]);
+		}
+		if ((t = now_ns() - start) < best[2])
+			best[2] = t;
+
+		start = now_ns();
+		for (i = 0; i < count; i++) {
+			node_destroy(&table, &arena, nodes[i]);
+			nodes[i] = node_add(&table, &arena, hits[i]);
+		}
+		if ((t = now_ns() - start) < best[3])
+			best[3] = t;
+
+		start = now_ns();
+		for (i = 0; i < count; i++)
+			node_destroy(&table, &arena, nodes[i]);
+		if ((t = now_ns() - start) < best[4])
+			best[4] = t;
+
+		if (table.t_count != 0 || arena.a_bytes > peak) {
+			errx(1, "table not empty or arena grew (%zu > %zu "
+			    "bytes) after destroy", arena.a_bytes, peak);
+		}
+
+		free(table.t_slots);
+	}
+
+	report("add", count, best[0], count);
+	report("find_hit", count, best[1], count);
+	report("find_miss", count, best[2], count);
+	report("churn", count, best[3], count);
+	report("destroy", count, best[4], count);
+	check_reuse(count);
+
+	free(nodes);
+	free_paths(hits, count);
+	free_paths(misses, count);
+}
+
+int
+main(int argc, char **argv)
+{
+	static long default_counts[] = { 10000, 25000, 50000, 100000 };
+	int rounds = DEFAULT_ROUNDS;
+	long count;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (rounds <= 0)
+		usage();
+
+	if (argc == 0) {
+		for (i = 0; i < 4; i++)
+			bench(default_counts[i], rounds);
+		return (0);
+	}
+
+	for (i = 0; i < argc; i++) {
+		if ((count = strtol(argv[i], NULL, 10)) <= 0)
+			usage();
+		bench(count, rounds);
+	}
+
+	return (0);
+}
@@ -4,9 +4,18 @@
 
 #include "usdt.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef __sun
+#include <procfs.h>
+#endif
+
+#define BENCHMARK_CYCLES 10
 
 static void
 create_and_free_provider(int argc, char **argv)
@@ -41,12 +50,126 @@ create_and_free_provider(int argc, char **argv)
         usdt_provider_free(provider);
 }
 
+/* current resident set size, in KB; the peak where we can't tell that */
+static long
+rss_kb(void)
+{
+#if defined(__sun)
+        psinfo_t psinfo;
+        int fd;
+
+        if ((fd = open("/proc/self/psinfo", O_RDONLY)) < 0)
+                return (-1);
+        if (read(fd, &psinfo, sizeof(psinfo)) != sizeof(psinfo)) {
+                close(fd);
+                return (-1);
+        }
+        close(fd);
+        return ((long)psinfo.pr_rssize);
+#elif defined(__linux__)
+        FILE *statm;
+        long size, rss;
+
+        if ((statm = fopen("/proc/self/statm", "r")) == NULL)
+                return (-1);
+        if (fscanf(statm, "%ld %ld", &size, &rss) != 2)
+                rss = -1;
+        fclose(statm);
+        return (rss < 0 ? -1 : rss * (sysconf(_SC_PAGESIZE) / 1024));
+#else
+        struct rusage ru;
+
+        if (getrusage(RUSAGE_SELF, &ru) < 0)
+                return (-1);
+#ifdef __APPLE__
+        return (ru.ru_maxrss / 1024);
+#else
+        return (ru.ru_maxrss);
+#endif
+#endif
+}
+
+static double
+now_ms(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0);
+}
+
+/*
+ * Enable and disable a provider with nprobes probes BENCHMARK_CYCLES
+ * times, and report the average time each took, and the RSS before the
+ * provider was created and after the last cycle. Disabling a provider
+ * leaks its tracepoints, so the RSS grows with every cycle.
+ */
+static void
+benchmark_provider(int nprobes, int argc, char **argv)
+{
+        usdt_provider_t *provider;
+        usdt_probedef_t **probedefs;
+        char name[64];
+        double start, enable = 0, disable = 0;
+        long rss_before, rss_after;
+        int i;
+
+        rss_before = rss_kb();
+
+        if ((provider = usdt_create_provider("testlibusdt", "modname")) == NULL ||
+            (probedefs = malloc(nprobes * sizeof(*probedefs))) == NULL) {
+                fprintf(stderr, "unable to create provider\n");
+                exit (1);
+        }
+
+        for (i = 0; i < nprobes; i++) {
+                snprintf(name, sizeof(name), "%s%d", argv[2], i);
+                if ((probedefs[i] = usdt_create_probe((const char *)argv[1],
+                                                      (const char *)name,
+                                                      (argc-3), (const char **)&argv[3])) == NULL)
+                {
+                        fprintf(stderr, "unable to create probe\n");
+                        exit (1);
+                }
+                usdt_provider_add_probe(provider, probedefs[i]);
+        }
+
+        for (i = 0; i < BENCHMARK_CYCLES; i++) {
+                start = now_ms();
+                if ((usdt_provider_enable(provider)) < 0) {
+                        fprintf(stderr, "unable to enable provider: %s\n", usdt_errstr(provider));
+                        exit (1);
+                }
+                enable += now_ms() - start;
+
+                start = now_ms();
+                if ((usdt_provider_disable(provider)) < 0) {
+                        fprintf(stderr, "unable to disable provider: %s\n", usdt_errstr(provider));
+                        exit (1);
+                }
+                disable += now_ms() - start;
+        }
+
+        rss_after = rss_kb();
+
+        for (i = 0; i < nprobes; i++)
+                usdt_probe_release(probedefs[i]);
+        free(probedefs);
+        usdt_provider_free(provider);
+
+        printf("%5d probes: enable %9.3f ms, disable %9.3f ms, "
+               "rss %ld KB -> %ld KB\n", nprobes,
+               enable / BENCHMARK_CYCLES, disable / BENCHMARK_CYCLES,
+               rss_before, rss_after);
+}
+
 int
 main(int argc, char **argv)
 {
         char char_argv[USDT_ARG_MAX];
         int int_argv[USDT_ARG_MAX * 2];
         int i;
+        int benchmark = 0;
         char buf[255];
 
         for (i = 0; i < USDT_ARG_MAX; i++)
@@ -54,8 +177,14 @@ main(int argc, char **argv)
         for (i = 0; i < USDT_ARG_MAX; i++)
                 char_argv[i] = (char) i + 65;
 
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                benchmark = 1;
+                argv++;
+                argc--;
+        }
+
         if (argc < 3) {
-                fprintf(stderr, "usage: %s func name [types ...]\n", argv[0]);
+                fprintf(stderr, "usage: %s [-b] func name [types ...]\n", argv[0]);
                 return(1);
         }
 
@@ -70,6 +199,13 @@ main(int argc, char **argv)
                 }
         }
 
+        /* with -b, time providers of 1 to 10000 probes instead */
+        if (benchmark) {
+                for (i = 1; i <= 10000; i *= 10)
+                        benchmark_provider(i, argc, argv);
+                return 0;
+        }
+
         for (i = 0; i < 100000; i++)
                 create_and_free_provider(argc, argv);
 
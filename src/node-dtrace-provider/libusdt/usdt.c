@@ -170,12 +170,17 @@ usdt_provider_enable(usdt_provider_t *provider)
         }
 
         for (pd = provider->probedefs; pd != NULL; pd = pd->next) {
-                if ((pd->probe = malloc(sizeof(*pd->probe))) == NULL) {
+                if ((pd->probe = calloc(1, sizeof(*pd->probe))) == NULL) {
                         usdt_error(provider, USDT_ERROR_MALLOC);
                         return (-1);
                 }
         }
 
+        if (usdt_create_tracepoints(provider) < 0) {
+                usdt_error(provider, USDT_ERROR_VALLOC);
+                return (-1);
+        }
+
         if ((usdt_strtab_init(&strtab, 0)) < 0) {
                 usdt_error(provider, USDT_ERROR_MALLOC);
                 return (-1);
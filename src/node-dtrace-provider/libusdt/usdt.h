@@ -21,6 +21,7 @@ typedef enum usdt_error {
 typedef struct usdt_probe {
         int (*isenabled_addr)(void);
         void *probe_addr;
+        struct usdt_arena *arena;
 } usdt_probe_t;
 
 int usdt_is_enabled(usdt_probe_t *probe);
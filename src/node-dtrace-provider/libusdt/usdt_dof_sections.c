@@ -29,11 +29,6 @@ usdt_dof_probes_sect(usdt_dof_section_t *probes,
                                 argv = type;
                 }
 
-                if (usdt_create_tracepoints(pd->probe) < 0) {
-                        usdt_error(provider, USDT_ERROR_VALLOC);
-                        return (-1);
-                }
-
 #ifdef __x86_64__
                 p.dofpr_addr     = (uint64_t) pd->probe->isenabled_addr;
 #elif __i386__ || __i386
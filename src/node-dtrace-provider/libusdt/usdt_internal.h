@@ -32,9 +32,17 @@ extern void usdt_tracepoint_probe(void);
 extern void usdt_tracepoint_end(void);
 extern void usdt_probe_args(void *, int, void**);
 
+/* The memory holding all of a provider's tracepoints, shared by its
+ * probes, and freed when the last of them is. */
+typedef struct usdt_arena {
+        char *base;
+        size_t size;
+        int refcnt;
+} usdt_arena_t;
+
 uint32_t usdt_probe_offset(usdt_probe_t *probe, char *dof, uint8_t argc);
 uint32_t usdt_is_enabled_offset(usdt_probe_t *probe, char *dof);
-int usdt_create_tracepoints(usdt_probe_t *probe);
+int usdt_create_tracepoints(usdt_provider_t *provider);
 void usdt_free_tracepoints(usdt_probe_t *probe);
 
 typedef struct usdt_dof_section {
@@ -64,60 +64,113 @@ usdt_is_enabled_offset(usdt_probe_t *probe, char *dof)
 
 #endif
 
+static void
+free_arena(usdt_arena_t *arena)
+{
+#ifdef __linux__
+        (void) munmap(arena->base, arena->size);
+#else
+        free(arena->base);
+#endif
+        free(arena);
+}
+
 int
-usdt_create_tracepoints(usdt_probe_t *probe)
+usdt_create_tracepoints(usdt_provider_t *provider)
 {
         /* Prepare the tracepoints - for each probe, a separate chunk
          * of memory with the tracepoint code copied into it, to give
-         * us unique addresses for each tracepoint.
+         * us unique addresses for each tracepoint. The chunks are cut
+         * from one page-aligned arena for the whole provider, so that
+         * enabling it takes one allocation and one mprotect however
+         * many probes it has.
          *
          * On Oracle Linux, this must be an mmapped file because USDT
          * probes there are implemented as uprobes, which are
-         * addressed by inode and offset. The file used is a small
-         * mkstemp'd file we immediately unlink.
+         * addressed by inode and offset. The file used is a
+         * mkstemp'd file we immediately unlink, and each probe is at
+         * its own offset in it.
          *
          * Elsewhere, we can use the heap directly because USDT will
          * instrument any memory mapped by the process.
          */
 
-        size_t size;
+        usdt_probedef_t *pd;
+        usdt_arena_t *arena;
+        size_t size, pagesize;
+        size_t nprobes = 0;
+        size_t i;
+        int prot;
 #ifdef __linux__
         int fd;
         char tmp[20] = "/tmp/libusdtXXXXXX";
+#endif
 
-        if ((fd = mkstemp(tmp)) < 0)
+        /* ensure that the tracepoints will fit the chunks we're allocating */
+        size = ((char *)usdt_tracepoint_end - (char *)usdt_tracepoint_isenabled);
+        assert(size < FUNC_SIZE);
+
+        for (pd = provider->probedefs; pd != NULL; pd = pd->next)
+                nprobes++;
+
+        /* usdt_provider_enable() refuses a provider with no probes, so
+         * the arena is never empty, which mmap would reject */
+        assert(nprobes > 0);
+
+        if ((arena = malloc(sizeof(*arena))) == NULL)
                 return (-1);
-        if (unlink(tmp) < 0)
+        pagesize = sysconf(_SC_PAGESIZE);
+        arena->size = (nprobes * FUNC_SIZE + pagesize - 1) & ~(pagesize - 1);
+        arena->refcnt = 0;
+
+#ifdef __linux__
+        if ((fd = mkstemp(tmp)) < 0) {
+                free(arena);
                 return (-1);
-        if (write(fd, "\0", FUNC_SIZE) < FUNC_SIZE)
+        }
+        if (unlink(tmp) < 0 || ftruncate(fd, arena->size) < 0) {
+                (void) close(fd);
+                free(arena);
                 return (-1);
+        }
 
-        probe->isenabled_addr = (int (*)())mmap(NULL, FUNC_SIZE,
-                                                PROT_READ | PROT_WRITE | PROT_EXEC,
-                                                MAP_PRIVATE, fd, 0);
+        arena->base = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, fd, 0);
+        (void) close(fd);
+        if (arena->base == MAP_FAILED) {
+                free(arena);
+                return (-1);
+        }
 #else
-        probe->isenabled_addr = (int (*)())valloc(FUNC_SIZE);
-#endif
-        if (probe->isenabled_addr == NULL)
+        if ((arena->base = valloc(arena->size)) == NULL) {
+                free(arena);
                 return (-1);
+        }
+#endif
 
-        /* ensure that the tracepoints will fit the heap we're allocating */
-        size = ((char *)usdt_tracepoint_end - (char *)usdt_tracepoint_isenabled);
-        assert(size < FUNC_SIZE);
-
-        size = ((char *)usdt_tracepoint_probe - (char *)usdt_tracepoint_isenabled);
-        probe->probe_addr = (char *)probe->isenabled_addr + size;
-
-        memcpy((void *)probe->isenabled_addr,
-               (const void *)usdt_tracepoint_isenabled, FUNC_SIZE);
+        for (i = 0; i < nprobes; i++)
+                memcpy(arena->base + i * FUNC_SIZE,
+                       (const void *)usdt_tracepoint_isenabled, FUNC_SIZE);
 
 #ifdef __linux__
-        mprotect((void *)probe->isenabled_addr, FUNC_SIZE,
-                 PROT_READ | PROT_EXEC);
+        prot = PROT_READ | PROT_EXEC;
 #else
-        mprotect((void *)probe->isenabled_addr, FUNC_SIZE,
-                 PROT_READ | PROT_WRITE | PROT_EXEC);
+        prot = PROT_READ | PROT_WRITE | PROT_EXEC;
 #endif
+        if (mprotect(arena->base, arena->size, prot) < 0) {
+                free_arena(arena);
+                return (-1);
+        }
+
+        size = ((char *)usdt_tracepoint_probe - (char *)usdt_tracepoint_isenabled);
+        i = 0;
+        for (pd = provider->probedefs; pd != NULL; pd = pd->next, i++) {
+                pd->probe->isenabled_addr =
+                        (int (*)())(arena->base + i * FUNC_SIZE);
+                pd->probe->probe_addr = arena->base + i * FUNC_SIZE + size;
+                pd->probe->arena = arena;
+                arena->refcnt++;
+        }
 
         return (0);
 }
@@ -125,9 +178,9 @@ usdt_create_tracepoints(usdt_probe_t *probe)
 void
 usdt_free_tracepoints(usdt_probe_t *probe)
 {
-#ifdef __linux__
-        (void) munmap(probe->isenabled_addr, FUNC_SIZE);
-#else
-        free(probe->isenabled_addr);
-#endif
+        usdt_arena_t *arena = probe->arena;
+
+        /* the arena goes once none of its probes are using it */
+        if (arena != NULL && --arena->refcnt == 0)
+                free_arena(arena);
 }
@@ -0,0 +1,108 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * Writes a version 2 bundle, with a table of contents, for testing
+ * vmunbundle.
+ *
+ * Usage: node mkbundle.js [-n] <name>=<file> ... > bundle
+ *
+ * Each argument is a member, in order, with its payload read from <file>.
+ * With -n, the table of contents has no checksums.
+ */
+
+var fs = require('fs');
+
+var ENTRY_SIZE = 512;
+var MASK = (BigInt(1) << BigInt(64)) - BigInt(1);
+
+var args = process.argv.slice(2);
+var checksums = true;
+var members = [];
+var offset = 0;
+var out = [];
+
+function fields(strs)
+{
+    var buf = Buffer.alloc(ENTRY_SIZE);
+    var pos = 0;
+
+    strs.forEach(function (str) {
+        pos += buf.write(String(str), pos) + 1;
+    });
+
+    return (buf);
+}
+
+function padded(size)
+{
+    return (size + (ENTRY_SIZE - size % ENTRY_SIZE) % ENTRY_SIZE);
+}
+
+function fletcher4(data)
+{
+    var a = BigInt(0), b = BigInt(0), c = BigInt(0), d = BigInt(0);
+    var word = Buffer.alloc(4);
+    var i;
+
+    for (i = 0; i < data.length; i += 4) {
+        word.fill(0);
+        data.copy(word, 0, i, Math.min(i + 4, data.length));
+        a = (a + BigInt(word.readUInt32LE(0))) & MASK;
+        b = (b + a) & MASK;
+        c = (c + b) & MASK;
+        d = (d + c) & MASK;
+    }
+
+    return ([a, b, c, d].map(function (w) {
+        return (w.toString(16).padStart(16, '0'));
+    }).join(''));
+}
+
+function add(name, data)
+{
+    out.push(fields(['MAGIC-VMBUNDLE', 2, 'CHECKSUM', name, data.length,
+        padded(data.length)]));
+    out.push(data);
+    out.push(Buffer.alloc(padded(data.length) - data.length));
+    offset += ENTRY_SIZE;
+
+    members.push({name: name, offset: offset, size: data.length,
+        checksum: checksums ? fletcher4(data) : '0'});
+    offset += padded(data.length);
+}
+
+if (args[0] === '-n') {
+    checksums = false;
+    args.shift();
+}
+
+args.forEach(function (arg) {
+    var eq = arg.indexOf('=');
+
+    add(arg.substring(0, eq), fs.readFileSync(arg.substring(eq + 1)));
+});
+
+var toc = members.map(function (m) {
+    return (fields([m.name, m.offset, m.size, m.checksum]));
+});
+toc.push(fields(['MAGIC-VMBUNDLE-TOC', 2, members.length,
+    offset + ENTRY_SIZE]));
+
+out.push(fields(['MAGIC-VMBUNDLE', 2, 'CHECKSUM', 'TOC',
+    toc.length * ENTRY_SIZE, toc.length * ENTRY_SIZE]));
+out = out.concat(toc);
+
+fs.writeSync(1, Buffer.concat(out));
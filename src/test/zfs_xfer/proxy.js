@@ -0,0 +1,80 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * A TCP proxy for testing zfs_send and zfs_recv, which damages the data
+ * going from the first connection's client to the server.
+ *
+ * Usage: node proxy.js <port> <target port> <action> <offset>
+ *
+ * where <action> is one of:
+ *
+ *   corrupt    flip the bits of the byte at <offset>
+ *   drop       pass <offset> bytes, then close both ends of the connection;
+ *              later connections are left alone
+ *   cut        as drop, but also stop accepting connections
+ *
+ * Prints "listening" on stdout once it is.
+ */
+
+var net = require('net');
+
+var port = Number(process.argv[2]);
+var target = Number(process.argv[3]);
+var action = process.argv[4];
+var offset = Number(process.argv[5]);
+var nconns = 0;
+
+var server = net.createServer(function (client) {
+    var first = (nconns++ === 0);
+    var seen = 0;
+    var upstream = net.connect(target, '127.0.0.1');
+
+    client.on('data', function (buf) {
+        if (first && action === 'corrupt' && offset >= seen &&
+            offset < seen + buf.length) {
+            buf[offset - seen] ^= 0xff;
+        }
+        if (first && (action === 'drop' || action === 'cut') &&
+            seen + buf.length > offset) {
+            upstream.write(buf.slice(0, offset - seen), function () {
+                upstream.destroy();
+                client.destroy();
+            });
+            client.removeAllListeners('data');
+            if (action === 'cut') {
+                server.close();
+            }
+            return;
+        }
+        seen += buf.length;
+        upstream.write(buf);
+    });
+    client.on('end', function () {
+        upstream.end();
+    });
+    client.on('error', function () {
+        upstream.destroy();
+    });
+
+    upstream.pipe(client);
+    upstream.on('error', function () {
+        client.destroy();
+    });
+});
+
+server.listen(port, '127.0.0.1', function () {
+    console.log('listening');
+});
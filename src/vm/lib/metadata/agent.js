@@ -21,6 +21,7 @@
  * CDDL HEADER END
  *
  * Copyright 2019 Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  *
  *
  * # OVERVIEW
@@ -136,6 +137,18 @@
  * for "GET user-script" means that we want to return the value from the vmobj's
  * customer_metadata['user-script'].
  *
+ *
+ * # GETMANY
+ *
+ * Besides the commands described in the protocol documentation, V2 clients can
+ * send GETMANY with a JSON array of key names. The response is a JSON object
+ * mapping each of those keys that has a value to what a GET of the key would
+ * return; keys without a value are left out. If a GET of any of the keys would
+ * answer FAILURE, so does the GETMANY. With no argument, GETMANY returns every
+ * key that KEYS would list, with its value. This saves clients a round trip per
+ * key. Agents that predate GETMANY answer it with FAILURE, as for any
+ * unknown command, and clients then fall back to a GET for each key.
+ *
  */
 
 var assert = require('/usr/node/node_modules/assert-plus');
@@ -971,7 +984,6 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
         var reqid;
         var req_is_v2 = false;
         var start_request_timer = newTimer();
-        var val;
         var vmobj;
         var want;
 
@@ -1015,33 +1027,204 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
             }
 
             zlog.trace('Serving GET ' + want);
+            lookupValue(want, returnit);
+        } else if (req_is_v2 && cmd === 'GETMANY') {
+            var gerr = null;
+            var gkeys;
+            var gvalues = {};
+
+            // GETMANY takes a JSON array of key names, and returns a JSON
+            // object mapping each of those keys that has a value to its value,
+            // as GET would return it. With no argument, it returns every key
+            // that KEYS would list.
+            if (!want) {
+                gkeys = listKeys();
+            } else {
+                try {
+                    gkeys = JSON.parse(want);
+                } catch (parseErr) {
+                    gkeys = null;
+                }
+                if (!Array.isArray(gkeys) || !gkeys.every(common.isString)) {
+                    returnit(new Error('Invalid GETMANY Request'));
+                    return;
+                }
+            }
+
+            zlog.trace('Serving GETMANY ' + gkeys.join(' '));
+            gkeys.forEach(function (k) {
+                var gkey = k.trim();
+
+                if (!gkey || gerr) {
+                    return;
+                }
+                lookupValue(gkey, function (err, v) {
+                    var str;
+
+                    if (err) {
+                        gerr = err;
+                        return;
+                    }
+
+                    str = valueString(v);
+                    if (str === null) {
+                        gerr = new Error('Value of "' + gkey
+                            + '" is not a string');
+                    } else if (str !== undefined) {
+                        gvalues[k] = str;
+                    }
+                });
+            });
+
+            if (gerr) {
+                returnit(gerr);
+                return;
+            }
+            returnit(null, JSON.stringify(gvalues));
+        } else if (!req_is_v2 && cmd === 'NEGOTIATE') {
+            if (want === 'V2') {
+                write('V2_OK\n');
+            } else {
+                write('FAILURE\n');
+            }
+            return;
+        } else if (req_is_v2 && cmd === 'DELETE') {
+            want = (want || '').trim();
+            if (!want) {
+                returnit(new Error('Invalid DELETE Request'));
+                return;
+            }
+
+            zlog.trace('Serving DELETE ' + want);
 
             if (want.slice(0, 4) === 'sdc:') {
-                want = want.slice(4);
+                returnit(new Error('Cannot update the "sdc" Namespace.'));
+                return;
+            }
+
+            ns = internalNamespace(vmobj, want);
+            if (ns !== null) {
+                returnit(new Error('Cannot update the "' + ns
+                    + '" Namespace.'));
+                return;
+            }
+
+            setMetadata(want, null, function (err) {
+                if (err) {
+                    returnit(err);
+                } else {
+                    returnit(null, 'OK');
+                }
+            });
+        } else if (req_is_v2 && cmd === 'PUT') {
+            var key;
+            var value;
+            var terms;
+
+            terms = (want || '').trim().split(' ');
+
+            if (terms.length !== 2) {
+                returnit(new Error('Invalid PUT Request'));
+                return;
+            }
+
+            // PUT requests have two space-separated BASE64-encoded
+            // arguments: the Key and then the Value.
+            key = (base64_decode(terms[0]) || '').trim();
+            value = base64_decode(terms[1]);
+            query.arg = key;
+
+            if (!key || value === null) {
+                returnit(new Error('Invalid PUT Request'));
+                return;
+            }
+
+            if (key.slice(0, 4) === 'sdc:') {
+                returnit(new Error('Cannot update the "sdc" Namespace.'));
+                return;
+            }
+
+            ns = internalNamespace(vmobj, key);
+            if (ns !== null) {
+                returnit(new Error('Cannot update the "' + ns
+                    + '" Namespace.'));
+                return;
+            }
+
+            zlog.trace('Serving PUT ' + key);
+            setMetadata(key, value, function (err) {
+                if (err) {
+                    zlog.error(err, 'could not set metadata (key "' + key
+                        + '")');
+                    returnit(err);
+                } else {
+                    returnit(null, 'OK');
+                }
+            });
+
+            return;
+        } else if (cmd === 'KEYS') {
+            returnit(null, listKeys().join('\n'));
+        } else {
+            zlog.error('Unknown command ' + cmd);
+            returnit(new Error('Unknown command ' + cmd));
+            return;
+        }
+
+        function _callCbAndLogTimer(opts, err, _cb) {
+            assert.object(opts, 'opts');
+            assert.arrayOfNumber(opts.timer, 'opts.timer');
+            assert.string(opts.loadFile, 'opts.loadFile');
+            assert.optionalObject(err, 'err');
+            assert.func(_cb, '_cb');
+
+            var elapsed = elapsedTimer(opts.timer);
+            var loglvl = 'trace';
+
+            if (elapsed >= 10) {
+                // If reading the file took more than 10ms we log at
+                // warn instead of trace. Something's not right.
+                loglvl = 'warn';
+            }
+            zlog[loglvl]({
+                elapsed: elapsed,
+                result: (err ? 'FAILED' : 'SUCCESS'),
+                zonename: vmobj.zonename
+            }, 'load ' + opts.loadFile);
+            _cb(err);
+        }
+
+        // Look up the value GET should return for a key, and pass it to
+        // cb(err, value).  This always calls cb before returning.
+        function lookupValue(key, cb) {
+            var val;
+
+            if (key.slice(0, 4) === 'sdc:') {
+                key = key.slice(4);
 
                 // NOTE: sdc:nics, sdc:resolvers and sdc:routes are not a
                 // committed interface, do not rely on it. At this point it
                 // should only be used by mdata-fetch, if you add a consumer
                 // that depends on it, please add a note about that here
                 // otherwise expect it will be removed on you sometime.
-                if (want === 'nics' && vmobj.hasOwnProperty('nics')) {
+                if (key === 'nics' && vmobj.hasOwnProperty('nics')) {
 
                     val = JSON.stringify(vmobj.nics);
-                    returnit(null, val);
+                    cb(null, val);
 
-                } else if (want === 'resolvers'
+                } else if (key === 'resolvers'
                     && vmobj.hasOwnProperty('resolvers')) {
 
                     val = JSON.stringify(vmobj.resolvers);
-                    returnit(null, val);
+                    cb(null, val);
 
-                } else if (want === 'tmpfs'
+                } else if (key === 'tmpfs'
                     && vmobj.hasOwnProperty('tmpfs')) {
 
                     val = JSON.stringify(vmobj.tmpfs);
-                    returnit(null, val);
+                    cb(null, val);
 
-                } else if (want === 'routes'
+                } else if (key === 'routes'
                     && vmobj.hasOwnProperty('routes')) {
 
                     var vmRoutes = [];
@@ -1128,133 +1311,51 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
                         vmRoutes.push(route);
                     }
 
-                    returnit(null, JSON.stringify(vmRoutes));
-                } else if (want === 'operator-script') {
-                    returnit(null, vmobj.internal_metadata['operator-script']);
-                } else if (want === 'volumes') {
-                    returnit(null, vmobj.internal_metadata['sdc:volumes']);
-                } else if (want.slice(0, 5) === 'tags.') {
-                    want = want.slice(5);
-                    if (vmobj.tags && hasKey(vmobj.tags, want)) {
-                        val = vmobj.tags[want];
+                    cb(null, JSON.stringify(vmRoutes));
+                } else if (key === 'operator-script') {
+                    cb(null, vmobj.internal_metadata['operator-script']);
+                } else if (key === 'volumes') {
+                    cb(null, vmobj.internal_metadata['sdc:volumes']);
+                } else if (key.slice(0, 5) === 'tags.') {
+                    key = key.slice(5);
+                    if (vmobj.tags && hasKey(vmobj.tags, key)) {
+                        val = vmobj.tags[key];
                     }
 
-                    returnit(null, val);
+                    cb(null, val);
                 } else {
-                    val = VM.flatten(vmobj, want);
-                    returnit(null, val);
+                    val = VM.flatten(vmobj, key);
+                    cb(null, val);
                 }
             } else {
                 var which_mdata = 'customer_metadata';
 
-                if (want.match(/_pw$/)) {
+                if (key.match(/_pw$/)) {
                     which_mdata = 'internal_metadata';
                 }
 
-                if (internalNamespace(vmobj, want) !== null) {
+                if (internalNamespace(vmobj, key) !== null) {
                     which_mdata = 'internal_metadata';
                 }
 
                 if (vmobj.hasOwnProperty(which_mdata)) {
-                    returnit(null, vmobj[which_mdata][want]);
+                    cb(null, vmobj[which_mdata][key]);
                     return;
                 } else {
-                    returnit(new Error('Zone did not contain '
+                    cb(new Error('Zone did not contain '
                         + which_mdata));
                     return;
                 }
             }
-        } else if (!req_is_v2 && cmd === 'NEGOTIATE') {
-            if (want === 'V2') {
-                write('V2_OK\n');
-            } else {
-                write('FAILURE\n');
-            }
-            return;
-        } else if (req_is_v2 && cmd === 'DELETE') {
-            want = (want || '').trim();
-            if (!want) {
-                returnit(new Error('Invalid DELETE Request'));
-                return;
-            }
-
-            zlog.trace('Serving DELETE ' + want);
-
-            if (want.slice(0, 4) === 'sdc:') {
-                returnit(new Error('Cannot update the "sdc" Namespace.'));
-                return;
-            }
-
-            ns = internalNamespace(vmobj, want);
-            if (ns !== null) {
-                returnit(new Error('Cannot update the "' + ns
-                    + '" Namespace.'));
-                return;
-            }
-
-            setMetadata(want, null, function (err) {
-                if (err) {
-                    returnit(err);
-                } else {
-                    returnit(null, 'OK');
-                }
-            });
-        } else if (req_is_v2 && cmd === 'PUT') {
-            var key;
-            var value;
-            var terms;
-
-            terms = (want || '').trim().split(' ');
-
-            if (terms.length !== 2) {
-                returnit(new Error('Invalid PUT Request'));
-                return;
-            }
-
-            // PUT requests have two space-separated BASE64-encoded
-            // arguments: the Key and then the Value.
-            key = (base64_decode(terms[0]) || '').trim();
-            value = base64_decode(terms[1]);
-            query.arg = key;
-
-            if (!key || value === null) {
-                returnit(new Error('Invalid PUT Request'));
-                return;
-            }
-
-            if (key.slice(0, 4) === 'sdc:') {
-                returnit(new Error('Cannot update the "sdc" Namespace.'));
-                return;
-            }
-
-            ns = internalNamespace(vmobj, key);
-            if (ns !== null) {
-                returnit(new Error('Cannot update the "' + ns
-                    + '" Namespace.'));
-                return;
-            }
-
-            zlog.trace('Serving PUT ' + key);
-            setMetadata(key, value, function (err) {
-                if (err) {
-                    zlog.error(err, 'could not set metadata (key "' + key
-                        + '")');
-                    returnit(err);
-                } else {
-                    returnit(null, 'OK');
-                }
-            });
+        }
 
-            return;
-        } else if (cmd === 'KEYS') {
+        // The keys that KEYS lists: keys that match *_pw$ and
+        // internal_metadata_namespace prefixed keys come from
+        // internal_metadata, everything else comes from customer_metadata.
+        function listKeys() {
             var ckeys = [];
             var ikeys = [];
 
-            /*
-             * Keys that match *_pw$ and internal_metadata_namespace
-             * prefixed keys come from internal_metadata, everything else
-             * comes from customer_metadata.
-             */
             ckeys = Object.keys(vmobj.customer_metadata)
                 .filter(function (k) {
 
@@ -1268,34 +1369,7 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
                     || internalNamespace(vmobj, k) !== null);
             });
 
-            returnit(null, ckeys.concat(ikeys).join('\n'));
-        } else {
-            zlog.error('Unknown command ' + cmd);
-            returnit(new Error('Unknown command ' + cmd));
-            return;
-        }
-
-        function _callCbAndLogTimer(opts, err, _cb) {
-            assert.object(opts, 'opts');
-            assert.arrayOfNumber(opts.timer, 'opts.timer');
-            assert.string(opts.loadFile, 'opts.loadFile');
-            assert.optionalObject(err, 'err');
-            assert.func(_cb, '_cb');
-
-            var elapsed = elapsedTimer(opts.timer);
-            var loglvl = 'trace';
-
-            if (elapsed >= 10) {
-                // If reading the file took more than 10ms we log at
-                // warn instead of trace. Something's not right.
-                loglvl = 'warn';
-            }
-            zlog[loglvl]({
-                elapsed: elapsed,
-                result: (err ? 'FAILED' : 'SUCCESS'),
-                zonename: vmobj.zonename
-            }, 'load ' + opts.loadFile);
-            _cb(err);
+            return (ckeys.concat(ikeys));
         }
 
         function setMetadata(_key, _value, cb) {
@@ -1395,6 +1469,20 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
             }, 'handled %s %s', query.cmd, query.arg);
         }
 
+        // Converts a value from lookupValue() to the string that GET returns
+        // for it. Returns undefined if there is nothing to return, and null if
+        // the value can't be returned, which GET answers with FAILURE.
+        function valueString(val) {
+            if (common.isString(val)) {
+                return (val);
+            } else if (!isNaN(val)) {
+                return (val.toString());
+            } else if (val) {
+                return (null);
+            }
+            return (undefined);
+        }
+
         function returnit(error, retval) {
             var towrite;
 
@@ -1409,6 +1497,8 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
                 return;
             }
 
+            retval = valueString(retval);
+
             // String value
             if (common.isString(retval)) {
                 if (req_is_v2) {
@@ -1419,16 +1509,7 @@ MetadataAgent.prototype.makeMetadataHandler = function (zone, socket) {
                 }
                 logReturn('SUCCESS');
                 return;
-            } else if (!isNaN(retval)) {
-                if (req_is_v2) {
-                    write(format_v2_response('SUCCESS', retval.toString()));
-                } else {
-                    towrite = retval.toString().replace(/^\./mg, '..');
-                    write('SUCCESS\n' + towrite + '\n.\n');
-                }
-                logReturn('SUCCESS');
-                return;
-            } else if (retval) {
+            } else if (retval === null) {
                 // Non-string value
                 if (req_is_v2) {
                     write(format_v2_response('FAILURE'));
@@ -1,5 +1,6 @@
 // Copyright (C) 1986 Gary S. Brown.
 // Copyright (c) 2013, Joyent, Inc. All rights reserved.
+// Copyright 2026 Edgecast Cloud LLC.
 // vim: set ts=4 sts=4 sw=4 et:
 
 // CRC polynomial 0xedb88320
@@ -49,15 +50,62 @@ var CRC32_TABLE = [
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 ];
 
+// Tables for "slice-by-8": CRC32_SLICES[k][b] is the CRC contribution of
+// byte b followed by k zero bytes, so that crc32_calc() can fold eight input
+// bytes into the CRC with independent lookups rather than a chain of eight
+// dependent ones.  CRC32_SLICES[0] is the same as CRC32_TABLE.
+var CRC32_SLICES = (function () {
+    var slices = [];
+    var i, k, c;
+
+    for (k = 0; k < 8; k++) {
+        slices.push(new Int32Array(256));
+    }
+    for (i = 0; i < 256; i++) {
+        slices[0][i] = CRC32_TABLE[i];
+    }
+    for (k = 1; k < 8; k++) {
+        for (i = 0; i < 256; i++) {
+            c = slices[k - 1][i];
+            slices[k][i] = slices[0][c & 0xff] ^ (c >>> 8);
+        }
+    }
+
+    return (slices);
+})();
+
 function update_crc32(inbyte, crc) {
-    return (CRC32_TABLE[(crc ^ inbyte) & 0xff] ^ (crc >>> 8));
+    return (CRC32_SLICES[0][(crc ^ inbyte) & 0xff] ^ (crc >>> 8));
 }
 
+// As with the C client, each character of the input string is treated as a
+// byte (i.e. only the low 8 bits of its code are used).  Reading bytes back out
+// of a 'binary' Buffer is much cheaper than charCodeAt() for long inputs.
 function crc32_calc(input) {
+    var buf = new Buffer(input, 'binary');
+    var t0 = CRC32_SLICES[0], t1 = CRC32_SLICES[1], t2 = CRC32_SLICES[2],
+        t3 = CRC32_SLICES[3], t4 = CRC32_SLICES[4], t5 = CRC32_SLICES[5],
+        t6 = CRC32_SLICES[6], t7 = CRC32_SLICES[7];
     var oldcrc32 = 0xffffffff;
+    var len = buf.length;
+    var end8 = len - (len % 8);
+    var lo, hi;
+    var i = 0;
+
+    for (; i < end8; i += 8) {
+        lo = oldcrc32 ^ (buf[i] | (buf[i + 1] << 8) | (buf[i + 2] << 16) |
+            (buf[i + 3] << 24));
+        hi = buf[i + 4] | (buf[i + 5] << 8) | (buf[i + 6] << 16) |
+            (buf[i + 7] << 24);
+
+        oldcrc32 = t7[lo & 0xff] ^ t6[(lo >>> 8) & 0xff] ^
+            t5[(lo >>> 16) & 0xff] ^ t4[lo >>> 24] ^
+            t3[hi & 0xff] ^ t2[(hi >>> 8) & 0xff] ^
+            t1[(hi >>> 16) & 0xff] ^ t0[hi >>> 24];
+    }
 
-    for (var i = 0; i < input.length; i++) {
-        oldcrc32 = update_crc32(0xff & input.charCodeAt(i), oldcrc32);
+    for (; i < len; i++) {
+        oldcrc32 = update_crc32(buf[i], oldcrc32);
     }
 
     var num = ~oldcrc32;
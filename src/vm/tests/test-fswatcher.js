@@ -21,6 +21,7 @@
  * CDDL HEADER END
  *
  * Copyright (c) 2018, Joyent, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
  *
  */
 
@@ -336,6 +337,157 @@ test('create a file and ensure we get multiple modify events',
     fsw.start();
 });
 
+test('watch and unwatch many files in a single batch',
+    function batchWatchTest(t) {
+
+    var count = 50;
+    var files = [];
+    var fsw = new FsWatcher({log: log});
+
+    // half of the files exist, the other half do not
+    for (var i = 0; i < count; i++) {
+        var filename = path.join(testdir, 'batchfile.' + i);
+        if (i % 2 === 0) {
+            fs.writeFileSync(filename, 'batch ' + i + '\n');
+        }
+        files.push(filename);
+    }
+
+    fsw.once('ready', function fswOnReady(evt) {
+        t.ok(fsw.batch_supported, 'fswatcher supports batch commands');
+
+        vasync.pipeline({funcs: [
+            function watchAll(_, cb) {
+                vasync.forEachParallel({
+                    func: function watchBatchFile(f, cb2) {
+                        fsw.watch(f, cb2);
+                    },
+                    inputs: files
+                }, function (err) {
+                    t.ok(!err, (err ? err.message : 'no errors'));
+                    cb();
+                });
+            }, function checkStatus(_, cb) {
+                t.equal(Object.keys(fsw.watching).length, count / 2,
+                    'existing files are being watched');
+                t.equal(Object.keys(fsw.not_yet_watching).length, count / 2,
+                    'non-existent files are waiting to be watched');
+
+                fsw.status(function fswStatus(err, obj) {
+                    t.ok(!err, (err ? err.message : 'no errors'));
+                    t.equal(obj.data.files_count, count / 2,
+                        'fswatcher.c is watching existing files');
+                    cb();
+                });
+            }, function unwatchAll(_, cb) {
+                vasync.forEachParallel({
+                    func: function unwatchBatchFile(f, cb2) {
+                        fsw.unwatch(f, cb2);
+                    },
+                    inputs: files
+                }, function (err) {
+                    t.ok(!err, (err ? err.message : 'no errors'));
+                    cb();
+                });
+            }, function checkStatusAgain(_, cb) {
+                fsw.status(function fswStatus(err, obj) {
+                    t.ok(!err, (err ? err.message : 'no errors'));
+                    t.equal(obj.data.files_count, 0,
+                        'fswatcher.c is not watching any files');
+                    cb();
+                });
+            }
+        ]}, function (err) {
+            t.ok(!err, (err ? err.message : 'no errors'));
+            fsw.stop(function fswStop() {
+                t.end();
+            });
+        });
+    });
+
+    fsw.start();
+});
+
+test('modify a file repeatedly with debounce and get a single event',
+    function debounceTest(t) {
+
+    var filename = path.join(testdir, 'debounce.txt');
+    var modifications = 5;
+    var events = 0;
+
+    var fsw = new FsWatcher({log: log, debounce: 1000});
+
+    fs.writeFileSync(filename, 'initial data\n');
+    t.ok(fs.existsSync(filename), 'file was created');
+
+    fsw.on('event', function fswOnEvent(evt) {
+        events++;
+        t.equal(evt.pathname, filename, 'event was for correct filename');
+        t.ok(evt.changes.indexOf('FILE_MODIFIED') > -1,
+            'event includes FILE_MODIFIED');
+        t.ok(evt.count > 1, 'event merged ' + evt.count + ' events');
+
+        // wait past another window to ensure no more events are seen
+        setTimeout(function checkEvents() {
+            t.equal(events, 1, 'saw a single event');
+            fsw.stop(function fswStop() {
+                t.end();
+            });
+        }, 1500);
+    });
+
+    fsw.once('ready', function fswOnReady(evt) {
+        fsw.watch(filename, function fswWatch(err) {
+            t.ok(!err, (err ? err.message : 'no errors'));
+
+            for (var i = 0; i < modifications; i++) {
+                fs.appendFileSync(filename, 'modification ' + i + '\n');
+            }
+        });
+    });
+
+    fsw.start();
+});
+
+test('watch a file using binary output and catch CHANGE',
+    function binaryOutputTest(t) {
+
+    var filename = path.join(testdir, 'binary.txt');
+
+    var fsw = new FsWatcher({log: log, binary: true});
+
+    fs.writeFileSync(filename, 'initial data\n');
+    t.ok(fs.existsSync(filename), 'file was created');
+
+    fsw.on('change', function fswOnChange(evt) {
+        t.equal(evt.pathname, filename, 'change was for correct filename');
+        t.ok(evt.changes.indexOf('FILE_MODIFIED') > -1,
+            'event includes FILE_MODIFIED');
+        t.equal(evt.final, false, 'event is not final');
+
+        fsw.status(function fswStatus(err, obj) {
+            t.ok(!err, (err ? err.message : 'no errors'));
+            t.equal(obj.data.files_count, 1, 'fswatcher.c is watching 1 file');
+            t.deepEqual(obj.data.files, [filename], 'correct file watched');
+
+            fsw.stop(function fswStop() {
+                t.end();
+            });
+        });
+    });
+
+    fsw.once('ready', function fswOnReady(evt) {
+        t.ok(fsw.batch_supported, 'commands decoded from ready record');
+
+        fsw.watch(filename, function fswWatch(err) {
+            t.ok(!err, (err ? err.message : 'no errors'));
+            fs.appendFileSync(filename, 'modification\n');
+        });
+    });
+
+    fsw.start();
+});
+
 test('watch 10000 non-existent files, create them, modify them and delete them',
     function createManyFilesTest(t) {
 
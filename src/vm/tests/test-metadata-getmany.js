@@ -0,0 +1,224 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at http://smartos.org/CDDL
+ *
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file.
+ *
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ *
+ * Copyright 2026 Edgecast Cloud LLC.
+ *
+ */
+
+/*
+ * Tests for the metadata agent's GETMANY command.  These drive the agent's
+ * request handler directly with V2 frames, with a made up VM object standing
+ * in for vminfod, so no zone is needed.
+ */
+
+var bunyan = require('/usr/vm/node_modules/bunyan');
+var crc32 = require('/usr/vm/lib/metadata/crc32');
+var MetadataAgent = require('/usr/vm/lib/metadata/agent');
+
+// this puts test stuff in global, so we need to tell jsl about that:
+/* jsl:import ../node_modules/nodeunit-plus/index.js */
+require('/usr/vm/node_modules/nodeunit-plus');
+
+var ZONENAME = 'e2d5d2e4-8d6b-4a2c-9c2e-4b7c3c6c2f9e';
+
+var log = bunyan.createLogger({
+    level: 'fatal',
+    name: 'metadata-getmany-test-dummy',
+    stream: process.stderr,
+    serializers: bunyan.stdSerializers
+});
+
+function makeVmobj() {
+    return ({
+        alias: 'getmany',
+        autoboot: true,
+        max_physical_memory: 256,
+        tags: {role: 'test'},
+        uuid: ZONENAME,
+        zonename: ZONENAME,
+        customer_metadata: {
+            'user-script': '#!/bin/sh\n.\necho "hi"\n',
+            'unicode': 'café 😀'
+        },
+        internal_metadata: {
+            'docker:cmd': '["sh"]',
+            'root_pw': 'secret'
+        },
+        internal_metadata_namespaces: ['docker']
+    });
+}
+
+/*
+ * Returns a function that sends a V2 request to a metadata handler for the VM
+ * object, and calls back with the response code and decoded body.
+ */
+function makeRequester(vmobj) {
+    var agent = new MetadataAgent({log: log});
+    var handler;
+    var output = [];
+    var reqid = 0;
+    var socket = {
+        writable: true,
+        write: function (str) {
+            output.push(str);
+        }
+    };
+
+    agent.vminfod_watcher = {
+        vm: function (zonename) {
+            return (zonename === ZONENAME ? vmobj : null);
+        }
+    };
+    handler = agent.makeMetadataHandler(ZONENAME, socket);
+
+    return (function request(cmd, arg, cb) {
+        var body;
+        var id = ('0000000' + (++reqid).toString(16)).slice(-8);
+        var m;
+
+        body = id + ' ' + cmd;
+        if (arg !== undefined) {
+            body += ' ' + new Buffer(arg).toString('base64');
+        }
+
+        output = [];
+        handler(new Buffer('V2 ' + body.length + ' '
+            + crc32.crc32_calc(body) + ' ' + body + '\n'));
+
+        m = output.join('')
+            .match(/^V2 \d+ [0-9a-f]+ ([0-9a-f]+) (\S+) ?(\S*)\n$/);
+        if (!m || m[1] !== id) {
+            cb(new Error('bad response: ' + JSON.stringify(output)));
+            return;
+        }
+
+        cb(null, m[2], new Buffer(m[3], 'base64').toString());
+    });
+}
+
+test('test GETMANY returns what GET returns', function (t) {
+    var keys = [
+        'user-script',
+        'unicode',
+        'docker:cmd',
+        'root_pw',
+        'sdc:alias',
+        'sdc:autoboot',
+        'sdc:max_physical_memory',
+        'sdc:tags.role',
+        'missing',
+        'docker:missing'
+    ];
+    var request = makeRequester(makeVmobj());
+
+    request('GETMANY', JSON.stringify(keys), function (err, code, body) {
+        var values;
+
+        t.ifError(err, 'GETMANY request');
+        t.equal(code, 'SUCCESS', 'GETMANY code');
+        values = JSON.parse(body);
+
+        keys.forEach(function (key) {
+            request('GET', key, function (gerr, gcode, gbody) {
+                t.ifError(gerr, 'GET ' + key);
+                if (gcode === 'SUCCESS') {
+                    t.equal(values[key], gbody, 'value of ' + key);
+                } else {
+                    t.equal(gcode, 'NOTFOUND', 'GET code for ' + key);
+                    t.ok(!values.hasOwnProperty(key), key + ' left out');
+                }
+            });
+        });
+
+        t.equal(values['sdc:autoboot'], 'true', 'boolean value');
+        t.equal(values['sdc:max_physical_memory'], '256', 'number value');
+        t.deepEqual(Object.keys(values).sort(), keys.slice(0, 8).sort(),
+            'only keys with values');
+        t.end();
+    });
+});
+
+test('test GETMANY with no argument returns every key', function (t) {
+    var request = makeRequester(makeVmobj());
+
+    request('KEYS', undefined, function (err, code, body) {
+        var keys;
+
+        t.ifError(err, 'KEYS request');
+        t.equal(code, 'SUCCESS', 'KEYS code');
+        keys = body.split('\n');
+
+        request('GETMANY', undefined, function (gerr, gcode, gbody) {
+            t.ifError(gerr, 'GETMANY request');
+            t.equal(gcode, 'SUCCESS', 'GETMANY code');
+            t.deepEqual(Object.keys(JSON.parse(gbody)).sort(), keys.sort(),
+                'GETMANY keys match KEYS');
+            t.end();
+        });
+    });
+});
+
+test('test GETMANY fails if a GET of any key fails', function (t) {
+    var request;
+    var vmobj = makeVmobj();
+
+    request = makeRequester(vmobj);
+
+    // sdc:tags is an object, which GET can't return as a string.
+    request('GET', 'sdc:tags', function (err, code) {
+        t.ifError(err, 'GET request');
+        t.equal(code, 'FAILURE', 'GET of an object');
+    });
+    request('GETMANY', JSON.stringify(['user-script', 'sdc:tags']),
+        function (err, code) {
+
+        t.ifError(err, 'GETMANY request');
+        t.equal(code, 'FAILURE', 'GETMANY with an object');
+    });
+
+    // Without customer_metadata, looking up a customer key is an error.
+    delete vmobj.customer_metadata;
+    request('GET', 'user-script', function (err, code) {
+        t.ifError(err, 'GET request');
+        t.equal(code, 'FAILURE', 'GET with lookup error');
+    });
+    request('GETMANY', JSON.stringify(['sdc:alias', 'user-script']),
+        function (err, code) {
+
+        t.ifError(err, 'GETMANY request');
+        t.equal(code, 'FAILURE', 'GETMANY with lookup error');
+        t.end();
+    });
+});
+
+test('test GETMANY rejects invalid requests', function (t) {
+    var request = makeRequester(makeVmobj());
+
+    ['not json', '{"a": 1}', '[1]', '["a", null]'].forEach(function (arg) {
+        request('GETMANY', arg, function (err, code) {
+            t.ifError(err, 'GETMANY ' + arg);
+            t.equal(code, 'FAILURE', 'GETMANY ' + arg);
+        });
+    });
+
+    t.end();
+});
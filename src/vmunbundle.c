@@ -10,14 +10,58 @@
  *
  * Copyright (c) 2019, Joyent, Inc.
  * Copyright 2024 MNX Cloud, Inc.
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * vmunbundle reads the members of a bundle written by 'vmadm send' from
+ * stdin.  Each member is a 512-byte header followed by its payload, padded
+ * to a multiple of 512 bytes.  JSON members are written to stdout, and
+ * datasets are given to 'zfs receive'.
+ *
+ * A dataset's size is 0 in bundles from 'vmadm send', which doesn't know how
+ * long the 'zfs send' stream will be.  'zfs receive' then reads the stream
+ * straight from our stdin, as it reads no further than the end of the stream.
+ * Where the header does give the size, 'zfs receive' is only allowed to see
+ * that many bytes: from a file, it reads them directly and we seek past the
+ * member afterwards; from a pipe, they are copied to it through a pipe of its
+ * own, a large buffer at a time.  Padding is seeked over where the input
+ * allows, and is only read from a pipe.
+ *
+ * A version 2 bundle is a version 1 bundle whose headers all give the real
+ * sizes, with a table of contents as its last member, named "TOC".  Its
+ * payload is a 512-byte entry for each of the other members, followed by a
+ * 512-byte trailer, which is therefore the last 512 bytes of the bundle:
+ *
+ *   entry:   <NAME>\0<OFFSET>\0<SIZE>\0<CHECKSUM>\0
+ *   trailer: MAGIC-VMBUNDLE-TOC\0<VERSION>\0<ENTRIES>\0<TOC-OFFSET>\0
+ *
+ * OFFSET is where the member's payload starts in the bundle, and TOC-OFFSET
+ * where the first entry does, all as ASCII numbers.  CHECKSUM is the
+ * fletcher-4 of the payload as 64 hex digits (the four 64-bit words in
+ * order), or "0" if it wasn't taken.
+ *
+ * When "all" is given a bundle in a file with a table of contents, the
+ * members are found from it instead of by reading the bundle through, and
+ * several datasets (-j, 4 by default) are received at once, each read by a
+ * child of its own with pread() and written to its own 'zfs receive'.  A
+ * dataset that is a descendant of another in the bundle waits for that one
+ * to be received.
+ * Anywhere else, a version 2 bundle is read like a version 1 bundle, and the
+ * table of contents is skipped.
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -25,6 +69,13 @@
 #define VMBUNDLE_VERSION "1"
 #define VMBUNDLE_NUM_SIZE 32
 #define VMBUNDLE_HEADER_SIZE 512
+#define VMBUNDLE_BUF_SIZE (1024 * 1024)
+#define VMBUNDLE_TOC_MAGIC "MAGIC-VMBUNDLE-TOC"
+#define VMBUNDLE_TOC_NAME "TOC"
+#define VMBUNDLE_TOC_ENTRY_SIZE 512
+#define VMBUNDLE_MAX_ENTRIES 1024
+#define VMBUNDLE_DEFAULT_JOBS 4
+#define ZFS_PATH "/usr/sbin/zfs"
 
 typedef struct {
     unsigned int version;
@@ -34,11 +85,30 @@ typedef struct {
     size_t padded_size;
 } header_t;
 
+typedef struct {
+    char name[VMBUNDLE_TOC_ENTRY_SIZE];
+    char checksum[VMBUNDLE_TOC_ENTRY_SIZE];
+    off_t offset;
+    size_t size;
+    pid_t pid;
+    enum {PENDING = 0, RUNNING, DONE} state;
+} toc_entry_t;
+
 char *progname;
+const char *zfs_path = ZFS_PATH;
+char *buf;
+unsigned int jobs = VMBUNDLE_DEFAULT_JOBS;
 int get_header(int fd, header_t *header, int fallback_to_raw);
 ssize_t read_bytes(int fd, char *data, size_t bytes);
 ssize_t write_bytes(int fd, const void *buf, size_t bytes);
+int copy_bytes(int in, int out, size_t bytes);
+int skip_bytes(int fd, size_t bytes);
+pid_t zfs_receive_start(int fd, const char *snapshot);
+size_t zfs_receive_wait(pid_t pid, const char *snapshot);
 size_t zfs_receive(int fd, const char * snapshot);
+int receive_member(int fd, header_t *header);
+int read_toc(int fd, toc_entry_t **entriesp, unsigned int *countp);
+int receive_indexed(int fd, toc_entry_t *entries, unsigned int count);
 
 /*
  * RETURNS
@@ -95,45 +165,120 @@ read_bytes(int fd, char *data, size_t bytes)
     return (total_read);
 }
 
-size_t
-zfs_receive(int fd, const char * snapshot)
+/*
+ * Copy exactly "bytes" bytes from "in" to "out" through the big buffer, so
+ * that a payload of any size is moved in a bounded amount of memory.
+ */
+int
+copy_bytes(int in, int out, size_t bytes)
 {
-    char *argv[5] = {"/usr/sbin/zfs", "receive", "-F", 0, 0};
+    size_t chunk;
+    ssize_t nread;
+
+    while (bytes > 0) {
+        chunk = (bytes < VMBUNDLE_BUF_SIZE) ? bytes : VMBUNDLE_BUF_SIZE;
+        if ((nread = read_bytes(in, buf, chunk)) < 0) {
+            return (-1);
+        } else if ((size_t) nread != chunk) {
+            fprintf(stderr, "EOF with %zu bytes of payload left\n",
+                bytes - nread);
+            return (-1);
+        }
+        if (write_bytes(out, buf, chunk) < 0) {
+            return (-1);
+        }
+        bytes -= chunk;
+    }
+
+    return (0);
+}
+
+/*
+ * Skip over "bytes" bytes of input: by seeking, where the input is a file,
+ * or by reading them otherwise.
+ */
+int
+skip_bytes(int fd, size_t bytes)
+{
+    size_t chunk;
+    ssize_t nread;
+
+    if (bytes == 0 || lseek(fd, (off_t) bytes, SEEK_CUR) != -1) {
+        return (0);
+    }
+
+    while (bytes > 0) {
+        chunk = (bytes < VMBUNDLE_BUF_SIZE) ? bytes : VMBUNDLE_BUF_SIZE;
+        if ((nread = read_bytes(fd, buf, chunk)) < 0) {
+            return (-1);
+        } else if ((size_t) nread != chunk) {
+            fprintf(stderr, "EOF while skipping padding\n");
+            return (-1);
+        }
+        bytes -= chunk;
+    }
+
+    return (0);
+}
+
+pid_t
+zfs_receive_start(int fd, const char *snapshot)
+{
+    char *argv[5] = {0, "receive", "-F", 0, 0};
     char *evp[1] = {0};
     pid_t pid;
-    int stat;
-    pid_t waitee;
 
     pid = fork();
     if (pid == 0) {
+        argv[0] = (char *)zfs_path;
         argv[3] = (char *)snapshot;
         if (dup2(fd, 0) < 0) {
             perror("dup2()");
-            return (1);
+            _exit(1);
         }
-        execve("/usr/sbin/zfs", argv, evp);
+        execve(zfs_path, argv, evp);
         perror("execve");
-        return (2);
-    } else if (pid > 0) {
-        while ((waitee = waitpid(pid, &stat, 0)) != pid) {
-            if (waitee == -1 && errno != EINTR) {
-                perror("waitpid");
-                return (3);
-            }
-        }
+        _exit(2);
+    } else if (pid < 0) {
+        perror("fork");
+    }
+
+    return (pid);
+}
+
+size_t
+zfs_receive_wait(pid_t pid, const char *snapshot)
+{
+    int stat;
+    pid_t waitee;
 
-        if (!WIFEXITED(stat) || WEXITSTATUS(stat) != 0) {
-            fprintf(stderr, "zfs receive barfed on %s\n", snapshot);
-            return (4);
+    while ((waitee = waitpid(pid, &stat, 0)) != pid) {
+        if (waitee == -1 && errno != EINTR) {
+            perror("waitpid");
+            return (3);
         }
-    } else {
-        perror("fork");
-        return (5);
+    }
+
+    if (!WIFEXITED(stat) || WEXITSTATUS(stat) != 0) {
+        fprintf(stderr, "zfs receive barfed on %s\n", snapshot);
+        return (4);
     }
 
     return (0);
 }
 
+size_t
+zfs_receive(int fd, const char * snapshot)
+{
+    pid_t pid;
+
+    if ((pid = zfs_receive_start(fd, snapshot)) < 0) {
+        return (5);
+    }
+
+    return (zfs_receive_wait(pid, snapshot));
+}
+
 int
 get_header(int fd, header_t *header, int fallback_to_raw)
 {
@@ -289,37 +434,476 @@ get_header(int fd, header_t *header, int fallback_to_raw)
     return (0);
 }
 
-char *
-read_json(header_t header)
+static double
+now(void)
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+report_member(const char *name, size_t bytes, double secs)
+{
+    fprintf(stderr, "Member: {'name': '%s', 'bytes': %zu, "
+        "'seconds': %.3f, 'MB/s': %.1f}\n", name, bytes, secs,
+        secs > 0 ? bytes / secs / (1024 * 1024) : 0.0);
+}
+
+/*
+ * Read the payload of the member whose header has just been read from "fd":
+ * JSON goes to stdout, and anything else is a dataset for 'zfs receive'.
+ * Returns 0 on success, with the input positioned at the next header.
+ */
+int
+receive_member(int fd, header_t *header)
+{
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    size_t bytes = header->size;
+    double begin = now();
+    double secs;
+    int pipefd[2];
+    pid_t pid;
+    int res = 0;
+
+    if (header->padded_size < header->size) {
+        fprintf(stderr, "Bad header: padded size %zu < size %zu\n",
+            header->padded_size, header->size);
+        return (1);
+    }
+
+    if (strcmp("JSON", header->name) == 0) {
+        if (copy_bytes(fd, 1, header->size) != 0 ||
+            skip_bytes(fd, header->padded_size - header->size) != 0) {
+            fprintf(stderr, "Error reading JSON\n");
+            return (1);
+        }
+        fsync(1);
+        fprintf(stderr, "END JSON\n");
+    } else if (header->size == 0 || start != -1) {
+        /*
+         * 'zfs receive' reads the stream itself, either because we don't
+         * know how long it is, or because we can put the input where the
+         * header says the member ends, whatever it reads.
+         */
+        fprintf(stderr, "Attempting zfs receive %s\n", header->name);
+        if ((res = zfs_receive(fd, header->name)) == 0 &&
+            header->padded_size > 0 &&
+            lseek(fd, start + header->padded_size, SEEK_SET) == -1) {
+            perror("lseek");
+            res = 6;
+        }
+        if (header->size == 0 && start != -1) {
+            bytes = lseek(fd, 0, SEEK_CUR) - start;
+        }
+    } else {
+        fprintf(stderr, "Attempting zfs receive %s\n", header->name);
+        /*
+         * The child mustn't hold the write end open, or it would never see
+         * the end of the member if we have to stop part way through.
+         */
+        if (pipe(pipefd) != 0 ||
+            fcntl(pipefd[1], F_SETFD, FD_CLOEXEC) != 0) {
+            perror("pipe");
+            return (1);
+        }
+        (void) signal(SIGPIPE, SIG_IGN);
+        if ((pid = zfs_receive_start(pipefd[0], header->name)) < 0) {
+            return (1);
+        }
+        (void) close(pipefd[0]);
+        if (copy_bytes(fd, pipefd[1], header->size) != 0) {
+            res = 7;
+        }
+        (void) close(pipefd[1]);
+        if (zfs_receive_wait(pid, header->name) != 0 && res == 0) {
+            res = 4;
+        }
+        if (res == 0 &&
+            skip_bytes(fd, header->padded_size - header->size) != 0) {
+            res = 8;
+        }
+    }
+
+    if (res != 0) {
+        fprintf(stderr, "Failed to receive dataset code: %d\n", res);
+        return (1);
+    }
+
+    /*
+     * When 'zfs receive' read a stream of unknown length from a pipe, we
+     * can't tell how much it read, so only the time is reported.
+     */
+    secs = now() - begin;
+    if (bytes == 0 && start == -1) {
+        fprintf(stderr, "Member: {'name': '%s', 'seconds': %.3f}\n",
+            header->name, secs);
+    } else {
+        report_member(header->name, bytes, secs);
+    }
+    if (strcmp("JSON", header->name) != 0) {
+        fprintf(stderr, "END DATASET\n");
+    }
+
+    return (0);
+}
+
+/*
+ * Copy the NUL-terminated field at "*pos" in the "size" bytes at "data" to
+ * "field", and move "*pos" past it.  Returns -1 if it isn't terminated.
+ */
+static int
+get_field(const char *data, size_t size, size_t *pos, char *field)
+{
+    size_t len;
+
+    if (*pos >= size ||
+        (len = strnlen(data + *pos, size - *pos)) == size - *pos) {
+        return (-1);
+    }
+    (void) memcpy(field, data + *pos, len + 1);
+    *pos += len + 1;
+
+    return (0);
+}
+
+static int
+get_number(const char *data, size_t size, size_t *pos,
+    unsigned long long *value)
+{
+    char field[VMBUNDLE_TOC_ENTRY_SIZE];
+    char *end;
+
+    if (get_field(data, size, pos, field) != 0) {
+        return (-1);
+    }
+    errno = 0;
+    *value = strtoull(field, &end, 10);
+    if (errno != 0 || end == field || *end != '\0') {
+        return (-1);
+    }
+
+    return (0);
+}
+
+/*
+ * Add "size" bytes to the fletcher-4 checksum in "cksum", taking them as
+ * little-endian 32-bit words.  Only the last bytes of a payload may be added
+ * in a piece whose size isn't a multiple of 4; its last word is padded with
+ * zeros.
+ */
+static void
+fletcher4(const unsigned char *data, size_t size, uint64_t cksum[4])
+{
+    size_t i;
+    uint32_t w;
+
+    for (i = 0; i < size; i += 4) {
+        w = data[i];
+        if (i + 1 < size) {
+            w |= (uint32_t) data[i + 1] << 8;
+        }
+        if (i + 2 < size) {
+            w |= (uint32_t) data[i + 2] << 16;
+        }
+        if (i + 3 < size) {
+            w |= (uint32_t) data[i + 3] << 24;
+        }
+        cksum[0] += w;
+        cksum[1] += cksum[0];
+        cksum[2] += cksum[1];
+        cksum[3] += cksum[2];
+    }
+}
+
+static int
+check_sum(const toc_entry_t *entry, const uint64_t cksum[4])
+{
+    char hex[4 * 16 + 1];
+
+    if (strcmp(entry->checksum, "0") == 0) {
+        return (0);
+    }
+
+    (void) snprintf(hex, sizeof (hex),
+        "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64,
+        cksum[0], cksum[1], cksum[2], cksum[3]);
+    if (strcasecmp(hex, entry->checksum) != 0) {
+        fprintf(stderr, "Checksum mismatch on %s: expected %s, got %s\n",
+            entry->name, entry->checksum, hex);
+        return (-1);
+    }
+
+    return (0);
+}
+
+/*
+ * Copy "bytes" bytes at "offset" in "in" to "out" with pread(), which leaves
+ * the offset of "in" alone for anyone else reading it, and add them to
+ * "cksum" on the way.
+ */
+static int
+pread_bytes(int in, off_t offset, size_t bytes, int out, uint64_t cksum[4])
 {
-    char * json = NULL;
+    size_t chunk;
+    size_t done;
     ssize_t nread;
 
-    json = (char *)malloc(header.padded_size);
-    if (json == NULL) {
-        perror("malloc");
-        exit(1);
+    while (bytes > 0) {
+        chunk = (bytes < VMBUNDLE_BUF_SIZE) ? bytes : VMBUNDLE_BUF_SIZE;
+        for (done = 0; done < chunk; done += nread) {
+            nread = pread(in, buf + done, chunk - done, offset + done);
+            if (nread < 0 && errno == EINTR) {
+                nread = 0;
+            } else if (nread < 0) {
+                perror("pread");
+                return (-1);
+            } else if (nread == 0) {
+                fprintf(stderr, "EOF with %zu bytes of payload left\n",
+                    bytes - done);
+                return (-1);
+            }
+        }
+        fletcher4((unsigned char *)buf, chunk, cksum);
+        if (write_bytes(out, buf, chunk) < 0) {
+            return (-1);
+        }
+        offset += chunk;
+        bytes -= chunk;
     }
-    nread = read_bytes(0, (char *)json, header.padded_size);
-    if (nread == 0) {
-        fprintf(stderr, "EOF reading JSON\n");
-        exit(1);
-    } else if (nread < 0) {
-        fprintf(stderr, "Error %d reading JSON\n", nread);
-        exit(1);
-    } else if ((size_t) nread != header.padded_size) {
-        fprintf(stderr, "JSON truncated: %zu of %zu bytes\n", nread,
-            header.padded_size);
-        exit(1);
+
+    return (0);
+}
+
+/*
+ * Read the table of contents of a version 2 bundle in a file.  Returns 0 with
+ * its entries, 1 if the input isn't a file or has no table of contents, or -1
+ * if the table of contents doesn't make sense.
+ */
+int
+read_toc(int fd, toc_entry_t **entriesp, unsigned int *countp)
+{
+    char data[VMBUNDLE_TOC_ENTRY_SIZE];
+    unsigned long long version, count, toc_offset, offset, size;
+    toc_entry_t *entries;
+    struct stat st;
+    off_t end;
+    size_t pos;
+    unsigned int i;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < VMBUNDLE_TOC_ENTRY_SIZE) {
+        return (1);
+    }
+    end = st.st_size - VMBUNDLE_TOC_ENTRY_SIZE;
+    if (pread(fd, data, sizeof (data), end) != sizeof (data) ||
+        memcmp(data, VMBUNDLE_TOC_MAGIC, sizeof (VMBUNDLE_TOC_MAGIC)) != 0) {
+        return (1);
+    }
+
+    pos = sizeof (VMBUNDLE_TOC_MAGIC);
+    if (get_number(data, sizeof (data), &pos, &version) != 0 ||
+        get_number(data, sizeof (data), &pos, &count) != 0 ||
+        get_number(data, sizeof (data), &pos, &toc_offset) != 0) {
+        fprintf(stderr, "Bad table of contents trailer\n");
+        return (-1);
+    }
+    if (version < 2 || count == 0 || count > VMBUNDLE_MAX_ENTRIES ||
+        toc_offset > (unsigned long long) end ||
+        (unsigned long long) end - toc_offset !=
+        count * VMBUNDLE_TOC_ENTRY_SIZE) {
+        fprintf(stderr, "Bad table of contents: version %llu, "
+            "%llu entries at %llu\n", version, count, toc_offset);
+        return (-1);
+    }
+
+    if ((entries = calloc(count, sizeof (toc_entry_t))) == NULL) {
+        perror("calloc");
+        return (-1);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pread(fd, data, sizeof (data),
+            (off_t) (toc_offset + i * VMBUNDLE_TOC_ENTRY_SIZE)) !=
+            sizeof (data)) {
+            perror("pread");
+            free(entries);
+            return (-1);
+        }
+        pos = 0;
+        if (get_field(data, sizeof (data), &pos, entries[i].name) != 0 ||
+            get_number(data, sizeof (data), &pos, &offset) != 0 ||
+            get_number(data, sizeof (data), &pos, &size) != 0 ||
+            get_field(data, sizeof (data), &pos, entries[i].checksum) != 0 ||
+            entries[i].name[0] == '\0' || offset > toc_offset ||
+            size > toc_offset - offset ||
+            (strcmp(entries[i].checksum, "0") != 0 &&
+            strlen(entries[i].checksum) != 4 * 16)) {
+            fprintf(stderr, "Bad table of contents entry %u\n", i);
+            free(entries);
+            return (-1);
+        }
+        entries[i].offset = (off_t) offset;
+        entries[i].size = (size_t) size;
+    }
+
+    *entriesp = entries;
+    *countp = (unsigned int) count;
+
+    return (0);
+}
+
+/*
+ * Receive a dataset as its table of contents entry describes it.  This runs
+ * in a child of its own, so that several can run at once.
+ */
+static int
+receive_entry(int fd, toc_entry_t *entry)
+{
+    uint64_t cksum[4] = {0, 0, 0, 0};
+    double begin = now();
+    int pipefd[2];
+    pid_t pid;
+    int res = 0;
+
+    fprintf(stderr, "Attempting zfs receive %s\n", entry->name);
+    if (pipe(pipefd) != 0 ||
+        fcntl(pipefd[1], F_SETFD, FD_CLOEXEC) != 0) {
+        perror("pipe");
+        return (1);
+    }
+    (void) signal(SIGPIPE, SIG_IGN);
+    if ((pid = zfs_receive_start(pipefd[0], entry->name)) < 0) {
+        return (1);
+    }
+    (void) close(pipefd[0]);
+    if (pread_bytes(fd, entry->offset, entry->size, pipefd[1], cksum) != 0) {
+        res = 7;
     }
+    (void) close(pipefd[1]);
+    if (zfs_receive_wait(pid, entry->name) != 0 && res == 0) {
+        res = 4;
+    }
+    if (res == 0 && check_sum(entry, cksum) != 0) {
+        res = 9;
+    }
+
+    if (res != 0) {
+        fprintf(stderr, "Failed to receive dataset %s code: %d\n",
+            entry->name, res);
+        return (1);
+    }
+
+    report_member(entry->name, entry->size, now() - begin);
+    fprintf(stderr, "END DATASET\n");
+
+    return (0);
+}
 
-    return (json);
+/*
+ * A dataset can be received once any other dataset in the bundle that it
+ * is a descendant of has been.
+ */
+static int
+entry_ready(const toc_entry_t *entries, unsigned int count, unsigned int i)
+{
+    unsigned int j;
+    size_t len;
+
+    for (j = 0; j < count; j++) {
+        len = strlen(entries[j].name);
+        if (entries[j].state != DONE &&
+            strncmp(entries[i].name, entries[j].name, len) == 0 &&
+            entries[i].name[len] == '/') {
+            return (0);
+        }
+    }
+
+    return (1);
+}
+
+/*
+ * Receive the members of a bundle in a file from its table of contents: the
+ * JSON first, then the datasets, up to "jobs" of them at once.  If one fails,
+ * no more are started, and those already running are waited for.
+ */
+int
+receive_indexed(int fd, toc_entry_t *entries, unsigned int count)
+{
+    uint64_t cksum[4];
+    unsigned int running = 0;
+    unsigned int i;
+    double begin;
+    int failed = 0;
+    int stat;
+    pid_t pid;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp("JSON", entries[i].name) != 0) {
+            continue;
+        }
+        begin = now();
+        bzero(cksum, sizeof (cksum));
+        if (pread_bytes(fd, entries[i].offset, entries[i].size, 1,
+            cksum) != 0 || check_sum(&entries[i], cksum) != 0) {
+            fprintf(stderr, "Error reading JSON\n");
+            return (1);
+        }
+        fsync(1);
+        fprintf(stderr, "END JSON\n");
+        report_member(entries[i].name, entries[i].size, now() - begin);
+        entries[i].state = DONE;
+    }
+
+    for (;;) {
+        for (i = 0; !failed && running < jobs && i < count; i++) {
+            if (entries[i].state != PENDING ||
+                !entry_ready(entries, count, i)) {
+                continue;
+            }
+            if ((pid = fork()) == 0) {
+                _exit(receive_entry(fd, &entries[i]));
+            } else if (pid < 0) {
+                perror("fork");
+                failed = 1;
+                break;
+            }
+            entries[i].pid = pid;
+            entries[i].state = RUNNING;
+            running++;
+        }
+
+        if (running == 0) {
+            break;
+        }
+
+        if ((pid = waitpid(-1, &stat, 0)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitpid");
+            return (1);
+        }
+        for (i = 0; i < count; i++) {
+            if (entries[i].state == RUNNING && entries[i].pid == pid) {
+                entries[i].state = DONE;
+                running--;
+                if (!WIFEXITED(stat) || WEXITSTATUS(stat) != 0) {
+                    failed = 1;
+                }
+            }
+        }
+    }
+
+    return (failed);
 }
 
 void
 usage(void)
 {
-    fprintf(stderr, "Usage: %s [json|dataset]\n", progname);
+    fprintf(stderr, "Usage: %s [-j jobs] [-Z zfs] [json|dataset|all]\n",
+        progname);
     exit(1);
 }
 
@@ -327,74 +911,116 @@ int
 main(int argc, char *argv[])
 {
     header_t header;
-    char * json = NULL;
-    enum {JSON = 0, DATASET} mode = JSON;
+    enum {JSON = 0, DATASET, ALL} mode = JSON;
+    toc_entry_t *entries;
+    unsigned int count;
+    int members = 0;
+    int opt;
     int res;
 
     progname = argv[0];
 
+    while ((opt = getopt(argc, argv, "j:Z:")) != -1) {
+        switch (opt) {
+        case 'j':
+            jobs = (unsigned int) strtoul(optarg, NULL, 10);
+            if (jobs == 0) {
+                usage();
+                /* NOTREACHED */
+            }
+            break;
+        case 'Z':
+            zfs_path = optarg;
+            break;
+        default:
+            usage();
+            /* NOTREACHED */
+        }
+    }
+
     // Ensure correct usage
-    if (argc != 2) {
+    if (argc - optind != 1) {
         usage();
         /* NOTREACHED */
     }
 
-    if (strcmp(argv[1], "json") == 0) {
+    if (strcmp(argv[optind], "json") == 0) {
         mode = JSON;
-    } else if (strcmp(argv[1], "dataset") == 0) {
+    } else if (strcmp(argv[optind], "dataset") == 0) {
         mode = DATASET;
+    } else if (strcmp(argv[optind], "all") == 0) {
+        mode = ALL;
     } else {
         usage();
         /* NOTREACHED */
     }
 
-    res = get_header(0, &header, (mode == JSON) ? 1 : 0);
-    if (res == -1 || res > 0) {
-        fprintf(stderr, "No header: this doesn't look like a vmbundle.\n");
-        exit(1);
-    } else if (res == -3) {
-        exit(3);
-    } else if ((mode == JSON) && (res == -2)) {
-        /*
-         * We dumped the raw data (passed input through unchanged)
-         * This option exists to support the manual receive of JSON then
-         * install.
-         */
-        exit(0);
-    } else if ((mode == JSON) && (res != 0)) {
-        fprintf(stderr, "Error %d: reading vmbundle header.\n", res);
+    if (posix_memalign((void **)&buf, sysconf(_SC_PAGESIZE),
+        VMBUNDLE_BUF_SIZE) != 0) {
+        fprintf(stderr, "Unable to allocate buffer\n");
         exit(1);
     }
 
-    fprintf(stderr, "Version: %zu\n", header.version);
-    fprintf(stderr, "Name: [%s]\n", header.name);
-    fprintf(stderr, "Size: %zu\n", header.size);
-    fprintf(stderr, "Padded Size: %zu\n", header.padded_size);
+    if (mode == ALL && (res = read_toc(0, &entries, &count)) <= 0) {
+        if (res < 0) {
+            exit(1);
+        }
+        fprintf(stderr, "Version: 2, %u members\n", count);
+        exit(receive_indexed(0, entries, count) == 0 ? 0 : 1);
+    }
+
+    /*
+     * In "all" mode, every member up to the end of the input is received in
+     * turn.  Otherwise there's only the one, but a table of contents before
+     * it is skipped.
+     */
+    for (;;) {
+        bzero(&header, sizeof (header));
+        res = get_header(0, &header, (mode == JSON) ? 1 : 0);
+        if (res == -3 && mode == ALL && members > 0) {
+            break;
+        } else if (res == -1 || res > 0) {
+            fprintf(stderr,
+                "No header: this doesn't look like a vmbundle.\n");
+            exit(1);
+        } else if (res == -3) {
+            exit(3);
+        } else if ((mode == JSON) && (res == -2)) {
+            /*
+             * We dumped the raw data (passed input through unchanged)
+             * This option exists to support the manual receive of JSON then
+             * install.
+             */
+            exit(0);
+        } else if ((mode == JSON) && (res != 0)) {
+            fprintf(stderr, "Error %d: reading vmbundle header.\n", res);
+            exit(1);
+        }
 
-    if (mode == JSON) {
-        if (strcmp("JSON", header.name) == 0) {
-            json = read_json(header);
-            write_bytes(1, json, header.size);
-            if (json != NULL) {
-                free(json);
-                json = NULL;
-            }
-            fsync(1);
-            fprintf(stderr, "END JSON\n");
-        } else {
+        fprintf(stderr, "Version: %u\n", header.version);
+        fprintf(stderr, "Name: [%s]\n", header.name);
+        fprintf(stderr, "Size: %zu\n", header.size);
+        fprintf(stderr, "Padded Size: %zu\n", header.padded_size);
+
+        if (mode == JSON && strcmp("JSON", header.name) != 0) {
             fprintf(stderr, "FATAL: expecting JSON, got '%s'\n", header.name);
             exit(1);
         }
-    } else if (mode == DATASET) {
-        fprintf(stderr, "Attempting zfs receive %s\n", header.name);
-        if ((res = zfs_receive(0, header.name)) != 0) {
-            fprintf(stderr, "Failed to receive dataset code: %d\n", res);
+        if (header.version >= 2 &&
+            strcmp(VMBUNDLE_TOC_NAME, header.name) == 0) {
+            if (skip_bytes(0, header.padded_size) != 0) {
+                exit(1);
+            }
+            fprintf(stderr, "END TOC\n");
+            continue;
+        }
+        if (receive_member(0, &header) != 0) {
             exit(1);
         }
-        fprintf(stderr, "END DATASET\n");
-    } else {
-        fprintf(stderr, "Internal error!\n");
-        exit(1);
+        members++;
+        if (mode != ALL) {
+            break;
+        }
     }
 
     exit(0);
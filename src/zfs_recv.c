@@ -21,6 +21,7 @@
  * CDDL HEADER END
  *
  * Copyright (c) 2012, Joyent, Inc. All rights reserved.
+ * Copyright 2026 Edgecast Cloud LLC.
  *
  */
 
@@ -29,11 +30,17 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <unistd.h>
 
+#include "zfs_xfer.h"
+
 /*
  * To match /usr/sbin/zfs, the following exit statuses will be used:
  *
@@ -44,44 +51,676 @@
  * Diagnostic output goes to stderr.
  * On success it a TCP socket will be opened listening for data from zfs_send.
  *
+ * With -n, we wait for that many connections from one zfs_send, and read the
+ * framed stream described in zfs_xfer.h from all of them at once.  Chunks are
+ * put back in order and written to a pipe to 'zfs recv'.  Connections that
+ * get too far ahead of the others wait, so that no more than WINDOW_PER_STREAM
+ * chunks per connection are ever held in memory.  Each connection's thread
+ * decompresses and checks the checksum of its own chunks.  If any chunk is
+ * bad, or any connection ends before the stream is complete, or the stream
+ * doesn't match the digest in the END frames, 'zfs recv' is killed rather
+ * than allowed to finish.
+ *
+ * With -r, losing a connection, or a bad chunk, isn't the end of the
+ * transfer.  We drop the other connections and the chunks that came ahead of
+ * what 'zfs recv' has been given, and wait up to the given number of seconds
+ * for zfs_send to connect again, while 'zfs recv' waits for the rest of the
+ * stream.  If it doesn't, 'zfs recv' is stopped, and if it was run with -s we
+ * report its resume token, with which 'zfs send -t' can carry on later.
+ */
+
+#define WINDOW_PER_STREAM   4
+#define TOKEN_MAX           4096
+
+typedef struct stream {
+    unsigned int s_index;
+    int s_sock;
+    pthread_t s_thread;
+} stream_t;
+
+typedef struct slot {
+    uint8_t *s_buf;             /* to free */
+    uint8_t *s_data;            /* the chunk, within s_buf */
+    size_t s_len;
+    zx_cksum_t s_cksum;
+} slot_t;
+
+/*
+ * Chunk seq goes in w_slots[seq % w_size] while it waits to be written.
+ * Chunks are added to w_digest as they are written, and the END frames'
+ * totals and digest, which must all agree, are kept in w_total, w_end_bytes
+ * and w_end_digest.
+ */
+static pthread_mutex_t w_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t w_cv = PTHREAD_COND_INITIALIZER;
+static slot_t *w_slots;
+static uint64_t w_size;
+static uint64_t w_next;
+static uint64_t w_total;
+static uint64_t w_wire;         /* DATA payload bytes received */
+static zx_cksum_t w_digest;
+static uint64_t w_end_bytes;
+static zx_cksum_t w_end_digest;
+static unsigned int w_ended;
+static int w_failed;
+
+static size_t max_chunk;
+static uint64_t session;
+static int resumable;
+
+static void
+fail(void)
+{
+    pthread_mutex_lock(&w_lock);
+    w_failed = 1;
+    pthread_cond_broadcast(&w_cv);
+    pthread_mutex_unlock(&w_lock);
+}
+
+static int
+read_end(stream_t *s, const zx_frame_t *zf)
+{
+    uint8_t payload[ZX_END_SIZE];
+    zx_cksum_t digest;
+    uint64_t bytes;
+
+    if (zf->zf_len != sizeof (payload) ||
+        zx_read_all(s->s_sock, payload, sizeof (payload)) != 0) {
+        fprintf(stderr, "zfs_recv: stream %u: bad END\n", s->s_index);
+        return (-1);
+    }
+    zx_end_decode(payload, &bytes, &digest);
+
+    pthread_mutex_lock(&w_lock);
+    if (w_ended > 0 && (w_total != zf->zf_seq || w_end_bytes != bytes ||
+        !zx_cksum_equal(&w_end_digest, &digest))) {
+        pthread_mutex_unlock(&w_lock);
+        fprintf(stderr, "zfs_recv: stream %u: mismatched END\n",
+            s->s_index);
+        return (-1);
+    }
+    w_total = zf->zf_seq;
+    w_end_bytes = bytes;
+    w_end_digest = digest;
+    w_ended++;
+    pthread_cond_broadcast(&w_cv);
+    pthread_mutex_unlock(&w_lock);
+
+    return (0);
+}
+
+/*
+ * Read a DATA frame's payload, and return a buffer holding the chunk,
+ * decompressed and with its checksum verified, at *datap.
+ */
+static uint8_t *
+read_chunk(stream_t *s, const zx_frame_t *zf, zx_cksum_t *zcp,
+    uint8_t **datap)
+{
+    size_t len = zf->zf_arg;
+    size_t datalen = zf->zf_len - ZX_CKSUM_SIZE;
+    uint8_t *payload;
+    uint8_t *buf;
+    zx_cksum_t zc;
+
+    if ((payload = malloc(zf->zf_len)) == NULL) {
+        perror("zfs_recv: malloc()");
+        return (NULL);
+    }
+    if (zx_read_all(s->s_sock, payload, zf->zf_len) != 0) {
+        fprintf(stderr, "zfs_recv: stream %u: read(): %s\n", s->s_index,
+            strerror(errno));
+        free(payload);
+        return (NULL);
+    }
+
+    if (zf->zf_flags & ZX_FLAG_LZ4) {
+        if ((buf = malloc(len)) == NULL) {
+            perror("zfs_recv: malloc()");
+            free(payload);
+            return (NULL);
+        }
+        if (zx_lz4_decompress(payload + ZX_CKSUM_SIZE, datalen, buf,
+            len) != 0) {
+            fprintf(stderr, "zfs_recv: stream %u: chunk %llu does not "
+                "decompress\n", s->s_index, (unsigned long long)zf->zf_seq);
+            free(payload);
+            free(buf);
+            return (NULL);
+        }
+    } else {
+        if (datalen != len) {
+            fprintf(stderr, "zfs_recv: stream %u: chunk %llu has the wrong "
+                "length\n", s->s_index, (unsigned long long)zf->zf_seq);
+            free(payload);
+            return (NULL);
+        }
+        buf = payload;
+    }
+
+    *datap = (buf == payload) ? payload + ZX_CKSUM_SIZE : buf;
+    zx_cksum_decode(payload, zcp);
+    zx_fletcher4(*datap, len, &zc);
+    if (buf != payload) {
+        free(payload);
+    }
+    if (!zx_cksum_equal(&zc, zcp)) {
+        fprintf(stderr, "zfs_recv: stream %u: checksum mismatch in chunk "
+            "%llu\n", s->s_index, (unsigned long long)zf->zf_seq);
+        free(buf);
+        return (NULL);
+    }
+
+    return (buf);
+}
+
+static void *
+receiver(void *arg)
+{
+    stream_t *s = arg;
+    zx_frame_t zf;
+    zx_cksum_t zc;
+    uint8_t *data;
+    uint8_t *buf;
+    slot_t *slot;
+
+    for (;;) {
+        if (zx_frame_read(s->s_sock, &zf) != 0) {
+            pthread_mutex_lock(&w_lock);
+            if (!w_failed) {
+                fprintf(stderr, "zfs_recv: stream %u: read(): %s\n",
+                    s->s_index, strerror(errno));
+            }
+            pthread_mutex_unlock(&w_lock);
+            fail();
+            return (NULL);
+        }
+
+        if (zf.zf_type == ZX_END) {
+            if (read_end(s, &zf) != 0) {
+                fail();
+            }
+            return (NULL);
+        }
+
+        if (zf.zf_type != ZX_DATA || (zf.zf_flags & ~ZX_FLAG_LZ4) != 0 ||
+            zf.zf_arg == 0 || zf.zf_arg > max_chunk ||
+            zf.zf_len <= ZX_CKSUM_SIZE ||
+            zf.zf_len > max_chunk + ZX_CKSUM_SIZE) {
+            fprintf(stderr, "zfs_recv: stream %u: unexpected frame "
+                "(type %u, flags %x, %u bytes)\n", s->s_index, zf.zf_type,
+                zf.zf_flags, zf.zf_len);
+            fail();
+            return (NULL);
+        }
+
+        if ((buf = read_chunk(s, &zf, &zc, &data)) == NULL) {
+            fail();
+            return (NULL);
+        }
+
+        pthread_mutex_lock(&w_lock);
+        while (zf.zf_seq >= w_next + w_size && !w_failed) {
+            pthread_cond_wait(&w_cv, &w_lock);
+        }
+        slot = &w_slots[zf.zf_seq % w_size];
+        if (!w_failed && (zf.zf_seq < w_next || slot->s_buf != NULL)) {
+            fprintf(stderr, "zfs_recv: stream %u: duplicate chunk %llu\n",
+                s->s_index, (unsigned long long)zf.zf_seq);
+            w_failed = 1;
+        }
+        if (w_failed) {
+            pthread_cond_broadcast(&w_cv);
+            pthread_mutex_unlock(&w_lock);
+            free(buf);
+            return (NULL);
+        }
+        slot->s_buf = buf;
+        slot->s_data = data;
+        slot->s_len = zf.zf_arg;
+        slot->s_cksum = zc;
+        w_wire += zf.zf_len;
+        pthread_cond_broadcast(&w_cv);
+        pthread_mutex_unlock(&w_lock);
+    }
+}
+
+/*
+ * Accept connections until we have one for each of the sender's streams.
+ * Connections that aren't part of the same transfer are dropped.  Once the
+ * first set has been accepted, only the same sender may connect again, and
+ * we wait no longer than "timeout" milliseconds for it.
+ */
+static int
+accept_streams(const zx_opts_t *zo, int sock, stream_t *streams, int timeout)
+{
+    uint8_t payload[ZX_HELLO_SIZE];
+    uint64_t deadline = zx_now_ns() + timeout * 1000000ULL;
+    uint16_t flags = resumable ? ZX_FLAG_RESUME : 0;
+    int first = (session == 0);
+    unsigned int nconns = 0;
+    unsigned int i;
+    zx_hello_t zh;
+    zx_frame_t zf;
+    int conn;
+
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        streams[i].s_sock = -1;
+    }
+
+    while (nconns < zo->zo_nstreams) {
+        if (timeout >= 0) {
+            struct pollfd pfd;
+            uint64_t now = zx_now_ns();
+            int n;
+
+            pfd.fd = sock;
+            pfd.events = POLLIN;
+            if (now >= deadline ||
+                (n = poll(&pfd, 1, (deadline - now) / 1000000)) == 0) {
+                fprintf(stderr, "zfs_recv: zfs_send did not reconnect\n");
+                goto fail;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("zfs_recv: poll()");
+                goto fail;
+            }
+        }
+
+        if ((conn = accept(sock, NULL, NULL)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("zfs_recv: accept()");
+            goto fail;
+        }
+
+        if (zx_frame_read(conn, &zf) != 0 || zf.zf_type != ZX_HELLO ||
+            zf.zf_len != sizeof (payload) ||
+            zx_read_all(conn, payload, sizeof (payload)) != 0) {
+            fprintf(stderr, "zfs_recv: dropping connection without "
+                "HELLO\n");
+            (void) close(conn);
+            continue;
+        }
+        zx_hello_decode(payload, &zh);
+
+        if (zh.zh_version != ZX_VERSION || zf.zf_flags != flags ||
+            zh.zh_nstreams != zo->zo_nstreams ||
+            zh.zh_index >= zo->zo_nstreams ||
+            streams[zh.zh_index].s_sock != -1 ||
+            ((nconns > 0 || !first) && zf.zf_seq != session) ||
+            (!first && zh.zh_chunk != max_chunk) ||
+            zh.zh_chunk < ZX_MIN_CHUNK || zh.zh_chunk > ZX_MAX_CHUNK) {
+            fprintf(stderr, "zfs_recv: dropping connection with bad HELLO "
+                "(version %u, flags %x, stream %u of %u)\n", zh.zh_version,
+                zf.zf_flags, zh.zh_index, zh.zh_nstreams);
+            (void) close(conn);
+            continue;
+        }
+
+        session = zf.zf_seq;
+        max_chunk = zh.zh_chunk;
+        streams[zh.zh_index].s_index = zh.zh_index;
+        streams[zh.zh_index].s_sock = conn;
+        nconns++;
+    }
+
+    return (0);
+
+fail:
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        if (streams[i].s_sock != -1) {
+            (void) close(streams[i].s_sock);
+        }
+    }
+    return (-1);
+}
+
+/*
+ * Tell zfs_send where to start, which is after whatever we have written to
+ * 'zfs recv'.
+ */
+static int
+send_resume(stream_t *s, uint64_t bytes)
+{
+    uint8_t payload[ZX_RESUME_SIZE];
+    struct iovec iov;
+    zx_frame_t zf;
+
+    bzero(&zf, sizeof (zf));
+    zf.zf_type = ZX_RESUME;
+    zf.zf_seq = w_next;
+    zf.zf_len = sizeof (payload);
+    zx_resume_encode(bytes, payload);
+    iov.iov_base = (void *)payload;
+    iov.iov_len = sizeof (payload);
+
+    return (zx_frame_write(s->s_sock, &zf, &iov, 1));
+}
+
+static int
+send_ack(stream_t *s)
+{
+    zx_frame_t zf;
+
+    bzero(&zf, sizeof (zf));
+    zf.zf_type = ZX_ACK;
+    zf.zf_seq = w_next;
+
+    return (zx_frame_write(s->s_sock, &zf, NULL, 0));
+}
+
+/*
+ * Stop the threads reading a set of connections after one of them has
+ * failed, close the connections, and forget any chunks that they read ahead
+ * of the one that 'zfs recv' needs next.  zfs_send will send those again.
+ */
+static void
+drop_streams(const zx_opts_t *zo, stream_t *streams)
+{
+    unsigned int i;
+
+    fail();
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        (void) shutdown(streams[i].s_sock, SHUT_RDWR);
+    }
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        (void) pthread_join(streams[i].s_thread, NULL);
+        (void) close(streams[i].s_sock);
+    }
+
+    pthread_mutex_lock(&w_lock);
+    for (i = 0; i < w_size; i++) {
+        free(w_slots[i].s_buf);
+        w_slots[i].s_buf = NULL;
+    }
+    w_ended = 0;
+    w_failed = 0;
+    pthread_mutex_unlock(&w_lock);
+}
+
+/*
+ * Write chunks to 'zfs recv' in order.  Returns 0 once the whole stream has
+ * been written, 1 if one of the connections failed, or -1 if writing to
+ * 'zfs recv' failed or the stream turned out to be wrong.
+ */
+static int
+write_chunks(const zx_opts_t *zo, stream_t *streams, int fd,
+    zx_progress_t *zp)
+{
+    pthread_mutex_lock(&w_lock);
+    for (;;) {
+        slot_t *slot = &w_slots[w_next % w_size];
+        slot_t s;
+
+        while (!w_failed && slot->s_buf == NULL &&
+            w_ended < zo->zo_nstreams) {
+            pthread_cond_wait(&w_cv, &w_lock);
+        }
+        if (w_failed) {
+            pthread_mutex_unlock(&w_lock);
+            return (1);
+        }
+        if (slot->s_buf == NULL) {
+            /*
+             * Every connection has ended.  That's only right if we have
+             * written every chunk.
+             */
+            pthread_mutex_unlock(&w_lock);
+            if (w_next == w_total && zp->zp_bytes == w_end_bytes &&
+                zx_cksum_equal(&w_digest, &w_end_digest)) {
+                return (0);
+            }
+            if (w_next == w_total) {
+                fprintf(stderr, "zfs_recv: stream digest mismatch\n");
+            } else {
+                fprintf(stderr, "zfs_recv: stream ended at chunk %llu of "
+                    "%llu\n", (unsigned long long)w_next,
+                    (unsigned long long)w_total);
+            }
+            return (-1);
+        }
+
+        s = *slot;
+        slot->s_buf = NULL;
+        zx_digest_add(&w_digest, w_next, s.s_len, &s.s_cksum);
+        w_next++;
+        pthread_cond_broadcast(&w_cv);
+        pthread_mutex_unlock(&w_lock);
+
+        if (zx_write_all(fd, s.s_data, s.s_len) != 0) {
+            perror("zfs_recv: write()");
+            free(s.s_buf);
+            return (-1);
+        }
+        zx_progress_add(zp, s.s_len);
+        free(s.s_buf);
+
+        if (resumable && send_ack(&streams[0]) != 0) {
+            fprintf(stderr, "zfs_recv: stream 0: write(): %s\n",
+                strerror(errno));
+            return (1);
+        }
+
+        pthread_mutex_lock(&w_lock);
+    }
+}
+
+/*
+ * Print the resume token that 'zfs recv -s' left on the dataset, if there is
+ * one.  The dataset is the last argument to 'zfs recv'.
  */
+static void
+print_resume_token(const zx_opts_t *zo, char **zfs_argv)
+{
+    char *argv[] = { NULL, "get", "-H", "-o", "value",
+        "receive_resume_token", NULL, NULL };
+    char token[TOKEN_MAX];
+    size_t len = 0;
+    ssize_t n;
+    int pipefd[2];
+    pid_t pid;
+
+    while (zfs_argv[1] != NULL) {
+        zfs_argv++;
+    }
+    argv[6] = zfs_argv[0];
+
+    if (pipe(pipefd) != 0) {
+        perror("zfs_recv: pipe()");
+        return;
+    }
+    pid = zx_spawn("zfs_recv", zo->zo_zfs, argv, -1, pipefd[1]);
+    (void) close(pipefd[1]);
+    if (pid < 0) {
+        (void) close(pipefd[0]);
+        return;
+    }
+
+    while (len < sizeof (token) - 1 &&
+        (n = read(pipefd[0], token + len, sizeof (token) - 1 - len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        len += n;
+    }
+    (void) close(pipefd[0]);
+    if (zx_wait("zfs_recv", pid) != 0) {
+        return;
+    }
+
+    while (len > 0 && token[len - 1] == '\n') {
+        len--;
+    }
+    token[len] = '\0';
+    if (len > 0 && strcmp(token, "-") != 0) {
+        fprintf(stderr, "Resume token: {'token': '%s'}\n", token);
+    }
+}
+
+static int
+recv_framed(const zx_opts_t *zo, int sock, char **zfs_argv)
+{
+    stream_t streams[ZX_MAX_STREAMS];
+    zx_progress_t zp;
+    zx_frame_t zf;
+    unsigned int i;
+    int pipefd[2];
+    int timeout = -1;
+    int error;
+    int ret;
+    pid_t pid;
+
+    resumable = (zo->zo_resume != 0);
+
+    w_size = zo->zo_nstreams * WINDOW_PER_STREAM;
+    if ((w_slots = calloc(w_size, sizeof (slot_t))) == NULL) {
+        perror("zfs_recv: calloc()");
+        return (-1);
+    }
+
+    if (accept_streams(zo, sock, streams, timeout) != 0) {
+        return (-1);
+    }
+    if (!resumable) {
+        (void) close(sock);
+    }
+
+    /*
+     * The stream protocol owns the connections, so 'zfs recv' output goes to
+     * our stderr rather than back to the sender.
+     */
+    if (pipe(pipefd) != 0) {
+        perror("zfs_recv: pipe()");
+        return (-1);
+    }
+    if ((pid = zx_spawn("zfs_recv", zo->zo_zfs, zfs_argv, pipefd[0],
+        STDERR_FILENO)) < 0) {
+        return (-1);
+    }
+    (void) close(pipefd[0]);
+
+    zx_progress_init(&zp, "Received", zo->zo_progress);
+
+    for (;;) {
+        if (resumable && send_resume(&streams[0], zp.zp_bytes) != 0) {
+            perror("zfs_recv: write()");
+            ret = 1;
+            i = 0;
+        } else {
+            for (i = 0; i < zo->zo_nstreams; i++) {
+                if ((error = pthread_create(&streams[i].s_thread, NULL,
+                    receiver, &streams[i])) != 0) {
+                    fprintf(stderr, "zfs_recv: pthread_create(): %s\n",
+                        strerror(error));
+                    (void) kill(pid, SIGTERM);
+                    return (-1);
+                }
+            }
+            ret = write_chunks(zo, streams, pipefd[1], &zp);
+        }
+
+        if (ret != 1 || !resumable) {
+            break;
+        }
+
+        if (i > 0) {
+            drop_streams(zo, streams);
+        } else {
+            for (i = 0; i < zo->zo_nstreams; i++) {
+                (void) close(streams[i].s_sock);
+            }
+        }
+        fprintf(stderr, "Connections lost at: {'chunk': %llu, "
+            "'offset': %llu}\n", (unsigned long long)w_next,
+            (unsigned long long)zp.zp_bytes);
+
+        timeout = zo->zo_resume * 1000;
+        if (accept_streams(zo, sock, streams, timeout) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret != 0) {
+        (void) kill(pid, SIGTERM);
+        (void) zx_wait("zfs_recv", pid);
+        if (resumable) {
+            print_resume_token(zo, zfs_argv);
+        }
+        return (-1);
+    }
+
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        (void) pthread_join(streams[i].s_thread, NULL);
+    }
+
+    (void) close(pipefd[1]);
+    ret = zx_wait("zfs_recv", pid);
+    if (ret == 0) {
+        zp.zp_wire = w_wire;
+        zx_progress_done(&zp);
+    }
+
+    bzero(&zf, sizeof (zf));
+    zf.zf_type = ZX_STATUS;
+    zf.zf_arg = (ret == 0) ? 0 : 1;
+    if (zx_frame_write(streams[0].s_sock, &zf, NULL, 0) != 0) {
+        perror("zfs_recv: write()");
+    }
+
+    return (ret);
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] <host> <port> ['zfs recv' args ...]\n",
+        prog);
+    zx_usage_opts();
+    exit(2);
+}
 
 int main(int argc, char *argv[]) {
     int conn;
-    struct addrinfo hints;
     struct addrinfo *res;
     char *host;
     char *port;
     char rhost[NI_MAXHOST + NI_MAXSERV];
     char rport[NI_MAXSERV];
+    zx_opts_t zo;
     int error;
     int opt;
     int sock;
 
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s <host> <port> ['zfs recv' args ...]\n",
-            argv[0]);
-        exit(2);
+    if (zx_parse_opts("zfs_recv", &argc, &argv, &zo) != 0 || argc < 4) {
+        usage(argv[0]);
     }
 
     host = argv[1];
     port = argv[2];
 
-    bzero((char *)&hints, sizeof (struct addrinfo));
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    hints.ai_flags |= AI_NUMERICHOST;
-    hints.ai_flags |= AI_NUMERICSERV;
-
-    if ((error = getaddrinfo(host, port, &hints, &res))) {
-        fprintf(stderr, "zfs_recv: getaddrinfo(): %s\n", gai_strerror(error));
+    if (zx_resolve("zfs_recv", host, port, &res) != 0) {
         exit(1);
     }
 
-    sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (zo.zo_nstreams > 0) {
+        /* the socket buffer size is inherited by accepted connections */
+        sock = zx_socket("zfs_recv", res, zo.zo_sockbuf);
+    } else {
+        sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (sock < 0) {
+            perror("zfs_recv: socket()");
+        }
+    }
     if (sock < 0) {
-        perror("zfs_recv: socket()");
         exit(1);
     }
 
@@ -98,7 +737,7 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    if (listen(sock, 1) < 0) {
+    if (listen(sock, zo.zo_nstreams > 0 ? zo.zo_nstreams : 1) < 0) {
         perror("zfs_recv: listen()");
         exit(1);
     }
@@ -114,6 +753,15 @@ int main(int argc, char *argv[]) {
 
     freeaddrinfo(res);
 
+    /* now: zfs recv <args> */
+    argv++;
+    argv[1] = "recv";           // replace port
+
+    if (zo.zo_nstreams > 0) {
+        (void) signal(SIGPIPE, SIG_IGN);
+        exit(recv_framed(&zo, sock, argv) == 0 ? 0 : 1);
+    }
+
     if ((conn = accept(sock, NULL, NULL)) < 0) {
         perror("zfs_recv: accept()");
         exit(1);
@@ -130,11 +778,8 @@ int main(int argc, char *argv[]) {
     }
 
     /* run the <program> and its args */
-    argv++;
-    argc--;
-    argv[0] = "/usr/sbin/zfs"; // replace host
-    argv[1] = "recv";         // replace port
-    execvp(*argv, argv);      // now 'zfs recv <args>'
+    argv[0] = (char *)zo.zo_zfs;
+    execvp(*argv, argv);
 
     /* if we got here we failed. */
     perror("zfs_recv: execvp()");
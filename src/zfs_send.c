@@ -21,6 +21,7 @@
  * CDDL HEADER END
  *
  * Copyright (c) 2012, Joyent, Inc. All rights reserved.
+ * Copyright 2026 Edgecast Cloud LLC.
  *
  */
 
@@ -29,11 +30,21 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "zfs_xfer.h"
+
+#ifndef __unused
+#define __unused    __attribute__((__unused__))
+#endif
+
 /*
  * To match /usr/sbin/zfs, the following exit statuses will be used:
  *
@@ -44,36 +55,768 @@
  * Diagnostic messages go to stderr.
  * On success a zfs stream will be sent over TCP to zfs_recv on the [host]:port.
  *
+ * Without -n, the stream goes over one connection exactly as 'zfs send'
+ * wrote it.  With -n, 'zfs send' writes to a pipe, and the stream is cut into
+ * chunks that are spread over that many connections in the framed format
+ * described in zfs_xfer.h.  zfs_recv must be given the same -n.  We exit
+ * successfully only once zfs_recv has told us that 'zfs recv' succeeded.
+ *
+ * Each chunk is checksummed, and with -c compressed with LZ4, by a pool of
+ * worker threads (-j) between reading the stream and sending it.
+ *
+ * With -r, chunks are kept after they have been sent until zfs_recv says
+ * that 'zfs recv' has them.  If the connections fail, we connect again, for
+ * up to the given number of seconds, and send again whatever zfs_recv
+ * doesn't have.  If we give up, and zfs_recv was running 'zfs recv -s', it
+ * reports the resume token, and the transfer can be restarted with
+ * 'zfs_send ... -t <token>' as it would be for 'zfs send'.
+ */
+
+typedef struct chunk {
+    struct chunk *c_next;
+    uint64_t c_seq;
+    size_t c_len;               /* length of the chunk in c_buf */
+    uint8_t *c_buf;
+    uint8_t *c_zbuf;            /* compressed chunk, if c_flags say so */
+    size_t c_zlen;
+    uint16_t c_flags;
+    int c_sent;                 /* written to a connection, with -r */
+    uint8_t c_cksum[ZX_CKSUM_SIZE];
+} chunk_t;
+
+typedef struct stream {
+    unsigned int s_index;
+    int s_sock;
+    pthread_t s_thread;
+} stream_t;
+
+/*
+ * Chunks pass from the reader (the main thread), which fills them from
+ * 'zfs send', through q_raw to the workers, which checksum and compress
+ * them, and through q_ready to the senders, one per connection.  They are
+ * then returned to q_free, or with -r kept on q_sent until zfs_recv
+ * acknowledges them.  There are two chunks for each worker and each
+ * connection, so that none of them has to wait for another to finish with
+ * one.
+ *
+ * The workers finish chunks in any order, but each connection must carry its
+ * chunks in order, or zfs_recv could fill its window with chunks from the
+ * other connections while waiting for one stuck behind a later chunk on the
+ * same connection.  So q_ready is kept sorted, and the senders take chunks
+ * from it strictly in turn.
+ *
+ * The connections are looked after by the transport thread, which connects
+ * them, starts a sender for each, and waits for zfs_recv's STATUS.  A failed
+ * connection sets q_broken, which stops the senders until the transport
+ * thread has connected again.  Anything else that goes wrong sets q_failed,
+ * which stops everything.
+ */
+typedef struct queue {
+    chunk_t *q_head;
+    chunk_t *q_tail;
+} queue_t;
+
+static pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t q_cv = PTHREAD_COND_INITIALIZER;
+static chunk_t *q_free;
+static queue_t q_raw;
+static queue_t q_ready;
+static queue_t q_sent;
+static unsigned int q_workers;  /* workers still running */
+static uint64_t q_send_next;    /* the next chunk to be sent */
+static uint64_t q_acked;        /* chunks that 'zfs recv' has */
+static uint64_t q_total;        /* chunks, once the reader is done */
+static uint64_t q_bytes;
+static uint64_t q_wire;         /* DATA payload bytes sent */
+static zx_cksum_t q_digest;
+static int q_eof;               /* the reader is done */
+static int q_status = -1;       /* from zfs_recv's STATUS frame */
+static int q_broken;
+static int q_failed;
+
+static int compress;
+static int resumable;
+
+typedef struct transport {
+    const zx_opts_t *t_opts;
+    struct addrinfo *t_addr;
+    uint64_t t_session;
+    stream_t t_streams[ZX_MAX_STREAMS];
+    pthread_t t_thread;
+} transport_t;
+
+static void
+fail(void)
+{
+    pthread_mutex_lock(&q_lock);
+    q_failed = 1;
+    pthread_cond_broadcast(&q_cv);
+    pthread_mutex_unlock(&q_lock);
+}
+
+/*
+ * Report a failed connection, unless another has already failed and taken
+ * the rest down with it.
+ */
+static void
+broken(const stream_t *s, const char *what)
+{
+    pthread_mutex_lock(&q_lock);
+    if (!q_broken && !q_failed && q_status == -1) {
+        fprintf(stderr, "zfs_send: stream %u: %s: %s\n", s->s_index, what,
+            strerror(errno));
+    }
+    q_broken = 1;
+    pthread_cond_broadcast(&q_cv);
+    pthread_mutex_unlock(&q_lock);
+}
+
+static void
+enqueue(queue_t *q, chunk_t *c)
+{
+    c->c_next = NULL;
+    if (q->q_tail == NULL) {
+        q->q_head = c;
+    } else {
+        q->q_tail->c_next = c;
+    }
+    q->q_tail = c;
+}
+
+static void
+enqueue_ready(chunk_t *c)
+{
+    chunk_t **cp;
+
+    cp = &q_ready.q_head;
+    while (*cp != NULL && (*cp)->c_seq < c->c_seq) {
+        cp = &(*cp)->c_next;
+    }
+    if ((c->c_next = *cp) == NULL) {
+        q_ready.q_tail = c;
+    }
+    *cp = c;
+}
+
+static chunk_t *
+dequeue(queue_t *q)
+{
+    chunk_t *c;
+
+    if ((c = q->q_head) != NULL && (q->q_head = c->c_next) == NULL) {
+        q->q_tail = NULL;
+    }
+
+    return (c);
+}
+
+/*
+ * Free the chunks on q_sent that zfs_recv has acknowledged.  An ACK can
+ * arrive before the sender that wrote the chunk has finished with it, so a
+ * chunk is only freed once both have happened.  Called with q_lock held.
+ */
+static void
+release_acked(void)
+{
+    chunk_t *c;
+
+    while ((c = q_sent.q_head) != NULL && c->c_seq < q_acked && c->c_sent) {
+        (void) dequeue(&q_sent);
+        c->c_next = q_free;
+        q_free = c;
+        pthread_cond_broadcast(&q_cv);
+    }
+}
+
+/*
+ * Checksum each chunk, and compress it if that was asked for and makes it
+ * smaller.  A chunk is only sent compressed if that saves at least 1/16 of
+ * it, and the compressor gives up as soon as its output reaches that size,
+ * so incompressible chunks cost little time and go out as they are.
+ */
+static void *
+worker(void *arg __unused)
+{
+    zx_cksum_t zc;
+    chunk_t *c;
+
+    for (;;) {
+        pthread_mutex_lock(&q_lock);
+        while (q_raw.q_head == NULL && !q_eof && !q_failed) {
+            pthread_cond_wait(&q_cv, &q_lock);
+        }
+        if (q_failed || (c = dequeue(&q_raw)) == NULL) {
+            if (--q_workers == 0) {
+                pthread_cond_broadcast(&q_cv);
+            }
+            pthread_mutex_unlock(&q_lock);
+            return (NULL);
+        }
+        pthread_mutex_unlock(&q_lock);
+
+        zx_fletcher4(c->c_buf, c->c_len, &zc);
+        zx_cksum_encode(&zc, c->c_cksum);
+
+        c->c_flags = 0;
+        if (compress && (c->c_zlen = zx_lz4_compress(c->c_buf, c->c_len,
+            c->c_zbuf, c->c_len - c->c_len / 16)) > 0) {
+            c->c_flags |= ZX_FLAG_LZ4;
+        }
+
+        pthread_mutex_lock(&q_lock);
+        zx_digest_add(&q_digest, c->c_seq, c->c_len, &zc);
+        enqueue_ready(c);
+        pthread_cond_broadcast(&q_cv);
+        pthread_mutex_unlock(&q_lock);
+    }
+}
+
+static void *
+sender(void *arg)
+{
+    stream_t *s = arg;
+    uint8_t end[ZX_END_SIZE];
+    struct iovec iov[2];
+    zx_frame_t zf;
+    chunk_t *c;
+
+    for (;;) {
+        pthread_mutex_lock(&q_lock);
+        while ((q_ready.q_head == NULL ||
+            q_ready.q_head->c_seq != q_send_next) && q_workers > 0 &&
+            !q_broken && !q_failed) {
+            pthread_cond_wait(&q_cv, &q_lock);
+        }
+        if (q_broken || q_failed) {
+            pthread_mutex_unlock(&q_lock);
+            return (NULL);
+        }
+        if ((c = dequeue(&q_ready)) == NULL) {
+            pthread_mutex_unlock(&q_lock);
+            break;
+        }
+        q_send_next++;
+        if (resumable) {
+            c->c_sent = 0;
+            enqueue(&q_sent, c);
+        }
+        pthread_mutex_unlock(&q_lock);
+
+        bzero(&zf, sizeof (zf));
+        zf.zf_type = ZX_DATA;
+        zf.zf_flags = c->c_flags;
+        zf.zf_seq = c->c_seq;
+        zf.zf_arg = c->c_len;
+        iov[0].iov_base = (void *)c->c_cksum;
+        iov[0].iov_len = sizeof (c->c_cksum);
+        if (c->c_flags & ZX_FLAG_LZ4) {
+            iov[1].iov_base = (void *)c->c_zbuf;
+            iov[1].iov_len = c->c_zlen;
+        } else {
+            iov[1].iov_base = (void *)c->c_buf;
+            iov[1].iov_len = c->c_len;
+        }
+        zf.zf_len = iov[0].iov_len + iov[1].iov_len;
+
+        if (zx_frame_write(s->s_sock, &zf, iov, 2) != 0) {
+            broken(s, "write()");
+            return (NULL);
+        }
+
+        pthread_mutex_lock(&q_lock);
+        q_wire += zf.zf_len;
+        if (resumable) {
+            c->c_sent = 1;
+            release_acked();
+        } else {
+            c->c_next = q_free;
+            q_free = c;
+            pthread_cond_broadcast(&q_cv);
+        }
+        pthread_mutex_unlock(&q_lock);
+    }
+
+    /*
+     * All of the workers have finished, so the totals and digest are final.
+     */
+    bzero(&zf, sizeof (zf));
+    zf.zf_type = ZX_END;
+    zf.zf_seq = q_total;
+    zf.zf_len = sizeof (end);
+    zx_end_encode(q_bytes, &q_digest, end);
+    iov[0].iov_base = (void *)end;
+    iov[0].iov_len = sizeof (end);
+    if (zx_frame_write(s->s_sock, &zf, iov, 1) != 0) {
+        broken(s, "write()");
+    }
+
+    return (NULL);
+}
+
+/*
+ * Read what zfs_recv sends back on connection 0: ACKs with -r, and finally
+ * its STATUS.
+ */
+static void *
+acker(void *arg)
+{
+    stream_t *s = arg;
+    zx_frame_t zf;
+
+    for (;;) {
+        if (zx_frame_read(s->s_sock, &zf) != 0) {
+            broken(s, "read()");
+            return (NULL);
+        }
+
+        if (zf.zf_type == ZX_ACK && zf.zf_len == 0 && resumable) {
+            pthread_mutex_lock(&q_lock);
+            if (zf.zf_seq > q_acked && zf.zf_seq <= q_send_next) {
+                q_acked = zf.zf_seq;
+                release_acked();
+            }
+            pthread_mutex_unlock(&q_lock);
+            continue;
+        }
+
+        if (zf.zf_type == ZX_STATUS && zf.zf_len == 0) {
+            pthread_mutex_lock(&q_lock);
+            q_status = zf.zf_arg;
+            pthread_cond_broadcast(&q_cv);
+            pthread_mutex_unlock(&q_lock);
+            return (NULL);
+        }
+
+        fprintf(stderr, "zfs_send: unexpected frame from zfs_recv (type %u, "
+            "%u bytes)\n", zf.zf_type, zf.zf_len);
+        fail();
+        return (NULL);
+    }
+}
+
+/*
+ * Read a chunk's worth of the stream, or as much as there is before EOF.
+ */
+static ssize_t
+read_chunk(int fd, uint8_t *buf, size_t size)
+{
+    size_t len = 0;
+    ssize_t n;
+
+    while (len < size) {
+        if ((n = read(fd, buf + len, size - len)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (-1);
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+
+    return (len);
+}
+
+static void
+close_streams(transport_t *t, unsigned int nconns)
+{
+    unsigned int i;
+
+    for (i = 0; i < nconns; i++) {
+        (void) close(t->t_streams[i].s_sock);
+    }
+}
+
+static int
+connect_streams(transport_t *t)
+{
+    const zx_opts_t *zo = t->t_opts;
+    struct addrinfo *res = t->t_addr;
+    uint8_t payload[ZX_HELLO_SIZE];
+    struct iovec iov;
+    zx_hello_t zh;
+    zx_frame_t zf;
+    unsigned int i;
+
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        stream_t *s = &t->t_streams[i];
+
+        s->s_index = i;
+        if ((s->s_sock = zx_socket("zfs_send", res, zo->zo_sockbuf)) < 0) {
+            close_streams(t, i);
+            return (-1);
+        }
+        if (connect(s->s_sock, res->ai_addr, res->ai_addrlen) < 0) {
+            perror("zfs_send: connect()");
+            close_streams(t, i + 1);
+            return (-1);
+        }
+
+        zh.zh_version = ZX_VERSION;
+        zh.zh_nstreams = zo->zo_nstreams;
+        zh.zh_index = i;
+        zh.zh_chunk = zo->zo_chunk;
+        zx_hello_encode(&zh, payload);
+
+        bzero(&zf, sizeof (zf));
+        zf.zf_type = ZX_HELLO;
+        zf.zf_flags = resumable ? ZX_FLAG_RESUME : 0;
+        zf.zf_seq = t->t_session;
+        zf.zf_len = sizeof (payload);
+        iov.iov_base = (void *)payload;
+        iov.iov_len = sizeof (payload);
+        if (zx_frame_write(s->s_sock, &zf, &iov, 1) != 0) {
+            perror("zfs_send: write()");
+            close_streams(t, i + 1);
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+/*
+ * Read the RESUME frame, and arrange to send again everything from the
+ * chunk it names.  Returns -1 if the connection failed, or -2 if zfs_recv
+ * wants a chunk that we no longer have, which it would only do if it
+ * weren't the zfs_recv that we started with.
+ */
+static int
+resume(transport_t *t)
+{
+    uint8_t payload[ZX_RESUME_SIZE];
+    zx_frame_t zf;
+    uint64_t bytes;
+    chunk_t *c;
+
+    if (zx_frame_read(t->t_streams[0].s_sock, &zf) != 0 ||
+        zf.zf_type != ZX_RESUME || zf.zf_len != sizeof (payload) ||
+        zx_read_all(t->t_streams[0].s_sock, payload,
+        sizeof (payload)) != 0) {
+        fprintf(stderr, "zfs_send: no RESUME from zfs_recv\n");
+        return (-1);
+    }
+    bytes = zx_resume_decode(payload);
+
+    pthread_mutex_lock(&q_lock);
+    if (zf.zf_seq < q_acked || zf.zf_seq > q_send_next) {
+        pthread_mutex_unlock(&q_lock);
+        fprintf(stderr, "zfs_send: zfs_recv asked to resume at chunk %llu, "
+            "but has chunks up to %llu and was sent up to %llu\n",
+            (unsigned long long)zf.zf_seq, (unsigned long long)q_acked,
+            (unsigned long long)q_send_next);
+        return (-2);
+    }
+
+    /*
+     * None of the senders are running, so everything on q_sent can either
+     * be freed or go back to be sent again.
+     */
+    q_acked = zf.zf_seq;
+    while ((c = dequeue(&q_sent)) != NULL) {
+        if (c->c_seq < q_acked) {
+            c->c_next = q_free;
+            q_free = c;
+        } else {
+            enqueue_ready(c);
+        }
+    }
+    q_send_next = q_acked;
+    pthread_cond_broadcast(&q_cv);
+    pthread_mutex_unlock(&q_lock);
+
+    if (zf.zf_seq > 0) {
+        fprintf(stderr, "Resuming at: {'chunk': %llu, 'offset': %llu}\n",
+            (unsigned long long)zf.zf_seq, (unsigned long long)bytes);
+    }
+
+    return (0);
+}
+
+/*
+ * Connect, and send until zfs_recv sends its STATUS.  Returns 0 once it
+ * has, 1 if the connections failed, or -1 if something else did.  *resumedp
+ * is set if the connections got as far as the RESUME frame.
+ */
+static int
+session(transport_t *t, int *resumedp)
+{
+    const zx_opts_t *zo = t->t_opts;
+    stream_t *streams = t->t_streams;
+    pthread_t ack;
+    unsigned int i, j;
+    int error;
+    int ret;
+
+    *resumedp = 0;
+    if (connect_streams(t) != 0) {
+        return (1);
+    }
+    if (resumable && (ret = resume(t)) != 0) {
+        close_streams(t, zo->zo_nstreams);
+        return (ret == -1 ? 1 : -1);
+    }
+    *resumedp = 1;
+
+    if ((error = pthread_create(&ack, NULL, acker, &streams[0])) != 0) {
+        fprintf(stderr, "zfs_send: pthread_create(): %s\n", strerror(error));
+        close_streams(t, zo->zo_nstreams);
+        return (-1);
+    }
+    for (i = 0; i < zo->zo_nstreams; i++) {
+        if ((error = pthread_create(&streams[i].s_thread, NULL, sender,
+            &streams[i])) != 0) {
+            fprintf(stderr, "zfs_send: pthread_create(): %s\n",
+                strerror(error));
+            fail();
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&q_lock);
+    while (q_status == -1 && !q_broken && !q_failed) {
+        pthread_cond_wait(&q_cv, &q_lock);
+    }
+    pthread_mutex_unlock(&q_lock);
+
+    /*
+     * Shutting the connections down stops any threads still using them, and
+     * tells zfs_recv that this set of connections is finished with.
+     */
+    for (j = 0; j < zo->zo_nstreams; j++) {
+        (void) shutdown(streams[j].s_sock, SHUT_RDWR);
+    }
+    while (i-- > 0) {
+        (void) pthread_join(streams[i].s_thread, NULL);
+    }
+    (void) pthread_join(ack, NULL);
+    close_streams(t, zo->zo_nstreams);
+
+    pthread_mutex_lock(&q_lock);
+    ret = q_failed ? -1 : (q_status != -1 ? 0 : 1);
+    q_broken = 0;
+    pthread_mutex_unlock(&q_lock);
+
+    return (ret);
+}
+
+/*
+ * Look after the connections until zfs_recv has sent its STATUS, connecting
+ * again for up to -r seconds whenever they fail.
  */
+static void *
+transport(void *arg)
+{
+    transport_t *t = arg;
+    uint64_t deadline = 0;
+    int resumed;
+    int ret;
+
+    while ((ret = session(t, &resumed)) == 1 && resumable) {
+        uint64_t now = zx_now_ns();
+
+        if (resumed || deadline == 0) {
+            deadline = now + t->t_opts->zo_resume * 1000000000ULL;
+        }
+        if (now >= deadline) {
+            fprintf(stderr, "zfs_send: giving up on reconnecting after %u "
+                "seconds\n", t->t_opts->zo_resume);
+            break;
+        }
+        fprintf(stderr, "Reconnecting\n");
+        (void) sleep(1);
+    }
+
+    if (ret != 0) {
+        fail();
+    }
+
+    return (NULL);
+}
+
+static int
+send_framed(const zx_opts_t *zo, const char *host, const char *port,
+    char **zfs_argv)
+{
+    transport_t t;
+    pthread_t workers[ZX_MAX_STREAMS];
+    zx_progress_t zp;
+    uint64_t seq = 0;
+    unsigned int i;
+    int pipefd[2];
+    int error;
+    pid_t pid;
+
+    fprintf(stderr, "Sending stream to: {'host': '%s', 'port': '%s', "
+        "'streams': %u, 'compress': '%s'}\n", host, port, zo->zo_nstreams,
+        zo->zo_compress ? "lz4" : "none");
+
+    compress = zo->zo_compress;
+    resumable = (zo->zo_resume != 0);
+
+    t.t_opts = zo;
+    t.t_session = zx_now_ns() ^ ((uint64_t)getpid() << 32) ^ time(NULL);
+    if (zx_resolve("zfs_send", host, port, &t.t_addr) != 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < 2 * (zo->zo_nstreams + zo->zo_workers); i++) {
+        chunk_t *c;
+
+        if ((c = calloc(1, sizeof (*c))) == NULL ||
+            (c->c_buf = malloc(zo->zo_chunk)) == NULL ||
+            (compress && (c->c_zbuf = malloc(zo->zo_chunk)) == NULL)) {
+            perror("zfs_send: malloc()");
+            return (-1);
+        }
+        c->c_next = q_free;
+        q_free = c;
+    }
+
+    if (pipe(pipefd) != 0) {
+        perror("zfs_send: pipe()");
+        return (-1);
+    }
+    if ((pid = zx_spawn("zfs_send", zo->zo_zfs, zfs_argv, -1,
+        pipefd[1])) < 0) {
+        return (-1);
+    }
+    (void) close(pipefd[1]);
+
+    q_workers = zo->zo_workers;
+    for (i = 0; i < zo->zo_workers; i++) {
+        if ((error = pthread_create(&workers[i], NULL, worker, NULL)) != 0) {
+            fprintf(stderr, "zfs_send: pthread_create(): %s\n",
+                strerror(error));
+            (void) kill(pid, SIGTERM);
+            return (-1);
+        }
+    }
+    if ((error = pthread_create(&t.t_thread, NULL, transport, &t)) != 0) {
+        fprintf(stderr, "zfs_send: pthread_create(): %s\n", strerror(error));
+        (void) kill(pid, SIGTERM);
+        return (-1);
+    }
+
+    zx_progress_init(&zp, "Sent", zo->zo_progress);
+
+    for (;;) {
+        chunk_t *c;
+        ssize_t len;
+
+        pthread_mutex_lock(&q_lock);
+        while (q_free == NULL && !q_failed) {
+            pthread_cond_wait(&q_cv, &q_lock);
+        }
+        if (q_failed) {
+            pthread_mutex_unlock(&q_lock);
+            (void) kill(pid, SIGTERM);
+            (void) zx_wait("zfs_send", pid);
+            return (-1);
+        }
+        c = q_free;
+        q_free = c->c_next;
+        pthread_mutex_unlock(&q_lock);
+
+        if ((len = read_chunk(pipefd[0], c->c_buf, zo->zo_chunk)) < 0) {
+            perror("zfs_send: read()");
+            fail();
+            continue;
+        }
+
+        pthread_mutex_lock(&q_lock);
+        if (len == 0) {
+            c->c_next = q_free;
+            q_free = c;
+            pthread_mutex_unlock(&q_lock);
+            break;
+        }
+        c->c_len = len;
+        c->c_seq = seq++;
+        enqueue(&q_raw, c);
+        pthread_cond_broadcast(&q_cv);
+        pthread_mutex_unlock(&q_lock);
+
+        zx_progress_add(&zp, len);
+    }
+
+    /*
+     * Only tell zfs_recv that the stream is complete if 'zfs send' says so.
+     * Otherwise the connections are closed without an END frame, and
+     * zfs_recv stops 'zfs recv' rather than let it see a truncated stream.
+     */
+    if (zx_wait("zfs_send", pid) != 0) {
+        fail();
+        (void) pthread_join(t.t_thread, NULL);
+        return (-1);
+    }
+
+    pthread_mutex_lock(&q_lock);
+    q_total = seq;
+    q_bytes = zp.zp_bytes;
+    q_eof = 1;
+    pthread_cond_broadcast(&q_cv);
+    pthread_mutex_unlock(&q_lock);
+
+    for (i = 0; i < zo->zo_workers; i++) {
+        (void) pthread_join(workers[i], NULL);
+    }
+    (void) pthread_join(t.t_thread, NULL);
+    freeaddrinfo(t.t_addr);
+    if (q_failed) {
+        return (-1);
+    }
+
+    zp.zp_wire = q_wire;
+    zx_progress_done(&zp);
+
+    if (q_status != 0) {
+        fprintf(stderr, "zfs_send: zfs recv failed on the receiver\n");
+        return (-1);
+    }
+
+    return (0);
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] <host> <port> ['zfs send' args ...]\n",
+        prog);
+    zx_usage_opts();
+    exit(2);
+}
 
 int main(int argc, char *argv[]) {
-    struct addrinfo hints;
     struct addrinfo *res;
     char *host;
     char *port;
     char rhost[NI_MAXHOST + NI_MAXSERV];
     char rport[NI_MAXSERV];
+    zx_opts_t zo;
     int error;
     int sock;
 
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s <host> <port> ['zfs send' args ...]\n",
-            argv[0]);
-        exit(2);
+    if (zx_parse_opts("zfs_send", &argc, &argv, &zo) != 0 || argc < 4) {
+        usage(argv[0]);
     }
 
     host = argv[1];
     port = argv[2];
 
-    bzero((char *)&hints, sizeof (struct addrinfo));
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    hints.ai_flags |= AI_NUMERICHOST;
-    hints.ai_flags |= AI_NUMERICSERV;
+    /* now: zfs send <args> */
+    argv++;
+    argv[1] = "send";           // replace port
+
+    (void) signal(SIGPIPE, SIG_IGN);
 
-    if ((error = getaddrinfo(host, port, &hints, &res))) {
-        fprintf(stderr, "zfs_send: getaddrinfo(): %s\n", gai_strerror(error));
+    if (zo.zo_nstreams > 0) {
+        exit(send_framed(&zo, host, port, argv) == 0 ? 0 : 1);
+    }
+
+    if (zx_resolve("zfs_send", host, port, &res) != 0) {
         exit(1);
     }
 
@@ -106,11 +849,9 @@ int main(int argc, char *argv[]) {
     }
 
     /* run the <program> and its args */
-    argv++;
-    argc--;
-    argv[0] = "/usr/sbin/zfs"; // replace host
-    argv[1] = "send";         // replace port
-    execvp(*argv, argv);      // now: zfs send <args>
+    (void) signal(SIGPIPE, SIG_DFL);
+    argv[0] = (char *)zo.zo_zfs;
+    execvp(*argv, argv);
 
     /* if we got here we failed. */
     perror("zfs_send: execvp()");
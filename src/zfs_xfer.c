@@ -0,0 +1,679 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * Pieces of zfs_send and zfs_recv that both ends of a framed transfer need:
+ * option parsing, sockets, frame encoding and running zfs.  See zfs_xfer.h
+ * for the protocol.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "zfs_xfer.h"
+
+#define	PROGRESS_INTERVAL	1000000000ULL	/* ns */
+#define	MAX_IOV			4
+
+static void
+put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v >> 16);
+	put16(p + 2, v & 0xffff);
+}
+
+static void
+put64(uint8_t *p, uint64_t v)
+{
+	put32(p, v >> 32);
+	put32(p + 4, v & 0xffffffff);
+}
+
+static uint16_t
+get16(const uint8_t *p)
+{
+	return ((uint16_t)(p[0] << 8 | p[1]));
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+	return ((uint32_t)get16(p) << 16 | get16(p + 2));
+}
+
+static uint64_t
+get64(const uint8_t *p)
+{
+	return ((uint64_t)get32(p) << 32 | get32(p + 4));
+}
+
+/*
+ * Parse a size such as "65536", "64k" or "4M".
+ */
+static int
+parse_size(const char *str, size_t min, size_t max, size_t *sizep)
+{
+	unsigned long long v;
+	char *end;
+
+	errno = 0;
+	v = strtoull(str, &end, 10);
+	if (errno != 0 || end == str)
+		return (-1);
+
+	switch (*end) {
+	case 'k':
+	case 'K':
+		v *= 1024;
+		end++;
+		break;
+	case 'm':
+	case 'M':
+		v *= 1024 * 1024;
+		end++;
+		break;
+	case '\0':
+		break;
+	default:
+		return (-1);
+	}
+
+	if (*end != '\0' || v < min || v > max)
+		return (-1);
+
+	*sizep = (size_t)v;
+	return (0);
+}
+
+void
+zx_usage_opts(void)
+{
+	(void) fprintf(stderr,
+	    "Options:\n"
+	    "  -n streams  use the framed protocol over this many "
+	    "connections (1-%d)\n"
+	    "  -s size     largest chunk to send (default 1M)\n"
+	    "  -w size     socket send and receive buffer size "
+	    "(default 4M)\n"
+	    "  -c          compress chunks with LZ4 (zfs_send)\n"
+	    "  -j workers  threads checksumming and compressing chunks "
+	    "(zfs_send,\n"
+	    "              default one per connection)\n"
+	    "  -p          report progress every second\n"
+	    "  -r seconds  if the connections fail, keep trying to "
+	    "reconnect and\n"
+	    "              resume for this long\n"
+	    "  -Z command  run this instead of %s\n",
+	    ZX_MAX_STREAMS, ZX_ZFS_PATH);
+}
+
+/*
+ * Parse the options that come before <host> and <port>.  Parsing stops at
+ * the first argument that isn't an option, as everything after the port
+ * belongs to zfs.  On return, (*argvp)[0] is still the program name and
+ * (*argvp)[1] is the host.
+ */
+int
+zx_parse_opts(const char *prog, int *argcp, char ***argvp, zx_opts_t *zo)
+{
+	char **argv = *argvp;
+	int argc = *argcp;
+	int i;
+
+	bzero(zo, sizeof (*zo));
+	zo->zo_chunk = ZX_DEFAULT_CHUNK;
+	zo->zo_sockbuf = ZX_DEFAULT_SOCKBUF;
+	zo->zo_zfs = ZX_ZFS_PATH;
+
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0';
+	    i++) {
+		char opt = argv[i][1];
+		const char *val = NULL;
+		size_t size;
+
+		if (strcmp(argv[i], "--") == 0) {
+			i++;
+			break;
+		}
+
+		if (opt == 'n' || opt == 's' || opt == 'w' || opt == 'j' ||
+		    opt == 'r' || opt == 'Z') {
+			if (argv[i][2] != '\0') {
+				val = &argv[i][2];
+			} else if (i + 1 < argc) {
+				val = argv[++i];
+			} else {
+				(void) fprintf(stderr, "%s: option -%c "
+				    "requires an argument\n", prog, opt);
+				return (-1);
+			}
+		} else if (argv[i][2] != '\0') {
+			opt = '?';
+		}
+
+		switch (opt) {
+		case 'n':
+			if (parse_size(val, 1, ZX_MAX_STREAMS, &size) != 0) {
+				(void) fprintf(stderr, "%s: invalid number of "
+				    "streams: %s\n", prog, val);
+				return (-1);
+			}
+			zo->zo_nstreams = (unsigned int)size;
+			break;
+		case 's':
+			if (parse_size(val, ZX_MIN_CHUNK, ZX_MAX_CHUNK,
+			    &zo->zo_chunk) != 0) {
+				(void) fprintf(stderr, "%s: invalid chunk "
+				    "size: %s\n", prog, val);
+				return (-1);
+			}
+			break;
+		case 'w':
+			if (parse_size(val, 0, 256 * 1024 * 1024, &size) != 0) {
+				(void) fprintf(stderr, "%s: invalid socket "
+				    "buffer size: %s\n", prog, val);
+				return (-1);
+			}
+			zo->zo_sockbuf = (int)size;
+			break;
+		case 'j':
+			if (parse_size(val, 1, ZX_MAX_STREAMS, &size) != 0) {
+				(void) fprintf(stderr, "%s: invalid number of "
+				    "workers: %s\n", prog, val);
+				return (-1);
+			}
+			zo->zo_workers = (unsigned int)size;
+			break;
+		case 'r':
+			if (parse_size(val, 1, ZX_MAX_RESUME, &size) != 0) {
+				(void) fprintf(stderr, "%s: invalid resume "
+				    "time: %s\n", prog, val);
+				return (-1);
+			}
+			zo->zo_resume = (unsigned int)size;
+			break;
+		case 'c':
+			zo->zo_compress = 1;
+			break;
+		case 'p':
+			zo->zo_progress = 1;
+			break;
+		case 'Z':
+			zo->zo_zfs = val;
+			break;
+		default:
+			(void) fprintf(stderr, "%s: unknown option: %s\n", prog,
+			    argv[i]);
+			return (-1);
+		}
+	}
+
+	if (zo->zo_workers == 0)
+		zo->zo_workers = zo->zo_nstreams;
+
+	if (zo->zo_resume != 0 && zo->zo_nstreams == 0) {
+		(void) fprintf(stderr, "%s: -r needs -n\n", prog);
+		return (-1);
+	}
+
+	argv[i - 1] = argv[0];
+	*argvp = &argv[i - 1];
+	*argcp = argc - (i - 1);
+
+	return (0);
+}
+
+int
+zx_resolve(const char *prog, const char *host, const char *port,
+    struct addrinfo **resp)
+{
+	struct addrinfo hints;
+	int error;
+
+	bzero(&hints, sizeof (hints));
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+	if ((error = getaddrinfo(host, port, &hints, resp)) != 0) {
+		(void) fprintf(stderr, "%s: getaddrinfo(): %s\n", prog,
+		    gai_strerror(error));
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Create a socket for the given address, with its send and receive buffers
+ * set to "sockbuf" bytes.  This has to happen before connect() or listen()
+ * for the TCP window to be scaled to match.  The system may cap the size,
+ * which is not an error.
+ */
+int
+zx_socket(const char *prog, const struct addrinfo *ai, int sockbuf)
+{
+	int sock;
+
+	if ((sock = socket(ai->ai_family, ai->ai_socktype,
+	    ai->ai_protocol)) < 0) {
+		(void) fprintf(stderr, "%s: socket(): %s\n", prog,
+		    strerror(errno));
+		return (-1);
+	}
+
+	if (sockbuf > 0) {
+		if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sockbuf,
+		    sizeof (sockbuf)) != 0 ||
+		    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &sockbuf,
+		    sizeof (sockbuf)) != 0) {
+			(void) fprintf(stderr, "%s: warning: could not set "
+			    "socket buffers to %d bytes: %s\n", prog, sockbuf,
+			    strerror(errno));
+		}
+	}
+
+	return (sock);
+}
+
+/*
+ * Read exactly "len" bytes.  End of file before then is an error, with errno
+ * set to ECONNRESET.
+ */
+int
+zx_read_all(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, p, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		if (n == 0) {
+			errno = ECONNRESET;
+			return (-1);
+		}
+		p += n;
+		len -= n;
+	}
+
+	return (0);
+}
+
+int
+zx_write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		p += n;
+		len -= n;
+	}
+
+	return (0);
+}
+
+int
+zx_frame_read(int fd, zx_frame_t *zf)
+{
+	uint8_t hdr[ZX_HDR_SIZE];
+
+	if (zx_read_all(fd, hdr, sizeof (hdr)) != 0)
+		return (-1);
+
+	if (get32(hdr) != ZX_MAGIC) {
+		errno = EPROTO;
+		return (-1);
+	}
+
+	zf->zf_type = get16(hdr + 4);
+	zf->zf_flags = get16(hdr + 6);
+	zf->zf_seq = get64(hdr + 8);
+	zf->zf_len = get32(hdr + 16);
+	zf->zf_arg = get32(hdr + 20);
+
+	return (0);
+}
+
+/*
+ * Write a frame header followed by its payload, gathered from "iov".  The
+ * payload must add up to zf_len bytes.
+ */
+int
+zx_frame_write(int fd, const zx_frame_t *zf, struct iovec *iov, int iovcnt)
+{
+	uint8_t hdr[ZX_HDR_SIZE];
+	struct iovec v[MAX_IOV];
+	struct iovec *vp = v;
+	int cnt = 1;
+	ssize_t n;
+
+	put32(hdr, ZX_MAGIC);
+	put16(hdr + 4, zf->zf_type);
+	put16(hdr + 6, zf->zf_flags);
+	put64(hdr + 8, zf->zf_seq);
+	put32(hdr + 16, zf->zf_len);
+	put32(hdr + 20, zf->zf_arg);
+
+	v[0].iov_base = (void *)hdr;
+	v[0].iov_len = sizeof (hdr);
+	for (int i = 0; i < iovcnt && cnt < MAX_IOV; i++) {
+		if (iov[i].iov_len > 0)
+			v[cnt++] = iov[i];
+	}
+
+	while (cnt > 0) {
+		if ((n = writev(fd, vp, cnt)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		while (cnt > 0 && (size_t)n >= vp->iov_len) {
+			n -= vp->iov_len;
+			vp++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			vp->iov_base = (char *)vp->iov_base + n;
+			vp->iov_len -= n;
+		}
+	}
+
+	return (0);
+}
+
+void
+zx_hello_encode(const zx_hello_t *zh, uint8_t *buf)
+{
+	put32(buf, zh->zh_version);
+	put32(buf + 4, zh->zh_nstreams);
+	put32(buf + 8, zh->zh_index);
+	put32(buf + 12, zh->zh_chunk);
+}
+
+void
+zx_hello_decode(const uint8_t *buf, zx_hello_t *zh)
+{
+	zh->zh_version = get32(buf);
+	zh->zh_nstreams = get32(buf + 4);
+	zh->zh_index = get32(buf + 8);
+	zh->zh_chunk = get32(buf + 12);
+}
+
+/*
+ * fletcher-4 of a buffer, as 32-bit words in native byte order like ZFS's
+ * fletcher_4_native().  A length that isn't a multiple of 4 is padded with
+ * zeros.
+ */
+void
+zx_fletcher4(const void *buf, size_t size, zx_cksum_t *zc)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = p + (size & ~(size_t)3);
+	uint64_t a = 0, b = 0, c = 0, d = 0;
+	uint32_t w;
+
+	for (; p < end; p += 4) {
+		(void) memcpy(&w, p, sizeof (w));
+		a += w;
+		b += a;
+		c += b;
+		d += c;
+	}
+
+	if ((size & 3) != 0) {
+		w = 0;
+		(void) memcpy(&w, p, size & 3);
+		a += w;
+		b += a;
+		c += b;
+		d += c;
+	}
+
+	zc->zc_word[0] = a;
+	zc->zc_word[1] = b;
+	zc->zc_word[2] = c;
+	zc->zc_word[3] = d;
+}
+
+/*
+ * Add chunk "seq" of "len" bytes and checksum "zc" to a stream digest, which
+ * starts out as zeros.
+ */
+void
+zx_digest_add(zx_cksum_t *digest, uint64_t seq, size_t len,
+    const zx_cksum_t *zc)
+{
+	uint8_t buf[16 + ZX_CKSUM_SIZE];
+	zx_cksum_t f;
+
+	put64(buf, seq);
+	put64(buf + 8, len);
+	zx_cksum_encode(zc, buf + 16);
+	zx_fletcher4(buf, sizeof (buf), &f);
+
+	for (int i = 0; i < 4; i++)
+		digest->zc_word[i] += f.zc_word[i];
+}
+
+void
+zx_cksum_encode(const zx_cksum_t *zc, uint8_t *buf)
+{
+	for (int i = 0; i < 4; i++)
+		put64(buf + 8 * i, zc->zc_word[i]);
+}
+
+void
+zx_cksum_decode(const uint8_t *buf, zx_cksum_t *zc)
+{
+	for (int i = 0; i < 4; i++)
+		zc->zc_word[i] = get64(buf + 8 * i);
+}
+
+int
+zx_cksum_equal(const zx_cksum_t *a, const zx_cksum_t *b)
+{
+	return (memcmp(a->zc_word, b->zc_word, sizeof (a->zc_word)) == 0);
+}
+
+void
+zx_end_encode(uint64_t bytes, const zx_cksum_t *digest, uint8_t *buf)
+{
+	put64(buf, bytes);
+	zx_cksum_encode(digest, buf + 8);
+}
+
+void
+zx_end_decode(const uint8_t *buf, uint64_t *bytes, zx_cksum_t *digest)
+{
+	*bytes = get64(buf);
+	zx_cksum_decode(buf + 8, digest);
+}
+
+void
+zx_resume_encode(uint64_t bytes, uint8_t *buf)
+{
+	put64(buf, bytes);
+}
+
+uint64_t
+zx_resume_decode(const uint8_t *buf)
+{
+	return (get64(buf));
+}
+
+/*
+ * Start "zfs" with the given arguments (argv[0] is ignored), with its stdin
+ * and stdout replaced by "fd_in" and "fd_out" where they aren't -1.  Every
+ * other descriptor above stderr is closed in the child, so that it can't
+ * hold our sockets or pipes open.
+ */
+pid_t
+zx_spawn(const char *prog, const char *zfs, char **argv, int fd_in,
+    int fd_out)
+{
+	pid_t pid;
+
+	if ((pid = fork()) < 0) {
+		(void) fprintf(stderr, "%s: fork(): %s\n", prog,
+		    strerror(errno));
+		return (-1);
+	}
+
+	if (pid == 0) {
+		if ((fd_in != -1 && dup2(fd_in, 0) < 0) ||
+		    (fd_out != -1 && dup2(fd_out, 1) < 0)) {
+			(void) fprintf(stderr, "%s: dup2(): %s\n", prog,
+			    strerror(errno));
+			_exit(1);
+		}
+		closefrom(3);
+		(void) signal(SIGPIPE, SIG_DFL);
+
+		argv[0] = (char *)zfs;
+		(void) execvp(zfs, argv);
+		(void) fprintf(stderr, "%s: execvp(%s): %s\n", prog, zfs,
+		    strerror(errno));
+		_exit(1);
+	}
+
+	return (pid);
+}
+
+/*
+ * Wait for a child started by zx_spawn(), and return 0 if it succeeded.
+ */
+int
+zx_wait(const char *prog, pid_t pid)
+{
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			(void) fprintf(stderr, "%s: waitpid(): %s\n", prog,
+			    strerror(errno));
+			return (-1);
+		}
+	}
+
+	if (WIFSIGNALED(status)) {
+		(void) fprintf(stderr, "%s: zfs killed by signal %d\n", prog,
+		    WTERMSIG(status));
+		return (-1);
+	}
+	if (WEXITSTATUS(status) != 0) {
+		(void) fprintf(stderr, "%s: zfs exited with status %d\n", prog,
+		    WEXITSTATUS(status));
+		return (-1);
+	}
+
+	return (0);
+}
+
+uint64_t
+zx_now_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+progress_print(zx_progress_t *zp, const char *what, uint64_t now)
+{
+	double secs = (now - zp->zp_start) / 1e9;
+	double mbps = secs > 0 ? zp->zp_bytes / secs / (1024 * 1024) : 0.0;
+
+	if (zp->zp_wire == 0) {
+		(void) fprintf(stderr, "%s: {'bytes': %llu, 'seconds': %.1f, "
+		    "'MB/s': %.1f}\n", what, (unsigned long long)zp->zp_bytes,
+		    secs, mbps);
+		return;
+	}
+
+	(void) fprintf(stderr, "%s: {'bytes': %llu, 'wire_bytes': %llu, "
+	    "'ratio': %.2f, 'seconds': %.1f, 'MB/s': %.1f}\n", what,
+	    (unsigned long long)zp->zp_bytes,
+	    (unsigned long long)zp->zp_wire,
+	    (double)zp->zp_bytes / zp->zp_wire, secs, mbps);
+}
+
+/*
+ * Count the bytes of the stream that have gone through.  With "periodic"
+ * set, a progress line is printed on stderr at most once a second, and
+ * zx_progress_done() prints a summary under "verb" either way.  If the
+ * caller has set zp_wire to the number of bytes that went over the network,
+ * the summary includes the compression ratio.
+ */
+void
+zx_progress_init(zx_progress_t *zp, const char *verb, int periodic)
+{
+	bzero(zp, sizeof (*zp));
+	zp->zp_verb = verb;
+	zp->zp_periodic = periodic;
+	zp->zp_start = zp->zp_last = zx_now_ns();
+}
+
+void
+zx_progress_add(zx_progress_t *zp, uint64_t bytes)
+{
+	uint64_t now;
+
+	zp->zp_bytes += bytes;
+
+	if (!zp->zp_periodic)
+		return;
+
+	if ((now = zx_now_ns()) - zp->zp_last >= PROGRESS_INTERVAL) {
+		zp->zp_last = now;
+		progress_print(zp, "Progress", now);
+	}
+}
+
+void
+zx_progress_done(zx_progress_t *zp)
+{
+	progress_print(zp, zp->zp_verb, zx_now_ns());
+}
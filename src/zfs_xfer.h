@@ -0,0 +1,200 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+#ifndef _ZFS_XFER_H
+#define	_ZFS_XFER_H
+
+/*
+ * Framed, multi-stream transfer of a zfs send stream, shared by zfs_send and
+ * zfs_recv.
+ *
+ * zfs_send cuts the output of "zfs send" into chunks and numbers them, and
+ * sends each one as a DATA frame on whichever of its connections is free.
+ * zfs_recv reads every connection at once and writes the chunks to
+ * "zfs recv" in order.  Every frame starts with the same fixed header, in
+ * network byte order:
+ *
+ *	offset	size	field
+ *	0	4	magic (ZX_MAGIC)
+ *	4	2	type (zx_frame_type_t)
+ *	6	2	flags (ZX_FLAG_*)
+ *	8	8	seq
+ *	16	4	len: payload bytes following the header
+ *	20	4	arg
+ *
+ * and the frames are:
+ *
+ *	HELLO	first on each connection.  seq is the session ID, which is the
+ *		same on all of a sender's connections, and the payload is the
+ *		version, the number of connections, this connection's index
+ *		and the largest chunk the sender will send, each 4 bytes.
+ *	DATA	seq is the chunk number, counting from 0, and arg is its
+ *		length.  The payload is the chunk's checksum, followed by the
+ *		chunk itself, compressed if ZX_FLAG_LZ4 is set.
+ *	END	last on each connection.  seq is the total number of chunks,
+ *		and the payload is the total length of the stream (8 bytes),
+ *		followed by its digest.
+ *	STATUS	sent back by zfs_recv on connection 0 once "zfs recv" has
+ *		exited.  arg is 0 if it succeeded.
+ *
+ * With -r on both ends, a transfer survives losing its connections.  Every
+ * HELLO then has ZX_FLAG_RESUME set, and there are two more frames, both
+ * sent by zfs_recv on connection 0:
+ *
+ *	RESUME	sent once all of the connections have said HELLO, before the
+ *		sender sends any DATA.  seq is the first chunk that "zfs recv"
+ *		hasn't been given, and the payload is the number of bytes it
+ *		has been given (8 bytes).  The sender starts from that chunk.
+ *	ACK	seq is the number of chunks that "zfs recv" has been given,
+ *		so the sender needn't keep them to send again.
+ *
+ * If any connection fails, both ends drop the rest, and zfs_send connects
+ * again with the same session ID.  zfs_recv keeps "zfs recv" running in the
+ * meantime, so the stream carries on from the chunk in the RESUME frame.
+ *
+ * Checksums are fletcher-4, as ZFS uses, written as four 8-byte words.  A
+ * chunk's checksum is taken before compression, so it covers compression as
+ * well as the network.  The stream's digest is the word-by-word sum of the
+ * fletcher-4 of each chunk's number, length and checksum.  The chunks can be
+ * added to it in any order, so neither end has to serialize to compute it,
+ * but it still catches a chunk that went missing or was sent twice, which
+ * the chunks' own checksums can't.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <netdb.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define	ZX_MAGIC		0x5a584652	/* "ZXFR" */
+#define	ZX_VERSION		1
+#define	ZX_HDR_SIZE		24
+#define	ZX_HELLO_SIZE		16
+#define	ZX_CKSUM_SIZE		32
+#define	ZX_END_SIZE		(8 + ZX_CKSUM_SIZE)
+#define	ZX_RESUME_SIZE		8
+
+#define	ZX_FLAG_LZ4		0x1	/* DATA */
+#define	ZX_FLAG_RESUME		0x2	/* HELLO */
+
+#define	ZX_MAX_STREAMS		64
+#define	ZX_MIN_CHUNK		(4 * 1024)
+#define	ZX_MAX_CHUNK		(16 * 1024 * 1024)
+#define	ZX_DEFAULT_CHUNK	(1024 * 1024)
+#define	ZX_DEFAULT_SOCKBUF	(4 * 1024 * 1024)
+#define	ZX_MAX_RESUME		86400	/* seconds */
+
+#define	ZX_ZFS_PATH		"/usr/sbin/zfs"
+
+typedef enum zx_frame_type {
+	ZX_HELLO = 1,
+	ZX_DATA,
+	ZX_END,
+	ZX_STATUS,
+	ZX_RESUME,
+	ZX_ACK
+} zx_frame_type_t;
+
+typedef struct zx_frame {
+	uint16_t zf_type;
+	uint16_t zf_flags;
+	uint64_t zf_seq;
+	uint32_t zf_len;
+	uint32_t zf_arg;
+} zx_frame_t;
+
+typedef struct zx_cksum {
+	uint64_t zc_word[4];
+} zx_cksum_t;
+
+typedef struct zx_hello {
+	uint32_t zh_version;
+	uint32_t zh_nstreams;
+	uint32_t zh_index;
+	uint32_t zh_chunk;
+} zx_hello_t;
+
+/*
+ * Options common to zfs_send and zfs_recv.  zo_nstreams is 0 unless -n was
+ * given, in which case the framed protocol is used instead of passing the
+ * stream straight through one connection.  zo_resume is the number of
+ * seconds to keep trying to reconnect after losing the connections, or 0 if
+ * the transfer should just fail.
+ */
+typedef struct zx_opts {
+	unsigned int zo_nstreams;
+	size_t zo_chunk;
+	int zo_sockbuf;
+	int zo_progress;
+	int zo_compress;
+	unsigned int zo_workers;
+	unsigned int zo_resume;
+	const char *zo_zfs;
+} zx_opts_t;
+
+typedef struct zx_progress {
+	const char *zp_verb;
+	uint64_t zp_start;
+	uint64_t zp_last;
+	uint64_t zp_bytes;
+	uint64_t zp_wire;
+	int zp_periodic;
+} zx_progress_t;
+
+extern int zx_parse_opts(const char *, int *, char ***, zx_opts_t *);
+extern void zx_usage_opts(void);
+
+extern int zx_resolve(const char *, const char *, const char *,
+    struct addrinfo **);
+extern int zx_socket(const char *, const struct addrinfo *, int);
+
+extern int zx_read_all(int, void *, size_t);
+extern int zx_write_all(int, const void *, size_t);
+extern int zx_frame_read(int, zx_frame_t *);
+extern int zx_frame_write(int, const zx_frame_t *, struct iovec *, int);
+extern void zx_hello_encode(const zx_hello_t *, uint8_t *);
+extern void zx_hello_decode(const uint8_t *, zx_hello_t *);
+
+extern void zx_fletcher4(const void *, size_t, zx_cksum_t *);
+extern void zx_digest_add(zx_cksum_t *, uint64_t, size_t,
+    const zx_cksum_t *);
+extern void zx_cksum_encode(const zx_cksum_t *, uint8_t *);
+extern void zx_cksum_decode(const uint8_t *, zx_cksum_t *);
+extern int zx_cksum_equal(const zx_cksum_t *, const zx_cksum_t *);
+extern void zx_end_encode(uint64_t, const zx_cksum_t *, uint8_t *);
+extern void zx_end_decode(const uint8_t *, uint64_t *, zx_cksum_t *);
+extern void zx_resume_encode(uint64_t, uint8_t *);
+extern uint64_t zx_resume_decode(const uint8_t *);
+
+extern size_t zx_lz4_compress(const uint8_t *, size_t, uint8_t *, size_t);
+extern int zx_lz4_decompress(const uint8_t *, size_t, uint8_t *, size_t);
+
+extern pid_t zx_spawn(const char *, const char *, char **, int, int);
+extern int zx_wait(const char *, pid_t);
+
+extern uint64_t zx_now_ns(void);
+extern void zx_progress_init(zx_progress_t *, const char *, int);
+extern void zx_progress_add(zx_progress_t *, uint64_t);
+extern void zx_progress_done(zx_progress_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ZFS_XFER_H */
@@ -0,0 +1,270 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright 2026 Edgecast Cloud LLC.
+ */
+
+/*
+ * LZ4 block compression for zfs_send and zfs_recv.
+ *
+ * This produces and consumes the standard LZ4 block format (as in the lz4
+ * command's frames, or ZFS's compress=lz4), but there is no userland LZ4
+ * library in the platform to use, so this is a small implementation of our
+ * own.  The compressor is the simple greedy one: a hash table of recent
+ * 4-byte sequences finds a match, which is extended as far as it goes, and
+ * the search steps further ahead the longer it goes without a match, so that
+ * incompressible data costs little.  The decompressor checks every length
+ * and offset against the buffers, as its input comes off the network.
+ *
+ * A block is a series of sequences, each of which is:
+ *
+ *	token		high 4 bits: literal count; low 4 bits: match length
+ *			less 4.  15 in either means more length bytes follow.
+ *	[length]	for a literal count of 15, bytes added to it up to and
+ *			including the first that isn't 255
+ *	literals
+ *	offset		2 bytes, little-endian: how far back the match starts
+ *	[length]	as above, for a match length of 15 + 4
+ *
+ * The last sequence is literals only.  The format requires that the last 5
+ * bytes are literals, and that no match starts in the last 12 bytes.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "zfs_xfer.h"
+
+#define	MINMATCH	4
+#define	LASTLITERALS	5
+#define	MFLIMIT		12
+#define	MAX_DISTANCE	65535
+#define	HASH_BITS	12
+#define	SKIP_SHIFT	6
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	(void) memcpy(&v, p, sizeof (v));
+	return (v);
+}
+
+static uint32_t
+hash32(uint32_t v)
+{
+	return ((v * 2654435761U) >> (32 - HASH_BITS));
+}
+
+static uint8_t *
+put_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = (uint8_t)len;
+	return (op);
+}
+
+/*
+ * Write a sequence of "litlen" literals from "lit", followed by a match of
+ * "mlen" bytes at "offset" unless mlen is 0.  Returns NULL if it won't fit
+ * before "oend".
+ */
+static uint8_t *
+put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t litlen,
+    size_t offset, size_t mlen)
+{
+	uint8_t *token;
+
+	if ((size_t)(oend - op) <
+	    1 + litlen + litlen / 255 + 1 + 2 + mlen / 255 + 1)
+		return (NULL);
+	token = op++;
+
+	if (litlen >= 15) {
+		*token = 15 << 4;
+		op = put_length(op, litlen - 15);
+	} else {
+		*token = (uint8_t)(litlen << 4);
+	}
+	(void) memcpy(op, lit, litlen);
+	op += litlen;
+
+	if (mlen == 0)
+		return (op);
+
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	mlen -= MINMATCH;
+	if (mlen >= 15) {
+		*token |= 15;
+		op = put_length(op, mlen - 15);
+	} else {
+		*token |= (uint8_t)mlen;
+	}
+
+	return (op);
+}
+
+/*
+ * Compress "srclen" bytes into at most "dstlen" bytes.  Returns the size of
+ * the compressed block, or 0 if it would not fit; callers pass the largest
+ * size that would be worth sending, so that incompressible data is noticed
+ * as soon as possible.
+ */
+size_t
+zx_lz4_compress(const uint8_t *src, size_t srclen, uint8_t *dst,
+    size_t dstlen)
+{
+	uint32_t table[1 << HASH_BITS];
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *end = src + srclen;
+	const uint8_t *mflimit = end - MFLIMIT;
+	const uint8_t *matchlimit = end - LASTLITERALS;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dstlen;
+
+	if (dstlen == 0)
+		return (0);
+
+	if (srclen > MFLIMIT) {
+		(void) memset(table, 0, sizeof (table));
+		table[hash32(read32(ip))] = 0;
+		ip++;
+
+		while (ip < mflimit) {
+			uint32_t h = hash32(read32(ip));
+			const uint8_t *ref = src + table[h];
+			size_t mlen;
+
+			table[h] = (uint32_t)(ip - src);
+			if (ref >= ip || ip - ref > MAX_DISTANCE ||
+			    read32(ref) != read32(ip)) {
+				ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+				continue;
+			}
+
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			mlen = MINMATCH;
+			while (ip + mlen < matchlimit && ip[mlen] == ref[mlen])
+				mlen++;
+
+			if ((op = put_sequence(op, oend, anchor, ip - anchor,
+			    ip - ref, mlen)) == NULL)
+				return (0);
+
+			ip += mlen;
+			anchor = ip;
+			if (ip < mflimit) {
+				table[hash32(read32(ip - 2))] =
+				    (uint32_t)(ip - 2 - src);
+			}
+		}
+	}
+
+	if ((op = put_sequence(op, oend, anchor, end - anchor, 0, 0)) == NULL)
+		return (0);
+
+	return (op - dst);
+}
+
+static int
+get_length(const uint8_t **ipp, const uint8_t *iend, size_t *lenp)
+{
+	const uint8_t *ip = *ipp;
+	uint8_t b;
+
+	do {
+		if (ip >= iend)
+			return (-1);
+		b = *ip++;
+		*lenp += b;
+	} while (b == 255);
+
+	*ipp = ip;
+	return (0);
+}
+
+/*
+ * Decompress a block into exactly "dstlen" bytes.  Returns 0 on success, or
+ * -1 if the block is malformed or doesn't decompress to that size.
+ */
+int
+zx_lz4_decompress(const uint8_t *src, size_t srclen, uint8_t *dst,
+    size_t dstlen)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + srclen;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dstlen;
+
+	for (;;) {
+		const uint8_t *match;
+		size_t litlen, mlen, offset;
+		uint8_t token;
+
+		if (ip >= iend)
+			return (-1);
+		token = *ip++;
+
+		litlen = token >> 4;
+		if (litlen == 15 && get_length(&ip, iend, &litlen) != 0)
+			return (-1);
+		if (litlen > (size_t)(iend - ip) ||
+		    litlen > (size_t)(oend - op))
+			return (-1);
+		(void) memcpy(op, ip, litlen);
+		ip += litlen;
+		op += litlen;
+
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return (-1);
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return (-1);
+
+		mlen = token & 15;
+		if (mlen == 15 && get_length(&ip, iend, &mlen) != 0)
+			return (-1);
+		mlen += MINMATCH;
+		if (mlen > (size_t)(oend - op))
+			return (-1);
+
+		/*
+		 * A match may overlap the bytes it produces, as a run of zeros
+		 * does with an offset of 1.  The bytes from "match" to "op"
+		 * repeat every "offset" bytes, so copying all of them at once
+		 * keeps the pattern going, and doubles what we can copy next.
+		 */
+		match = op - offset;
+		while (mlen > 0) {
+			size_t n = op - match;
+
+			if (n > mlen)
+				n = mlen;
+			(void) memcpy(op, match, n);
+			op += n;
+			mlen -= n;
+		}
+	}
+
+	return (op == oend ? 0 : -1);
+}